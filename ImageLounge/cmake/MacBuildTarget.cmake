@@ -21,6 +21,7 @@ set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wno-unknown-pragmas")
 
 # create the targets
 set(BINARY_NAME ${PROJECT_NAME})
+set(BATCH_BINARY_NAME ${PROJECT_NAME}-batch)
 set(DLL_CORE_NAME ${PROJECT_NAME}Core)
 
 #binary
@@ -39,6 +40,20 @@ target_link_libraries(
 	)
 
 set_target_properties(${BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DDK_DLL_IMPORT -DNOMINMAX")
+
+# headless batch binary (runs on a QCoreApplication)
+add_executable(${BATCH_BINARY_NAME} ${BATCH_EXE_SOURCES})
+target_link_libraries(
+	${BATCH_BINARY_NAME} 
+	${DLL_CORE_NAME}
+	${EXIV2_LIBRARIES} 
+	${LIBRAW_LIBRARIES} 
+	${OpenCV_LIBS} 
+	${TIFF_LIBRARIES} 
+	${QUAZIP_LIBRARIES} 
+	)
+
+set_target_properties(${BATCH_BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DDK_DLL_IMPORT -DNOMINMAX")
 set_target_properties(${BINARY_NAME} PROPERTIES IMPORTED_IMPLIB "")
 
 # add core
@@ -65,8 +80,10 @@ add_dependencies(
 	${DLL_CORE_NAME} 
 	${QUAZIP_DEPENDENCY} 
 	${LIBQPSD_LIBRARY}) 
+add_dependencies(${BATCH_BINARY_NAME} ${DLL_CORE_NAME})
 
 qt5_use_modules(${BINARY_NAME} 		Widgets Gui Network LinguistTools PrintSupport Concurrent Svg)
+qt5_use_modules(${BATCH_BINARY_NAME} 	Widgets Gui Concurrent)	# headers only - no QApplication is created
 qt5_use_modules(${DLL_CORE_NAME} 	Widgets Gui Network LinguistTools PrintSupport Concurrent Svg)
 
 # core flags
@@ -89,7 +106,7 @@ set(MACOSX_BUNDLE_BUNDLE_VERSION "${NOMACS_VERSION}")
 set(MACOSX_BUNDLE_COPYRIGHT "(c) Nomacs team")
 set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/macosx/nomacs.icns PROPERTIES MACOSX_PACKAGE_LOCATION Resources)
 
-install(TARGETS ${BINARY_NAME} ${DLL_CORE_NAME} BUNDLE DESTINATION ${CMAKE_INSTALL_PREFIX} LIBRARY DESTINATION ${CMAKE_INSTALL_PREFIX})
+install(TARGETS ${BINARY_NAME} ${BATCH_BINARY_NAME} ${DLL_CORE_NAME} BUNDLE DESTINATION ${CMAKE_INSTALL_PREFIX} RUNTIME DESTINATION ${CMAKE_INSTALL_PREFIX} LIBRARY DESTINATION ${CMAKE_INSTALL_PREFIX})
 
 # create a "transportable" bundle - all libs into the bundle: "make bundle" after make install
 configure_file(${CMAKE_CURRENT_SOURCE_DIR}/macosx/bundle.cmake.in ${CMAKE_CURRENT_BINARY_DIR}/bundle.cmake @ONLY)
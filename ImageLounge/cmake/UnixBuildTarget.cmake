@@ -10,6 +10,7 @@ set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wno-unknown-pragmas")
 
 # create the targets
 set(BINARY_NAME ${PROJECT_NAME})
+set(BATCH_BINARY_NAME ${PROJECT_NAME}-batch)
 set(DLL_CORE_NAME ${PROJECT_NAME}Core)
 
 #binary
@@ -30,6 +31,20 @@ target_link_libraries(
 set_target_properties(${BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DDK_DLL_IMPORT -DNOMINMAX")
 set_target_properties(${BINARY_NAME} PROPERTIES IMPORTED_IMPLIB "")
 
+# headless batch binary (runs on a QCoreApplication)
+add_executable(${BATCH_BINARY_NAME} ${BATCH_EXE_SOURCES})
+target_link_libraries(
+	${BATCH_BINARY_NAME} 
+	${DLL_CORE_NAME}
+	${EXIV2_LIBRARIES} 
+	${LIBRAW_LIBRARIES} 
+	${OpenCV_LIBS} 
+	${TIFF_LIBRARIES} 
+	${QUAZIP_LIBRARIES} 
+	)
+
+set_target_properties(${BATCH_BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DDK_DLL_IMPORT -DNOMINMAX")
+
 # add core
 add_library(
 	${DLL_CORE_NAME} SHARED 
@@ -56,8 +71,10 @@ add_dependencies(
 	${DLL_CORE_NAME} 
 	${QUAZIP_DEPENDENCY} 
 	${LIBQPSD_LIBRARY}) 
+add_dependencies(${BATCH_BINARY_NAME} ${DLL_CORE_NAME})
 
 qt5_use_modules(${BINARY_NAME} 		Widgets Gui Network LinguistTools PrintSupport Concurrent Svg)
+qt5_use_modules(${BATCH_BINARY_NAME} 	Widgets Gui Concurrent)	# headers only - no QApplication is created
 qt5_use_modules(${DLL_CORE_NAME} 	Widgets Gui Network LinguistTools PrintSupport Concurrent Svg)
 
 # core flags
@@ -70,7 +87,7 @@ set_target_properties(${DLL_CORE_NAME} PROPERTIES RELEASE_OUTPUT_NAME ${DLL_CORE
 
 # installation
 #  binary
-install(TARGETS ${BINARY_NAME} ${DLL_CORE_NAME} DESTINATION bin LIBRARY DESTINATION lib${LIB_SUFFIX})
+install(TARGETS ${BINARY_NAME} ${BATCH_BINARY_NAME} ${DLL_CORE_NAME} DESTINATION bin LIBRARY DESTINATION lib${LIB_SUFFIX})
 #  desktop file
 install(FILES nomacs.desktop DESTINATION share/applications)
 #  icon
@@ -3,6 +3,7 @@ set(VERSION_LIB Version.lib)
 
 # create the targets
 set(BINARY_NAME ${PROJECT_NAME})
+set(BATCH_BINARY_NAME ${PROJECT_NAME}-batch)
 set(DLL_CORE_NAME ${PROJECT_NAME}Core)
 set(LIB_CORE_NAME optimized ${DLL_CORE_NAME}.lib debug ${DLL_CORE_NAME}d.lib)
 
@@ -33,6 +34,24 @@ if (ENABLE_READ_BUILD)
 	set_target_properties(${BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DREAD_TUWIEN")
 endif()
 
+# headless batch binary (console application on a QCoreApplication)
+add_executable(${BATCH_BINARY_NAME} ${BATCH_EXE_SOURCES} ${NOMACS_RC})
+target_link_libraries(
+	${BATCH_BINARY_NAME} 
+	${LIB_CORE_NAME} 
+	${EXIV2_LIBRARIES} 
+	${LIBRAW_LIBRARIES} 
+	${OpenCV_LIBS} 
+	${TIFF_LIBRARIES} 
+	${QUAZIP_DEPENDENCY}
+	)
+
+set_target_properties(${BATCH_BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DDK_DLL_IMPORT -DNOMINMAX")
+
+if (ENABLE_READ_BUILD)
+	set_target_properties(${BATCH_BINARY_NAME} PROPERTIES COMPILE_FLAGS "-DREAD_TUWIEN")
+endif()
+
 # add DLL
 add_library(
 	${DLL_CORE_NAME} SHARED 
@@ -57,12 +76,15 @@ add_dependencies(
 	${QUAZIP_DEPENDENCY} 
 	${LIBQPSD_LIBRARY}
 	)
+add_dependencies(${BATCH_BINARY_NAME} ${DLL_CORE_NAME})
 
 target_include_directories(${BINARY_NAME} 		PRIVATE ${OpenCV_INCLUDE_DIRS} ${ZLIB_INCLUDE_DIRS})
+target_include_directories(${BATCH_BINARY_NAME} 	PRIVATE ${OpenCV_INCLUDE_DIRS} ${ZLIB_INCLUDE_DIRS})
 target_include_directories(${DLL_CORE_NAME} 	PRIVATE ${OpenCV_INCLUDE_DIRS} ${ZLIB_INCLUDE_DIRS})
 
 qt5_use_modules(${BINARY_NAME} 		Widgets Gui Network LinguistTools PrintSupport Concurrent Svg WinExtras)
 qt5_use_modules(${DLL_CORE_NAME} 	Widgets Gui Network LinguistTools PrintSupport Concurrent Svg WinExtras)
+qt5_use_modules(${BATCH_BINARY_NAME} 	Widgets Gui Concurrent)	# headers only - no QApplication is created
 
 # set(_moc ${CMAKE_CURRENT_BINARY_DIR}/GeneratedFiles)
 file(GLOB NOMACS_AUTOMOC "${CMAKE_BINARY_DIR}/*_automoc.cpp ${CMAKE_BINARY_DIR}/moc_.cpp")
@@ -147,6 +147,9 @@ public:
 		menu_sort_date_created,
 		menu_sort_date_modified,
 		menu_sort_random,
+		menu_sort_date_taken,
+		menu_sort_rating,
+		menu_sort_camera,
 		menu_sort_ascending,
 		menu_sort_descending,
 
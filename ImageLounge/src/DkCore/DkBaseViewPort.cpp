@@ -68,6 +68,7 @@ DkBaseViewPort::DkBaseViewPort(QWidget *parent) : QGraphicsView(parent) {
 	mZoomTimer->setSingleShot(true);
 	connect(mZoomTimer, SIGNAL(timeout()), this, SLOT(stopBlockZooming()));
 	connect(&mImgStorage, SIGNAL(imageUpdated()), this, SLOT(update()));
+	connect(&mTileCache, SIGNAL(tilesChanged()), this, SLOT(update()));
 
 	mPattern.setTexture(QPixmap(":/nomacs/img/tp-pattern.png"));
 
@@ -294,6 +295,15 @@ QImage DkBaseViewPort::getImage() const {
 	return mImgStorage.getImageConst();
 }
 
+/**
+ * Returns true if an image is displayed.
+ * In contrast to getImage() this never decodes the image.
+ **/ 
+bool DkBaseViewPort::hasImage() const {
+
+	return mImgStorage.hasImage() || (mMovie && mMovie->isValid());
+}
+
 QSize DkBaseViewPort::getImageSize() const {
 
 	if (mSvg) {
@@ -572,8 +582,8 @@ void DkBaseViewPort::draw(QPainter & painter, double opacity) {
 	}
 	else if (mMovie && mMovie->isValid())
 		painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
-	else
-		painter.drawImage(mImgViewRect, imgQt, imgQt.rect());
+	else if (!mTileCache.draw(painter, imgQt, mImgViewRect, viewport()->rect(), painter.testRenderHint(QPainter::SmoothPixmapTransform)))
+		painter.drawImage(mImgViewRect, imgQt, imgQt.rect());	// fall-back if the image is not zoomed in
 
 	painter.setOpacity(oldOp);
 
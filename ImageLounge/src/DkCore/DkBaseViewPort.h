@@ -139,6 +139,7 @@ public:
 #endif
 
 	virtual QImage getImage() const;
+	virtual bool hasImage() const;
 	virtual QSize getImageSize() const;
 	virtual QRectF getImageViewRect() const;
 	virtual bool imageInside() const;
@@ -191,6 +192,7 @@ protected:
 	Qt::KeyboardModifier mCtrlMod;
 
 	DkImageStorage mImgStorage;
+	DkTileCache mTileCache;
 	QSharedPointer<QMovie> mMovie;
 	QSharedPointer<QSvgRenderer> mSvg;
 	QBrush mPattern;
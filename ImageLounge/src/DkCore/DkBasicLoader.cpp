@@ -47,9 +47,20 @@
 #include <QPixmap>
 #include <QIcon>
 #include <QDebug>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+#include <QCoreApplication>
+#include <QDir>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QTextCodec>
+#include <QtEndian>
 
 #include <qmath.h>
 #include <assert.h>
+#include <functional>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -68,6 +79,15 @@
 
 #ifdef WITH_LIBRAW
 #include <libraw/libraw.h>
+
+// vectorized RAW development: AVX2 if the build targets it, SSE2 on any other x86 build
+#if defined(__AVX2__)
+#define DK_RAW_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DK_RAW_SSE2
+#include <emmintrin.h>
+#endif
 #endif
 
 #ifdef WITH_LIBTIFF
@@ -98,6 +118,16 @@
 #pragma comment(lib, "oleaut32.lib")
 #endif //#ifdef Q_OS_WIN
 
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <climits>
+#include <cstring>
+#endif
+
 
 #pragma warning(pop)
 
@@ -111,6 +141,11 @@ DkEditImage::DkEditImage(const QImage& img, const QString& editName) {
 
 void DkEditImage::setImage(const QImage& img) {
 	mImg = img;
+
+	// the delta is not valid anymore
+	mHasDelta = false;
+	mDelta.clear();
+	mKeyFrame.clear();
 }
 
 QImage DkEditImage::image() const {
@@ -121,9 +156,160 @@ QString DkEditImage::editName() const {
 	return mEditName;
 }
 
-int DkEditImage::size() const {
+/**
+ * Returns the memory needed by this state.
+ * @return float the memory in MB
+ **/ 
+float DkEditImage::size() const {
 	
-	return qRound(DkImage::getBufferSizeFloat(mImg.size(), mImg.depth()));
+	float deltaSize = mKeyFrame.size();
+	for (const DeltaBand& b : mDelta)
+		deltaSize += b.data.size();
+
+	return DkImage::getBufferSizeFloat(mImg.size(), mImg.depth()) + deltaSize/(1024.0f*1024.0f);
+}
+
+bool DkEditImage::hasImage() const {
+	return !mImg.isNull();
+}
+
+bool DkEditImage::hasDelta() const {
+	return mHasDelta;
+}
+
+bool DkEditImage::isKeyFrame() const {
+	return mHasDelta && !mKeyFrame.isEmpty();
+}
+
+/**
+ * Stores the difference of this state to the previous state.
+ * The image is split into bands and only bands that changed are stored (XOR, zlib compressed).
+ * If the size or format changed (e.g. crop, resize) the whole image is compressed.
+ * @param prevImg the image of the previous state
+ **/ 
+void DkEditImage::computeDelta(const QImage& prevImg) {
+
+	if (mImg.isNull())
+		return;
+
+	const int bandHeight = 64;
+
+	mDelta.clear();
+	mKeyFrame.clear();
+	mSize = mImg.size();
+	mFormat = mImg.format();
+	mColorTable = mImg.colorTable();
+
+	int lineLength = (mImg.width() * mImg.depth() + 7) / 8;
+
+	if (prevImg.size() != mImg.size() || prevImg.format() != mImg.format()) {
+
+		QByteArray data;
+		data.reserve(lineLength*mImg.height());
+
+		for (int y = 0; y < mImg.height(); y++)
+			data.append(reinterpret_cast<const char*>(mImg.constScanLine(y)), lineLength);
+
+		mKeyFrame = qCompress(data, 1);
+	}
+	else {
+
+		QByteArray band;
+
+		for (int y = 0; y < mImg.height(); y += bandHeight) {
+
+			int numRows = qMin(bandHeight, mImg.height() - y);
+			band.resize(numRows*lineLength);
+			char* bPtr = band.data();
+			bool changed = false;
+
+			for (int r = y; r < y + numRows; r++) {
+
+				const uchar* cPtr = mImg.constScanLine(r);
+				const uchar* pPtr = prevImg.constScanLine(r);
+
+				for (int idx = 0; idx < lineLength; idx++) {
+					*bPtr = cPtr[idx] ^ pPtr[idx];
+					changed |= *bPtr != 0;
+					bPtr++;
+				}
+			}
+
+			if (changed) {
+				DeltaBand b = {y, qCompress(band, 1)};
+				mDelta << b;
+			}
+		}
+	}
+
+	mHasDelta = true;
+}
+
+/**
+ * Reconstructs the image of this state.
+ * @param prevImg the image of the previous state (not needed for key frames)
+ * @return QImage the reconstructed image
+ **/ 
+QImage DkEditImage::applyDelta(const QImage& prevImg) const {
+
+	if (!mHasDelta)
+		return mImg;
+
+	QImage img;
+	int lineLength = 0;
+
+	if (isKeyFrame()) {
+
+		img = QImage(mSize, mFormat);
+		lineLength = (img.width() * img.depth() + 7) / 8;
+		QByteArray data = qUncompress(mKeyFrame);
+
+		if (data.size() < lineLength*img.height()) {
+			qWarning() << "[DkEditImage] corrupted history state" << mEditName;
+			return QImage();
+		}
+
+		for (int y = 0; y < img.height(); y++)
+			memcpy(img.scanLine(y), data.constData() + y*lineLength, lineLength);
+	}
+	else {
+		
+		img = prevImg.copy();
+		lineLength = (img.width() * img.depth() + 7) / 8;
+
+		for (const DeltaBand& b : mDelta) {
+
+			QByteArray band = qUncompress(b.data);
+			const char* bPtr = band.constData();
+			int numRows = band.size() / lineLength;
+
+			for (int r = b.row; r < b.row + numRows && r < img.height(); r++) {
+
+				uchar* iPtr = img.scanLine(r);
+
+				for (int idx = 0; idx < lineLength; idx++)
+					iPtr[idx] ^= (uchar)*bPtr++;
+			}
+		}
+	}
+
+	if (!mColorTable.isEmpty())
+		img.setColorTable(mColorTable);
+
+	return img;
+}
+
+void DkEditImage::cacheImage(const QImage& img) {
+	mImg = img;
+}
+
+/**
+ * Releases the image if it can be reconstructed from the delta.
+ **/ 
+void DkEditImage::releaseImage() {
+
+	if (mHasDelta)
+		mImg = QImage();
 }
 
 // Basic loader and image edit class --------------------------------------------------------------------
@@ -159,6 +345,10 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 
 	release();
 
+	// loaders are reused - never report the preview (or tiles) of the previous image
+	mFullSize = QSize();
+	mTiledImage.clear();
+
 	if (mPageIdxDirty)
 		imgLoaded = loadPage();
 
@@ -213,12 +403,24 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		}
 	}
 
+	// stream tiff images that do not fit into memory
+	if (!imgLoaded && mTargetSize.isValid() && fInfo.exists() && DkTiledImage::isTiff(mFile)) {
+
+		imgLoaded = loadTiledFile(mFile, img);
+		if (imgLoaded) mLoader = tiled_loader;
+	}
+
 	// default Qt loader
 	// here we just try those formats that are officially supported
 	if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str())) {
 
 		// if image has Indexed8 + alpha channel -> we crash... sorry for that
-		if (!ba || ba->isEmpty())
+		if (mTargetSize.isValid()) {
+			// the image is rotated after loading - so the target size needs to be rotated too
+			int orientation = loadMetaData && !DkSettingsManager::param().metaData().ignoreExifOrientation ? mMetaData->getOrientationDegree() : 0;
+			imgLoaded = loadQtFile(mFile, img, ba, suf, qAbs(orientation) == 90);
+		}
+		else if (!ba || ba->isEmpty())
 			imgLoaded = img.load(mFile, suf.toStdString().c_str());
 		else
 			imgLoaded = img.loadFromData(*ba.data(), suf.toStdString().c_str());	// toStdString() in order get 1 byte per char
@@ -308,6 +510,145 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 	return imgLoaded;
 }
 
+/**
+ * Loads images using the Qt image plugins.
+ * Images larger than the target size are decoded directly to the target size
+ * if the plugin supports scaled decoding (e.g. jpg). This is much faster
+ * and needs less memory than decoding the full image.
+ * @param filePath the file to be loaded.
+ * @param img the loaded image.
+ * @param ba the file buffer (might be empty).
+ * @param suffix the format hint.
+ * @param transposed if true, the image is rotated by 90 degrees after loading.
+ * @return bool true if the image could be loaded.
+ **/ 
+bool DkBasicLoader::loadQtFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba, const QString& suffix, bool transposed) {
+
+	QBuffer buffer;
+	QImageReader reader;
+
+	if (ba && !ba->isEmpty()) {
+		buffer.setBuffer(ba.data());
+		buffer.open(QIODevice::ReadOnly);
+		reader.setDevice(&buffer);
+	}
+	else
+		reader.setFileName(filePath);
+	
+	reader.setFormat(suffix.toLatin1());
+
+	QSize imgSize = reader.size();
+	QSize targetSize = mTargetSize;
+
+	if (transposed)
+		targetSize.transpose();
+
+	if (imgSize.isValid() && targetSize.isValid() && 
+		(imgSize.width() > targetSize.width() || imgSize.height() > targetSize.height()) &&
+		reader.supportsOption(QImageIOHandler::ScaledSize)) {
+
+		reader.setScaledSize(imgSize.scaled(targetSize, Qt::KeepAspectRatio));
+		mFullSize = transposed ? imgSize.transposed() : imgSize;
+	}
+
+	if (!reader.read(&img)) {
+		mFullSize = QSize();
+		return false;
+	}
+
+	if (isPreview())
+		qInfo() << "preview decoded with" << img.size() << "full size:" << mFullSize;
+
+	return true;
+}
+
+/**
+ * Loads an overview of tiff images that exceed the memory limit.
+ * The full resolution is streamed from tiledImage() when needed.
+ * @param filePath the tiff file.
+ * @param img the overview.
+ * @return bool true if the image is streamed.
+ **/ 
+bool DkBasicLoader::loadTiledFile(const QString& filePath, QImage& img) {
+
+	QSharedPointer<DkTiledImage> tiledImage(new DkTiledImage(filePath));
+
+	// images that fit into memory are loaded at once
+	if (!tiledImage->open() || 
+		(qint64)tiledImage->size().width() * tiledImage->size().height() * 4 <= DkTiledImage::memoryLimit())
+		return false;
+
+	// the pyramid is created in the background - we show the exif thumbnail (or a placeholder) meanwhile
+	if (!tiledImage->hasPyramid()) {
+
+		DkPyramidBuilder::instance().build(filePath);
+
+		img = mMetaData ? mMetaData->getThumbnail() : QImage();
+
+		if (img.isNull()) {
+			img = QImage(tiledImage->size().scaled(256, 256, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)), QImage::Format_ARGB32_Premultiplied);
+			img.fill(QColor(128, 128, 128));
+		}
+
+		mFullSize = tiledImage->size();
+		qInfo() << "creating pyramid for" << filePath << "full size:" << mFullSize;
+
+		return true;
+	}
+
+	img = tiledImage->overview(mTargetSize);
+
+	if (img.isNull())
+		return false;
+
+	mTiledImage = tiledImage;
+	mFullSize = tiledImage->size();
+	qInfo() << "streaming" << filePath << "overview:" << img.size() << "full size:" << mFullSize;
+
+	return true;
+}
+
+/**
+ * Returns the size of the full resolution image.
+ * This size differs from the size of image() if just a preview is loaded.
+ * @return QSize the image size.
+ **/ 
+QSize DkBasicLoader::fullSize() const {
+
+	if (isPreview())
+		return mFullSize;
+
+	return image().size();
+}
+
+/**
+ * Returns true if the full resolution of a preview may be loaded at once.
+ * Streamed images and images that exceed the memory limit are never decoded completely.
+ * @return bool false if no preview is loaded or the full resolution is too large.
+ **/ 
+bool DkBasicLoader::canLoadFullResolution() const {
+
+	return isPreview() && !mTiledImage &&
+		(qint64)mFullSize.width() * mFullSize.height() * 4 <= DkTiledImage::memoryLimit();
+}
+
+/**
+ * Replaces the preview with the full resolution image.
+ * @param img the full resolution image.
+ * @return bool false if no preview is loaded or the image was edited in the meantime.
+ **/ 
+bool DkBasicLoader::setFullResolution(const QImage& img) {
+
+	if (!canLoadFullResolution() || img.isNull() || mImages.size() != 1)
+		return false;
+
+	mImages[0].setImage(img);
+	mFullSize = QSize();
+	mTiledImage.clear();
+
+	return true;
+}
+
 /**
  * Loads special RAW files that are generated by the Hamamatsu camera.
  * @param fileName the filename of the file to be loaded.
@@ -455,20 +796,89 @@ void DkBasicLoader::setEditImage(const QImage& img, const QString& editName) {
 	}
 
 	// compute new history size
-	int historySize = 0;
+	float historySize = 0;
 	for (const DkEditImage& e : mImages) {
 		historySize += e.size();
 	}
 
 	DkEditImage newImg(img, editName);
 
-	if (historySize + newImg.size() > DkSettingsManager::param().resources().historyMemory && mImages.size() > mMinHistorySize) {
-		mImages.removeAt(1);
-		qDebug() << "removing history image because it's too large:" << historySize + newImg.size() << "MB";
-	}
+	// we just need to store the difference to the last state
+	if (!mImages.empty())
+		newImg.computeDelta(historyImage(mImages.size()-1));
 
 	mImages.append(newImg);
 	mImageIndex = mImages.size() - 1;	// set the index again to the last
+	updateHistoryCache();
+
+	historySize += mImages.last().size();
+
+	while (historySize > DkSettingsManager::param().resources().historyMemory && mImages.size() > qMax(mMinHistorySize, 2)) {
+		
+		// the second state is now relative to the original image
+		if (mImages.size() > 2) {
+			QImage img2 = historyImage(2);
+			mImages[2].setImage(img2);
+			mImages[2].computeDelta(mImages[0].image());
+		}
+
+		mImages.removeAt(1);
+		mImageIndex--;
+		mRecentStates.clear();
+		updateHistoryCache();
+
+		qDebug() << "removing history image because it's too large:" << historySize << "MB";
+
+		historySize = 0;
+		for (const DkEditImage& e : mImages)
+			historySize += e.size();
+	}
+}
+
+/**
+ * Returns the image of a history state.
+ * Images of states that are not cached are reconstructed from their deltas.
+ * @param idx the history index
+ * @return QImage the image
+ **/ 
+QImage DkBasicLoader::historyImage(int idx) const {
+
+	const DkEditImage& e = mImages[idx];
+
+	if (e.hasImage() || !e.hasDelta() || idx == 0)
+		return e.image();
+	else if (e.isKeyFrame())
+		return e.applyDelta(QImage());
+
+	return e.applyDelta(historyImage(idx-1));
+}
+
+/**
+ * Makes sure that the current state has its image
+ * and releases the images of states that were not used recently.
+ **/ 
+void DkBasicLoader::updateHistoryCache() {
+
+	if (mImages.empty())
+		return;
+
+	if (mImageIndex < 0 || mImageIndex >= mImages.size())
+		mImageIndex = mImages.size()-1;
+
+	if (!mImages[mImageIndex].hasImage())
+		mImages[mImageIndex].cacheImage(historyImage(mImageIndex));
+
+	mRecentStates.removeAll(mImageIndex);
+	mRecentStates.prepend(mImageIndex);
+
+	while (mRecentStates.size() > mNumCachedStates)
+		mRecentStates.removeLast();
+
+	for (int idx = 1; idx < mImages.size(); idx++) {
+
+		if (!mRecentStates.contains(idx))
+			mImages[idx].releaseImage();
+	}
 }
 
 QImage DkBasicLoader::image() const {
@@ -488,12 +898,16 @@ void DkBasicLoader::undo() {
 	
 	if (mImageIndex > 0)
 		mImageIndex--;
+
+	updateHistoryCache();
 }
 
 void DkBasicLoader::redo() {
 
 	if (mImageIndex < mImages.size()-1)
 		mImageIndex++;
+
+	updateHistoryCache();
 }
 
 QVector<DkEditImage>* DkBasicLoader::history() {
@@ -516,13 +930,16 @@ void DkBasicLoader::setMinHistorySize(int size) {
 
 void DkBasicLoader::setHistoryIndex(int idx) {
 	mImageIndex = idx;
+	updateHistoryCache();
 }
 
 void DkBasicLoader::loadFileToBuffer(const QString& fileInfo, QByteArray& ba) const {
 
 #ifdef WITH_QUAZIP
-	if (QFileInfo(fileInfo).dir().path().contains(DkZipContainer::zipMarker())) 
+	if (QFileInfo(fileInfo).dir().path().contains(DkZipContainer::zipMarker())) {
 		DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo), ba);
+		return;
+	}
 #endif
 	
 	QFile file(fileInfo);
@@ -538,6 +955,10 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileIn
 		return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo));
 #endif
 
+	QSharedPointer<QByteArray> mapped = DkMappedFile::map(fileInfo);
+	if (mapped)
+		return mapped;
+
 	QFile file(fileInfo);
 	file.open(QIODevice::ReadOnly);
 
@@ -552,10 +973,13 @@ bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPoin
 	if (!ba || ba->isEmpty())
 		return false;
 
-	QFile file(fileInfo);
+	// the file is replaced (not truncated) - buffers that map the old file stay valid
+	QSaveFile file(fileInfo);
 	file.open(QIODevice::WriteOnly);
 	qint64 bytesWritten = file.write(*ba.data(), ba->size());
-	file.close();
+	
+	if (!file.commit())
+		bytesWritten = -1;
 	qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
 
 	if (!bytesWritten || bytesWritten == -1)
@@ -911,6 +1335,9 @@ void DkBasicLoader::release(bool clear) {
 	saveMetaData(mFile);
 
 	mImages.clear();
+	mRecentStates.clear();
+	mFullSize = QSize();
+	mTiledImage.clear();
 	//metaData.clear();
 	
 	// TODO: where should we clear the metadata?
@@ -1351,13 +1778,14 @@ QString DkZipContainer::decodeImageFile(const QString& encodedFileInfo) {
 
 QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile) {
 
+	QSharedPointer<DkZipArchive> archive = DkZipArchive::open(zipFile);
+	if (archive)
+		return archive->extract(imageFile);
+
 	QuaZip zip(zipFile);		
 	if(!zip.open(QuaZip::mdUnzip)) 
 		return QSharedPointer<QByteArray>(new QByteArray());
 
-	qDebug() << "DkZip::extractImage filePath: " << zipFile;
-	qDebug() << "3.0 image file" << imageFile;
-
 	zip.setCurrentFile(imageFile);
 	QuaZipFile extractedFile(&zip);
 	if(!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK) 
@@ -1373,6 +1801,15 @@ QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString& zipFile,
 
 void DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile, QByteArray& ba) {
 
+	QSharedPointer<DkZipArchive> archive = DkZipArchive::open(zipFile);
+	if (archive) {
+		QSharedPointer<QByteArray> data = archive->extract(imageFile);
+
+		// stored entries point into the mapped archive - so we have to copy them
+		ba = DkMappedFile::isMapped(data) ? QByteArray(data->constData(), data->size()) : *data;
+		return;
+	}
+
 	QuaZip zip(zipFile);		
 	if(!zip.open(QuaZip::mdUnzip)) 
 		return;
@@ -1414,489 +1851,1809 @@ QString DkZipContainer::zipMarker() {
 	return mZipMarker;
 }
 
-#endif
+// DkZipArchive --------------------------------------------------------------------
+DkZipArchive::DkZipArchive(const QString& zipFile) {
 
-// DkRawLoader --------------------------------------------------------------------
-DkRawLoader::DkRawLoader(const QString & filePath, const QSharedPointer<DkMetaDataT>& metaData) {
-	mFilePath = filePath;
-	mMetaData = metaData;
+	mFilePath = zipFile;
 }
 
-bool DkRawLoader::isEmpty() const {
-	return mFilePath.isEmpty();
-}
+/**
+ * Returns the shared reader of a zip archive.
+ * Archives are indexed once and cached until they change on disk.
+ * @param zipFile the archive's file path
+ * @return QSharedPointer<DkZipArchive> the reader or a null pointer if the archive
+ * cannot be indexed (e.g. Zip64 archives which are read by QuaZip then).
+ **/ 
+QSharedPointer<DkZipArchive> DkZipArchive::open(const QString& zipFile) {
 
-void DkRawLoader::setLoadFast(bool fast) {
-	mLoadFast = fast;
-}
+	static QMutex mutex;
+	static QList<QSharedPointer<DkZipArchive> > archives;	// most recently used first
 
-bool DkRawLoader::load(const QSharedPointer<QByteArray> ba) {
+	QFileInfo zipInfo(zipFile);
+	QString filePath = zipInfo.absoluteFilePath();
 
-	DkTimer dt;
+	QMutexLocker locker(&mutex);
 
-	// try fetching the preview
-	if (mLoadFast) {
+	for (int idx = 0; idx < archives.size(); idx++) {
 
-		if (loadPreview(ba))
-			return true;
-	}
+		QSharedPointer<DkZipArchive> archive = archives.at(idx);
 
-#ifdef WITH_LIBRAW
-	
-	try {
+		if (archive->mFilePath != filePath)
+			continue;
 
-		// open the buffer
-		LibRaw iProcessor;
+		archives.removeAt(idx);
 
-		if (!openBuffer(ba, iProcessor)) {
-			qDebug() << "could not open buffer for" << mFilePath;
-			return false;
+		if (archive->mFileSize == zipInfo.size() && archive->mModified == zipInfo.lastModified()) {
+			archives.prepend(archive);
+			return archive;
 		}
 
-		// check camera models for specific hacks
-		detectSpecialCamera(iProcessor);
+		break;	// the archive was changed - index it again
+	}
 
-		// try loading RAW preview
-		if (mLoadFast) {
-			mImg = loadPreviewRaw(iProcessor);
+	QSharedPointer<DkZipArchive> archive(new DkZipArchive(filePath));
 
-			// are we done already?
-			if (!mImg.isNull())
-				return true;
-		}
+	if (!archive->index())
+		return QSharedPointer<DkZipArchive>();
 
-		//unpack the data
-		int error = iProcessor.unpack();
-		if (std::strcmp(iProcessor.version(), "0.13.5") != 0)	// fixes a bug specific to libraw 13 - version call is UNTESTED
-			iProcessor.raw2image();
+	archives.prepend(archive);
 
-		if (error != LIBRAW_SUCCESS)
-			return false;
+	while (archives.size() > maxCachedArchives)
+		archives.removeLast();
 
+	return archive;
+}
 
-		// demosaic image
-		cv::Mat rawMat;
+QString DkZipArchive::filePath() const {
 
-		if (iProcessor.imgdata.idata.filters)
-			rawMat = demosaic(iProcessor);
-		else
-			rawMat = prepareImg(iProcessor);
+	return mFilePath;
+}
 
-		// color correction + white balance
-		if (mIsChromatic) {
-			whiteBalance(iProcessor, rawMat);
-		}
-		
-		// gamma correction
-		gammaCorrection(iProcessor, rawMat);
+QStringList DkZipArchive::fileNames() const {
 
-		// reduce color noise
-		if (DkSettingsManager::param().resources().filterRawImages && mIsChromatic)
-			reduceColorNoise(iProcessor, rawMat);
+	return mFileNames;
+}
 
-		mImg = raw2Img(iProcessor, rawMat);
-		
-		qDebug() << "img size" << mImg.size();
-		qDebug() << "raw mat size" << rawMat.rows << "x" << rawMat.cols;
+bool DkZipArchive::contains(const QString& imageFile) const {
 
-		iProcessor.recycle();
-		rawMat.release();
+	return mEntries.contains(imageFile);
+}
+
+/**
+ * Parses the archive's central directory.
+ * @return bool false if the archive is no (supported) zip file.
+ **/ 
+bool DkZipArchive::index() {
+
+	QFileInfo zipInfo(mFilePath);
+	mFileSize = zipInfo.size();
+	mModified = zipInfo.lastModified();
+	mData = DkMappedFile::map(mFilePath);
+
+	// the end of central directory record is followed by a comment of up to 64 KB
+	const int eocdSize = 22;
+	qint64 tailOffset = qMax(mFileSize - eocdSize - 0xffff, 0LL);
+	QByteArray tail = read(tailOffset, mFileSize - tailOffset);
+
+	int eocdPos = -1;
+	for (int idx = tail.size() - eocdSize; idx >= 0; idx--) {
+
+		if (qFromLittleEndian<quint32>((const uchar*)tail.constData() + idx) == 0x06054b50) {
+			eocdPos = idx;
+			break;
+		}
 	}
-	catch (...) {
-		qDebug() << "[RAW] error during processing...";
+
+	if (eocdPos < 0)
+		return false;
+
+	const uchar* eocd = (const uchar*)tail.constData() + eocdPos;
+	quint16 numEntries = qFromLittleEndian<quint16>(eocd + 10);
+	quint32 cdSize = qFromLittleEndian<quint32>(eocd + 12);
+	quint32 cdOffset = qFromLittleEndian<quint32>(eocd + 16);
+
+	// Zip64 archives are left to QuaZip
+	if (numEntries == 0xffff || cdSize == 0xffffffff || cdOffset == 0xffffffff)
+		return false;
+
+	// self-extracting archives have an executable in front of the zip
+	qint64 shift = tailOffset + eocdPos - ((qint64)cdOffset + cdSize);
+	if (shift < 0)
 		return false;
+
+	QByteArray cd = read(cdOffset + shift, cdSize);
+	if (cd.size() != (int)cdSize)
+		return false;
+
+	QTextCodec* codec = QTextCodec::codecForLocale();	// QuaZip's default file name codec
+	const uchar* cdData = (const uchar*)cd.constData();
+	int pos = 0;
+
+	for (int idx = 0; idx < numEntries; idx++) {
+
+		const uchar* header = cdData + pos;
+
+		if (pos + 46 > cd.size() || qFromLittleEndian<quint32>(header) != 0x02014b50)
+			return false;
+
+		int nameLength = qFromLittleEndian<quint16>(header + 28);
+		quint32 localOffset = qFromLittleEndian<quint32>(header + 42);
+
+		Entry entry;
+		entry.flags = qFromLittleEndian<quint16>(header + 8);
+		entry.method = qFromLittleEndian<quint16>(header + 10);
+		entry.compressedSize = qFromLittleEndian<quint32>(header + 20);
+		entry.size = qFromLittleEndian<quint32>(header + 24);
+		entry.localOffset = localOffset + shift;
+		entry.centralOffset = cdOffset + shift + pos;
+		entry.centralSize = 46 + nameLength + 
+			qFromLittleEndian<quint16>(header + 30) +	// extra field
+			qFromLittleEndian<quint16>(header + 32);	// comment
+
+		if (pos + entry.centralSize > cd.size())
+			return false;
+
+		if (entry.compressedSize == 0xffffffff || entry.size == 0xffffffff || localOffset == 0xffffffff)
+			return false;
+
+		QByteArray name = cd.mid(pos + 46, nameLength);
+		QString fileName = (entry.flags & 0x800) ? QString::fromUtf8(name) : codec->toUnicode(name);
+
+		// QuaZip returns the first entry of duplicated names
+		if (!mEntries.contains(fileName)) {
+			mEntries.insert(fileName, entry);
+			mFileNames.append(fileName);
+		}
+
+		pos += entry.centralSize;
 	}
 
-	qInfo() << "[RAW] loaded in " << dt;
+	return true;
+}
+
+/**
+ * Reads a part of the archive.
+ * Mapped archives are not copied. Otherwise, the file is opened for
+ * each read so that archives are not locked while they are browsed.
+ **/ 
+QByteArray DkZipArchive::read(qint64 offset, qint64 size) const {
+
+	qint64 fileSize = mData ? mData->size() : mFileSize;
+
+	if (offset < 0 || size < 0 || size > INT_MAX || offset + size > fileSize)
+		return QByteArray();
+
+	if (mData)
+		return QByteArray::fromRawData(mData->constData() + offset, (int)size);
+
+	QFile file(mFilePath);
+
+	if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+		return QByteArray();
+
+	return file.read(size);
+}
+
+/**
+ * Extracts an entry of the archive.
+ * This function is thread-safe. Stored (uncompressed) entries of mapped archives
+ * are not copied - the buffer keeps the archive mapped.
+ * @param imageFile the entry's file name
+ * @return QSharedPointer<QByteArray> the entry's data (empty if it cannot be extracted)
+ **/ 
+QSharedPointer<QByteArray> DkZipArchive::extract(const QString& imageFile) const {
+
+	auto entryIt = mEntries.constFind(imageFile);
+
+	if (entryIt == mEntries.constEnd())
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	const Entry& entry = entryIt.value();
+
+	QByteArray localHeader = read(entry.localOffset, 30);
+	if (localHeader.size() != 30 || qFromLittleEndian<quint32>((const uchar*)localHeader.constData()) != 0x04034b50)
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	qint64 dataOffset = entry.localOffset + 30 + 
+		qFromLittleEndian<quint16>((const uchar*)localHeader.constData() + 26) +	// file name
+		qFromLittleEndian<quint16>((const uchar*)localHeader.constData() + 28);	// extra field
+
+	QByteArray data = read(dataOffset, entry.compressedSize);
+	if (data.size() != entry.compressedSize)
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	// stored entries are just a slice of the archive
+	if (entry.method == 0 && !(entry.flags & 0x1)) {
+
+		if (!mData)
+			return QSharedPointer<QByteArray>(new QByteArray(data));
+
+		QSharedPointer<QByteArray> archiveData = mData;
+		return QSharedPointer<QByteArray>(new QByteArray(data), [archiveData](QByteArray* ba) {
+			Q_UNUSED(archiveData);	// keeps the archive mapped as long as the slice is used
+			delete ba;
+		});
+	}
+
+	return inflate(entry, read(entry.localOffset, dataOffset - entry.localOffset), data);
+}
+
+/**
+ * Decompresses an entry.
+ * QuaZip can only locate entries by name (linear search through the central directory).
+ * Hence, the entry is wrapped into a single-entry zip in memory which is then opened by QuaZip.
+ * This allows for concurrent extraction without sharing a QuaZip handle.
+ **/ 
+QSharedPointer<QByteArray> DkZipArchive::inflate(const Entry& entry, const QByteArray& localHeader, const QByteArray& data) const {
+
+	QByteArray central = read(entry.centralOffset, entry.centralSize);
+	if (central.size() != entry.centralSize)
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	// the local header is at the start of the in-memory zip
+	qToLittleEndian<quint32>(0, (uchar*)central.data() + 42);
+
+	QByteArray eocd(22, '\0');
+	uchar* eocdData = (uchar*)eocd.data();
+	qToLittleEndian<quint32>(0x06054b50, eocdData);
+	qToLittleEndian<quint16>(1, eocdData + 8);		// entries on this disk
+	qToLittleEndian<quint16>(1, eocdData + 10);		// entries
+	qToLittleEndian<quint32>(central.size(), eocdData + 12);
+	qToLittleEndian<quint32>(localHeader.size() + data.size(), eocdData + 16);
+
+	QByteArray zipData;
+	zipData.reserve(localHeader.size() + data.size() + central.size() + eocd.size());
+	zipData.append(localHeader);
+	zipData.append(data);
+	zipData.append(central);
+	zipData.append(eocd);
+
+	QBuffer buffer(&zipData);
+	QuaZip zip(&buffer);
+
+	if (!zip.open(QuaZip::mdUnzip) || !zip.goToFirstFile())
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	QuaZipFile extractedFile(&zip);
+	if (!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK)
+		return QSharedPointer<QByteArray>(new QByteArray());
+
+	QSharedPointer<QByteArray> ba(new QByteArray(extractedFile.readAll()));
+	extractedFile.close();
+
+	zip.close();
+
+	return ba;
+}
 
 #endif
 
-	return !mImg.isNull();
+// DkMappedFile --------------------------------------------------------------------
+#ifdef Q_OS_UNIX
+namespace {
+
+// the mapped ranges are read by the SIGBUS handler - so they are lock-free
+QAtomicInt mappedClaims[DkMappedFile::maxMappings];
+QAtomicInteger<quintptr> mappedStarts[DkMappedFile::maxMappings];
+QAtomicInteger<quintptr> mappedSizes[DkMappedFile::maxMappings];
+QAtomicInt mappedTruncated[DkMappedFile::maxMappings];
+quintptr pageSize = 4096;
+struct sigaction oldBusAction;
+
+/**
+ * Handles SIGBUS raised by reading pages of a truncated file.
+ * The missing page is replaced by zeros so that the read returns.
+ * Jumping out (longjmp) instead would skip the destructors & locks of the decoders.
+ * Faults outside our mappings are passed to the former handler.
+ **/ 
+void mappedBusHandler(int sig, siginfo_t* info, void* context) {
+
+	quintptr addr = (quintptr)info->si_addr;
+
+	for (int idx = 0; idx < DkMappedFile::maxMappings; idx++) {
+
+		quintptr start = mappedStarts[idx].loadAcquire();
+
+		if (!start || addr < start || addr >= start + mappedSizes[idx].loadAcquire())
+			continue;
+
+		void* page = (void*)(addr & ~(pageSize - 1));
+		if (mmap(page, pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+			mappedTruncated[idx].storeRelease(1);
+			return;
+		}
+	}
+
+	if (oldBusAction.sa_flags & SA_SIGINFO)
+		oldBusAction.sa_sigaction(sig, info, context);
+	else if (oldBusAction.sa_handler != SIG_DFL && oldBusAction.sa_handler != SIG_IGN)
+		oldBusAction.sa_handler(sig);
+	else
+		sigaction(SIGBUS, &oldBusAction, 0);	// the fault is raised again and handled by default
 }
 
-QImage DkRawLoader::image() const {
-	return mImg;
+void installBusHandler() {
+
+	static bool installed = [] {
+		pageSize = (quintptr)sysconf(_SC_PAGESIZE);
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = &mappedBusHandler;
+		action.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&action.sa_mask);
+
+		return sigaction(SIGBUS, &action, &oldBusAction) == 0;
+	}();
+
+	Q_UNUSED(installed);
 }
 
-bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray>& ba) {
+/**
+ * Registers a mapping for the SIGBUS handler.
+ * @return int the mapping's slot or -1 if the table is full.
+ **/ 
+int addMappedRange(const void* data, size_t size) {
 
-	try {
+	installBusHandler();
 
-		// try to get preview image from exiv2
-		if (mMetaData) {
-			if (mLoadFast || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
-				DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
+	for (int idx = 0; idx < DkMappedFile::maxMappings; idx++) {
 
-				mMetaData->readMetaData(mFilePath, ba);
+		if (!mappedClaims[idx].testAndSetOrdered(0, 1))
+			continue;
 
-				int minWidth = 0;
+		mappedSizes[idx].storeRelease((quintptr)size);
+		mappedTruncated[idx].storeRelease(0);
+		mappedStarts[idx].storeRelease((quintptr)data);
+		return idx;
+	}
 
-#ifdef WITH_LIBRAW	// if nomacs has libraw - we can still hope for a fallback -> otherwise try whatever we have here
-				if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
-					minWidth = 1920;
+	return -1;
+}
+
+void removeMappedRange(int slot) {
+
+	mappedStarts[slot].storeRelease(0);
+	mappedClaims[slot].storeRelease(0);
+}
+
+}
 #endif
-				mImg = mMetaData->getPreviewImage(minWidth);
 
-				if (!mImg.isNull()) {
-					qDebug() << "[RAW] loaded with exiv2";
-					return true;
-				}
+/**
+ * Maps a file into memory.
+ * The buffer wraps the mapped pages (QByteArray::fromRawData) so
+ * Exiv2 (MemIo), Qt (QBuffer) and LibRaw (open_buffer) read the file
+ * without copying it. Writing to the buffer detaches (copies) it - the file is
+ * never changed. The file is unmapped when the last reference is released, so
+ * copies of the QByteArray must not outlive the shared pointer.
+ * Files are only mapped on Unix - Windows locks mapped files which could then
+ * neither be renamed nor deleted while they are cached.
+ * @param filePath the file to be mapped
+ * @param willNeed if true, the OS reads the file ahead (prefetching)
+ * @return QSharedPointer<QByteArray> the mapped buffer or a null pointer if the file is not mapped.
+ **/ 
+QSharedPointer<QByteArray> DkMappedFile::map(const QString& filePath, bool willNeed) {
+
+#ifdef Q_OS_UNIX
+
+	QByteArray path = QFile::encodeName(filePath);
+	int fd = ::open(path.constData(), O_RDONLY);
+
+	if (fd < 0)
+		return QSharedPointer<QByteArray>();
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < minFileSize || st.st_size > INT_MAX) {
+		::close(fd);
+		return QSharedPointer<QByteArray>();
+	}
+
+	size_t size = (size_t)st.st_size;
+	void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// the mapping keeps the file open
+
+	if (data == MAP_FAILED)
+		return QSharedPointer<QByteArray>();
+
+	// unguarded mappings crash if the file is truncated - read the file to the heap instead
+	int slot = addMappedRange(data, size);
+	if (slot < 0) {
+		munmap(data, size);
+		return QSharedPointer<QByteArray>();
+	}
+
+	// prefetching just tells the kernel to read ahead - nothing is read here
+	madvise(data, size, willNeed ? MADV_WILLNEED : MADV_SEQUENTIAL);
+
+	// remember the file's state - see isStale()
+	Mapping m;
+	m.filePath = path;
+	m.size = (qint64)st.st_size;
+	m.modified = (qint64)st.st_mtime;
+	m.inode = (quint64)st.st_ino;
+	m.slot = slot;
+
+	{
+		QMutexLocker locker(&mappingsMutex());
+		mappings().insert((const char*)data, m);
+	}
+
+	return QSharedPointer<QByteArray>(
+		new QByteArray(QByteArray::fromRawData((const char*)data, (int)size)), 
+		[data, size, slot](QByteArray* ba) {
+			delete ba;
+
+			{
+				QMutexLocker locker(&mappingsMutex());
+				mappings().remove((const char*)data);
+			}
+
+			removeMappedRange(slot);
+			munmap(data, size);
+	});
+#else
+	Q_UNUSED(filePath);
+	Q_UNUSED(willNeed);
+	return QSharedPointer<QByteArray>();
+#endif
+}
+
+/**
+ * Returns true if the buffer wraps a mapped file.
+ * Mapped buffers are backed by the page cache and should not be counted as
+ * our memory. QByteArray::fromRawData does not allocate, hence its capacity is 0.
+ **/ 
+bool DkMappedFile::isMapped(const QSharedPointer<QByteArray>& ba) {
+
+	return ba && !ba->isEmpty() && ba->capacity() < ba->size();
+}
+
+/**
+ * Returns true if the mapped file was changed since it was mapped.
+ * Another program might truncate or rewrite the file - reading its mapping
+ * then returns zeros (see mappedBusHandler) or mixed contents. Stale mappings
+ * should be dropped and the file should be read again.
+ * @param ba the buffer (a mapping or a slice of it, e.g. a stored zip entry)
+ * @return bool true if ba is a mapping whose file changed (or vanished).
+ **/ 
+bool DkMappedFile::isStale(const QSharedPointer<QByteArray>& ba) {
+
+#ifdef Q_OS_UNIX
+
+	if (!isMapped(ba))
+		return false;
+
+	const char* data = ba->constData();
+	Mapping m;
+	bool found = false;
+
+	{
+		QMutexLocker locker(&mappingsMutex());
+
+		for (auto it = mappings().constBegin(); it != mappings().constEnd(); it++) {
+
+			if (data >= it.key() && data < it.key() + it->size) {
+				m = it.value();
+				found = true;
+				break;
 			}
 		}
 	}
-	catch (...) {
-		qWarning() << "Exception caught during fetching RAW from thumbnail...";
-	}
 
+	if (!found)
+		return false;
+
+	if (mappedTruncated[m.slot].loadAcquire())
+		return true;
+
+	struct stat st;
+	return stat(m.filePath.constData(), &st) != 0 || 
+		(qint64)st.st_size != m.size || 
+		(qint64)st.st_mtime != m.modified || 
+		(quint64)st.st_ino != m.inode;
+#else
+	Q_UNUSED(ba);
 	return false;
+#endif
+}
+
+QMutex& DkMappedFile::mappingsMutex() {
+
+	static QMutex mutex;
+	return mutex;
+}
+
+QHash<const char*, DkMappedFile::Mapping>& DkMappedFile::mappings() {
+
+	static QHash<const char*, Mapping> maps;
+	return maps;
+}
+
+// DkRawLoader --------------------------------------------------------------------
+DkRawLoader::DkRawLoader(const QString & filePath, const QSharedPointer<DkMetaDataT>& metaData) {
+	mFilePath = filePath;
+	mMetaData = metaData;
+}
+
+bool DkRawLoader::isEmpty() const {
+	return mFilePath.isEmpty();
+}
+
+void DkRawLoader::setLoadFast(bool fast) {
+	mLoadFast = fast;
 }
 
+bool DkRawLoader::load(const QSharedPointer<QByteArray> ba) {
+
+	DkTimer dt;
+
+	// try fetching the preview
+	if (mLoadFast) {
+
+		if (loadPreview(ba))
+			return true;
+	}
 
 #ifdef WITH_LIBRAW
+	
+	try {
 
-// here are some hints from earlier days...
-//// (-w) Use camera white balance, if possible (otherwise, fallback to auto_wb)
-//iProcessor.imgdata.params.use_camera_wb = 1;
-//// (-a) Use automatic white balance obtained after averaging over the entire image
-//iProcessor.imgdata.params.use_auto_wb = 1;
-//// (-q 3) Adaptive homogeneity-directed de-mosaicing algorithm (AHD)
-//iProcessor.imgdata.params.user_qual = 3;
-//iProcessor.imgdata.params.output_tiff = 1;
-////iProcessor.imgdata.params.four_color_rgb = 1;
-////iProcessor.imgdata.params.output_color = 1; //sRGB  (0...raw)
-//// RAW data filtration mode during data unpacking and post-processing
-//iProcessor.imgdata.params.filtering_mode = LIBRAW_FILTERING_AUTOMATIC;
+		// open the buffer
+		LibRaw iProcessor;
+
+		if (!openBuffer(ba, iProcessor)) {
+			qDebug() << "could not open buffer for" << mFilePath;
+			return false;
+		}
+
+		// check camera models for specific hacks
+		detectSpecialCamera(iProcessor);
+
+		// try loading RAW preview
+		if (mLoadFast) {
+			mImg = loadPreviewRaw(iProcessor);
+
+			// are we done already?
+			if (!mImg.isNull())
+				return true;
+		}
+
+		//unpack the data
+		int error = iProcessor.unpack();
+		if (std::strcmp(iProcessor.version(), "0.13.5") != 0)	// fixes a bug specific to libraw 13 - version call is UNTESTED
+			iProcessor.raw2image();
+
+		if (error != LIBRAW_SUCCESS)
+			return false;
+
+
+		// demosaic image
+		cv::Mat rawMat;
+
+		if (iProcessor.imgdata.idata.filters)
+			rawMat = demosaic(iProcessor);
+		else
+			rawMat = prepareImg(iProcessor);
+
+		// white balance + color correction + gamma correction
+		develop(iProcessor, rawMat);
+
+		// reduce color noise
+		if (DkSettingsManager::param().resources().filterRawImages && mIsChromatic)
+			reduceColorNoise(iProcessor, rawMat);
+
+		mImg = raw2Img(iProcessor, rawMat);
+		
+		qDebug() << "img size" << mImg.size();
+		qDebug() << "raw mat size" << rawMat.rows << "x" << rawMat.cols;
+
+		iProcessor.recycle();
+		rawMat.release();
+	}
+	catch (...) {
+		qDebug() << "[RAW] error during processing...";
+		return false;
+	}
+
+	qInfo() << "[RAW] loaded in " << dt;
+
+#endif
+
+	return !mImg.isNull();
+}
+
+QImage DkRawLoader::image() const {
+	return mImg;
+}
+
+bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray>& ba) {
+
+	try {
+
+		// try to get preview image from exiv2
+		if (mMetaData) {
+			if (mLoadFast || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
+				DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
+
+				mMetaData->readMetaData(mFilePath, ba);
+
+				int minWidth = 0;
+
+#ifdef WITH_LIBRAW	// if nomacs has libraw - we can still hope for a fallback -> otherwise try whatever we have here
+				if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
+					minWidth = 1920;
+#endif
+				mImg = mMetaData->getPreviewImage(minWidth);
+
+				if (!mImg.isNull()) {
+					qDebug() << "[RAW] loaded with exiv2";
+					return true;
+				}
+			}
+		}
+	}
+	catch (...) {
+		qWarning() << "Exception caught during fetching RAW from thumbnail...";
+	}
+
+	return false;
+}
+
+
+#ifdef WITH_LIBRAW
+
+// here are some hints from earlier days...
+//// (-w) Use camera white balance, if possible (otherwise, fallback to auto_wb)
+//iProcessor.imgdata.params.use_camera_wb = 1;
+//// (-a) Use automatic white balance obtained after averaging over the entire image
+//iProcessor.imgdata.params.use_auto_wb = 1;
+//// (-q 3) Adaptive homogeneity-directed de-mosaicing algorithm (AHD)
+//iProcessor.imgdata.params.user_qual = 3;
+//iProcessor.imgdata.params.output_tiff = 1;
+////iProcessor.imgdata.params.four_color_rgb = 1;
+////iProcessor.imgdata.params.output_color = 1; //sRGB  (0...raw)
+//// RAW data filtration mode during data unpacking and post-processing
+//iProcessor.imgdata.params.filtering_mode = LIBRAW_FILTERING_AUTOMATIC;
+
+// splits the rows into blocks which are processed in parallel
+static void processRowBlocks(int numRows, const std::function<void(int, int)>& fn) {
+
+	int blockSize = qMax(16, numRows / (QThread::idealThreadCount() * 4) + 1);
+
+	QVector<QPair<int, int> > blocks;
+	for (int rIdx = 0; rIdx < numRows; rIdx += blockSize)
+		blocks << QPair<int, int>(rIdx, qMin(rIdx + blockSize, numRows));
+
+	QtConcurrent::blockingMap(blocks, [&fn](const QPair<int, int>& b) { fn(b.first, b.second); });
+}
+
+// same as DkRawLoader::clip<unsigned short>(qRound(val))
+static inline unsigned short clipRaw(int vr) {
+
+	// with -2 we do not get pink in oversaturated areas
+	if (vr > USHRT_MAX)
+		vr = USHRT_MAX - 2;
+	if (vr < 0)
+		vr = 0;
+
+	return static_cast<unsigned short>(vr);
+}
+
+// white balance, color correction and gamma correction of numPixels RGB pixels
+static void developRowScalar(unsigned short* ptr, int numPixels, const float* wb, const float cm[3][3], const unsigned short* lut) {
+
+	for (int idx = 0; idx < numPixels; idx++, ptr += 3) {
+
+		//apply white balance correction
+		unsigned short r = clipRaw(qRound(ptr[0] * wb[0]));
+		unsigned short g = clipRaw(qRound(ptr[1] * wb[1]));
+		unsigned short b = clipRaw(qRound(ptr[2] * wb[2]));
+
+		//apply color correction
+		int cr = qRound(cm[0][0] * r + cm[0][1] * g + cm[0][2] * b);
+		int cg = qRound(cm[1][0] * r + cm[1][1] * g + cm[1][2] * b);
+		int cb = qRound(cm[2][0] * r + cm[2][1] * g + cm[2][2] * b);
+
+		// clip & gamma correct
+		ptr[0] = lut[clipRaw(cr)];
+		ptr[1] = lut[clipRaw(cg)];
+		ptr[2] = lut[clipRaw(cb)];
+	}
+}
+
+#if defined(DK_RAW_AVX2)
+
+// qRound & clipRaw of 8 non-negative floats (negative values are clipped to 0 anyway)
+static inline __m256i clipRaw(__m256 val) {
+
+	__m256i vr = _mm256_cvttps_epi32(_mm256_add_ps(val, _mm256_set1_ps(0.5f)));
+	__m256i over = _mm256_cmpgt_epi32(vr, _mm256_set1_epi32(USHRT_MAX));
+	vr = _mm256_blendv_epi8(vr, _mm256_set1_epi32(USHRT_MAX - 2), over);
+
+	return _mm256_max_epi32(vr, _mm256_setzero_si256());
+}
+
+// the lut needs one padding entry since the gather reads 32 bit
+static inline __m256i lookup(const unsigned short* lut, __m256i idx) {
+
+	__m256i val = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx, 2);
+	return _mm256_and_si256(val, _mm256_set1_epi32(0xFFFF));
+}
+
+static void developRow(unsigned short* ptr, int numPixels, const float* wb, const float cm[3][3], const unsigned short* lut) {
+
+	const __m256 wbr = _mm256_set1_ps(wb[0]);
+	const __m256 wbg = _mm256_set1_ps(wb[1]);
+	const __m256 wbb = _mm256_set1_ps(wb[2]);
+
+	__m256 cmv[3][3];
+	for (int rIdx = 0; rIdx < 3; rIdx++)
+		for (int cIdx = 0; cIdx < 3; cIdx++)
+			cmv[rIdx][cIdx] = _mm256_set1_ps(cm[rIdx][cIdx]);
+
+	alignas(32) int out[3][8];
+	int idx = 0;
+
+	for (; idx + 8 <= numPixels; idx += 8, ptr += 24) {
+
+		const unsigned short* p = ptr;
+		__m256 r = _mm256_setr_ps(p[0], p[3], p[6], p[9], p[12], p[15], p[18], p[21]);
+		__m256 g = _mm256_setr_ps(p[1], p[4], p[7], p[10], p[13], p[16], p[19], p[22]);
+		__m256 b = _mm256_setr_ps(p[2], p[5], p[8], p[11], p[14], p[17], p[20], p[23]);
+
+		//apply white balance correction
+		r = _mm256_cvtepi32_ps(clipRaw(_mm256_mul_ps(r, wbr)));
+		g = _mm256_cvtepi32_ps(clipRaw(_mm256_mul_ps(g, wbg)));
+		b = _mm256_cvtepi32_ps(clipRaw(_mm256_mul_ps(b, wbb)));
+
+		//apply color correction, clip & gamma correct (same order of operations as the scalar path)
+		for (int cIdx = 0; cIdx < 3; cIdx++) {
+			__m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cmv[cIdx][0], r), _mm256_mul_ps(cmv[cIdx][1], g)), _mm256_mul_ps(cmv[cIdx][2], b));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(out[cIdx]), lookup(lut, clipRaw(c)));
+		}
+
+		for (int pIdx = 0; pIdx < 8; pIdx++) {
+			ptr[pIdx * 3] = (unsigned short)out[0][pIdx];
+			ptr[pIdx * 3 + 1] = (unsigned short)out[1][pIdx];
+			ptr[pIdx * 3 + 2] = (unsigned short)out[2][pIdx];
+		}
+	}
+
+	developRowScalar(ptr, numPixels - idx, wb, cm, lut);
+}
+
+#elif defined(DK_RAW_SSE2)
+
+// qRound & clipRaw of 4 non-negative floats (negative values are clipped to 0 anyway)
+static inline __m128i clipRaw(__m128 val) {
+
+	__m128i vr = _mm_cvttps_epi32(_mm_add_ps(val, _mm_set1_ps(0.5f)));
+	__m128i over = _mm_cmpgt_epi32(vr, _mm_set1_epi32(USHRT_MAX));
+	vr = _mm_or_si128(_mm_andnot_si128(over, vr), _mm_and_si128(over, _mm_set1_epi32(USHRT_MAX - 2)));
+
+	return _mm_andnot_si128(_mm_cmplt_epi32(vr, _mm_setzero_si128()), vr);
+}
+
+static void developRow(unsigned short* ptr, int numPixels, const float* wb, const float cm[3][3], const unsigned short* lut) {
+
+	const __m128 wbr = _mm_set1_ps(wb[0]);
+	const __m128 wbg = _mm_set1_ps(wb[1]);
+	const __m128 wbb = _mm_set1_ps(wb[2]);
+
+	__m128 cmv[3][3];
+	for (int rIdx = 0; rIdx < 3; rIdx++)
+		for (int cIdx = 0; cIdx < 3; cIdx++)
+			cmv[rIdx][cIdx] = _mm_set1_ps(cm[rIdx][cIdx]);
+
+	alignas(16) int out[3][4];
+	int idx = 0;
+
+	for (; idx + 4 <= numPixels; idx += 4, ptr += 12) {
+
+		const unsigned short* p = ptr;
+		__m128 r = _mm_setr_ps(p[0], p[3], p[6], p[9]);
+		__m128 g = _mm_setr_ps(p[1], p[4], p[7], p[10]);
+		__m128 b = _mm_setr_ps(p[2], p[5], p[8], p[11]);
+
+		//apply white balance correction
+		r = _mm_cvtepi32_ps(clipRaw(_mm_mul_ps(r, wbr)));
+		g = _mm_cvtepi32_ps(clipRaw(_mm_mul_ps(g, wbg)));
+		b = _mm_cvtepi32_ps(clipRaw(_mm_mul_ps(b, wbb)));
+
+		//apply color correction & clip (same order of operations as the scalar path)
+		for (int cIdx = 0; cIdx < 3; cIdx++) {
+			__m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cmv[cIdx][0], r), _mm_mul_ps(cmv[cIdx][1], g)), _mm_mul_ps(cmv[cIdx][2], b));
+			_mm_store_si128(reinterpret_cast<__m128i*>(out[cIdx]), clipRaw(c));
+		}
+
+		// gamma correct - SSE2 has no gather
+		for (int pIdx = 0; pIdx < 4; pIdx++) {
+			ptr[pIdx * 3] = lut[out[0][pIdx]];
+			ptr[pIdx * 3 + 1] = lut[out[1][pIdx]];
+			ptr[pIdx * 3 + 2] = lut[out[2][pIdx]];
+		}
+	}
+
+	developRowScalar(ptr, numPixels - idx, wb, cm, lut);
+}
+
+#else
+
+static void developRow(unsigned short* ptr, int numPixels, const float* wb, const float cm[3][3], const unsigned short* lut) {
+	developRowScalar(ptr, numPixels, wb, cm, lut);
+}
+
+#endif
+
+// name of the code path used by developRow
+static QString developPath() {
+
+#if defined(DK_RAW_AVX2)
+	return "AVX2";
+#elif defined(DK_RAW_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+
+QImage DkRawLoader::loadPreviewRaw(LibRaw & iProcessor) const {
+	
+	int tW = iProcessor.imgdata.thumbnail.twidth;
+
+	if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
+		(DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tW >= 1920)) {
+
+		// crashes here if image is broken
+		int err = iProcessor.unpack_thumb();
+		char* tPtr = iProcessor.imgdata.thumbnail.thumb;
+
+		if (!err && tPtr) {
+
+			QImage img;
+			img.loadFromData((const uchar*)tPtr, iProcessor.imgdata.thumbnail.tlength);
+
+			// we're good to go
+			if (!img.isNull()) {
+				qDebug() << "[RAW] I loaded the RAW's thumbnail";
+				return img;
+			}
+			else
+				qDebug() << "RAW could not load the thumb";
+		}
+		else
+			qDebug() << "error unpacking the thumb...";
+	}
+
+	// default: return nothing
+	return QImage();
+}
+
+bool DkRawLoader::openBuffer(const QSharedPointer<QByteArray>& ba, LibRaw& iProcessor) const {
+
+	int error = LIBRAW_DATA_ERROR;
+
+	QFileInfo fi(mFilePath);
+
+	//use iprocessor from libraw to read the data
+	// OK - so LibRaw 0.17 cannot identify iiq files in the buffer - so we load them from the file
+	if (fi.suffix().contains("iiq", Qt::CaseInsensitive) || !ba || ba->isEmpty()) {
+		error = iProcessor.open_file(mFilePath.toStdString().c_str());
+	}
+	else {
+		// the buffer check is because:
+		// libraw has an error when loading buffers if the first 4 bytes encode as 'RIFF'
+		// and no data follows at all
+		if (ba->isEmpty() || ba->size() < 100)
+			return false;
+
+		error = iProcessor.open_buffer((void*)ba->constData(), ba->size());
+	}
+
+	return (error == LIBRAW_SUCCESS);
+}
+
+void DkRawLoader::detectSpecialCamera(const LibRaw & iProcessor) {
+
+	if (QString(iProcessor.imgdata.idata.model) == "IQ260 Achromatic")
+		mIsChromatic = false;
+	
+	if (QString(iProcessor.imgdata.idata.model).contains("IQ260"))
+		mCamType = camera_iiq;
+	else if (QString(iProcessor.imgdata.idata.make).compare("Canon", Qt::CaseInsensitive))
+		mCamType = camera_canon;
+
+	// add your camera flag (for hacks) here
+}
+
+cv::Mat DkRawLoader::demosaic(LibRaw & iProcessor) const {
+
+	cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC1);
+	double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+
+	// normalize all image values
+	processRowBlocks(rawMat.rows, [&](int start, int end) {
+
+		for (int rIdx = start; rIdx < end; rIdx++) {
+			unsigned short *ptrRaw = rawMat.ptr<unsigned short>(rIdx);
+
+			for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
+
+				int colIdx = iProcessor.COLOR(rIdx, cIdx);
+				double val = (double)(iProcessor.imgdata.image[(rawMat.cols*rIdx) + cIdx][colIdx]);
+
+				// normalize the value w.r.t the black point defined
+				val = (val - iProcessor.imgdata.color.black) / dynamicRange;
+				ptrRaw[cIdx] = clip<unsigned short>(val * USHRT_MAX);  // for conversion to 16U
+			}
+		}
+	});
+
+	// no demosaicing
+	if (mIsChromatic) {
+
+		unsigned long type = (unsigned long)iProcessor.imgdata.idata.filters;
+		type = type & 255;
+
+		cv::Mat rgbImg;
+
+		//define bayer pattern
+		if (type == 180) {
+			cvtColor(rawMat, rgbImg, CV_BayerBG2RGB);		//bitmask  10 11 01 00  -> 3(G) 2(B) 1(G) 0(R) ->	RG RG RG
+															//													GB GB GB
+		}
+		else if (type == 30) {
+			cvtColor(rawMat, rgbImg, CV_BayerRG2RGB);		//bitmask  00 01 11 10	-> 0 1 3 2
+		}
+		else if (type == 225) {
+			cvtColor(rawMat, rgbImg, CV_BayerGB2RGB);		//bitmask  11 10 00 01
+		}
+		else if (type == 75) {
+			cvtColor(rawMat, rgbImg, CV_BayerGR2RGB);		//bitmask  01 00 10 11
+		}
+		else {
+			qWarning() << "Wrong Bayer Pattern (not BG, RG, GB, GR)\n";
+			return cv::Mat();
+		}
+
+		rawMat = rgbImg;
+	}
+
+	// 16U (1 or 3 channeled) Mat
+	return rawMat;
+}
+
+cv::Mat DkRawLoader::prepareImg(const LibRaw & iProcessor) const {
+
+	cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC3, cv::Scalar(0));
+	double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+
+	// normalization function
+	auto normalize = [&](double val) { 
+	
+		val = (val - iProcessor.imgdata.color.black) / dynamicRange;
+		return clip<unsigned short>(val * USHRT_MAX);
+	};
+
+	processRowBlocks(rawMat.rows, [&](int start, int end) {
+
+		for (int rIdx = start; rIdx < end; rIdx++) {
+			unsigned short *ptrI = rawMat.ptr<unsigned short>(rIdx);
+
+			for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
+
+				*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][0]);
+				ptrI++;
+				*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][1]);
+				ptrI++;
+				*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][2]);
+				ptrI++;
+			}
+		}
+	});
+
+	return rawMat;
+}
+
+cv::Mat DkRawLoader::whiteMultipliers(const LibRaw & iProcessor) const {
+	
+	// get camera white balance multipliers
+	cv::Mat wm(1, 4, CV_32FC1);
+	
+	float* wmp = wm.ptr<float>();
+
+	for (int idx = 0; idx < wm.cols; idx++)
+		wmp[idx] = iProcessor.imgdata.color.cam_mul[idx];
+
+	if (wmp[3] == 0)
+		wmp[3] = wmp[1];	// take green (usually its RGBG)
+
+	// normalize white balance multipliers
+	float w = (float)cv::sum(wm)[0] / 4.0f;
+	float maxW = 1.0f;
+
+	//clipping according the camera model
+	//if w > 2.0 maxW is 256, otherwise 512
+	//tested empirically
+	//check if it can be defined by some metadata settings?
+	if (w > 2.0f)
+		maxW = 255.0f;
+	if (w > 2.0f && mCamType == camera_canon)
+		maxW = 511.0f;	// some cameras would even need ~800 - why?
+
+	//normalize white point
+	wm /= maxW;
+
+	// 1 x 4 32FC1 white balance vector
+	return wm;
+}
+
+cv::Mat DkRawLoader::gammaTable(const LibRaw & iProcessor) const {
+	
+	// OK this is an instance of reverse engineering:
+	// we found out that the values of (at least) the PhaseOne's achromatic back have to be doubled
+	// our images are no close to what their software (Capture One does) - only the gamma correction
+	// seems to be slightly different... -> now we can load compressed IIQs that are not supported by PS : )
+	double cameraHackMlp = (QString(iProcessor.imgdata.idata.model) == "IQ260 Achromatic") ? 2.0 : 1.0;
+
+	//read gamma value and create gamma table	
+	double gamma = (double)iProcessor.imgdata.params.gamm[0];
+	
+	cv::Mat gmt(1, USHRT_MAX, CV_16UC1);
+	unsigned short* gmtp = gmt.ptr<unsigned short>();
+	
+	for (int idx = 0; idx < gmt.cols; idx++) {
+		gmtp[idx] = clip<unsigned short>(qRound((1.099*std::pow((double)idx / USHRT_MAX, gamma) - 0.099) * 255 * cameraHackMlp));
+	}
+
+	// a 1 x 65535 U16 gamma table
+	return gmt;
+}
+
+void DkRawLoader::develop(const LibRaw & iProcessor, cv::Mat & img) const {
+
+	DkTimer dt;
+
+	// white balance must not be empty at this point
+	cv::Mat wb = whiteMultipliers(iProcessor);
+	const float* wbp = wb.ptr<float>();
+	assert(wb.cols == 4);
+
+	float cm[3][3];
+	for (int rIdx = 0; rIdx < 3; rIdx++)
+		for (int cIdx = 0; cIdx < 3; cIdx++)
+			cm[rIdx][cIdx] = iProcessor.imgdata.color.rgb_cam[rIdx][cIdx];
+
+	// extend the gamma table to the full 16 bit range so that it can be applied without branching
+	cv::Mat gt = gammaTable(iProcessor);
+	const unsigned short* gammaLookup = gt.ptr<unsigned short>();
+	assert(gt.cols == USHRT_MAX);
+
+	// one padding entry for the 32 bit gather of the AVX2 path
+	QVector<unsigned short> lut(USHRT_MAX + 2, 0);
+	for (int idx = 0; idx <= USHRT_MAX; idx++) {
+
+		// values close to 0 are treated linear
+		if (idx <= 5)	// 0.018 * 255
+			lut[idx] = (unsigned short)qRound(idx * (double)iProcessor.imgdata.params.gamm[1] / 255.0);
+		else
+			lut[idx] = gammaLookup[qMin(idx, USHRT_MAX - 1)];
+	}
+	const unsigned short* lutp = lut.constData();
+
+	processRowBlocks(img.rows, [&](int start, int end) {
+
+		for (int rIdx = start; rIdx < end; rIdx++) {
+
+			unsigned short *ptr = img.ptr<unsigned short>(rIdx);
+
+			// achromatic images are gamma corrected only
+			if (!mIsChromatic) {
+				for (int cIdx = 0; cIdx < img.cols * img.channels(); cIdx++)
+					ptr[cIdx] = lutp[ptr[cIdx]];
+				continue;
+			}
+
+			developRow(ptr, img.cols, wbp, cm, lutp);
+		}
+	});
+
+	qDebug() << "[RAW] developed (" << developPath() << ") in" << dt;
+}
+
+bool DkRawLoader::benchmarkDevelop(int width, int height) {
+
+	// synthetic sensor data with a typical camera white balance, color matrix and gamma curve
+	cv::Mat src(height, width, CV_16UC3);
+	cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(USHRT_MAX));
+
+	const float wb[3] = { 2.1f, 1.0f, 1.6f };
+	const float cm[3][3] = {
+		{ 1.72f, -0.61f, -0.11f },
+		{ -0.19f, 1.53f, -0.34f },
+		{ 0.02f, -0.48f, 1.46f } };
+
+	QVector<unsigned short> lut(USHRT_MAX + 2, 0);
+	int maxStep = 0;
+	for (int idx = 0; idx <= USHRT_MAX; idx++) {
+		lut[idx] = (unsigned short)qRound(qPow(idx / (double)USHRT_MAX, 1.0 / 2.2) * USHRT_MAX);
+		if (idx > 0)
+			maxStep = qMax(maxStep, lut[idx] - lut[idx - 1]);
+	}
+
+	cv::Mat scalarImg = src.clone();
+	cv::Mat simdImg = src.clone();
+
+	DkTimer dt;
+	processRowBlocks(scalarImg.rows, [&](int start, int end) {
+		for (int rIdx = start; rIdx < end; rIdx++)
+			developRowScalar(scalarImg.ptr<unsigned short>(rIdx), scalarImg.cols, wb, cm, lut.constData());
+	});
+	int scalarTime = dt.elapsed();
+
+	dt.start();
+	processRowBlocks(simdImg.rows, [&](int start, int end) {
+		for (int rIdx = start; rIdx < end; rIdx++)
+			developRow(simdImg.ptr<unsigned short>(rIdx), simdImg.cols, wb, cm, lut.constData());
+	});
+	int simdTime = dt.elapsed();
+
+	// the paths may only differ if the compiler fuses the scalar multiply-adds
+	// in that case the values before the gamma correction differ by 1 at most
+	double maxDiff = cv::norm(scalarImg, simdImg, cv::NORM_INF);
+	int numDiff = cv::countNonZero(cv::Mat(scalarImg != simdImg).reshape(1));
+
+	qInfoClean() << QString("[RAW] developing %1 MP: scalar %2 ms, %3 %4 ms - %5 values differ (max %6)")
+		.arg(width * height / 1e6, 0, 'f', 1)
+		.arg(scalarTime)
+		.arg(developPath())
+		.arg(simdTime)
+		.arg(numDiff)
+		.arg(maxDiff);
+
+	return maxDiff <= maxStep;
+}
+
+void DkRawLoader::reduceColorNoise(const LibRaw & iProcessor, cv::Mat & img) const {
+
+	// filter color noise with a median filter
+	float isoSpeed = iProcessor.imgdata.other.iso_speed;
+
+	if (isoSpeed > 0) {
+
+		DkTimer dt;
+
+		int winSize;
+		if (isoSpeed > 6400) 
+			winSize = 13;
+		else if (isoSpeed >= 3200) 
+			winSize = 11;
+		else if (isoSpeed >= 2500) 
+			winSize = 9;
+		else if (isoSpeed >= 400) 
+			winSize = 7;
+		else 
+			winSize = 5;
+
+		DkTimer dMed;
+		
+		cv::cvtColor(img, img, CV_RGB2YCrCb);
+
+		std::vector<cv::Mat> imgCh;
+		cv::split(img, imgCh);
+		assert(imgCh.size() == 3);
+
+		cv::medianBlur(imgCh[1], imgCh[1], winSize);
+		cv::medianBlur(imgCh[2], imgCh[2], winSize);
+
+		cv::merge(imgCh, img);
+		cv::cvtColor(img, img, CV_YCrCb2RGB);
+		qDebug() << "median blur takes:" << dt;
+	}
+
+}
+
+QImage DkRawLoader::raw2Img(const LibRaw & iProcessor, cv::Mat & img) const {
+	
+	//check the pixel aspect ratio of the raw image
+	if (iProcessor.imgdata.sizes.pixel_aspect != 1.0f)
+		cv::resize(img, img, cv::Size(), (double)iProcessor.imgdata.sizes.pixel_aspect, 1.0f);
+	
+	// revert back to 8-bit image
+	img.convertTo(img, CV_8U);
+
+	// TODO: for now - fix this!
+	if (img.channels() == 1)
+		cv::cvtColor(img, img, CV_GRAY2RGB);
+
+	// img is released afterwards - so we can share its buffer
+	return DkImage::imageView(img);
+}
+
+#endif
+
+// DkTiledImage --------------------------------------------------------------------
+#ifdef WITH_LIBTIFF
+/**
+ * Turns off libtiff's warning/error dialogs while it is in scope (we do the GUI : )
+ **/ 
+class DkTiffSilencer {
+
+public:
+	DkTiffSilencer() {
+		mOldWarningHandler = TIFFSetWarningHandler(NULL);
+		mOldErrorHandler = TIFFSetErrorHandler(NULL);
+	};
+
+	~DkTiffSilencer() {
+		TIFFSetWarningHandler(mOldWarningHandler);
+		TIFFSetErrorHandler(mOldErrorHandler);
+	};
+
+protected:
+	TIFFErrorHandler mOldWarningHandler;
+	TIFFErrorHandler mOldErrorHandler;
+};
+#endif
+
+/**
+ * Appends the rows of bottom to top.
+ * Both images need the same width & format.
+ **/ 
+static QImage stackRows(const QImage& top, const QImage& bottom) {
+
+	QImage img(top.width(), top.height() + bottom.height(), top.format());
+
+	for (int y = 0; y < top.height(); y++)
+		memcpy(img.scanLine(y), top.constScanLine(y), top.bytesPerLine());
+	for (int y = 0; y < bottom.height(); y++)
+		memcpy(img.scanLine(top.height() + y), bottom.constScanLine(y), bottom.bytesPerLine());
+
+	return img;
+}
+
+DkTiledImage::DkTiledImage(const QString& filePath) {
+
+	mFilePath = filePath;
+	mBlocks.setMaxCost(qMax(memoryLimit() / 1024, (qint64)1024));	// KB
+
+	QFileInfo fInfo(filePath);
+
+	// the pyramid is invalid as soon as the file changes
+	QString key = fInfo.absoluteFilePath() + QString::number(fInfo.size()) + QString::number(fInfo.lastModified().toMSecsSinceEpoch());
+	QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex();
+	mCacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pyramids/" + hash;
+}
+
+DkTiledImage::~DkTiledImage() {
+	close();
+}
+
+/**
+ * Reads the tiff header.
+ * Images that store all rows in a single strip cannot be streamed.
+ * @return bool true if the image can be streamed.
+ **/ 
+bool DkTiledImage::open() {
+
+	close();
+
+#ifdef WITH_LIBTIFF
+	QMutexLocker locker(&mMutex);
+	DkTiffSilencer silencer;
+
+	mTiff = TIFFOpen(QFile::encodeName(mFilePath), "r");
+
+	if (!mTiff)
+		return false;
+
+	uint32 width = 0;
+	uint32 height = 0;
+	TIFFGetField(mTiff, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(mTiff, TIFFTAG_IMAGELENGTH, &height);
+	mSize = QSize(width, height);
+
+	if (TIFFIsTiled(mTiff)) {
+		uint32 tw = 0;
+		uint32 th = 0;
+		TIFFGetField(mTiff, TIFFTAG_TILEWIDTH, &tw);
+		TIFFGetField(mTiff, TIFFTAG_TILELENGTH, &th);
+		mTileSize = QSize(tw, th);
+	}
+	else {
+		uint32 rps = 0;
+		TIFFGetFieldDefaulted(mTiff, TIFFTAG_ROWSPERSTRIP, &rps);
+		mTileSize = QSize(width, qMin(rps, height));
+	}
+
+	// each block needs to fit into the block cache
+	if (mSize.isEmpty() || mTileSize.isEmpty() ||
+		(qint64)mTileSize.width() * mTileSize.height() * 4 > memoryLimit() / 4) {
+		TIFFClose(mTiff);
+		mTiff = 0;
+		return false;
+	}
+
+	// the coarsest level is about the size of a thumbnail preview
+	mNumLevels = 1;
+	while (qMax(levelSize(mNumLevels-1).width(), levelSize(mNumLevels-1).height()) > 1024 && 
+		!levelSize(mNumLevels).isEmpty())
+		mNumLevels++;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Returns true if the pyramid was created before.
+ * The pyramid is marked as used, so that it is kept in the cache.
+ * Call open() first.
+ **/ 
+bool DkTiledImage::hasPyramid() const {
+
+	if (!mNumLevels)
+		return false;
+
+	for (int level = 1; level < mNumLevels; level++) {
+
+		QFileInfo fInfo(levelPath(level));
+		QSize s = levelSize(level);
+
+		if (!fInfo.exists() || fInfo.size() != (qint64)s.width() * s.height() * 4)
+			return false;
+	}
+
+	touch();
+
+	return true;
+}
+
+/**
+ * Writes the downscaled levels to the disk cache.
+ * The image is read block by block so that just one row of blocks is in memory.
+ * Pyramids of previous sessions are re-used.
+ * This function blocks for a while - see DkPyramidBuilder.
+ * @param cancel the pyramid is discarded if this is set
+ * @return bool true if the pyramid is ready.
+ **/ 
+bool DkTiledImage::createPyramid(const QAtomicInt* cancel) {
+
+	if (!mTiff)
+		return false;
+
+	if (hasPyramid())
+		return true;
+
+	DkTimer dt;
+	QDir().mkpath(mCacheDir);
+	touch();	// the pyramid is not pruned while we create it
+
+	QVector<QSharedPointer<QFile> > files(mNumLevels);
+	QVector<QImage> carry(mNumLevels);
+
+	bool ok = true;
+	for (int level = 1; level < mNumLevels && ok; level++) {
+		files[level] = QSharedPointer<QFile>(new QFile(levelPath(level)));
+		ok = files[level]->open(QIODevice::WriteOnly | QIODevice::Truncate);
+	}
+
+	QSize bs = blockSize(0);
+	int numBx = qCeil((double)mSize.width() / bs.width());
+	int numBy = qCeil((double)mSize.height() / bs.height());
+
+	for (int by = 0; by < numBy && ok; by++) {
+
+		if (cancel && cancel->load()) {
+			ok = false;
+			break;
+		}
+
+		QImage band(mSize.width(), qMin(bs.height(), mSize.height() - by * bs.height()), QImage::Format_ARGB32_Premultiplied);
+
+		for (int bx = 0; bx < numBx && ok; bx++) {
+
+			QImage b;
+			{
+				QMutexLocker locker(&mMutex);
+				b = readBlock(0, bx, by);
+			}
+
+			if (b.isNull()) {
+				ok = false;
+				break;
+			}
+
+			for (int y = 0; y < b.height(); y++)
+				memcpy(band.scanLine(y) + bx * bs.width() * 4, b.constScanLine(y), b.width() * 4);
+		}
+
+		ok = ok && writeLevels(carry, files, band, 1);
+	}
+
+	// do not keep broken pyramids
+	for (QSharedPointer<QFile> f : files) {
+
+		if (!f)
+			continue;
+
+		f->close();
+		if (!ok)
+			f->remove();
+	}
+
+	if (!ok) {
+		QDir(mCacheDir).removeRecursively();
+		qWarning() << "could not create pyramid for" << mFilePath;
+		return false;
+	}
+
+	pruneCache();
+
+	qInfo() << "pyramid with" << mNumLevels << "levels created in" << dt;
+
+	return true;
+}
+
+/**
+ * Marks the pyramid as used.
+ **/ 
+void DkTiledImage::touch() const {
+
+	QFile file(mCacheDir + "/used");
+
+	if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		file.write(QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+}
+
+/**
+ * Removes the least recently used pyramids if all pyramids exceed maxCacheSize.
+ * The current pyramid is always kept.
+ **/ 
+void DkTiledImage::pruneCache() const {
+
+	QDir pyramidDir(QFileInfo(mCacheDir).absolutePath());
+	QFileInfoList pyramids = pyramidDir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+
+	// recently used first
+	qSort(pyramids.begin(), pyramids.end(), [](const QFileInfo& lhs, const QFileInfo& rhs) {
+		return QFileInfo(lhs.absoluteFilePath() + "/used").lastModified() > QFileInfo(rhs.absoluteFilePath() + "/used").lastModified();
+	});
+
+	QString currentDir = QFileInfo(mCacheDir).absoluteFilePath();
+	qint64 cacheSize = 0;
+
+	for (const QFileInfo& p : pyramids) {
+
+		for (const QFileInfo& f : QDir(p.absoluteFilePath()).entryInfoList(QDir::Files))
+			cacheSize += f.size();
+
+		if (cacheSize > maxCacheSize && p.absoluteFilePath() != currentDir) {
+			qInfo() << "removing pyramid" << p.absoluteFilePath() << "- the cache exceeds" << maxCacheSize / (1024*1024) << "MB";
+			QDir(p.absoluteFilePath()).removeRecursively();
+		}
+	}
+}
+
+// DkPyramidBuilder --------------------------------------------------------------------
+DkPyramidBuilder::DkPyramidBuilder() {
+
+	// pyramids are I/O bound & large - so we create one at a time
+	mPool.setMaxThreadCount(1);
+
+	// we might be created by a loading thread
+	if (QCoreApplication::instance())
+		moveToThread(QCoreApplication::instance()->thread());
+}
+
+DkPyramidBuilder::~DkPyramidBuilder() {
+
+	mCancel = 1;
+	mPool.waitForDone();
+}
 
+DkPyramidBuilder& DkPyramidBuilder::instance() {
 
-QImage DkRawLoader::loadPreviewRaw(LibRaw & iProcessor) const {
-	
-	int tW = iProcessor.imgdata.thumbnail.twidth;
+	static DkPyramidBuilder inst;
+	return inst;
+}
 
-	if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
-		(DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tW >= 1920)) {
+/**
+ * Creates the pyramid of a tiff image in the background.
+ * pyramidCreated() is emitted when it is done.
+ * @param filePath the tiff image
+ **/ 
+void DkPyramidBuilder::build(const QString& filePath) {
 
-		// crashes here if image is broken
-		int err = iProcessor.unpack_thumb();
-		char* tPtr = iProcessor.imgdata.thumbnail.thumb;
+	{
+		QMutexLocker locker(&mMutex);
 
-		if (!err && tPtr) {
+		if (mFilePaths.contains(filePath))
+			return;
 
-			QImage img;
-			img.loadFromData((const uchar*)tPtr, iProcessor.imgdata.thumbnail.tlength);
+		mFilePaths.insert(filePath);
+	}
 
-			// we're good to go
-			if (!img.isNull()) {
-				qDebug() << "[RAW] I loaded the RAW's thumbnail";
-				return img;
-			}
-			else
-				qDebug() << "RAW could not load the thumb";
+	QtConcurrent::run(&mPool, [this, filePath]() {
+
+		DkTiledImage tiledImage(filePath);
+		bool created = tiledImage.open() && tiledImage.createPyramid(&mCancel);
+
+		{
+			QMutexLocker locker(&mMutex);
+			mFilePaths.remove(filePath);
 		}
-		else
-			qDebug() << "error unpacking the thumb...";
-	}
 
-	// default: return nothing
-	return QImage();
+		emit pyramidCreated(filePath, created);
+	});
 }
 
-bool DkRawLoader::openBuffer(const QSharedPointer<QByteArray>& ba, LibRaw& iProcessor) const {
+bool DkPyramidBuilder::isBuilding(const QString& filePath) const {
 
-	int error = LIBRAW_DATA_ERROR;
+	QMutexLocker locker(&mMutex);
+	return mFilePaths.contains(filePath);
+}
 
-	QFileInfo fi(mFilePath);
+/**
+ * Downsamples rows of the previous level and appends them to the level's file.
+ * An odd row is kept in carry until the next rows arrive.
+ **/ 
+bool DkTiledImage::writeLevels(QVector<QImage>& carry, QVector<QSharedPointer<QFile> >& files, const QImage& rows, int level) const {
 
-	//use iprocessor from libraw to read the data
-	// OK - so LibRaw 0.17 cannot identify iiq files in the buffer - so we load them from the file
-	if (fi.suffix().contains("iiq", Qt::CaseInsensitive) || !ba || ba->isEmpty()) {
-		error = iProcessor.open_file(mFilePath.toStdString().c_str());
-	}
-	else {
-		// the buffer check is because:
-		// libraw has an error when loading buffers if the first 4 bytes encode as 'RIFF'
-		// and no data follows at all
-		if (ba->isEmpty() || ba->size() < 100)
-			return false;
+	if (level >= mNumLevels)
+		return true;
 
-		error = iProcessor.open_buffer((void*)ba->constData(), ba->size());
+	QImage src = rows;
+
+	if (!carry[level].isNull()) {
+		src = stackRows(carry[level], rows);
+		carry[level] = QImage();
 	}
 
-	return (error == LIBRAW_SUCCESS);
-}
+	int numRows = src.height() & ~1;
 
-void DkRawLoader::detectSpecialCamera(const LibRaw & iProcessor) {
+	if (numRows < src.height())
+		carry[level] = src.copy(0, numRows, src.width(), 1);
 
-	if (QString(iProcessor.imgdata.idata.model) == "IQ260 Achromatic")
-		mIsChromatic = false;
-	
-	if (QString(iProcessor.imgdata.idata.model).contains("IQ260"))
-		mCamType = camera_iiq;
-	else if (QString(iProcessor.imgdata.idata.make).compare("Canon", Qt::CaseInsensitive))
-		mCamType = camera_canon;
+	if (numRows == 0)
+		return true;
 
-	// add your camera flag (for hacks) here
+	QImage dst = DkImage::downsampleHalf(numRows == src.height() ? src : src.copy(0, 0, src.width(), numRows));
+	qint64 numBytes = (qint64)dst.bytesPerLine() * dst.height();
+
+	if (files[level]->write((const char*)dst.constBits(), numBytes) != numBytes)
+		return false;
+
+	return writeLevels(carry, files, dst, level + 1);
 }
 
-cv::Mat DkRawLoader::demosaic(LibRaw & iProcessor) const {
+void DkTiledImage::close() {
 
-	cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC1);
-	double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+	QMutexLocker locker(&mMutex);
 
-	// normalize all image values
-	for (int rIdx = 0; rIdx < rawMat.rows; rIdx++) {
-		unsigned short *ptrRaw = rawMat.ptr<unsigned short>(rIdx);
+#ifdef WITH_LIBTIFF
+	if (mTiff)
+		TIFFClose(mTiff);
+#endif
+	mTiff = 0;
+	mBlocks.clear();
+}
 
-		for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
+QString DkTiledImage::filePath() const {
+	return mFilePath;
+}
 
-			int colIdx = iProcessor.COLOR(rIdx, cIdx);
-			double val = (double)(iProcessor.imgdata.image[(rawMat.cols*rIdx) + cIdx][colIdx]);
-			
-			// normalize the value w.r.t the black point defined
-			val = (val - iProcessor.imgdata.color.black) / dynamicRange;
-			ptrRaw[cIdx] = clip<unsigned short>(val * USHRT_MAX);  // for conversion to 16U
-		}
-	}
+QSize DkTiledImage::size() const {
+	return mSize;
+}
 
-	// no demosaicing
-	if (mIsChromatic) {
+int DkTiledImage::numLevels() const {
+	return mNumLevels;
+}
 
-		unsigned long type = (unsigned long)iProcessor.imgdata.idata.filters;
-		type = type & 255;
+QSize DkTiledImage::levelSize(int level) const {
+	return QSize(mSize.width() >> level, mSize.height() >> level);
+}
 
-		cv::Mat rgbImg;
+/**
+ * Returns the coarsest level that has at least the resolution needed.
+ * @param scale the scale w.r.t. the full resolution.
+ * @return int the pyramid level.
+ **/ 
+int DkTiledImage::levelFor(double scale) const {
 
-		//define bayer pattern
-		if (type == 180) {
-			cvtColor(rawMat, rgbImg, CV_BayerBG2RGB);		//bitmask  10 11 01 00  -> 3(G) 2(B) 1(G) 0(R) ->	RG RG RG
-															//													GB GB GB
-		}
-		else if (type == 30) {
-			cvtColor(rawMat, rgbImg, CV_BayerRG2RGB);		//bitmask  00 01 11 10	-> 0 1 3 2
-		}
-		else if (type == 225) {
-			cvtColor(rawMat, rgbImg, CV_BayerGB2RGB);		//bitmask  11 10 00 01
-		}
-		else if (type == 75) {
-			cvtColor(rawMat, rgbImg, CV_BayerGR2RGB);		//bitmask  01 00 10 11
-		}
-		else {
-			qWarning() << "Wrong Bayer Pattern (not BG, RG, GB, GR)\n";
-			return cv::Mat();
-		}
+	if (scale <= 0.0)
+		return mNumLevels - 1;
 
-		rawMat = rgbImg;
-	}
+	int level = qFloor(qLn(1.0 / scale) / qLn(2.0));
 
-	// 16U (1 or 3 channeled) Mat
-	return rawMat;
+	return qBound(0, level, mNumLevels - 1);
 }
 
-cv::Mat DkRawLoader::prepareImg(const LibRaw & iProcessor) const {
+/**
+ * Returns a region of the image.
+ * Just the blocks that intersect with rect are decoded.
+ * @param rect the region w.r.t. the level's coordinates.
+ * @param level the pyramid level (0 is the full resolution).
+ * @return QImage the region (ARGB32_Premultiplied).
+ **/ 
+QImage DkTiledImage::region(const QRect& rect, int level) const {
 
-	cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC3, cv::Scalar(0));
-	double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+	if (level < 0 || level >= mNumLevels)
+		return QImage();
 
-	// normalization function
-	auto normalize = [&](double val) { 
-	
-		val = (val - iProcessor.imgdata.color.black) / dynamicRange;
-		return clip<unsigned short>(val * USHRT_MAX);
-	};
+	QRect r = rect.intersected(QRect(QPoint(), levelSize(level)));
+
+	if (r.isEmpty())
+		return QImage();
+
+	QImage img(r.size(), QImage::Format_ARGB32_Premultiplied);
+	img.fill(Qt::transparent);
 
-	for (int rIdx = 0; rIdx < rawMat.rows; rIdx++) {
-		unsigned short *ptrI = rawMat.ptr<unsigned short>(rIdx);
+	QSize bs = blockSize(level);
 
-		for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
+	for (int by = r.top() / bs.height(); by <= r.bottom() / bs.height(); by++) {
+		for (int bx = r.left() / bs.width(); bx <= r.right() / bs.width(); bx++) {
 
-			*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][0]);
-			ptrI++;
-			*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][1]);
-			ptrI++;
-			*ptrI = normalize(iProcessor.imgdata.image[rawMat.cols*rIdx + cIdx][2]);
-			ptrI++;
+			QImage b = block(level, bx, by);
+
+			if (b.isNull())
+				continue;
+
+			QRect br = QRect(QPoint(bx * bs.width(), by * bs.height()), b.size()).intersected(r);
+
+			for (int y = br.top(); y <= br.bottom(); y++) {
+				memcpy(img.scanLine(y - r.top()) + (br.left() - r.left()) * 4, 
+					b.constScanLine(y - by * bs.height()) + (br.left() - bx * bs.width()) * 4, 
+					br.width() * 4);
+			}
 		}
 	}
 
-	return rawMat;
+	return img;
 }
 
-cv::Mat DkRawLoader::whiteMultipliers(const LibRaw & iProcessor) const {
-	
-	// get camera white balance multipliers
-	cv::Mat wm(1, 4, CV_32FC1);
-	
-	float* wmp = wm.ptr<float>();
-
-	for (int idx = 0; idx < wm.cols; idx++)
-		wmp[idx] = iProcessor.imgdata.color.cam_mul[idx];
+/**
+ * Returns the coarsest level that is at least as large as size.
+ * The level is reduced if it exceeds the memory limit.
+ * @param size the size the overview is displayed with.
+ * @return QImage the overview.
+ **/ 
+QImage DkTiledImage::overview(const QSize& size) const {
 
-	if (wmp[3] == 0)
-		wmp[3] = wmp[1];	// take green (usually its RGBG)
+	int level = mNumLevels - 1;
 
-	// normalize white balance multipliers
-	float w = (float)cv::sum(wm)[0] / 4.0f;
-	float maxW = 1.0f;
+	while (level > 0) {
 
-	//clipping according the camera model
-	//if w > 2.0 maxW is 256, otherwise 512
-	//tested empirically
-	//check if it can be defined by some metadata settings?
-	if (w > 2.0f)
-		maxW = 255.0f;
-	if (w > 2.0f && mCamType == camera_canon)
-		maxW = 511.0f;	// some cameras would even need ~800 - why?
+		QSize s = levelSize(level);
+		if (s.width() >= size.width() || s.height() >= size.height())
+			break;
+		level--;
+	}
 
-	//normalize white point
-	wm /= maxW;
+	while (level < mNumLevels - 1 && (qint64)levelSize(level).width() * levelSize(level).height() * 4 > memoryLimit())
+		level++;
 
-	// 1 x 4 32FC1 white balance vector
-	return wm;
+	return region(QRect(QPoint(), levelSize(level)), level);
 }
 
-cv::Mat DkRawLoader::gammaTable(const LibRaw & iProcessor) const {
-	
-	// OK this is an instance of reverse engineering:
-	// we found out that the values of (at least) the PhaseOne's achromatic back have to be doubled
-	// our images are no close to what their software (Capture One does) - only the gamma correction
-	// seems to be slightly different... -> now we can load compressed IIQs that are not supported by PS : )
-	double cameraHackMlp = (QString(iProcessor.imgdata.idata.model) == "IQ260 Achromatic") ? 2.0 : 1.0;
+/**
+ * Returns the memory images may occupy before they are streamed.
+ * @return qint64 the limit in bytes.
+ **/ 
+qint64 DkTiledImage::memoryLimit() {
+	return (qint64)DkSettingsManager::param().resources().maxImageMemory * 1024 * 1024;
+}
 
-	//read gamma value and create gamma table	
-	double gamma = (double)iProcessor.imgdata.params.gamm[0];
-	
-	cv::Mat gmt(1, USHRT_MAX, CV_16UC1);
-	unsigned short* gmtp = gmt.ptr<unsigned short>();
-	
-	for (int idx = 0; idx < gmt.cols; idx++) {
-		gmtp[idx] = clip<unsigned short>(qRound((1.099*std::pow((double)idx / USHRT_MAX, gamma) - 0.099) * 255 * cameraHackMlp));
-	}
+bool DkTiledImage::isTiff(const QString& filePath) {
+	return QFileInfo(filePath).suffix().contains(QRegExp("^(tif|tiff)$", Qt::CaseInsensitive));
+}
 
-	// a 1 x 65535 U16 gamma table
-	return gmt;
+QString DkTiledImage::levelPath(int level) const {
+	return mCacheDir + "/" + QString::number(level) + ".raw";
 }
 
-void DkRawLoader::whiteBalance(const LibRaw & iProcessor, cv::Mat & img) const {
+QSize DkTiledImage::blockSize(int level) const {
 
-	// white balance must not be empty at this point
-	cv::Mat wb = whiteMultipliers(iProcessor);
-	const float* wbp = wb.ptr<float>();
-	assert(wb.cols == 4);
+	// the full resolution is read in the tiff's native blocks
+	if (level == 0)
+		return mTileSize;
 
-	for (int rIdx = 0; rIdx < img.rows; rIdx++) {
-		
-		unsigned short *ptr = img.ptr<unsigned short>(rIdx);
-		
-		for (int cIdx = 0; cIdx < img.cols; cIdx++) {
-			
-			//apply white balance correction
-			unsigned short r = clip<unsigned short>(*ptr		* wbp[0]);
-			unsigned short g = clip<unsigned short>(*(ptr+1)	* wbp[1]);
-			unsigned short b = clip<unsigned short>(*(ptr+2)	* wbp[2]);
-
-			//apply color correction					
-			int cr = qRound(iProcessor.imgdata.color.rgb_cam[0][0] * r + 
-							iProcessor.imgdata.color.rgb_cam[0][1] * g + 
-							iProcessor.imgdata.color.rgb_cam[0][2] * b);
-			int cg = qRound(iProcessor.imgdata.color.rgb_cam[1][0] * r + 
-							iProcessor.imgdata.color.rgb_cam[1][1] * g + 
-							iProcessor.imgdata.color.rgb_cam[1][2] * b);
-			int cb = qRound(iProcessor.imgdata.color.rgb_cam[2][0] * r + 
-							iProcessor.imgdata.color.rgb_cam[2][1] * g + 
-							iProcessor.imgdata.color.rgb_cam[2][2] * b);
-
-			// clip & save color corrected values
-			*ptr = clip<unsigned short>(cr);
-			ptr++;
-			*ptr = clip<unsigned short>(cg);
-			ptr++;
-			*ptr = clip<unsigned short>(cb);
-			ptr++;
-		}
-	}
+	return QSize(256, 256);
 }
 
-void DkRawLoader::gammaCorrection(const LibRaw & iProcessor, cv::Mat& img) const {
+QImage DkTiledImage::block(int level, int bx, int by) const {
 
-	// white balance must not be empty at this point
-	cv::Mat gt = gammaTable(iProcessor);
-	const unsigned short* gammaLookup = gt.ptr<unsigned short>();
-	assert(gt.cols == USHRT_MAX);
-	
-	for (int rIdx = 0; rIdx < img.rows; rIdx++) {
+	quint64 key = ((quint64)level << 48) | ((quint64)by << 24) | (quint32)bx;
 
-		unsigned short *ptr = img.ptr<unsigned short>(rIdx);
+	QMutexLocker locker(&mMutex);
+	QImage* cached = mBlocks.object(key);
 
-		for (int cIdx = 0; cIdx < img.cols * img.channels(); cIdx++) {
+	if (cached)
+		return *cached;
 
-			//apply gamma correction
-			const unsigned short maxLin = 5;	// 0.018 * 255
+	QImage b = readBlock(level, bx, by);
 
-			// values close to 0 are treated linear
-			if (ptr[cIdx] <= 5)	// 0.018 * 255
-				ptr[cIdx] = (unsigned short)qRound(ptr[cIdx] * (double)iProcessor.imgdata.params.gamm[1] / 255.0);
-			else
-				ptr[cIdx] = gammaLookup[ptr[cIdx]];
-		}
-	}
+	if (!b.isNull())
+		mBlocks.insert(key, new QImage(b), b.bytesPerLine() * b.height() / 1024);
 
+	return b;
 }
 
-void DkRawLoader::reduceColorNoise(const LibRaw & iProcessor, cv::Mat & img) const {
+/**
+ * Reads a block from the tiff (level 0) or from the pyramid.
+ * The caller needs to lock mMutex.
+ **/ 
+QImage DkTiledImage::readBlock(int level, int bx, int by) const {
 
-	// filter color noise with a median filter
-	float isoSpeed = iProcessor.imgdata.other.iso_speed;
+	QSize ls = levelSize(level);
+	QSize bs = blockSize(level);
+	int x = bx * bs.width();
+	int y = by * bs.height();
+	QSize s(qMin(bs.width(), ls.width() - x), qMin(bs.height(), ls.height() - y));
 
-	if (isoSpeed > 0) {
+	if (s.isEmpty())
+		return QImage();
 
-		DkTimer dt;
+	QImage img(s, QImage::Format_ARGB32_Premultiplied);
 
-		int winSize;
-		if (isoSpeed > 6400) 
-			winSize = 13;
-		else if (isoSpeed >= 3200) 
-			winSize = 11;
-		else if (isoSpeed >= 2500) 
-			winSize = 9;
-		else if (isoSpeed >= 400) 
-			winSize = 7;
-		else 
-			winSize = 5;
+	if (level > 0) {
 
-		DkTimer dMed;
-		
-		cv::cvtColor(img, img, CV_RGB2YCrCb);
+		QFile file(levelPath(level));
 
-		std::vector<cv::Mat> imgCh;
-		cv::split(img, imgCh);
-		assert(imgCh.size() == 3);
+		if (!file.open(QIODevice::ReadOnly))
+			return QImage();
 
-		cv::medianBlur(imgCh[1], imgCh[1], winSize);
-		cv::medianBlur(imgCh[2], imgCh[2], winSize);
+		for (int r = 0; r < s.height(); r++) {
 
-		cv::merge(imgCh, img);
-		cv::cvtColor(img, img, CV_YCrCb2RGB);
-		qDebug() << "median blur takes:" << dt;
+			if (!file.seek(((qint64)(y + r) * ls.width() + x) * 4) ||
+				file.read((char*)img.scanLine(r), s.width() * 4) != s.width() * 4)
+				return QImage();
+		}
+
+		return img;
 	}
 
-}
+#ifdef WITH_LIBTIFF
+	if (!mTiff)
+		return QImage();
 
-QImage DkRawLoader::raw2Img(const LibRaw & iProcessor, cv::Mat & img) const {
-	
-	//check the pixel aspect ratio of the raw image
-	if (iProcessor.imgdata.sizes.pixel_aspect != 1.0f)
-		cv::resize(img, img, cv::Size(), (double)iProcessor.imgdata.sizes.pixel_aspect, 1.0f);
-	
-	// revert back to 8-bit image
-	img.convertTo(img, CV_8U);
+	DkTiffSilencer silencer;
+	QVector<uint32> raster(bs.width() * bs.height());
+	int numRows = 0;
+	bool ok = false;
 
-	// TODO: for now - fix this!
-	if (img.channels() == 1)
-		cv::cvtColor(img, img, CV_GRAY2RGB);
+	if (TIFFIsTiled(mTiff)) {
+		ok = TIFFReadRGBATile(mTiff, x, y, raster.data()) != 0;
+		numRows = bs.height();	// libtiff pads the tiles
+	}
+	else {
+		ok = TIFFReadRGBAStrip(mTiff, y, raster.data()) != 0;
+		numRows = s.height();
+	}
+
+	if (!ok)
+		return QImage();
 
+	// libtiff returns the rows bottom-up & in ABGR order
+	for (int r = 0; r < s.height(); r++) {
 
-	return DkImage::mat2QImage(img);
-}
+		const uint32* src = raster.constData() + (numRows - 1 - r) * bs.width();
+		uint32* dst = reinterpret_cast<uint32*>(img.scanLine(r));
+
+		for (int c = 0; c < s.width(); c++) {
+			uint32 p = src[c];
+			dst[c] = (p & 0xff00ff00) | ((p & 0x00ff0000) >> 16) | ((p & 0x000000ff) << 16);
+		}
+	}
 
+	return img;
+#else
+	return QImage();
 #endif
+}
 
 }
@@ -32,6 +32,14 @@
 #include <QSharedPointer>
 #include <QUrl>
 #include <QImage>
+#include <QCache>
+#include <QMutex>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QStringList>
 #pragma warning(pop)
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -64,7 +72,9 @@
 
 // Qt defines
 class QNetworkReply;
+class QFile;
 class LibRaw;
+struct tiff;
 
 namespace nmc {
 
@@ -94,8 +104,88 @@ protected:
 	bool mImageInZip;
 	static QString mZipMarker;
 };
+
+/**
+ * Shared reader for zip archives.
+ * The central directory is parsed once into a name index,
+ * the archive stays mapped (Unix) and all entries can be
+ * extracted concurrently from worker threads.
+ **/ 
+class DllCoreExport DkZipArchive {
+
+public:
+	static QSharedPointer<DkZipArchive> open(const QString& zipFile);
+
+	QString filePath() const;
+	QStringList fileNames() const;
+	bool contains(const QString& imageFile) const;
+	QSharedPointer<QByteArray> extract(const QString& imageFile) const;
+
+	static const int maxCachedArchives = 4;
+
+protected:
+	DkZipArchive(const QString& zipFile);
+
+	struct Entry {
+		qint64 centralOffset = 0;
+		int centralSize = 0;
+		qint64 localOffset = 0;
+		quint16 flags = 0;
+		quint16 method = 0;
+		qint64 compressedSize = 0;
+		qint64 size = 0;
+	};
+
+	bool index();
+	QByteArray read(qint64 offset, qint64 size) const;
+	QSharedPointer<QByteArray> inflate(const Entry& entry, const QByteArray& localHeader, const QByteArray& data) const;
+
+	QString mFilePath;
+	qint64 mFileSize = 0;
+	QDateTime mModified;
+	QSharedPointer<QByteArray> mData;		// the mapped archive (or null if it is read on demand)
+	QHash<QString, Entry> mEntries;
+	QStringList mFileNames;					// in archive order
+};
 #endif
 
+/**
+ * Maps image files into memory.
+ * Mapped buffers share the OS page cache instead of
+ * copying the whole file to the heap.
+ * Reading a mapping whose file was truncated raises SIGBUS. Our handler
+ * then replaces the missing pages with zeros (the decoder reads garbage but
+ * does not crash) - check isStale() before a mapping is reused.
+ **/ 
+class DllCoreExport DkMappedFile {
+
+public:
+	static QSharedPointer<QByteArray> map(const QString& filePath, bool willNeed = false);
+	static bool isMapped(const QSharedPointer<QByteArray>& ba);
+	static bool isStale(const QSharedPointer<QByteArray>& ba);
+
+	static const qint64 minFileSize = 1024*1024;	// smaller files are faster read than mapped
+	static const int maxMappings = 1024;			// more files are read to the heap
+
+protected:
+	struct Mapping {
+		QByteArray filePath;	// encoded
+		qint64 size = 0;
+		qint64 modified = 0;
+		quint64 inode = 0;
+		int slot = -1;			// in the SIGBUS handler's table
+	};
+
+	static QMutex& mappingsMutex();
+	static QHash<const char*, Mapping>& mappings();
+};
+
+/**
+ * A state of the edit history.
+ * Besides the original image, states just need to store
+ * their difference to the previous state (see computeDelta).
+ * The image itself is then just cached for recently used states.
+ **/ 
 class DllCoreExport DkEditImage {
 
 public:
@@ -104,12 +194,32 @@ public:
 	void setImage(const QImage& img);
 	QImage image() const;
 	QString editName() const;
-	int size() const;
+	float size() const;
+
+	bool hasImage() const;
+	bool hasDelta() const;
+	bool isKeyFrame() const;
+	void computeDelta(const QImage& prevImg);
+	QImage applyDelta(const QImage& prevImg) const;
+	void cacheImage(const QImage& img);
+	void releaseImage();
 
 protected:
 	QImage mImg;
 	QString mEditName;
 
+	// zlib compressed XOR of bands that changed w.r.t. the previous state
+	struct DeltaBand {
+		int row;
+		QByteArray data;
+	};
+
+	bool mHasDelta = false;
+	QVector<DeltaBand> mDelta;
+	QByteArray mKeyFrame;	// the compressed image if the size or format changed
+	QSize mSize;
+	QImage::Format mFormat = QImage::Format_Invalid;
+	QVector<QRgb> mColorTable;
 };
 
 class DllCoreExport DkRawLoader {
@@ -124,6 +234,15 @@ public:
 
 	QImage image() const;
 
+#ifdef WITH_LIBRAW
+	/**
+	 * Compares the vectorized development (white balance, color matrix, gamma) with the scalar one.
+	 * Both run on a synthetic width x height image and their timings are logged.
+	 * @return true if the vectorized results match the scalar results
+	 **/
+	static bool benchmarkDevelop(int width = 6000, int height = 4000);
+#endif
+
 protected:
 	QString mFilePath;
 	QSharedPointer<DkMetaDataT> mMetaData;
@@ -158,9 +277,7 @@ protected:
 	cv::Mat whiteMultipliers(const LibRaw& iProcessor) const;
 	cv::Mat gammaTable(const LibRaw& iProcessor) const;
 
-	void whiteBalance(const LibRaw& iProcessor, cv::Mat& img) const;
-
-	void gammaCorrection(const LibRaw& iProcessor, cv::Mat& img) const;
+	void develop(const LibRaw& iProcessor, cv::Mat& img) const;
 
 	void reduceColorNoise(const LibRaw& iProcessor, cv::Mat& img) const;
 
@@ -183,6 +300,89 @@ protected:
 #endif
 };
 
+/**
+ * Streams large tiff images region by region.
+ * The first time an image is opened, a multi-resolution pyramid is
+ * written to the disk cache (see DkPyramidBuilder). Afterwards, only the blocks
+ * that are needed for rendering are decoded - the full image is never resident.
+ **/
+class DllCoreExport DkTiledImage {
+
+public:
+	DkTiledImage(const QString& filePath);
+	~DkTiledImage();
+
+	bool open();
+	bool hasPyramid() const;
+	bool createPyramid(const QAtomicInt* cancel = 0);
+	void close();
+
+	QString filePath() const;
+	QSize size() const;
+	int numLevels() const;
+	QSize levelSize(int level) const;
+	int levelFor(double scale) const;
+
+	QImage region(const QRect& rect, int level) const;
+	QImage overview(const QSize& size) const;
+
+	static qint64 memoryLimit();
+	static bool isTiff(const QString& filePath);
+
+	static const qint64 maxCacheSize = 4LL*1024*1024*1024;	// bytes of all pyramids on the disk
+
+protected:
+	QString levelPath(int level) const;
+	void touch() const;
+	void pruneCache() const;
+	QSize blockSize(int level) const;
+	QImage block(int level, int bx, int by) const;
+	QImage readBlock(int level, int bx, int by) const;
+	bool writeLevels(QVector<QImage>& carry, QVector<QSharedPointer<QFile> >& files, const QImage& rows, int level) const;
+
+	QString mFilePath;
+	QString mCacheDir;
+	QSize mSize;
+	QSize mTileSize;	// tile or strip size of the source
+	int mNumLevels = 0;
+
+	struct tiff* mTiff = 0;
+	mutable QMutex mMutex;
+	mutable QCache<quint64, QImage> mBlocks;
+};
+
+/**
+ * Creates the pyramids of streamed images in the background.
+ * A pyramid needs a pass over the whole image which takes a while
+ * for large images. Loaders show a placeholder until pyramidCreated()
+ * is emitted.
+ **/
+class DllCoreExport DkPyramidBuilder : public QObject {
+	Q_OBJECT
+
+public:
+	static DkPyramidBuilder& instance();
+	~DkPyramidBuilder();
+
+	// singleton
+	DkPyramidBuilder(DkPyramidBuilder const&)	= delete;
+	void operator=(DkPyramidBuilder const&)		= delete;
+
+	void build(const QString& filePath);
+	bool isBuilding(const QString& filePath) const;
+
+signals:
+	void pyramidCreated(const QString& filePath, bool created) const;
+
+protected:
+	DkPyramidBuilder();
+
+	mutable QMutex mMutex;
+	QSet<QString> mFilePaths;
+	QAtomicInt mCancel;
+	QThreadPool mPool;
+};
+
 /**
  * This class provides image loading and editing capabilities.
  * It additionally stores the currently loaded image.
@@ -206,6 +406,7 @@ public:
 		raw_loader,
 		roh_loader,
 		hdr_loader,
+		tiled_loader,
 	};
 
 	DkBasicLoader(int mode = mode_default);
@@ -293,6 +494,40 @@ public:
 		return mPageIdxDirty;
 	};
 
+	/**
+	 * Sets the size images are decoded to.
+	 * Larger images are decoded to a downscaled preview (if the image plugin supports it).
+	 * @param size the target size, an invalid size disables previews
+	 **/
+	void setTargetSize(const QSize& size) {
+		mTargetSize = size;
+	};
+
+	QSize targetSize() const {
+		return mTargetSize;
+	};
+
+	/**
+	 * Returns true if the loaded image is a downscaled preview.
+	 * @return bool true if the full resolution still needs to be loaded.
+	 **/
+	bool isPreview() const {
+		return mFullSize.isValid();
+	};
+
+	QSize fullSize() const;
+	bool canLoadFullResolution() const;
+	bool setFullResolution(const QImage& img);
+
+	/**
+	 * Returns the tiled source if the image is too large to be loaded at once.
+	 * In this case, image() is an overview of the image.
+	 * @return QSharedPointer<DkTiledImage> the tiled source or NULL.
+	 **/
+	QSharedPointer<DkTiledImage> tiledImage() const {
+		return mTiledImage;
+	};
+
 	/**
 	 * Returns the current image size.
 	 * @return QSize the image size.
@@ -359,8 +594,12 @@ public slots:
 protected:
 	bool loadRohFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
 	bool loadRawFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false) const;
+	bool loadQtFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba, const QString& suffix, bool transposed = false);
+	bool loadTiledFile(const QString& filePath, QImage& img);
 	void indexPages(const QString& filePath);
 	void convert32BitOrder(void *buffer, int width);
+	QImage historyImage(int idx) const;
+	void updateHistoryCache();
 
 	int mLoader;
 	bool mTraining;
@@ -374,6 +613,11 @@ protected:
 	QVector<DkEditImage> mImages;
 	int mMinHistorySize = 2;
 	int mImageIndex = 0;
+	QList<int> mRecentStates;	// history states that keep their image
+	int mNumCachedStates = 3;
+	QSize mTargetSize;
+	QSize mFullSize;	// valid if just a preview is loaded
+	QSharedPointer<DkTiledImage> mTiledImage;
 };
 
 // file downloader from: http://qt-project.org/wiki/Download_Data_from_URL
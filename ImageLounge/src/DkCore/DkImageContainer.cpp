@@ -37,7 +37,15 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QObject>
 #include <QImage>
+#include <QGuiApplication>
+#include <QScreen>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QThread>
+#include <qmath.h>
+
+#include <algorithm>
+#include <random>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -115,8 +123,7 @@ void DkImageContainer::clear() {
 
 	if (mLoader)
 		mLoader->release();
-	if (mFileBuffer)
-		mFileBuffer->clear();
+	mFileBuffer.clear();	// releases mapped files too
 	init();
 }
 
@@ -252,6 +259,12 @@ QSharedPointer<DkImageContainerT> DkImageContainerT::fromImageContainer(QSharedP
 
 QSharedPointer<QByteArray> DkImageContainer::getFileBuffer() {
 
+	// another program changed the mapped file - reading the mapping might crash
+	if (DkMappedFile::isStale(mFileBuffer)) {
+		qInfo() << mFilePath << "changed on disk - the mapping is released";
+		mFileBuffer.clear();
+	}
+
 	if (!mFileBuffer) {
 		mFileBuffer = QSharedPointer<QByteArray>(new QByteArray());
 	}
@@ -259,12 +272,23 @@ QSharedPointer<QByteArray> DkImageContainer::getFileBuffer() {
 	return mFileBuffer;
 }
 
+/**
+ * Sets the file buffer which is used by loadImage().
+ * This allows for reading the file in a different thread than decoding it.
+ * @param fileBuffer the (encoded) file
+ **/ 
+void DkImageContainer::setFileBuffer(QSharedPointer<QByteArray> fileBuffer) {
+
+	mFileBuffer = fileBuffer;
+}
+
 float DkImageContainer::getMemoryUsage() const {
 
 	if (!mLoader)
 		return 0;
 
-	float memSize = mFileBuffer ? mFileBuffer->size()/(1024.0f*1024.0f) : 0;
+	// mapped files are part of the OS page cache
+	float memSize = mFileBuffer && !DkMappedFile::isMapped(mFileBuffer) ? mFileBuffer->size()/(1024.0f*1024.0f) : 0;
 	memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
 
 	return memSize;
@@ -280,7 +304,7 @@ DkRotatingRect DkImageContainer::cropRect() {
 	QSharedPointer<DkMetaDataT> metaData = getMetaData();
 
 	if (metaData) {
-		return metaData->getXMPRect(image().size());
+		return metaData->getXMPRect(displayImage().size());
 	}
 	else
 		qWarning() << "empty crop rect because there are no metadata...";
@@ -291,6 +315,24 @@ DkRotatingRect DkImageContainer::cropRect() {
 
 QImage DkImageContainer::image() {
 
+	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
+		loadImage();
+
+	// replace previews if the full resolution fits into memory
+	// images that are too large keep their overview - see hasFullResolution()
+	if (mLoader->canLoadFullResolution())
+		loadFullResolution();
+
+	return mLoader->image();
+}
+
+/**
+ * Returns the image for displaying it.
+ * In contrast to image() this might be a downscaled preview.
+ * @return QImage the loaded image
+ **/ 
+QImage DkImageContainer::displayImage() {
+
 	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
 		loadImage();
 
@@ -306,7 +348,7 @@ QImage DkImageContainer::imageScaledToHeight(int height) {
 	}
 
 	// cache it
-	QImage sImg = image().scaledToHeight(height, Qt::SmoothTransformation);
+	QImage sImg = displayImage().scaledToHeight(height, Qt::SmoothTransformation);
 	scaledImages << sImg;
 
 	// clean up
@@ -325,7 +367,7 @@ QImage DkImageContainer::imageScaledToWidth(int width) {
 	}
 
 	// cache it
-	QImage sImg = image().scaledToWidth(width, Qt::SmoothTransformation);
+	QImage sImg = displayImage().scaledToWidth(width, Qt::SmoothTransformation);
 	scaledImages << sImg;
 
 	// clean up
@@ -342,6 +384,12 @@ void DkImageContainer::setImage(const QImage& img, const QString& editName) {
 
 void DkImageContainer::setImage(const QImage& img, const QString& editName, const QString& filePath) {
 
+	// the edit history must not start with a preview
+	if (!loadFullResolution() && !hasFullResolution()) {
+		qWarning() << "cannot edit" << mFilePath << "- only a preview can be loaded";
+		return;
+	}
+
 	scaledImages.clear();	// invalid now
 
 	setFilePath(mFilePath);
@@ -354,14 +402,10 @@ void DkImageContainer::setFilePath(const QString& filePath) {
 	mFilePath = filePath;
 	mFileInfo = filePath;
 
-#ifdef Q_OS_WIN
-#if QT_VERSION < 0x050000
-	mFileNameStr = fileName().toStdWString();
-#else
-	mFileNameStr = DkUtils::qStringToStdWString(fileName());
-#endif
-#endif
-
+	mSortKey = DkUtils::naturalSortKey(fileName());
+	mDateCreated = -1;
+	mDateModified = -1;
+	mFileSize = -1;
 }
 
 bool DkImageContainer::hasImage() const {
@@ -372,6 +416,17 @@ bool DkImageContainer::hasImage() const {
 	return mLoader->hasImage();
 }
 
+/**
+ * Returns false if only a preview of the image can be loaded.
+ * This is the case for streamed images and images that exceed the memory limit.
+ * Such images must neither be edited nor saved since the preview would replace the original.
+ * @return bool true if the full resolution image is (or can be) loaded.
+ **/ 
+bool DkImageContainer::hasFullResolution() {
+
+	return !getLoader()->isPreview() || getLoader()->canLoadFullResolution();
+}
+
 int DkImageContainer::getLoadState() const {
 
 	return mLoadState;
@@ -390,12 +445,35 @@ bool DkImageContainer::loadImage() {
 	return mLoader->hasImage();
 }
 
+/**
+ * Replaces a preview with the full resolution image.
+ * @return bool true if the full resolution image was loaded.
+ **/ 
+bool DkImageContainer::loadFullResolution() {
+
+	if (!getLoader()->canLoadFullResolution()) {
+		if (getLoader()->isPreview())
+			qWarning() << "full resolution of" << mFilePath << getLoader()->fullSize() << "exceeds the memory limit - keeping the preview";
+		return false;
+	}
+
+	if (getFileBuffer()->isEmpty())
+		mFileBuffer = loadFileToBuffer(mFilePath);
+
+	return mLoader->setFullResolution(loadFullResolutionIntern(mFilePath, mFileBuffer));
+}
+
 bool DkImageContainer::saveImage(const QString& filePath, int compression /* = -1 */) {
-	return saveImage(filePath, getLoader()->image(), compression);
+	return saveImage(filePath, image(), compression);
 }
 
 bool DkImageContainer::saveImage(const QString& filePath, const QImage saveImg, int compression /* = -1 */) {
 
+	if (!hasFullResolution()) {
+		qWarning() << "cannot save" << mFilePath << "- only a preview can be loaded";
+		return false;
+	}
+
 	QFileInfo saveFile = saveImageIntern(filePath, getLoader(), saveImg, compression);
 
 	saveFile.refresh();
@@ -420,10 +498,15 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString& fil
 		return QSharedPointer<QByteArray>(new QByteArray());
 	}
 
+	// large files are mapped and prefetched by the OS
+	QSharedPointer<QByteArray> ba = DkMappedFile::map(fInfo.absoluteFilePath(), true);
+	if (ba)
+		return ba;
+
 	QFile file(fInfo.absoluteFilePath());
 	file.open(QIODevice::ReadOnly);
 
-	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
+	ba = QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
 	file.close();
 
 	return ba;
@@ -441,6 +524,20 @@ QSharedPointer<DkBasicLoader> DkImageContainer::loadImageIntern(const QString& f
 	return loader;
 }
 
+QImage DkImageContainer::loadFullResolutionIntern(const QString& filePath, QSharedPointer<QByteArray> fileBuffer) {
+
+	// use a new loader - the current one keeps the preview until we are done
+	DkBasicLoader loader;
+
+	try {
+		loader.loadGeneral(filePath, fileBuffer, true);
+	} catch (...) {
+		qWarning() << "Unknown error in DkImageContainer::loadFullResolutionIntern";
+	}
+
+	return loader.image();
+}
+
 QString DkImageContainer::saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression) {
 
 	return loader->save(filePath, saveImg, compression);
@@ -451,7 +548,7 @@ void DkImageContainer::saveMetaData() {
 	if (!mLoader)
 		return;
 
-	saveMetaDataIntern(mFilePath, mLoader, mFileBuffer);
+	saveMetaDataIntern(mFilePath, mLoader, getFileBuffer());
 }
 
 void DkImageContainer::saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer) {
@@ -494,12 +591,60 @@ QSharedPointer<DkZipContainer> DkImageContainer::getZipData() {
 	return mZipData;
 }
 #endif
-#ifdef Q_OS_WIN
-std::wstring DkImageContainer::getFileNameWStr() const {
-	
-	return mFileNameStr;
+/**
+ * Returns the natural sort key of the file name.
+ * @return QByteArray a key that can be compared with DkUtils::compareSortKeys().
+ **/ 
+QByteArray DkImageContainer::sortKey() const {
+
+	return mSortKey;
+}
+
+/**
+ * Returns the creation date in ms since epoch.
+ * The date is read once - images are re-created if the file changes.
+ **/ 
+qint64 DkImageContainer::dateCreated() const {
+
+	if (mDateCreated == -1)
+		mDateCreated = QFileInfo(mFilePath).created().toMSecsSinceEpoch();
+
+	return mDateCreated;
+}
+
+/**
+ * Returns the modification date in ms since epoch.
+ * The date is read once - images are re-created if the file changes.
+ **/ 
+qint64 DkImageContainer::dateModified() const {
+
+	if (mDateModified == -1)
+		mDateModified = QFileInfo(mFilePath).lastModified().toMSecsSinceEpoch();
+
+	return mDateModified;
+}
+
+/**
+ * Returns the file size in bytes.
+ * Like the modification date, the size is read once.
+ **/ 
+qint64 DkImageContainer::fileSize() const {
+
+	if (mFileSize == -1)
+		mFileSize = QFileInfo(mFilePath).size();
+
+	return mFileSize;
+}
+
+/**
+ * Returns true if the file was overwritten since the container read it.
+ * @param fileInfo the current state of the file (e.g. from a folder listing).
+ * @return bool true if the modification date or the size changed.
+ **/ 
+bool DkImageContainer::isChanged(const QFileInfo& fileInfo) const {
+
+	return dateModified() != fileInfo.lastModified().toMSecsSinceEpoch() || fileSize() != fileInfo.size();
 }
-#endif
 
 bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const QSharedPointer<DkImageContainer> r) {
 
@@ -509,55 +654,194 @@ bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const Q
 	return imageContainerLessThan(*l, *r);
 }
 
-bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r) {
+/**
+ * Returns the sort values of meta data sort modes (see DkMetaDataIndex).
+ * Images that are not indexed yet keep the default values and are sorted by file name.
+ **/ 
+static void metaDataSortValues(const QFileInfo& file, int mode, QByteArray& group, qint64& value) {
 
-	switch(DkSettingsManager::param().global().sortMode) {
-
-	case DkSettings::sort_filename:
-#ifdef Q_OS_WIN
-		// not beautiful if you take a look at the code, but:
-		// time on Win8 with compFilename:
-		//		WinAPI, indexed ( 73872 ) files in:  " 92 ms"
-		//		[DkImageLoader]  73872  containers created in  " 1.825 sec"
-		//		[DkImageLoader] after sorting:  " 52.246 sec"
-		// time on Win8 with direct wCompLogic:
-		//		WinAPI, indexed ( 73872 ) files in:  " 63 ms"
-		//		[DkImageLoader]  73872  containers created in  " 1.203 sec"
-		//		[DkImageLoader] after sorting:  " 14.407 sec"
-		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-		else
-			return !DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-		break;
-#else
-		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compFilenameInv(l.fileInfo(), r.fileInfo());
-		break;
-#endif
+	DkMetaDataIndex::Entry e;
+	if (!DkMetaDataIndex::instance().entry(file, e))
+		return;
 
-	case DkSettings::sort_date_created:
-		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateCreated(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compDateCreatedInv(l.fileInfo(), r.fileInfo());
-		break;
+	if (mode == DkSettings::sort_rating)
+		value = e.rating;
+	else if (mode == DkSettings::sort_date_taken)
+		value = e.dateTaken;
+	else if (mode == DkSettings::sort_camera) {
+		group = DkUtils::naturalSortKey(e.camera);
+		value = e.dateTaken;	// photos of a camera are sorted by date
+	}
+}
 
-	case DkSettings::sort_date_modified:
-		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateModified(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compDateModifiedInv(l.fileInfo(), r.fileInfo());
+static bool isMetaDataSortMode(int mode) {
+	return mode == DkSettings::sort_date_taken || mode == DkSettings::sort_rating || mode == DkSettings::sort_camera;
+}
 
-	case DkSettings::sort_random:
+bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r) {
+
+	int mode = DkSettingsManager::param().global().sortMode;
+
+	if (mode == DkSettings::sort_random)
 		return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
 
-	default:
-		// filename
-		return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+	const DkImageContainer& a = ascending ? l : r;
+	const DkImageContainer& b = ascending ? r : l;
+
+	if (mode == DkSettings::sort_date_created && a.dateCreated() != b.dateCreated())
+		return a.dateCreated() < b.dateCreated();
+	if (mode == DkSettings::sort_date_modified && a.dateModified() != b.dateModified())
+		return a.dateModified() < b.dateModified();
+
+	if (isMetaDataSortMode(mode)) {
+
+		QByteArray ga, gb;
+		qint64 va = 0, vb = 0;
+		metaDataSortValues(a.fileInfo(), mode, ga, va);
+		metaDataSortValues(b.fileInfo(), mode, gb, vb);
+
+		int cmp = DkUtils::compareSortKeys(ga, gb);
+		if (cmp != 0)
+			return cmp < 0;
+		if (va != vb)
+			return va < vb;
 	}
-	
+
+	// file names are compared if the dates are equal too
+	return DkUtils::compareSortKeys(a.sortKey(), b.sortKey()) < 0;
+}
+
+struct DkSortItem {
+	QByteArray key;
+	QByteArray group;	// e.g. camera
+	qint64 value = 0;	// e.g. date, rating
+	int idx = 0;
+};
+
+struct DkMergeRange {
+	int first;
+	int mid;
+	int last;
+};
+
+/**
+ * Sorts chunks of items in parallel and merges them afterwards.
+ **/ 
+template <typename T, typename LessThan>
+static void parallelSort(QVector<T>& items, LessThan lessThan) {
+
+	int numChunks = QThread::idealThreadCount();
+
+	if (numChunks < 2 || items.size() < 4096) {
+		std::sort(items.begin(), items.end(), lessThan);
+		return;
+	}
+
+	T* data = items.data();
+	int chunkSize = qCeil((double)items.size() / numChunks);
+
+	QVector<int> bounds;
+	for (int idx = 0; idx < items.size(); idx += chunkSize)
+		bounds << idx;
+	bounds << items.size();
+
+	QVector<DkMergeRange> chunks;
+	for (int idx = 0; idx < bounds.size() - 1; idx++) {
+		DkMergeRange r = {bounds[idx], bounds[idx + 1], bounds[idx + 1]};
+		chunks << r;
+	}
+
+	QtConcurrent::blockingMap(chunks, [&](DkMergeRange& r) {
+		std::sort(data + r.first, data + r.last, lessThan);
+	});
+
+	// merge neighboring chunks until all items are sorted
+	while (bounds.size() > 2) {
+
+		QVector<DkMergeRange> merges;
+		QVector<int> mergedBounds;
+
+		for (int idx = 0; idx < bounds.size() - 1; idx += 2) {
+
+			mergedBounds << bounds[idx];
+
+			if (idx + 2 < bounds.size()) {
+				DkMergeRange r = {bounds[idx], bounds[idx + 1], bounds[idx + 2]};
+				merges << r;
+			}
+		}
+		mergedBounds << items.size();
+
+		QtConcurrent::blockingMap(merges, [&](DkMergeRange& r) {
+			std::inplace_merge(data + r.first, data + r.mid, data + r.last, lessThan);
+		});
+
+		bounds = mergedBounds;
+	}
+}
+
+/**
+ * Sorts images according to the current sort settings.
+ * The sort keys are collected once per image (in parallel) - so sorting 
+ * just compares keys instead of file names & file dates.
+ * @param images the images to be sorted
+ **/ 
+void sortImageContainers(QVector<QSharedPointer<DkImageContainerT> >& images) {
+
+	int mode = DkSettingsManager::param().global().sortMode;
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	if (mode == DkSettings::sort_random) {
+		std::shuffle(images.begin(), images.end(), std::mt19937(std::random_device()()));
+		return;
+	}
+
+	bool sortByValue = mode == DkSettings::sort_date_created || mode == DkSettings::sort_date_modified || isMetaDataSortMode(mode);
+
+	QVector<DkSortItem> items(images.size());
+	for (int idx = 0; idx < items.size(); idx++)
+		items[idx].idx = idx;
+
+	QtConcurrent::blockingMap(items, [&](DkSortItem& item) {
+
+		const QSharedPointer<DkImageContainerT>& imgC = images.at(item.idx);
+
+		if (!imgC)
+			return;
+
+		item.key = imgC->sortKey();
+
+		if (mode == DkSettings::sort_date_created)
+			item.value = imgC->dateCreated();
+		else if (mode == DkSettings::sort_date_modified)
+			item.value = imgC->dateModified();
+		else if (isMetaDataSortMode(mode))
+			metaDataSortValues(imgC->fileInfo(), mode, item.group, item.value);
+	});
+
+	parallelSort(items, [&](const DkSortItem& l, const DkSortItem& r) {
+
+		const DkSortItem& a = ascending ? l : r;
+		const DkSortItem& b = ascending ? r : l;
+
+		int cmp = DkUtils::compareSortKeys(a.group, b.group);
+		if (cmp != 0)
+			return cmp < 0;
+
+		if (sortByValue && a.value != b.value)
+			return a.value < b.value;
+
+		return DkUtils::compareSortKeys(a.key, b.key) < 0;
+	});
+
+	QVector<QSharedPointer<DkImageContainerT> > sorted;
+	sorted.reserve(images.size());
+
+	for (const DkSortItem& item : items)
+		sorted << images.at(item.idx);
+
+	images = sorted;
 }
 
 // DkImageContainerT --------------------------------------------------------------------
@@ -615,6 +899,11 @@ void DkImageContainerT::checkForFileUpdates() {
 	if (mWaitForUpdate != update_loading && mFileInfo.lastModified() != modifiedBefore)
 		mWaitForUpdate = update_pending;
 
+	if (mFileInfo.lastModified() != modifiedBefore) {
+		mDateModified = -1;	// the cached sort key is outdated
+		mFileSize = -1;
+	}
+
 #ifdef WITH_QUAZIP
 	if(isFromZip()) 
 		setFilePath(getZipData()->getImageFileName());
@@ -687,11 +976,76 @@ bool DkImageContainerT::loadImageThreaded(bool force) {
 		setFilePath(getZipData()->getImageFileName());
 #endif
 	
+	// we do not need more pixels than the screen has - the full resolution is loaded on demand
+	getLoader()->setTargetSize(DkSettingsManager::param().resources().loadPreview ? previewSize() : QSize());
+
 	mLoadState = loading;
 	fetchFile();
 	return true;
 }
 
+/**
+ * Replaces a preview synchronously (e.g. if the image is saved or edited).
+ * fullResolutionLoadedSignal() is emitted so that views swap their preview too.
+ * @return bool true if the full resolution image was loaded.
+ **/ 
+bool DkImageContainerT::loadFullResolution() {
+
+	if (!DkImageContainer::loadFullResolution())
+		return false;
+
+	scaledImages.clear();
+	emit fullResolutionLoadedSignal();
+
+	return true;
+}
+
+/**
+ * Loads the full resolution image in the background if just a preview is loaded.
+ * fullResolutionLoadedSignal() is emitted as soon as the preview was replaced.
+ **/ 
+void DkImageContainerT::fetchFullResolution() {
+
+	// streamed images are rendered from their tiles
+	if (mFetchingFullResolution || !getLoader()->canLoadFullResolution())
+		return;
+
+	mFetchingFullResolution = true;
+	mPreviewKey = getLoader()->image().cacheKey();
+
+	// buffers are released (not cleared) - so the pointer keeps the data alive while we are loading
+	QSharedPointer<QByteArray> fileBuffer = getFileBuffer();
+
+	connect(&mFullResolutionWatcher, SIGNAL(finished()), this, SLOT(fullResolutionLoaded()), Qt::UniqueConnection);
+
+	mFullResolutionWatcher.setFuture(QtConcurrent::run(this, 
+		&nmc::DkImageContainerT::loadFullResolutionIntern, filePath(), fileBuffer));
+}
+
+void DkImageContainerT::fullResolutionLoaded() {
+
+	mFetchingFullResolution = false;
+
+	// the image was reloaded in the meantime
+	if (getLoader()->image().cacheKey() != mPreviewKey)
+		return;
+
+	if (getLoader()->setFullResolution(mFullResolutionWatcher.result())) {
+		scaledImages.clear();
+		emit fullResolutionLoadedSignal();
+	}
+}
+
+QSize DkImageContainerT::previewSize() const {
+
+	// take the largest screen - the window might be moved
+	QSize s;
+	for (const QScreen* screen : QGuiApplication::screens())
+		s = s.expandedTo(screen->size() * screen->devicePixelRatio());
+
+	return s;
+}
+
 void DkImageContainerT::fetchFile() {
 	
 	if (mFetchingBuffer && getLoadState() == loading_canceled) {
@@ -705,11 +1059,15 @@ void DkImageContainerT::fetchFile() {
 		return;
 
 	// ignore doubled calls
-	if (mFileBuffer && !mFileBuffer->isEmpty()) {
+	if (!getFileBuffer()->isEmpty()) {
 		bufferLoaded();
 		return;
 	}
 
+	// remember the state of the file we read - see isChanged()
+	dateModified();
+	fileSize();
+
 	mFetchingBuffer = true;	// saves the threaded call
 	connect(&mBufferWatcher, SIGNAL(finished()), this, SLOT(bufferLoaded()), Qt::UniqueConnection);
 
@@ -812,12 +1170,48 @@ void DkImageContainerT::loadingFinished() {
 	}
 
 	// clear file buffer if it exceeds a certain size?! e.g. psd files
-	if (mFileBuffer && mFileBuffer->size()/(1024.0f*1024.0f) > DkSettingsManager::param().resources().cacheMemory*0.5f)
-		mFileBuffer->clear();
+	if (mFileBuffer && !DkMappedFile::isMapped(mFileBuffer) && mFileBuffer->size()/(1024.0f*1024.0f) > DkSettingsManager::param().resources().cacheMemory*0.5f)
+		mFileBuffer.clear();
 	
 	mLoadState = loaded;
 	emit fileLoadedSignal(true);
 	qInfoClean() << filePath() << " loaded";
+
+	// streamed images show a placeholder until their pyramid is created
+	if (getLoader()->getLoader() == DkBasicLoader::tiled_loader && !getLoader()->tiledImage()) {
+
+		connect(&DkPyramidBuilder::instance(), SIGNAL(pyramidCreated(const QString&, bool)), this, SLOT(pyramidCreated(const QString&, bool)), Qt::UniqueConnection);
+
+		if (DkPyramidBuilder::instance().isBuilding(getLoader()->getFile()))
+			emit showInfoSignal(tr("Creating a preview of %1...").arg(fileName()));
+		else
+			pyramidCreated(getLoader()->getFile(), true);	// it finished in the meantime
+	}
+}
+
+/**
+ * Reloads the image when its pyramid was created.
+ * Until then, just a placeholder of the streamed image is shown.
+ **/ 
+void DkImageContainerT::pyramidCreated(const QString& filePath, bool created) {
+
+	if (!mLoader || filePath != mLoader->getFile())
+		return;
+
+	disconnect(&DkPyramidBuilder::instance(), SIGNAL(pyramidCreated(const QString&, bool)), this, SLOT(pyramidCreated(const QString&, bool)));
+
+	if (!created) {
+		emit showInfoSignal(tr("Sorry, I could not create a preview of %1").arg(fileName()));
+		return;
+	}
+
+	// do not keep the placeholder
+	if (mSelected)
+		loadImageThreaded(true);
+	else {
+		getThumb()->setImage(QImage());
+		clear();
+	}
 }
 
 void DkImageContainerT::downloadFile(const QUrl& url) {
@@ -864,13 +1258,14 @@ void DkImageContainerT::cancel() {
 
 void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = true */) {
 
-	// !selected - do not connect twice
-	if (connectSignals && !mSelected) {
+	// the container is shared by loaders (tabs) - each of them is connected once
+	if (connectSignals && !mReceivers.contains(obj)) {
 		connect(this, SIGNAL(errorDialogSignal(const QString&)), obj, SLOT(errorDialog(const QString&)), Qt::UniqueConnection);
 		connect(this, SIGNAL(fileLoadedSignal(bool)), obj, SLOT(imageLoaded(bool)), Qt::UniqueConnection);
 		connect(this, SIGNAL(showInfoSignal(const QString&, int, int)), obj, SIGNAL(showInfoSignal(const QString&, int, int)), Qt::UniqueConnection);
 		connect(this, SIGNAL(fileSavedSignal(const QString&, bool)), obj, SLOT(imageSaved(const QString&, bool)), Qt::UniqueConnection);
 		connect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()), Qt::UniqueConnection);
+		mReceivers.insert(obj);
 		mFileUpdateTimer.start();
 	}
 	else if (!connectSignals) {
@@ -879,10 +1274,14 @@ void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = tr
 		disconnect(this, SIGNAL(showInfoSignal(const QString&, int, int)), obj, SIGNAL(showInfoSignal(const QString&, int, int)));
 		disconnect(this, SIGNAL(fileSavedSignal(const QString&, bool)), obj, SLOT(imageSaved(const QString&, bool)));
 		disconnect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()));
-		mFileUpdateTimer.stop();
+		mReceivers.remove(obj);
+
+		if (mReceivers.isEmpty())
+			mFileUpdateTimer.stop();
 	}
 
-	mSelected = connectSignals;
+	// selected as long as any loader displays the image
+	mSelected = !mReceivers.isEmpty();
 
 }
 
@@ -899,7 +1298,7 @@ void DkImageContainerT::saveMetaDataThreaded() {
 
 bool DkImageContainerT::saveImageThreaded(const QString& filePath, int compression /* = -1 */) {
 
-	return saveImageThreaded(filePath, getLoader()->image(), compression);
+	return saveImageThreaded(filePath, image(), compression);
 }
 
 
@@ -914,6 +1313,11 @@ bool DkImageContainerT::saveImageThreaded(const QString& filePath, const QImage
 		emit errorDialogSignal(msg);
 		return false;
 	}
+	if (!hasFullResolution()) {
+		QString msg = tr("Sorry, %1 is too large to be loaded at full resolution.\nSaving it would replace it with a preview.").arg(fileName());
+		emit errorDialogSignal(msg);
+		return false;
+	}
 	if (!fInfo.absoluteDir().exists()) {
 		QString msg = tr("Sorry, the directory: %1  does not exist\n").arg(filePath);
 		emit errorDialogSignal(msg);
@@ -950,8 +1354,7 @@ void DkImageContainerT::savingFinished() {
 		//// reset thumb - loadImageThreaded should do it anyway
 		//thumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(saveFile, loader->image()));
 
-		if (mFileBuffer)
-			mFileBuffer->clear();	// do a complete clear?
+		mFileBuffer.clear();	// the file changed
 		setFilePath(savePath);
 		mEdited = false;
 		mDownloaded = false;
@@ -973,6 +1376,14 @@ QSharedPointer<DkBasicLoader> DkImageContainerT::loadImageIntern(const QString&
 	return DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
 }
 
+QImage DkImageContainerT::loadFullResolutionIntern(const QString& filePath, QSharedPointer<QByteArray> fileBuffer) {
+
+	if (!fileBuffer || fileBuffer->isEmpty())
+		fileBuffer = DkImageContainer::loadFileToBuffer(filePath);
+
+	return DkImageContainer::loadFullResolutionIntern(filePath, fileBuffer);
+}
+
 QString DkImageContainerT::saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression) {
 
 	return DkImageContainer::saveImageIntern(filePath, loader, saveImg, compression);
@@ -31,6 +31,7 @@
 #include <QFutureWatcher>
 #include <QTimer>
 #include <QSharedPointer>
+#include <QSet>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -55,6 +56,7 @@ class DkMetaDataT;
 class DkZipContainer;
 class FileDownloader;
 class DkRotatingRect;
+class DkImageContainerT;
 
 class DllCoreExport DkImageContainer {
 
@@ -76,10 +78,12 @@ public:
 	bool operator>= (const DkImageContainer& o) const;
 
 	QImage image();
+	QImage displayImage();
 	QImage imageScaledToHeight(int height);
 	QImage imageScaledToWidth(int width);
 
 	bool hasImage() const;
+	bool hasFullResolution();
 	int getLoadState() const;
 	QFileInfo fileInfo() const;
 	QString filePath() const;
@@ -97,18 +101,22 @@ public:
 	virtual QSharedPointer<DkMetaDataT> getMetaData();
 	virtual QSharedPointer<DkThumbNailT> getThumb();
 	virtual QSharedPointer<QByteArray> getFileBuffer();
+	void setFileBuffer(QSharedPointer<QByteArray> fileBuffer);
 #ifdef WITH_QUAZIP
 	QSharedPointer<DkZipContainer> getZipData();
 #endif
-#ifdef Q_OS_WIN
-	std::wstring getFileNameWStr() const;
-#endif
+	QByteArray sortKey() const;
+	qint64 dateCreated() const;
+	qint64 dateModified() const;
+	qint64 fileSize() const;
+	bool isChanged(const QFileInfo& fileInfo) const;
 
 	bool exists();
 	bool setPageIdx(int skipIdx);
 
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	bool loadImage();
+	virtual bool loadFullResolution();
 	void setImage(const QImage& img, const QString& editName);
 	void setImage(const QImage& img, const QString& editName, const QString& filePath);
 	bool saveImage(const QString& filePath, const QImage saveImg, int compression = -1);
@@ -123,6 +131,7 @@ public:
 
 protected:
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
+	QImage loadFullResolutionIntern(const QString& filePath, QSharedPointer<QByteArray> fileBuffer);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer = QSharedPointer<QByteArray>());
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void setFilePath(const QString& filePath);
@@ -142,9 +151,11 @@ protected:
 #ifdef WITH_QUAZIP	
 	QSharedPointer<DkZipContainer> mZipData;
 #endif
-#ifdef Q_OS_WIN
-	std::wstring mFileNameStr;	// speeds up sorting of filenames on windows
-#endif
+	// sorting keys - computed once
+	QByteArray mSortKey;
+	mutable qint64 mDateCreated = -1;
+	mutable qint64 mDateModified = -1;
+	mutable qint64 mFileSize = -1;
 
 private:
 	QString mFilePath;
@@ -153,6 +164,7 @@ private:
 
 bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r);
 bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const QSharedPointer<DkImageContainer> r);
+void sortImageContainers(QVector<QSharedPointer<DkImageContainerT> >& images);
 
 class DllCoreExport DkImageContainerT : public QObject, public DkImageContainer {
 	Q_OBJECT
@@ -168,6 +180,8 @@ public:
 	void downloadFile(const QUrl& url);
 
 	bool loadImageThreaded(bool force = false);
+	bool loadFullResolution() override;
+	void fetchFullResolution();
 	bool saveImageThreaded(const QString& filePath, const QImage saveImg, int compression = -1);
 	bool saveImageThreaded(const QString& filePath, int compression = -1);
 	void saveMetaDataThreaded();
@@ -188,6 +202,7 @@ signals:
 	void errorDialogSignal(const QString& msg) const;
 	void thumbLoadedSignal(bool loaded = true) const;
 	void imageUpdatedSignal() const;
+	void fullResolutionLoadedSignal() const;
 
 public slots:
 	void checkForFileUpdates(); 
@@ -197,6 +212,8 @@ protected slots:
 	void imageLoaded();
 	void savingFinished();
 	void loadingFinished();
+	void fullResolutionLoaded();
+	void pyramidCreated(const QString& filePath, bool created);
 	void fileDownloaded();
 
 protected:
@@ -204,11 +221,14 @@ protected:
 	
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
+	QImage loadFullResolutionIntern(const QString& filePath, QSharedPointer<QByteArray> fileBuffer);
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
+	QSize previewSize() const;
 	
 	QFutureWatcher<QSharedPointer<QByteArray> > mBufferWatcher;
 	QFutureWatcher<QSharedPointer<DkBasicLoader> > mImageWatcher;
+	QFutureWatcher<QImage> mFullResolutionWatcher;
 	QFutureWatcher<QString> mSaveImageWatcher;
 	QFutureWatcher<bool> mSaveMetaDataWatcher;
 
@@ -226,7 +246,10 @@ protected:
 
 	bool mFetchingImage = false;
 	bool mFetchingBuffer = false;
+	bool mFetchingFullResolution = false;
 	bool mDownloaded = false;
+	qint64 mPreviewKey = 0;
+	QSet<QObject*> mReceivers;	// containers are shared by loaders (tabs)
 
 	QTimer mFileUpdateTimer;
 };
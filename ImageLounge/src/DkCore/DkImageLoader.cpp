@@ -73,6 +73,12 @@
 #include <QPainter>
 #include <qmath.h>
 #include <QtConcurrentRun>
+#include <QSet>
+#include <QThreadPool>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <algorithm>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -95,8 +101,576 @@
 
 #pragma warning(pop)	// no warnings from includes - end
 
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 namespace nmc {
 
+// DkImageCache --------------------------------------------------------------------
+DkImageCache::DkImageCache() {
+
+	// release the images while the application is still alive
+	if (QCoreApplication::instance())
+		connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(clear()));
+}
+
+DkImageCache& DkImageCache::instance() {
+
+	static DkImageCache inst;
+	return inst;
+}
+
+/**
+ * Registers the image that is displayed.
+ * @param imgC the image container which is displayed.
+ **/ 
+void DkImageCache::use(QSharedPointer<DkImageContainerT> imgC) {
+
+	if (!imgC)
+		return;
+
+	if (imgC->hasImage())
+		mHits++;
+	else
+		mMisses++;
+
+	touch(imgC, 1.0f);
+}
+
+/**
+ * Updates the priority of an image.
+ * @param imgC the image container.
+ * @param weight the higher the weight, the longer the image is kept.
+ **/ 
+void DkImageCache::touch(QSharedPointer<DkImageContainerT> imgC, float weight) {
+
+	if (!imgC || !DkSettingsManager::param().resources().cacheMemory)
+		return;
+
+	Entry& e = mEntries[imgC->filePath()];
+
+	// another loader created its own container for this file
+	if (e.imgC && e.imgC != imgC && !e.imgC->isSelected() && !e.imgC->isEdited())
+		e.imgC->clear();
+
+	e.imgC = imgC;
+	e.priority = mInflation + weight;
+}
+
+/**
+ * Registers an image that will probably be displayed soon.
+ * The image is loaded if the memory budget allows for it.
+ * @param imgC the image container.
+ * @param weight the higher the weight, the longer the image is kept.
+ * @param decode if true, the image is decoded - otherwise just the file is buffered.
+ **/ 
+void DkImageCache::prefetch(QSharedPointer<DkImageContainerT> imgC, float weight, bool decode) {
+
+	touch(imgC, weight);
+
+	if (!imgC || imgC->getLoadState() != DkImageContainerT::not_loaded || 
+		memoryUsage() >= DkSettingsManager::param().resources().cacheMemory)
+		return;
+
+	if (decode)
+		imgC->loadImageThreaded();
+	else
+		imgC->fetchFile();
+}
+
+/**
+ * Returns a cached container that is currently not used by any loader.
+ * @param filePath the image's file path.
+ * @return QSharedPointer<DkImageContainerT> the container or NULL.
+ **/ 
+QSharedPointer<DkImageContainerT> DkImageCache::find(const QString& filePath) const {
+
+	auto it = mEntries.constFind(filePath);
+
+	if (it == mEntries.constEnd() || it->imgC->isSelected() || it->imgC->isEdited())
+		return QSharedPointer<DkImageContainerT>();
+
+	return it->imgC;
+}
+
+/**
+ * Evicts images until the cache fits into the memory budget.
+ * Images that are displayed, edited or currently loading are never evicted.
+ **/ 
+void DkImageCache::evict() {
+
+	float budget = DkSettingsManager::param().resources().cacheMemory;
+	float mem = memoryUsage();
+
+	while (mem > budget || mEntries.size() > mMaxEntries) {
+
+		auto victim = mEntries.end();
+
+		for (auto it = mEntries.begin(); it != mEntries.end(); it++) {
+
+			const QSharedPointer<DkImageContainerT>& imgC = it->imgC;
+
+			if (imgC->isSelected() || imgC->isEdited() || imgC->getLoadState() == DkImageContainerT::loading)
+				continue;
+
+			if (victim == mEntries.end() || it->priority < victim->priority)
+				victim = it;
+		}
+
+		// everything is in use
+		if (victim == mEntries.end())
+			break;
+
+		mInflation = victim->priority;
+		mem -= victim->imgC->getMemoryUsage();
+		victim->imgC->clear();
+		mEntries.erase(victim);
+	}
+}
+
+void DkImageCache::clear() {
+
+	mEntries.clear();
+}
+
+/**
+ * Returns the memory used by cached images.
+ * @return float the memory in MB.
+ **/ 
+float DkImageCache::memoryUsage() const {
+
+	float mem = 0;
+
+	for (const Entry& e : mEntries)
+		mem += e.imgC->getMemoryUsage();
+
+	return mem;
+}
+
+int DkImageCache::numHits() const {
+	return mHits;
+}
+
+int DkImageCache::numMisses() const {
+	return mMisses;
+}
+
+// DkFolderCache --------------------------------------------------------------------
+DkFolderCache::DkFolderCache() {
+
+	load();
+}
+
+DkFolderCache& DkFolderCache::instance() {
+
+	static DkFolderCache inst;
+	return inst;
+}
+
+/**
+ * Returns the cached sub folders of a folder.
+ * @param dirPath the folder
+ * @param modified the folder's current modification time
+ * @param folders the sub folders which are only set if they are cached
+ * @return bool false if the folder is not cached or if it was modified since.
+ **/ 
+bool DkFolderCache::subFolders(const QString& dirPath, qint64 modified, QStringList& folders) const {
+
+	QReadLocker locker(&mLock);
+	QHash<QString, Node>::const_iterator it = mNodes.constFind(dirPath);
+
+	if (it == mNodes.constEnd() || it->modified != modified)
+		return false;
+
+	folders = it->subFolders;
+	return true;
+}
+
+void DkFolderCache::insert(const QString& dirPath, qint64 modified, const QStringList& folders) {
+
+	Node n;
+	n.modified = modified;
+	n.subFolders = folders;
+
+	QWriteLocker locker(&mLock);
+	mNodes.insert(dirPath, n);
+}
+
+/**
+ * Removes folders of a tree that were not visited (i.e. deleted) by the last scan.
+ **/ 
+void DkFolderCache::prune(const QString& rootPath, const QSet<QString>& visited) {
+
+	QString prefix = rootPath.endsWith("/") ? rootPath : rootPath + "/";
+
+	QWriteLocker locker(&mLock);
+
+	for (QHash<QString, Node>::iterator it = mNodes.begin(); it != mNodes.end();) {
+
+		if ((it.key() == rootPath || it.key().startsWith(prefix)) && !visited.contains(it.key()))
+			it = mNodes.erase(it);
+		else
+			it++;
+	}
+}
+
+/**
+ * Returns all cached folders of a tree (without the root).
+ * The disk is not accessed - hence, the tree might be outdated.
+ **/ 
+QStringList DkFolderCache::tree(const QString& rootPath) const {
+
+	QStringList folders;
+	QStringList level = QStringList() << rootPath;
+
+	QReadLocker locker(&mLock);
+
+	while (!level.isEmpty()) {
+
+		QStringList nextLevel;
+
+		for (const QString& dirPath : level) {
+			QHash<QString, Node>::const_iterator it = mNodes.constFind(dirPath);
+			if (it != mNodes.constEnd())
+				nextLevel << it->subFolders;
+		}
+
+		folders << nextLevel;
+		level = nextLevel;
+	}
+
+	return folders;
+}
+
+QString DkFolderCache::cacheFilePath() {
+
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/folders.cache";
+}
+
+void DkFolderCache::load() {
+
+	QFile file(cacheFilePath());
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream ds(&file);
+	quint32 magic = 0, version = 0;
+	int numNodes = 0;
+	ds >> magic >> version >> numNodes;
+
+	if (magic != 0x4e4d4654 || version != 1)	// NMFT
+		return;
+
+	QWriteLocker locker(&mLock);
+
+	for (int idx = 0; idx < numNodes && ds.status() == QDataStream::Ok; idx++) {
+
+		QString dirPath;
+		Node n;
+		ds >> dirPath >> n.modified >> n.subFolders;
+
+		if (ds.status() == QDataStream::Ok)
+			mNodes.insert(dirPath, n);
+	}
+}
+
+void DkFolderCache::save() const {
+
+	if (DkSettingsManager::param().app().privateMode)
+		return;
+
+	QMutexLocker saveLocker(&mSaveMutex);
+
+	QString cachePath = cacheFilePath();
+	QDir().mkpath(QFileInfo(cachePath).absolutePath());
+
+	QSaveFile file(cachePath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkFolderCache] cannot write" << cachePath;
+		return;
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)0x4e4d4654 << (quint32)1;
+
+	{
+		QReadLocker locker(&mLock);
+		ds << mNodes.size();
+
+		for (QHash<QString, Node>::const_iterator it = mNodes.constBegin(); it != mNodes.constEnd(); it++)
+			ds << it.key() << it->modified << it->subFolders;
+	}
+
+	file.commit();
+}
+
+// DkFolderScanner --------------------------------------------------------------------
+DkFolderScanner::DkFolderScanner(QObject* parent) : QObject(parent) {
+
+	connect(&mWatcher, SIGNAL(finished()), this, SLOT(scanFinished()));
+}
+
+DkFolderScanner::~DkFolderScanner() {
+
+	// the scan emits signals of this object
+	cancel();
+	mWatcher.blockSignals(true);
+	mWatcher.waitForFinished();
+}
+
+/**
+ * Scans a folder tree in a thread.
+ * A running scan is canceled. Found folders are emitted with foldersFound().
+ * The sorted tree is emitted with finished().
+ * @param rootPath the tree's root folder
+ **/ 
+void DkFolderScanner::scan(const QString& rootPath) {
+
+	cancel();
+
+	mRootPath = rootPath;
+	mCancel = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+	QSharedPointer<QAtomicInt> cancel = mCancel;
+	int scanIdx = 0;
+
+	{
+		QMutexLocker locker(&mLevelMutex);
+		mLevels.clear();
+		mLevelsDone = false;
+		scanIdx = ++mScanIdx;
+	}
+
+	QFuture<QStringList> future = QtConcurrent::run([this, rootPath, cancel, scanIdx]() {
+		QStringList folders = scanFolders(rootPath, [this, rootPath, cancel, scanIdx](const QStringList& folders) {
+			if (!cancel->load()) {
+				addLevel(scanIdx, folders);
+				emit foldersFound(rootPath, folders);
+			}
+		}, cancel.data());
+
+		addLevel(scanIdx, QStringList(), true);
+		return folders;
+	});
+
+	mWatcher.setFuture(future);
+}
+
+void DkFolderScanner::cancel() {
+
+	if (mCancel)
+		mCancel->store(1);
+}
+
+bool DkFolderScanner::isScanning() const {
+
+	return mWatcher.isRunning();
+}
+
+/**
+ * Blocks until the scan found the next level of the tree.
+ * This allows for processing a tree while it is scanned.
+ * @param timeout the maximal time (ms) to wait for the level, -1 waits until the scan is done
+ * @return QStringList the sorted folders of the next level (empty if the scan is finished, canceled or timed out).
+ **/ 
+QStringList DkFolderScanner::waitForLevel(int timeout) {
+
+	DkTimer dt;
+	QMutexLocker locker(&mLevelMutex);
+
+	while (mLevels.isEmpty() && !mLevelsDone && !(mCancel && mCancel->load())) {
+
+		if (timeout >= 0 && dt.elapsed() >= timeout)
+			break;
+
+		mLevelAdded.wait(&mLevelMutex, 100);	// re-check the cancel flag
+	}
+
+	if (mLevels.isEmpty() || (mCancel && mCancel->load()))
+		return QStringList();
+
+	QStringList folders = mLevels.takeFirst();
+	qSort(folders.begin(), folders.end(), DkUtils::compLogicQString);
+
+	return folders;
+}
+
+void DkFolderScanner::addLevel(int scanIdx, const QStringList& folders, bool done) {
+
+	QMutexLocker locker(&mLevelMutex);
+
+	// a canceled scan must not change the levels of the current scan
+	if (scanIdx != mScanIdx)
+		return;
+
+	if (!folders.isEmpty())
+		mLevels << folders;
+	mLevelsDone = done;
+	mLevelAdded.wakeAll();
+}
+
+void DkFolderScanner::scanFinished() {
+
+	if (!mCancel || mCancel->load())
+		return;
+
+	emit finished(mRootPath, mWatcher.result());
+}
+
+/**
+ * Returns all sub folders of a folder (recursively).
+ * Each level of the tree is listed in parallel. Folders that did not change
+ * since the last scan are not listed again (see DkFolderCache).
+ * Symbolic links and hidden folders are ignored.
+ * This function blocks - run it in a thread.
+ * @param rootPath the root folder
+ * @param found is called with the folders of each level
+ * @param cancel the scan is aborted if this is set
+ * @return QStringList the sorted sub folders (without the root).
+ **/ 
+QStringList DkFolderScanner::scanFolders(const QString& rootPath, std::function<void (const QStringList&)> found, const QAtomicInt* cancel) {
+
+	DkTimer dt;
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(maxConcurrentDirs);
+
+	QStringList folders;
+	QSet<QString> visited;
+	QStringList level = QStringList() << rootPath;
+
+	while (!level.isEmpty()) {
+
+		QVector<QFuture<QStringList> > listings;
+		for (const QString& dirPath : level)
+			listings << QtConcurrent::run(&pool, &DkFolderScanner::listFolders, dirPath, cancel);
+
+		QStringList nextLevel;
+		for (QFuture<QStringList>& l : listings)
+			nextLevel << l.result();
+
+		if (cancel && cancel->load())
+			return QStringList();
+
+		for (const QString& dirPath : level)
+			visited.insert(dirPath);
+
+		if (found && !nextLevel.isEmpty())
+			found(nextLevel);
+
+		folders << nextLevel;
+		level = nextLevel;
+	}
+
+	DkFolderCache::instance().prune(rootPath, visited);
+	DkFolderCache::instance().save();
+
+	qSort(folders.begin(), folders.end(), DkUtils::compLogicQString);
+
+	qInfo() << "[DkFolderScanner]" << folders.size() << "folders scanned in" << dt;
+
+	return folders;
+}
+
+QStringList DkFolderScanner::listFolders(const QString& dirPath, const QAtomicInt* cancel) {
+
+	// skip the remaining listings if the scan is canceled - each might take seconds on network drives
+	if (cancel && cancel->load())
+		return QStringList();
+
+	qint64 modified = QFileInfo(dirPath).lastModified().toMSecsSinceEpoch();
+	QStringList folders;
+
+	if (DkFolderCache::instance().subFolders(dirPath, modified, folders))
+		return folders;
+
+	folders = readFolders(dirPath);
+	DkFolderCache::instance().insert(dirPath, modified, folders);
+
+	return folders;
+}
+
+/**
+ * Lists the sub folders of a folder.
+ * The raw directory listing provides the entry types, so
+ * (unlike QDir) files do not need to be stat'ed.
+ **/ 
+QStringList DkFolderScanner::readFolders(const QString& dirPath) {
+
+	QStringList folders;
+	QString prefix = dirPath.endsWith("/") ? dirPath : dirPath + "/";
+
+#ifdef Q_OS_WIN
+
+	QString winPath = QDir::toNativeSeparators(prefix) + "*";
+
+	WIN32_FIND_DATAW findData;
+	HANDLE handle = FindFirstFileExW(reinterpret_cast<const wchar_t *>(winPath.utf16()), FindExInfoBasic, &findData, 
+		FindExSearchLimitToDirectories, NULL, FIND_FIRST_EX_LARGE_FETCH);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		return folders;
+
+	do {
+		DWORD attributes = findData.dwFileAttributes;
+		QString name = QString::fromWCharArray(findData.cFileName);
+
+		// ignore links (like QDir::NoSymLinks) and hidden folders
+		if ((attributes & FILE_ATTRIBUTE_DIRECTORY) && 
+			!(attributes & (FILE_ATTRIBUTE_REPARSE_POINT | FILE_ATTRIBUTE_HIDDEN)) &&
+			name != "." && name != "..")
+			folders << prefix + name;
+
+	} while (FindNextFileW(handle, &findData) != 0);
+
+	FindClose(handle);
+
+#elif defined(Q_OS_UNIX)
+
+	QByteArray path = QFile::encodeName(dirPath);
+	DIR* dir = opendir(path.constData());
+
+	if (!dir)
+		return folders;
+
+	while (struct dirent* entry = readdir(dir)) {
+
+		// ignore ., .. and hidden folders
+		if (entry->d_name[0] == '.')
+			continue;
+
+		bool isDir = false;
+
+#ifdef DT_DIR
+		if (entry->d_type == DT_DIR)
+			isDir = true;
+		else if (entry->d_type == DT_UNKNOWN)	// some file systems do not provide the type
+#endif
+		{
+			struct stat st;
+			QByteArray entryPath = path + "/" + entry->d_name;
+			isDir = lstat(entryPath.constData(), &st) == 0 && S_ISDIR(st.st_mode);	// lstat: links are ignored
+		}
+
+		if (isDir)
+			folders << prefix + QFile::decodeName(entry->d_name);
+	}
+
+	closedir(dir);
+
+#else
+
+	QFileInfoList entries = QDir(dirPath).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+	for (const QFileInfo& fi : entries)
+		folders << fi.absoluteFilePath();
+
+#endif
+
+	return folders;
+}
+
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
  * Default constructor.
@@ -114,6 +688,9 @@ DkImageLoader::DkImageLoader(const QString& filePath) {
 	mSortingImages = false;
 
 	connect(&mCreateImageWatcher, SIGNAL(finished()), this, SLOT(imagesSorted()));
+	connect(&mMetaDataWatcher, SIGNAL(finished()), this, SLOT(metaDataIndexed()));
+	connect(&mFolderScanner, SIGNAL(foldersFound(const QString&, const QStringList&)), this, SLOT(subFoldersFound(const QString&, const QStringList&)));
+	connect(&mFolderScanner, SIGNAL(finished(const QString&, const QStringList&)), this, SLOT(subFoldersScanned(const QString&, const QStringList&)));
 
 	mDelayedUpdateTimer.setSingleShot(true);
 	connect(&mDelayedUpdateTimer, SIGNAL(timeout()), this, SLOT(directoryChanged()));
@@ -138,6 +715,11 @@ DkImageLoader::~DkImageLoader() {
 	
 	if (mCreateImageWatcher.isRunning())
 		mCreateImageWatcher.blockSignals(true);
+
+	if (mMetaDataWatcher.isRunning()) {
+		mMetaDataCancel->store(1);
+		mMetaDataWatcher.blockSignals(true);
+	}
 }
 
 /**
@@ -165,7 +747,9 @@ void DkImageLoader::clearPath() {
  **/ 
 bool DkImageLoader::loadZipArchive(const QString& zipPath) {
 
-	QStringList fileNameList = JlCompress::getFileList(zipPath);
+	// indexing the archive here speeds up extracting its images
+	QSharedPointer<DkZipArchive> archive = DkZipArchive::open(zipPath);
+	QStringList fileNameList = archive ? archive->fileNames() : JlCompress::getFileList(zipPath);
 	
 	// remove the * in fileFilters
 	QStringList fileFiltersClean = DkSettingsManager::param().app().browseFilters;
@@ -241,8 +825,11 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		//	sortImagesThreaded(images);
 		//}
 		//else
+		if (!updateImages(files))
 			createImages(files, true);
 
+		indexMetaData();
+
 		qDebug() << "getting file list.....";
 	}
 	// new folder is loaded
@@ -253,6 +840,10 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		//newDir.setNameFilters(DkSettingsManager::param().app().fileFilters);
 		//newDir.setSorting(QDir::LocaleAware);		// TODO: extend
 
+		// the old folder's meta data are not needed anymore
+		if (mMetaDataCancel)
+			mMetaDataCancel->store(1);
+
 		// update save directory
 		mCurrentDir = newDirPath;
 		mFolderUpdated = false;
@@ -284,6 +875,8 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		//else
 			createImages(files, true);
 
+		indexMetaData();
+
 		qInfoClean() << newDirPath << " [" << mImages.size() << "] loaded in " << dt;
 	}
 	//else
@@ -307,6 +900,72 @@ void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT
 	qDebug() << "sorting images threaded...";
 }
 
+/**
+ * Indexes the meta data of the folder in the background.
+ * Nothing is done unless a meta data sort mode or a meta data filter (e.g. rating>=3) is active.
+ **/ 
+void DkImageLoader::indexMetaData() {
+
+	int mode = DkSettingsManager::param().global().sortMode;
+	bool sortByMetaData = mode == DkSettings::sort_date_taken || mode == DkSettings::sort_rating || mode == DkSettings::sort_camera;
+
+	if (mImages.empty() || (!sortByMetaData && !hasMetaDataQuery()))
+		return;
+
+	if (mMetaDataWatcher.isRunning()) {
+		mMetaDataIsDirty = true;
+		return;
+	}
+
+	QFileInfoList files;
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages)
+		files << imgC->fileInfo();
+
+	mMetaDataIsDirty = false;
+
+	QSharedPointer<QAtomicInt> cancel(new QAtomicInt(0));
+	mMetaDataCancel = cancel;
+
+	mMetaDataWatcher.setFuture(QtConcurrent::run([files, cancel]() {
+		return DkMetaDataIndex::instance().update(files, cancel.data());
+	}));
+}
+
+void DkImageLoader::metaDataIndexed() {
+
+	bool changed = mMetaDataWatcher.result();
+	bool canceled = mMetaDataCancel && mMetaDataCancel->load();
+
+	if (mMetaDataIsDirty)
+		indexMetaData();
+
+	// a canceled index belongs to the previous folder
+	if (!changed || canceled)
+		return;
+
+	// files that were not indexed were kept by the filter
+	if (hasMetaDataQuery()) {
+		mFolderUpdated = true;
+		loadDir(mCurrentDir);
+	}
+
+	int mode = DkSettingsManager::param().global().sortMode;
+	if (mode == DkSettings::sort_date_taken || mode == DkSettings::sort_rating || mode == DkSettings::sort_camera) {
+		sortImageContainers(mImages);
+		emit updateDirSignal(mImages);
+	}
+}
+
+bool DkImageLoader::hasMetaDataQuery() const {
+
+	for (const QString& token : mFolderFilterString.split(" ", QString::SkipEmptyParts)) {
+		if (DkMetaDataIndex::isQuery(token))
+			return true;
+	}
+
+	return false;
+}
+
 void DkImageLoader::imagesSorted() {
 
 	mSortingImages = false;
@@ -333,22 +992,36 @@ void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
 
 	// TODO: change files to QStringList
 	DkTimer dt;
-	QVector<QSharedPointer<DkImageContainerT > > oldImages = mImages;
+	QHash<QString, QSharedPointer<DkImageContainerT> > oldImages;
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages)
+		oldImages.insert(imgC->filePath(), imgC);
 	mImages.clear();
 
 	for (int idx = 0; idx < files.size(); idx++) {
 
-		int oIdx = findFileIdx(files.at(idx).absoluteFilePath(), oldImages);
+		// keep existing containers - they might be edited or currently displayed
+		QSharedPointer<DkImageContainerT> oldImg = oldImages.value(files.at(idx).absoluteFilePath());
 
-		if (oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == files.at(idx).lastModified())
-			mImages.append(oldImages.at(oIdx));
-		else
-			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(files.at(idx).absoluteFilePath())));
+		// the file was overwritten - the displayed image is reloaded by its container
+		if (oldImg && oldImg != mCurrentImage && !oldImg->isEdited() && oldImg->isChanged(files.at(idx)))
+			oldImg.clear();
+
+		if (oldImg)
+			mImages.append(oldImg);
+		else {
+			// another tab might have loaded the image already
+			QSharedPointer<DkImageContainerT> imgC = DkImageCache::instance().find(files.at(idx).absoluteFilePath());
+
+			if (!imgC || imgC->isChanged(files.at(idx)))
+				imgC = QSharedPointer<DkImageContainerT>(new DkImageContainerT(files.at(idx).absoluteFilePath()));
+
+			mImages.append(imgC);
+		}
 	}
 	qDebugClean() << "[DkImageLoader] " << mImages.size() << " containers created in " << dt;
 
 	if (sort) {
-		qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+		sortImageContainers(mImages);
 		qDebug() << "[DkImageLoader] after sorting: " << dt;
 
 		emit updateDirSignal(mImages);
@@ -362,9 +1035,94 @@ void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
 
 }
 
+/**
+ * Updates the folder's containers incrementally.
+ * Containers of deleted files are removed, containers of overwritten files
+ * are replaced and new files are inserted at their sorted position. 
+ * Views are notified for every single change so that they do not need 
+ * to rebuild all thumbnails.
+ * @param files the current (filtered) files of the folder.
+ * @return bool false if the folder should rather be re-indexed.
+ **/ 
+bool DkImageLoader::updateImages(const QFileInfoList& files) {
+
+	if (mImages.empty() || DkSettingsManager::param().global().sortMode == DkSettings::sort_random)
+		return false;
+
+	DkTimer dt;
+
+	QHash<QString, QFileInfo> newFiles;
+	for (const QFileInfo& fi : files)
+		newFiles.insert(fi.absoluteFilePath(), fi);
+
+	QSet<QString> oldPaths;
+	QVector<int> removed;
+	QFileInfoList added;
+	for (int idx = 0; idx < mImages.size(); idx++) {
+
+		const QSharedPointer<DkImageContainerT>& imgC = mImages.at(idx);
+		oldPaths.insert(imgC->filePath());
+
+		auto fi = newFiles.constFind(imgC->filePath());
+
+		if (fi == newFiles.constEnd())
+			removed << idx;
+		// the file was overwritten - it is removed and inserted again
+		else if (imgC != mCurrentImage && !imgC->isEdited() && imgC->isChanged(*fi)) {
+			removed << idx;
+			added << *fi;
+		}
+	}
+
+	for (const QFileInfo& fi : files) {
+		if (!oldPaths.contains(fi.absoluteFilePath()))
+			added << fi;
+	}
+
+	// re-indexing is faster if (nearly) everything changed
+	if (removed.size() + added.size() > qMax(100, mImages.size()/4))
+		return false;
+
+	// remove back to front so that the indexes stay valid
+	for (int idx = removed.size()-1; idx >= 0; idx--) {
+		mImages.remove(removed.at(idx));
+		emit imageRemovedSignal(removed.at(idx));
+	}
+
+	for (const QFileInfo& fi : added) {
+
+		// another tab might have loaded the image already
+		QSharedPointer<DkImageContainerT> imgC = DkImageCache::instance().find(fi.absoluteFilePath());
+
+		if (!imgC || imgC->isChanged(fi))
+			imgC = QSharedPointer<DkImageContainerT>(new DkImageContainerT(fi.absoluteFilePath()));
+
+		auto pos = std::upper_bound(mImages.begin(), mImages.end(), imgC, 
+			[](const QSharedPointer<DkImageContainerT>& l, const QSharedPointer<DkImageContainerT>& r) {
+			return imageContainerLessThan(*l, *r);
+		});
+
+		int idx = (int)(pos - mImages.begin());
+		mImages.insert(idx, imgC);
+		emit imageInsertedSignal(idx, imgC);
+	}
+
+	// the current image might have moved
+	if (mCurrentImage) {
+		int cIdx = findFileIdx(mCurrentImage->filePath(), mImages);
+		
+		if (cIdx != -1)
+			emit imageUpdatedSignal(cIdx);
+	}
+
+	qDebug() << "[DkImageLoader]" << removed.size() << "removed and" << added.size() << "added in" << dt;
+
+	return true;
+}
+
 QVector<QSharedPointer<DkImageContainerT > > DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const {
 
-	qSort(images.begin(), images.end(), imageContainerLessThanPtr);
+	sortImageContainers(images);
 
 	return images;
 }
@@ -643,6 +1401,9 @@ QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString&
 
 	QSharedPointer<DkImageContainerT> imgC = findFile(filePath);
 
+	if (!imgC)
+		imgC = DkImageCache::instance().find(filePath);
+
 	if (!imgC)
 		imgC = QSharedPointer<DkImageContainerT>(new DkImageContainerT(filePath));
 
@@ -907,6 +1668,8 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
 	if (mCurrentImage && mCurrentImage->getLoadState() == DkImageContainerT::loading)
 		return;
 
+	DkImageCache::instance().use(mCurrentImage);
+
 	emit updateSpinnerSignalDelayed(true);
 	bool loaded = mCurrentImage->loadImageThreaded();	// loads file threaded
 	
@@ -1244,6 +2007,11 @@ void DkImageLoader::saveFile(const QString& filePath, const QImage& saveImg, con
 	if (saveImg.isNull() && (!mCurrentImage || !mCurrentImage->hasImage()))
 		emit showInfoSignal(tr("Sorry, I cannot save an empty image..."));
 
+	if (!imgC->hasFullResolution()) {
+		errorDialog(tr("Sorry, %1 is too large to be loaded at full resolution.\nSaving it would replace it with a preview.").arg(imgC->fileName()));
+		return;
+	}
+
 	// if the user did not specify the suffix - append the suffix of the file filter
 	QString newSuffix = QFileInfo(filePath).suffix();
 	QString lFilePath = filePath;
@@ -1581,55 +2349,120 @@ QString DkImageLoader::getDirPath() const {
 
 QStringList DkImageLoader::getFoldersRecursive(const QString& dirPath) {
 
-	//DkTimer dt;
 	QStringList subFolders;
-	//qDebug() << "scanning recursively: " << dir.absolutePath();
-
-	if (DkSettingsManager::param().global().scanSubFolders) {
 
-		QDirIterator dirs(dirPath, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
-	
-		int nFolders = 0;
-		while (dirs.hasNext()) {
-			dirs.next();
-			subFolders << dirs.filePath();
-			nFolders++;
-
-			if (nFolders > 100)
-				break;
-			
-			//getFoldersRecursive(dirs.filePath(), subFolders);
-			//qDebug() << "loop: " << dirs.filePath();
-		}
-	}	
+	if (DkSettingsManager::param().global().scanSubFolders)
+		subFolders = DkFolderScanner::scanFolders(dirPath);
 
 	subFolders << dirPath;
 
 	qSort(subFolders.begin(), subFolders.end(), DkUtils::compLogicQString);
 
-	qDebug() << dirPath << "loaded recursively...";
-	
-	//qDebug() << "scanning folders recursively took me: " << QString::fromStdString(dt.getTotal());
 	return subFolders;
 }
 
+/**
+ * Updates the sub folders of the root folder.
+ * Cached sub folders are available right away while the tree is scanned in the background.
+ * @param rootDirPath the root folder
+ * @return QFileInfoList the files of the first folder that contains images.
+ **/ 
 QFileInfoList DkImageLoader::updateSubFolders(const QString& rootDirPath) {
 	
-	mSubFolders = getFoldersRecursive(rootDirPath);
+	mSubFolderRoot = rootDirPath;
+	mSubFolders = QStringList() << rootDirPath;
+
+	if (DkSettingsManager::param().global().scanSubFolders) {
+		mSubFolders << DkFolderCache::instance().tree(rootDirPath);
+		qSort(mSubFolders.begin(), mSubFolders.end(), DkUtils::compLogicQString);
+		mFolderScanner.scan(rootDirPath);
+	}
+	else
+		mFolderScanner.cancel();
+
 	QFileInfoList files;
-	qDebug() << mSubFolders;
+	QSet<QString> checked;
 
 	// find the first subfolder that has images
 	for (int idx = 0; idx < mSubFolders.size(); idx++) {
 		mCurrentDir = mSubFolders[idx];
+		checked.insert(mCurrentDir);
 		files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
 		if (!files.empty())
 			break;
 	}
 
+	// no cached folder has images - so we check the levels as they are scanned
+	// and stop at the first folder that has images (the scan continues in the background)
+	// this blocks the GUI, so we give up after DkFolderScanner::maxBlockingTime
+	DkTimer dt;
+
+	while (files.empty() && DkSettingsManager::param().global().scanSubFolders) {
+
+		int timeLeft = DkFolderScanner::maxBlockingTime - dt.elapsed();
+
+		if (timeLeft <= 0) {
+			qInfo() << "[DkImageLoader] no images found in" << checked.size() << "folders - I stop waiting for the folder scan";
+			break;
+		}
+
+		QStringList level = mFolderScanner.waitForLevel(timeLeft);
+
+		if (level.isEmpty())
+			break;
+
+		subFoldersFound(rootDirPath, level);
+
+		for (const QString& dirPath : level) {
+
+			if (checked.contains(dirPath))
+				continue;
+
+			if (dt.elapsed() > DkFolderScanner::maxBlockingTime)
+				break;
+
+			mCurrentDir = dirPath;
+			checked.insert(dirPath);
+			files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords);
+			if (!files.empty())
+				break;
+		}
+	}
+
 	return files;
 }
 
+void DkImageLoader::subFoldersFound(const QString& rootPath, const QStringList& folders) {
+
+	if (rootPath != mSubFolderRoot)
+		return;
+
+	QSet<QString> known = mSubFolders.toSet();
+	bool added = false;
+
+	for (const QString& f : folders) {
+		if (!known.contains(f)) {
+			mSubFolders << f;
+			added = true;
+		}
+	}
+
+	if (added)
+		qSort(mSubFolders.begin(), mSubFolders.end(), DkUtils::compLogicQString);
+}
+
+void DkImageLoader::subFoldersScanned(const QString& rootPath, const QStringList& folders) {
+
+	// the scan was canceled
+	if (rootPath != mSubFolderRoot || !DkSettingsManager::param().global().scanSubFolders)
+		return;
+
+	// deleted folders are removed too
+	mSubFolders = folders;
+	mSubFolders << rootPath;
+	qSort(mSubFolders.begin(), mSubFolders.end(), DkUtils::compLogicQString);
+}
+
 int DkImageLoader::getNextFolderIdx(int folderIdx) {
 	
 	int nextIdx = -1;
@@ -1704,55 +2537,61 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC) {
 
 	DkTimer dt;
 
-	//// no caching? delete all
-	//if (!DkSettingsManager::param().resources().cacheMemory) {
-	//	for (int idx = 0; idx < images.size(); idx++) {
-	//		images.at(idx)->clear();
-	//	}
-	//	return;
-	//}
-
 	int cIdx = findFileIdx(imgC->filePath(), mImages);
-	float mem = 0;
 
 	if (cIdx == -1) {
 		qDebug() << "WARNING: image not found for caching!";
 		return;
 	}
 
+	bool loop = DkSettingsManager::param().global().loop;
+	int numImages = mImages.size();
+
+	// prefetch in the direction the user is browsing
+	int lIdx = findFileIdx(mLastCachedPath, mImages);
+	int dir = (lIdx != -1 && lIdx > cIdx) ? -1 : 1;
+
+	// we stepped from the last to the first image (or vice versa)
+	if (loop && lIdx != -1 && qAbs(lIdx - cIdx) > numImages/2)
+		dir = -dir;
+
+	mLastCachedPath = imgC->filePath();
+
+	// indexes continue at the other end of the folder if we loop
+	auto folderIdx = [loop, numImages](int idx) {
+		return (loop && numImages > 0) ? ((idx % numImages) + numImages) % numImages : idx;
+	};
+
+	// clear images if they are edited
 	for (int idx = 0; idx < mImages.size(); idx++) {
 
-		// clear images if they are edited
-		if (idx != cIdx && mImages.at(idx)->isEdited()) {
+		if (idx != cIdx && mImages.at(idx)->isEdited())
 			mImages.at(idx)->clear();
-			continue;
-		}
+	}
 
-		if (idx >= cIdx-1 && idx <= cIdx+DkSettingsManager::param().resources().maxImagesCached)
-			mem += mImages.at(idx)->getMemoryUsage();
-		else {
-			mImages.at(idx)->clear();
-			continue;
-		}
+	DkImageCache& cache = DkImageCache::instance();
 
-		// ignore the last and current one
-		if (idx == cIdx-1 || idx == cIdx) {
-			continue;
-		}
-		// fully load the next image
-		else if (idx == cIdx+1 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			mImages.at(idx)->loadImageThreaded();
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " fully cached...";
-		}
-		else if (idx > cIdx && idx < cIdx+DkSettingsManager::param().resources().maxImagesCached-2 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			//dt.getIvl();
-			mImages.at(idx)->fetchFile();		// TODO: crash detected here
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " file fetched...";
-		}
+	// keep the last image
+	int lastIdx = folderIdx(cIdx-dir);
+	if (lastIdx >= 0 && lastIdx < numImages && lastIdx != cIdx)
+		cache.touch(mImages.at(lastIdx), 0.5f);
+
+	// fully load the next image & fetch the files of the following ones
+	int numPrefetch = qMax(DkSettingsManager::param().resources().maxImagesCached-2, 1);
+
+	for (int i = 1; i <= numPrefetch; i++) {
+
+		int idx = folderIdx(cIdx + i*dir);
+
+		if (idx < 0 || idx >= numImages || idx == cIdx)
+			break;
+
+		cache.prefetch(mImages.at(idx), 1.0f/i, i == 1);
 	}
 
-	qDebug() << "cache with: " << mem << " MB created in: " << dt;
+	cache.evict();
 
+	qDebug() << "cache with: " << cache.memoryUsage() << " MB [hits:" << cache.numHits() << "misses:" << cache.numMisses() << "] updated in: " << dt;
 }
 
 /**
@@ -1839,6 +2678,19 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 		fileList = fileList.filter(keywords[idx], Qt::CaseInsensitive);
 	}
 
+	// meta data queries (e.g. rating>=3) are evaluated against the meta data index
+	QStringList metaDataQueries;
+	QStringList textKeywords;
+	for (const QString& token : folderKeywords.split(" ")) {
+		if (DkMetaDataIndex::isQuery(token))
+			metaDataQueries << token;
+		else
+			textKeywords << token;
+	}
+
+	if (!metaDataQueries.isEmpty())
+		folderKeywords = textKeywords.join(" ").trimmed();
+
 	if (folderKeywords != "") {
 		QStringList filterList = fileList;
 		fileList = DkUtils::filterStringList(folderKeywords, filterList);
@@ -1887,13 +2739,16 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 	for (int idx = 0; idx < fileList.size(); idx++)
 		fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
 
-	return fileInfoList;
+	return DkMetaDataIndex::instance().filter(fileInfoList, metaDataQueries);
 }
 
 void DkImageLoader::sort() {
 	
-	qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+	sortImageContainers(mImages);
 	emit updateDirSignal(mImages);
+
+	// the index is needed if the user switched to a meta data sort mode
+	indexMetaData();
 }
 
 void DkImageLoader::currentImageUpdated() const {
@@ -2052,6 +2907,12 @@ QSharedPointer<DkImageContainerT> DkImageLoader::setImage(const QImage& img, con
 	qDebug() << "edited file: " << editFilePath;
 
 	QSharedPointer<DkImageContainerT> newImg = findOrCreateFile(editFilePath);
+
+	if (!newImg->hasFullResolution()) {
+		errorDialog(tr("Sorry, %1 is too large to be loaded at full resolution.\nIt cannot be edited.").arg(newImg->fileName()));
+		return newImg;
+	}
+
 	newImg->setImage(img, editName, editFilePath);
 	
 	setCurrentImage(newImg);
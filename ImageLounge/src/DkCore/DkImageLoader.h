@@ -30,8 +30,17 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTimer>
 #include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <QFutureWatcher>
 #pragma warning(pop)	// no warnings from includes - end
 
+#include <functional>
+
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
 #define DllCoreExport Q_DECL_EXPORT
@@ -55,6 +64,137 @@ class QUrl;
 
 namespace nmc {
 
+/**
+ * Global cache of decoded images which is shared by all loaders (tabs).
+ * Images are kept as long as they fit into the memory budget (resources().cacheMemory).
+ * If the budget is exceeded, images are evicted by their weight and age (GreedyDual):
+ * each access assigns the priority inflation + weight and evicting an image 
+ * raises the inflation to its priority. Hence, rarely used images age out while
+ * heavily weighted images (e.g. the next image) survive longer.
+ **/ 
+class DllCoreExport DkImageCache : public QObject {
+	Q_OBJECT
+
+public:
+	static DkImageCache& instance();
+
+	// singleton
+	DkImageCache(DkImageCache const&) = delete;
+	void operator=(DkImageCache const&) = delete;
+
+	void use(QSharedPointer<DkImageContainerT> imgC);
+	void touch(QSharedPointer<DkImageContainerT> imgC, float weight);
+	void prefetch(QSharedPointer<DkImageContainerT> imgC, float weight, bool decode);
+	QSharedPointer<DkImageContainerT> find(const QString& filePath) const;
+	void evict();
+
+	float memoryUsage() const;
+	int numHits() const;
+	int numMisses() const;
+
+public slots:
+	void clear();
+
+protected:
+	DkImageCache();
+
+	struct Entry {
+		QSharedPointer<DkImageContainerT> imgC;
+		double priority = 0.0;
+	};
+
+	QHash<QString, Entry> mEntries;
+	double mInflation = 0.0;
+	int mMaxEntries = 250;	// limits containers that are not decoded but still referenced
+	int mHits = 0;
+	int mMisses = 0;
+};
+
+/**
+ * Persistent cache of folder trees.
+ * Folders are only listed again if their modification time changed
+ * (adding or removing a sub folder updates the parent's time).
+ **/ 
+class DllCoreExport DkFolderCache {
+
+public:
+	static DkFolderCache& instance();
+
+	// singleton
+	DkFolderCache(DkFolderCache const&) = delete;
+	void operator=(DkFolderCache const&) = delete;
+
+	bool subFolders(const QString& dirPath, qint64 modified, QStringList& folders) const;
+	void insert(const QString& dirPath, qint64 modified, const QStringList& folders);
+	void prune(const QString& rootPath, const QSet<QString>& visited);
+	QStringList tree(const QString& rootPath) const;
+	void save() const;
+
+protected:
+	DkFolderCache();
+	void load();
+	static QString cacheFilePath();
+
+	class Node {
+
+	public:
+		qint64 modified = 0;	// ms since epoch
+		QStringList subFolders;
+	};
+
+	mutable QReadWriteLock mLock;
+	QHash<QString, Node> mNodes;		// folder path -> sub folders
+	mutable QMutex mSaveMutex;
+};
+
+/**
+ * Scans folder trees in parallel.
+ * Each level of the tree is listed concurrently (at most maxConcurrentDirs
+ * folders at once) and found folders are reported as they arrive.
+ **/ 
+class DllCoreExport DkFolderScanner : public QObject {
+	Q_OBJECT
+
+public:
+	DkFolderScanner(QObject* parent = 0);
+	virtual ~DkFolderScanner();
+
+	void scan(const QString& rootPath);
+	void cancel();
+	bool isScanning() const;
+	QStringList waitForLevel(int timeout = -1);
+
+	static QStringList scanFolders(const QString& rootPath, 
+		std::function<void (const QStringList&)> found = std::function<void (const QStringList&)>(), 
+		const QAtomicInt* cancel = 0);
+
+	static const int maxConcurrentDirs = 8;	// limits the requests to a (network) drive
+	static const int maxBlockingTime = 3000;	// ms the loader waits for the scan if no cached folder has images
+
+signals:
+	void foldersFound(const QString& rootPath, const QStringList& folders) const;
+	void finished(const QString& rootPath, const QStringList& folders) const;
+
+public slots:
+	void scanFinished();
+
+protected:
+	static QStringList listFolders(const QString& dirPath, const QAtomicInt* cancel);
+	static QStringList readFolders(const QString& dirPath);
+	void addLevel(int scanIdx, const QStringList& folders, bool done = false);
+
+	QString mRootPath;
+	QSharedPointer<QAtomicInt> mCancel;
+	QFutureWatcher<QStringList> mWatcher;
+
+	// levels that were not consumed by waitForLevel()
+	QMutex mLevelMutex;
+	QWaitCondition mLevelAdded;
+	QList<QStringList> mLevels;
+	bool mLevelsDone = true;
+	int mScanIdx = 0;	// levels of older (canceled) scans are dropped
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -140,6 +280,8 @@ signals:
 	void imageLoadedSignal(QSharedPointer<DkImageContainerT> image, bool loaded = true) const;
 	void showInfoSignal(const QString& msg, int time = 3000, int position = 0) const;
 	void updateDirSignal(QVector<QSharedPointer<DkImageContainerT> > images) const;
+	void imageInsertedSignal(int idx, QSharedPointer<DkImageContainerT> image) const;
+	void imageRemovedSignal(int idx) const;
 	void imageHasGPSSignal(bool hasGPS) const;
 
 public slots:
@@ -168,6 +310,9 @@ public slots:
 	void imageLoaded(bool loaded = false);
 	void imageSaved(const QString& file, bool saved = true);
 	void imagesSorted();
+	void metaDataIndexed();
+	void subFoldersFound(const QString& rootPath, const QStringList& folders);
+	void subFoldersScanned(const QString& rootPath, const QStringList& folders);
 	bool unloadFile();
 	void reloadImage();
 
@@ -179,7 +324,10 @@ protected:
 	void updateHistory();
 	void sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images);
 	void createImages(const QFileInfoList& files, bool sort = true);
+	bool updateImages(const QFileInfoList& files);
 	QVector<QSharedPointer<DkImageContainerT > > sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const;
+	void indexMetaData();
+	bool hasMetaDataQuery() const;
 
 	QStringList mIgnoreKeywords;
 	QStringList mKeywords;
@@ -191,14 +339,20 @@ protected:
 	QString mSaveDir;
 	QFileSystemWatcher* mDirWatcher = 0;
 	QStringList mSubFolders;
+	QString mSubFolderRoot;
+	DkFolderScanner mFolderScanner;
 	QVector<QSharedPointer<DkImageContainerT > > mImages;
 	QSharedPointer<DkImageContainerT > mCurrentImage;
 	QSharedPointer<DkImageContainerT > mLastImageLoaded;
+	QString mLastCachedPath;
 	bool mFolderUpdated = false;
 	int mTmpFileIdx = 0;
 	bool mSortingImages = false;
 	bool mSortingIsDirty = false;
 	QFutureWatcher<QVector<QSharedPointer<DkImageContainerT > > > mCreateImageWatcher;
+	QFutureWatcher<bool> mMetaDataWatcher;
+	QSharedPointer<QAtomicInt> mMetaDataCancel;
+	bool mMetaDataIsDirty = false;
 
 };
 
@@ -31,15 +31,19 @@
 #include "DkTimer.h"
 #include "DkMath.h"
 #include "DkThumbs.h"
+#include "DkBasicLoader.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QDebug>
 #include <QThread>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
 #include <QPixmap>
 #include <QPainter>
 #include <QBitmap>
 #include <qmath.h>
 #include <QSvgRenderer>
+#include <QGuiApplication>
 #pragma warning(pop)		// no warnings from includes - end
 
 #if defined(Q_OS_WIN) && !defined(SOCK_STREAM)
@@ -306,6 +310,72 @@ float DkImage::getBufferSizeFloat(const QSize& imgSize, const int depth) {
 	return (float)size/(1024.0f*1024.0f);
 }
 
+// rows [start end[ of the destination image computed by downsampleBand
+struct DkDownsampleBand {
+	const uchar* src;
+	uchar* dst;
+	int srcBpl;
+	int dstBpl;
+	int width;
+	int start;
+	int end;
+};
+
+static void downsampleBand(DkDownsampleBand& band) {
+
+	for (int y = band.start; y < band.end; y++) {
+
+		const QRgb* s0 = reinterpret_cast<const QRgb*>(band.src + 2*y*band.srcBpl);
+		const QRgb* s1 = reinterpret_cast<const QRgb*>(band.src + (2*y+1)*band.srcBpl);
+		QRgb* d = reinterpret_cast<QRgb*>(band.dst + y*band.dstBpl);
+
+		for (int x = 0; x < band.width; x++) {
+
+			QRgb p0 = s0[2*x], p1 = s0[2*x+1], p2 = s1[2*x], p3 = s1[2*x+1];
+
+			// average two channels at once (4*255 fits into 16 bits)
+			quint32 rb = (p0 & 0x00ff00ff) + (p1 & 0x00ff00ff) + (p2 & 0x00ff00ff) + (p3 & 0x00ff00ff);
+			quint32 ag = ((p0 >> 8) & 0x00ff00ff) + ((p1 >> 8) & 0x00ff00ff) + ((p2 >> 8) & 0x00ff00ff) + ((p3 >> 8) & 0x00ff00ff);
+
+			d[x] = (((rb + 0x00020002) >> 2) & 0x00ff00ff) | ((((ag + 0x00020002) >> 2) & 0x00ff00ff) << 8);
+		}
+	}
+}
+
+/**
+ * Halves the image size using a 2x2 box filter.
+ * The filter works directly on the 32 bit image buffer and
+ * the rows are split into bands that are processed in parallel.
+ * @param img the image to downsample
+ * @return QImage the downsampled image (RGB32 or ARGB32_Premultiplied)
+ **/ 
+QImage DkImage::downsampleHalf(const QImage& img) {
+
+	QImage src = img;
+
+	if (src.format() != QImage::Format_RGB32 && src.format() != QImage::Format_ARGB32_Premultiplied)
+		src = src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+
+	QImage dst(src.width()/2, src.height()/2, src.format());
+
+	if (dst.isNull())
+		return dst;
+
+	// a few bands per core - so that the load is balanced
+	int numBands = qMax(1, qMin(QThread::idealThreadCount()*4, dst.height()/16));
+	int bandHeight = qCeil((double)dst.height()/numBands);
+
+	QVector<DkDownsampleBand> bands;
+	for (int y = 0; y < dst.height(); y += bandHeight) {
+		DkDownsampleBand b = {src.constBits(), dst.bits(), src.bytesPerLine(), dst.bytesPerLine(), dst.width(), y, qMin(y + bandHeight, dst.height())};
+		bands << b;
+	}
+
+	QtConcurrent::blockingMap(bands, &downsampleBand);
+
+	return dst;
+}
+
 /**
  * This function resizes an image according to the interpolation method specified.
  * @param img the image to resize
@@ -352,7 +422,12 @@ QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float facto
 	try {
 		
 		QImage qImg;
-		cv::Mat resizeImage = DkImage::qImage2Mat(img);
+
+		// the pixels are just read - so we do not need a copy
+		cv::Mat resizeImage = DkImage::constMatView(img);
+		
+		if (resizeImage.empty())
+			resizeImage = DkImage::qImage2Mat(img);
 		
 		if (correctGamma) {
 			resizeImage.convertTo(resizeImage, CV_16U, USHRT_MAX/255.0f);
@@ -374,7 +449,7 @@ QImage DkImage::resizeImage(const QImage& img, const QSize& newSize, float facto
 				resizeImage.convertTo(resizeImage, CV_8U, 255.0f/USHRT_MAX);
 			}
 
-			qImg = DkImage::mat2QImage(resizeImage);
+			qImg = DkImage::imageView(resizeImage);
 		}
 
 		if (!img.colorTable().isEmpty())
@@ -498,11 +573,16 @@ QImage DkImage::grayscaleImage(const QImage & img) {
 
 #ifdef WITH_OPENCV
 
-	cv::Mat cvImg = DkImage::qImage2Mat(img);
-	cv::cvtColor(cvImg, cvImg, CV_RGB2Lab);
+	cv::Mat cvImg = DkImage::constMatView(img);
+
+	if (cvImg.empty())
+		cvImg = DkImage::qImage2Mat(img);
+
+	cv::Mat labImg;
+	cv::cvtColor(cvImg, labImg, CV_RGB2Lab);
 
 	std::vector<cv::Mat> imgs;
-	cv::split(cvImg, imgs);
+	cv::split(labImg, imgs);
 
 	// get the luminance channel
 	if (!imgs.empty())
@@ -511,7 +591,7 @@ QImage DkImage::grayscaleImage(const QImage & img) {
 	// convert it back for the painter
 	cv::cvtColor(cvImg, cvImg, CV_GRAY2RGB);
 
-	imgR = DkImage::mat2QImage(cvImg);
+	imgR = DkImage::imageView(cvImg);
 #else
 
 	QVector<QRgb> table(256);
@@ -932,16 +1012,38 @@ QImage DkImage::hueSaturation(const QImage & src, int hue, int sat, int brightne
 
 #ifdef WITH_OPENCV
 
-	// normalize brightness/saturation
-	int brightnessN = qRound(brightness / 100.0 * 255.0);
-	double satN = sat / 100.0 + 1.0;
+	cv::Mat rgbImg = DkImage::constMatView(src);
+	
+	if (rgbImg.empty())
+		rgbImg = DkImage::qImage2Mat(src);
+
+	// never convert in place - rgbImg shares the pixels of src
+	cv::Mat hsvImg;
+	if (rgbImg.channels() > 3) {
+		cv::cvtColor(rgbImg, hsvImg, CV_RGBA2BGR);
+		cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
+	}
+	else
+		cv::cvtColor(rgbImg, hsvImg, CV_BGR2HSV);
+
+	hueSaturationMat(hsvImg, hue, sat, brightness);
+	cv::cvtColor(hsvImg, hsvImg, CV_HSV2BGR);
+	imgR = DkImage::imageView(hsvImg);
 
-	cv::Mat hsvImg = DkImage::qImage2Mat(src);
+#endif // WITH_OPENCV
 	
-	if (hsvImg.channels() > 3)
-		cv::cvtColor(hsvImg, hsvImg, CV_RGBA2BGR);
+	return imgR;
+}
 
-	cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
+#ifdef WITH_OPENCV
+/**
+ * Changes hue, saturation and brightness of a CV_8UC3 HSV image in place.
+ **/ 
+void DkImage::hueSaturationMat(cv::Mat& hsvImg, int hue, int sat, int brightness) {
+
+	// normalize brightness/saturation
+	int brightnessN = qRound(brightness / 100.0 * 255.0);
+	double satN = sat / 100.0 + 1.0;
 
 	// apply hue/saturation changes
 	for (int rIdx = 0; rIdx < hsvImg.rows; rIdx++) {
@@ -970,14 +1072,8 @@ QImage DkImage::hueSaturation(const QImage & src, int hue, int sat, int brightne
 			iPtr[cIdx + 1] = (unsigned char)s;
 		}
 	}
-	
-	cv::cvtColor(hsvImg, hsvImg, CV_HSV2BGR);
-	imgR = DkImage::mat2QImage(hsvImg);
-
-#endif // WITH_OPENCV
-	
-	return imgR;
 }
+#endif // WITH_OPENCV
 
 QImage DkImage::exposure(const QImage & src, double exposure, double offset, double gamma) {
 
@@ -987,8 +1083,13 @@ QImage DkImage::exposure(const QImage & src, double exposure, double offset, dou
 	QImage imgR;
 #ifdef WITH_OPENCV
 
-	cv::Mat rgbImg = DkImage::qImage2Mat(src);
-	rgbImg.convertTo(rgbImg, CV_16U, 256, offset*std::numeric_limits<unsigned short>::max());
+	cv::Mat srcImg = DkImage::constMatView(src);
+
+	if (srcImg.empty())
+		srcImg = DkImage::qImage2Mat(src);
+
+	cv::Mat rgbImg;
+	srcImg.convertTo(rgbImg, CV_16U, 256, offset*std::numeric_limits<unsigned short>::max());
 
 	if (rgbImg.channels() > 3)
 		cv::cvtColor(rgbImg, rgbImg, CV_RGBA2BGR);
@@ -1000,7 +1101,7 @@ QImage DkImage::exposure(const QImage & src, double exposure, double offset, dou
 		rgbImg = gammaMat(rgbImg, gamma);
 
 	rgbImg.convertTo(rgbImg, CV_8U, 1.0/256.0);
-	imgR = DkImage::mat2QImage(rgbImg);
+	imgR = DkImage::imageView(rgbImg);
 
 #endif // WITH_OPENCV
 
@@ -1119,7 +1220,8 @@ QPixmap DkImage::colorizePixmap(const QPixmap& icon, const QColor& col, float op
 
 QPixmap DkImage::loadIcon(const QString & filePath, const QSize& size) {
 	
-	if (filePath.isEmpty())
+	// pixmaps need a gui application (e.g. not available in nomacs-batch)
+	if (filePath.isEmpty() || !qobject_cast<QGuiApplication*>(QCoreApplication::instance()))
 		return QPixmap();
 
 	QSize s = size * DkSettingsManager::param().dPIScaleFactor();
@@ -1138,6 +1240,9 @@ QPixmap DkImage::loadIcon(const QString & filePath, const QSize& size) {
 
 QPixmap DkImage::loadIcon(const QString & filePath, const QColor& col) {
 
+	if (!qobject_cast<QGuiApplication*>(QCoreApplication::instance()))
+		return QPixmap();
+
 	int s = DkSettingsManager::param().effectiveIconSize();
 	QPixmap icon = loadFromSvg(filePath, QSize(s, s));
 	icon = colorizePixmap(icon, col);
@@ -1161,6 +1266,29 @@ QPixmap DkImage::loadFromSvg(const QString & filePath, const QSize & size) {
 
 #ifdef WITH_OPENCV
 
+/**
+ * Returns the cv::Mat type that shares the memory layout of a QImage format.
+ * @return int CV_8UC4 | CV_8UC3 or -1 if the format needs to be converted
+ **/ 
+static int matType(QImage::Format format) {
+
+	switch (format) {
+	case QImage::Format_ARGB32:
+	case QImage::Format_RGB32:
+		return CV_8UC4;
+	case QImage::Format_RGB888:
+		return CV_8UC3;
+	//// converting to indexed8 causes bugs in the qpainter
+	//// see: http://qt-project.org/doc/qt-4.8/qimage.html
+	default:
+		return -1;
+	}
+}
+
+static void releaseMat(void* mat) {
+	delete static_cast<cv::Mat*>(mat);
+}
+
 /**
  * Converts a QImage to a Mat
  * @param img formats supported: ARGB32 | RGB32 | RGB888 | Indexed8
@@ -1172,28 +1300,11 @@ cv::Mat DkImage::qImage2Mat(const QImage& img) {
 	QImage cImg;	// must be initialized here!	(otherwise the data is lost before clone())
 
 	try {
-		if (img.format() == QImage::Format_RGB32)
-			qDebug() << "we have an RGB32 in memory...";
+		mat2 = constMatView(img);
 
-		if (img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB32) {
-			mat2 = cv::Mat(img.height(), img.width(), CV_8UC4, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "ARGB32 or RGB32";
-		}
-		else if (img.format() == QImage::Format_RGB888) {
-			mat2 = cv::Mat(img.height(), img.width(), CV_8UC3, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "RGB888";
-		}
-		//// converting to indexed8 causes bugs in the qpainter
-		//// see: http://qt-project.org/doc/qt-4.8/qimage.html
-		//else if (img.format() == QImage::Format_Indexed8) {
-		//	mat2 = Mat(img.height(), img.width(), CV_8UC1, (uchar*)img.bits(), img.bytesPerLine());
-		//	//qDebug() << "indexed...";
-		//}
-		else {
-			//qDebug() << "image flag: " << img.format();
+		if (mat2.empty()) {
 			cImg = img.convertToFormat(QImage::Format_ARGB32);
-			mat2 = cv::Mat(cImg.height(), cImg.width(), CV_8UC4, (uchar*)cImg.bits(), cImg.bytesPerLine());
-			//qDebug() << "I need to convert the QImage to ARGB32";
+			mat2 = constMatView(cImg);
 		}
 
 		mat2 = mat2.clone();	// we need to own the pointer
@@ -1240,6 +1351,77 @@ QImage DkImage::mat2QImage(cv::Mat img) {
 	return qImg;
 }
 
+/**
+ * Returns a read-only Mat header that shares the pixels of img.
+ * No pixels are copied. Hence, the header is valid as long as img is alive
+ * and it must not be written to (img is not detached).
+ * @param img formats supported: ARGB32 | RGB32 | RGB888
+ * @return cv::Mat a CV_8UC4 or CV_8UC3 header - empty if the format is not supported
+ **/ 
+cv::Mat DkImage::constMatView(const QImage& img) {
+
+	int type = matType(img.format());
+
+	if (img.isNull() || type == -1)
+		return cv::Mat();
+
+	return cv::Mat(img.height(), img.width(), type, (uchar*)img.constBits(), img.bytesPerLine());
+}
+
+/**
+ * Returns a Mat header that writes directly to the pixels of img.
+ * img is detached and converted to ARGB32 if its format is not supported.
+ * The header is valid as long as img is alive and not reassigned.
+ * @param img the image that is changed in place
+ * @return cv::Mat a CV_8UC4 or CV_8UC3 header
+ **/ 
+cv::Mat DkImage::matView(QImage& img) {
+
+	if (img.isNull())
+		return cv::Mat();
+
+	if (matType(img.format()) == -1)
+		img = img.convertToFormat(QImage::Format_ARGB32);
+
+	return cv::Mat(img.height(), img.width(), matType(img.format()), img.bits(), img.bytesPerLine());
+}
+
+/**
+ * Returns a QImage that shares the buffer of mat.
+ * In contrast to mat2QImage() no pixels are copied: the image keeps a 
+ * reference to the buffer, so mat can be released safely. Changes of
+ * mat are visible in the image - so just pass matrices that are not used afterwards.
+ * Headers of foreign memory are copied since we cannot keep them alive.
+ * @param mat supported formats CV_8UC1 | CV_8UC3 | CV_8UC4
+ * @return QImage the corresponding QImage
+ **/ 
+QImage DkImage::imageView(const cv::Mat& mat) {
+
+	QImage::Format format = QImage::Format_Invalid;
+
+	switch (mat.type()) {
+	case CV_8UC1: format = QImage::Format_Indexed8; break;
+	case CV_8UC3: format = QImage::Format_RGB888; break;
+	case CV_8UC4: format = QImage::Format_ARGB32; break;
+	}
+
+	if (mat.empty() || format == QImage::Format_Invalid)
+		return mat2QImage(mat);
+
+#if CV_MAJOR_VERSION >= 3
+	bool ownsData = mat.u != 0;
+#else
+	bool ownsData = mat.refcount != 0;
+#endif
+
+	if (!ownsData)
+		return QImage(mat.data, mat.cols, mat.rows, (int)mat.step, format).copy();
+
+	cv::Mat* ref = new cv::Mat(mat);
+
+	return QImage(ref->data, ref->cols, ref->rows, (int)ref->step, format, &releaseMat, ref);
+}
+
 cv::Mat DkImage::get1DGauss(double sigma) {
 
 	// correct -> checked with matlab reference
@@ -1397,7 +1579,7 @@ bool DkImage::unsharpMask(QImage& img, float sigma, float weight) {
 #ifdef WITH_OPENCV
 	DkTimer dt;
 	//DkImage::gammaToLinear(img);
-	cv::Mat imgCv = DkImage::qImage2Mat(img);
+	cv::Mat imgCv = DkImage::matView(img);	// the result is written to img directly
 
 	cv::Mat imgG;
 	cv::Mat gx = cv::getGaussianKernel(qRound(4*sigma+1), sigma);
@@ -1405,7 +1587,6 @@ bool DkImage::unsharpMask(QImage& img, float sigma, float weight) {
 	cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
 	//cv::GaussianBlur(imgCv, imgG, cv::Size(4*sigma+1, 4*sigma+1), sigma);		// this is awesomely slow
 	cv::addWeighted(imgCv, weight, imgG, 1-weight, 0, imgCv);
-	img = DkImage::mat2QImage(imgCv);
 
 	qDebug() << "unsharp mask takes: " << dt;
 	//DkImage::linearToGamma(img);
@@ -1548,8 +1729,9 @@ DkImageStorage::DkImageStorage(const QImage& img) {
 
 void DkImageStorage::setImage(const QImage& img) {
 
+	QMutexLocker locker(&mMutex);
 	mStop = true;
-	mImgs.clear();	// is it save (if the thread is still working?)
+	mImgs.clear();
 	mImg = img;
 }
 
@@ -1558,6 +1740,7 @@ void DkImageStorage::antiAliasingChanged(bool antiAliasing) {
 	DkSettingsManager::param().display().antiAliasing = antiAliasing;
 
 	if (!antiAliasing) {
+		QMutexLocker locker(&mMutex);
 		mStop = true;
 		mImgs.clear();
 	}
@@ -1577,7 +1760,10 @@ QImage DkImageStorage::getImage(float factor) {
 	if (factor >= 0.5f || mImg.isNull() || !DkSettingsManager::param().display().antiAliasing)
 		return mImg;
 
+	QMutexLocker locker(&mMutex);
+
 	// check if we have an image similar to that requested
+	// levels are published while they are computed - so we might get a larger one first
 	for (int idx = 0; idx < mImgs.size(); idx++) {
 
 		if ((float)mImgs.at(idx).height()/mImg.height() >= factor)
@@ -1597,61 +1783,338 @@ QImage DkImageStorage::getImage(float factor) {
 
 void DkImageStorage::computeImage() {
 
+	mMutex.lock();
+	QImage img = mImg;
+	qint64 imgKey = mImg.cacheKey();
+	bool computed = !mImgs.empty();
+	mMutex.unlock();
+
 	// obviously, computeImage gets called multiple times in some wired cases...
-	if (!mImgs.empty())
+	if (computed)
 		return;
 
 	DkTimer dt;
 	mBusy = true;
-	QImage resizedImg = mImg;
-	
 
 	// down sample the image until it is twice times full HD
-	QSize iSize = mImg.size();
-	while (iSize.width() > 2*1920 && iSize.height() > 2*1920)	// in general we need less than 200 ms for the whole downscaling if we start at 1500 x 1500
+	// this nearest neighbor pass is cheap - so a 100 MP image does not start with a 25 MP level
+	QSize iSize = img.size();
+	while (iSize.width() > 2*1920 && iSize.height() > 2*1920)
 		iSize *= 0.5;
 
-	// for extreme panorama images the Qt scaling crashes (if we have a width > 30000) so we simply 
-	if (qMax(iSize.width(), iSize.height()) < 20000)
-		resizedImg = resizedImg.scaled(iSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+	// for extreme panorama images the Qt scaling crashes (if we have a width > 30000)
+	if (iSize != img.size() && qMax(iSize.width(), iSize.height()) < 20000)
+		img = img.scaled(iSize, Qt::KeepAspectRatio, Qt::FastTransformation);
 
-	// it would be pretty strange if we needed more than 30 sub-images
-	for (int idx = 0; idx < 30; idx++) {
+	// halve the image until it gets smaller than 32 px
+	// each level is published as soon as it is ready so that the viewport can use it right away
+	while (img.width() >= 64 && img.height() >= 64) {
 
-		QSize s = resizedImg.size();
-		s *= 0.5;
+		QImage resizedImg = DkImage::downsampleHalf(img);
 
-		if (s.width() < 32 || s.height() < 32)
+		mMutex.lock();
+		
+		// new image assigned?
+		bool stop = mStop || mImg.cacheKey() != imgKey;
+		if (!stop)
+			mImgs.push_front(resizedImg);
+		
+		mMutex.unlock();
+
+		if (stop)
 			break;
 
-#ifdef WITH_OPENCV
-		cv::Mat rImgCv = DkImage::qImage2Mat(resizedImg);
-		cv::Mat tmp;
-		cv::resize(rImgCv, tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
-		resizedImg = DkImage::mat2QImage(tmp);
+		// tell my caller I did something
+		emit imageUpdated();
+
+		img = resizedImg;
+	}
+
+	mBusy = false;
+
+	qDebug() << "pyramid computation took me: " << dt << " layers: " << mImgs.size();
+}
+
+// DkTileCache --------------------------------------------------------------------
+DkTileCache::DkTileCache(QObject* parent) : QObject(parent) {
+
+	mTiles.setMaxCost(96 * 1024);	// KB
+
+	mZoomTimer.setSingleShot(true);
+	mZoomTimer.setInterval(150);
+	connect(&mZoomTimer, SIGNAL(timeout()), this, SIGNAL(tilesChanged()));
+}
+
+DkTileCache::~DkTileCache() {
+
+	mPool.clear();
+	mPool.waitForDone();
+}
+
+int DkTileCache::tileSize() {
+	return 256;
+}
+
+/**
+ * Draws the image with pre-scaled tiles.
+ * The painter's world transform must scale & translate only.
+ * Tiles are rendered in device pixels. While the zoom level changes
+ * (e.g. zoom animations), false is returned and the tiles are kept
+ * until the zoom level did not change for a moment.
+ * @param painter a painter with the world transform of the viewport
+ * @param img the image (or pyramid level) that is drawn to imgViewRect
+ * @param imgViewRect the image rect in world coordinates
+ * @param viewportRect the visible area in device coordinates
+ * @param smooth if true, the tiles are interpolated
+ * @return bool false if the image should be drawn without tiles
+ **/ 
+bool DkTileCache::draw(QPainter& painter, const QImage& img, const QRectF& imgViewRect, const QRect& viewportRect, bool smooth) {
+
+	QTransform wm = painter.worldTransform();
+
+	if (img.isNull() || imgViewRect.isEmpty() || wm.type() > QTransform::TxScale)
+		return false;
+
+	QRectF imgRect = wm.mapRect(imgViewRect);
+
+	// the whole image is visible - there is nothing to save
+	if (viewportRect.contains(imgRect.toAlignedRect()))
+		return false;
+
+#if QT_VERSION >= 0x050600
+	double dpr = painter.device()->devicePixelRatioF();
 #else
-		resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	double dpr = painter.device()->devicePixelRatio();
 #endif
 
-		// new image assigned?
-		if (mStop)
-			break;
+	// from now on we work in device pixels
+	imgRect = QRectF(imgRect.topLeft() * dpr, imgRect.size() * dpr);
+	QRect deviceRect = QRectF(QPointF(viewportRect.topLeft()) * dpr, QSizeF(viewportRect.size()) * dpr).toAlignedRect();
 
-		mMutex.lock();
-		mImgs.push_front(resizedImg);
-		mMutex.unlock();
+	double scale = imgRect.width() / img.width();
+	bool sameImage = img.cacheKey() == mImgKey && smooth == mSmooth;
+
+	// zooming: keep the current tiles until the zoom level settles
+	if (scale != mNextScale) {
+		mNextScale = scale;
+		if (sameImage)
+			mZoomTimer.start();
 	}
 
-	mBusy = false;
+	if (sameImage && scale != mScale && mZoomTimer.isActive())
+		return false;
 
-	// tell my caller I did something
-	emit imageUpdated();
+	// the overview of a streamed image is magnified -> read the tiles from the full resolution
+	mStreamed = mSource && scale > 1.0 && img.cacheKey() == mSourceKey;
+
+	// the tiles are valid for one image & zoom level only
+	if (!sameImage || scale != mScale) {
+		clear();
+		mImgKey = img.cacheKey();
+		mScale = scale;
+		mSmooth = smooth;
+
+		// convert once - otherwise the painter converts the whole image for every tile
+		if (img.format() == QImage::Format_RGB32 || img.format() == QImage::Format_ARGB32_Premultiplied)
+			mImg = img;
+		else
+			mImg = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+	}
 
-	qDebug() << "pyramid computation took me: " << dt << " layers: " << mImgs.size();
+	QSharedPointer<DkTiledImage> source = mStreamed ? mSource : QSharedPointer<DkTiledImage>();
+	QSize srcSize = source ? source->size() : mImg.size();
+	double srcScale = imgRect.width() / srcSize.width();
+
+	int ts = tileSize();
+	QPoint origin = imgRect.topLeft().toPoint();
+	QRect scaledRect(0, 0, qCeil(srcSize.width() * srcScale), qCeil(srcSize.height() * srcScale));
+	QRect visible = deviceRect.translated(-origin).intersected(scaledRect);
+
+	if (visible.isEmpty())
+		return true;
+
+	int tx0 = visible.left() / ts;
+	int tx1 = visible.right() / ts;
+	int ty0 = visible.top() / ts;
+	int ty1 = visible.bottom() / ts;
+
+	auto tileAt = [&](int tx, int ty) {
+		Tile t;
+		t.key = ((quint64)ty << 32) | (quint32)tx;
+		t.rect = QRect(tx * ts, ty * ts, ts, ts).intersected(scaledRect);
+		return t;
+	};
+
+	// collect the visible tiles
+	QVector<Tile> tiles;
+	QVector<Tile> missing;
+
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+
+			Tile t = tileAt(tx, ty);
+			QImage* cached = mTiles.object(t.key);
+
+			if (cached) {
+				t.img = *cached;
+				tiles << t;
+			}
+			else
+				missing << t;
+		}
+	}
+
+	// render missing tiles in parallel
+	// streamed tiles are read in the background - meanwhile we show the magnified overview
+	QImage src = mImg;
+	QtConcurrent::blockingMap(missing, [&](Tile& t) {
+		t.img = renderTile(src, scale, t.rect, smooth, dpr);
+	});
+
+	for (const Tile& t : missing) {
+
+		if (source)
+			continue;
+
+		mPending.remove(t.key);
+		mTiles.insert(t.key, new QImage(t.img), t.img.bytesPerLine() * t.img.height() / 1024);
+	}
+	tiles << missing;
+
+	painter.setWorldMatrixEnabled(false);
+
+	// the tiles have the painter's device pixel ratio -> they are mapped 1:1 to device pixels
+	for (const Tile& t : tiles)
+		painter.drawImage(QPointF(origin + t.rect.topLeft()) / dpr, t.img);
+
+	painter.setWorldMatrixEnabled(true);
+
+	auto renderThreaded = [&](int tx, int ty) {
+
+		Tile t = tileAt(tx, ty);
+
+		if (t.rect.isEmpty() || mPending.contains(t.key) || mTiles.contains(t.key))
+			return;
+
+		mPending.insert(t.key);
+		int generation = mGeneration;
+		double tileScale = source ? srcScale : scale;
+		QtConcurrent::run(&mPool, [=]() {
+			renderTileThreaded(generation, t, src, source, tileScale, smooth, dpr);
+		});
+	};
+
+	// the visible tiles of streamed images come first
+	for (const Tile& t : missing)
+		renderThreaded((int)(t.key & 0xffffffff), (int)(t.key >> 32));
+
+	// prepare the tiles next to the viewport
+	for (int ty = qMax(ty0 - 1, 0); ty <= ty1 + 1; ty++) {
+		for (int tx = qMax(tx0 - 1, 0); tx <= tx1 + 1; tx++)
+			renderThreaded(tx, ty);
+	}
+
+	return true;
+}
+
+void DkTileCache::clear() {
+
+	mPool.clear();
+	mTiles.clear();
+	mPending.clear();
+	mImg = QImage();
+	mImgKey = 0;
+	mGeneration++;
+}
+
+/**
+ * Sets the full resolution of a streamed image.
+ * The tiles are read from source if the overview (imgKey) is magnified.
+ * @param source the tiled image or NULL
+ * @param imgKey the cache key of the overview
+ **/ 
+void DkTileCache::setSource(QSharedPointer<DkTiledImage> source, qint64 imgKey) {
+
+	if (source == mSource && imgKey == mSourceKey)
+		return;
+
+	clear();
+	mSource = source;
+	mSourceKey = source ? imgKey : 0;
+}
+
+void DkTileCache::addTile(int generation, quint64 key, const QImage& tile) {
+
+	// the zoom level changed in the meantime
+	if (generation != mGeneration)
+		return;
+
+	mPending.remove(key);
+	mTiles.insert(key, new QImage(tile), tile.bytesPerLine() * tile.height() / 1024);
+
+	// replace the magnified overview
+	if (mStreamed)
+		emit tilesChanged();
+}
+
+QImage DkTileCache::renderTile(const QImage& img, double scale, const QRect& tileRect, bool smooth, double dpr) {
+
+	QImage tile(tileRect.size(), QImage::Format_ARGB32_Premultiplied);
+	tile.fill(Qt::transparent);
+
+	// the painter just resamples pixels within the tile
+	QPainter p(&tile);
+	p.setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+	p.translate(-tileRect.topLeft());
+	p.scale(scale, scale);
+	p.drawImage(QPointF(), img);
+	p.end();
+
+	// set it after painting - otherwise the painter works in logical pixels
+	tile.setDevicePixelRatio(dpr);
+
+	return tile;
+}
+
+/**
+ * Renders a tile from the pyramid of a streamed image.
+ * @param source the streamed image
+ * @param scale the scale w.r.t. the full resolution
+ * @param tileRect the tile w.r.t. the scaled image
+ * @param smooth if true, the tile is interpolated
+ * @param dpr the device pixel ratio of the tile
+ * @return QImage the tile
+ **/ 
+QImage DkTileCache::renderTile(const QSharedPointer<DkTiledImage>& source, double scale, const QRect& tileRect, bool smooth, double dpr) {
+
+	// read the coarsest level that has enough resolution
+	int level = source->levelFor(scale);
+	double levelScale = scale * (1 << level);
+
+	// add a border for the interpolation
+	QRect r = QRectF(tileRect.left() / levelScale, tileRect.top() / levelScale, 
+		tileRect.width() / levelScale, tileRect.height() / levelScale).toAlignedRect().adjusted(-1, -1, 1, 1);
+	r = r.intersected(QRect(QPoint(), source->levelSize(level)));
+
+	QImage tile(tileRect.size(), QImage::Format_ARGB32_Premultiplied);
+	tile.fill(Qt::transparent);
+
+	QPainter p(&tile);
+	p.setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+	p.translate(-tileRect.topLeft());
+	p.scale(levelScale, levelScale);
+	p.drawImage(r.topLeft(), source->region(r, level));
+	p.end();
+
+	tile.setDevicePixelRatio(dpr);
+
+	return tile;
+}
 
-	if (mImgs.size() > 6)
-		qDebug() << "layer size > 6: " << mImg.size();
+void DkTileCache::renderTileThreaded(int generation, Tile tile, QImage img, QSharedPointer<DkTiledImage> source, double scale, bool smooth, double dpr) {
 
+	QImage t = source ? renderTile(source, scale, tile.rect, smooth, dpr) : renderTile(img, scale, tile.rect, smooth, dpr);
+	QMetaObject::invokeMethod(this, "addTile", Qt::QueuedConnection, Q_ARG(int, generation), Q_ARG(quint64, tile.key), Q_ARG(QImage, t));
 }
 
 }
@@ -33,6 +33,11 @@
 #include <QVector>
 #include <QObject>
 #include <QColor>
+#include <QCache>
+#include <QSet>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QTimer>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -58,6 +63,7 @@
 #endif
 
 // Qt defines
+class QPainter;
 class QPixmap;
 class QString;
 class QSize;
@@ -66,6 +72,7 @@ class QColor;
 namespace nmc {
 
 class DkRotatingRect;
+class DkTiledImage;
 
 /**
  * DkImage holds some basic image processing
@@ -90,6 +97,9 @@ public:
 #ifdef WITH_OPENCV
 	static cv::Mat qImage2Mat(const QImage& img);
 	static QImage mat2QImage(cv::Mat img);
+	static cv::Mat constMatView(const QImage& img);
+	static cv::Mat matView(QImage& img);
+	static QImage imageView(const cv::Mat& mat);
 	static cv::Mat get1DGauss(double sigma);
 	static void mapGammaTable(cv::Mat& img, const QVector<unsigned short>& gammaTable);
 	static void gammaToLinear(cv::Mat& img);
@@ -102,6 +112,7 @@ public:
 	static QString getBufferSize(const QSize& imgSize, const int depth);
 	static float getBufferSizeFloat(const QSize& imgSize, const int depth);
 	static QImage resizeImage(const QImage& img, const QSize& newSize, float factor = 1.0f, int interpolation = ipl_cubic, bool correctGamma = true);
+	static QImage downsampleHalf(const QImage& img);
 
 	template <typename numFmt>
 	static QVector<numFmt> getGamma2LinearTable(int maxVal = USHRT_MAX);
@@ -134,6 +145,7 @@ public:
 	static QImage exposure(const QImage& src, double exposure, double offset, double gamma);
 	
 #ifdef WITH_OPENCV
+	static void hueSaturationMat(cv::Mat& hsvImg, int hue, int sat, int brightness);
 	static cv::Mat exposureMat(const cv::Mat& src, double exposure);
 	static cv::Mat gammaMat(const cv::Mat& src, double gmma);
 	static cv::Mat applyLUT(const cv::Mat& src, const cv::Mat& lut);
@@ -172,4 +184,59 @@ protected:
 	bool mStop = true;
 };
 
+/**
+ * Draws zoomed images with pre-scaled tiles.
+ * Only tiles that intersect the viewport are drawn, so panning
+ * costs about the screen area - regardless of the image size.
+ * The tiles of the current zoom level are kept in a LRU cache
+ * and the tiles next to the viewport are prepared on worker threads.
+ * Tiles have the device pixel ratio of the painter, so they are sharp on HiDPI screens.
+ **/
+class DllCoreExport DkTileCache : public QObject {
+	Q_OBJECT
+
+public:
+	DkTileCache(QObject* parent = 0);
+	~DkTileCache();
+
+	bool draw(QPainter& painter, const QImage& img, const QRectF& imgViewRect, const QRect& viewportRect, bool smooth);
+	void clear();
+	void setSource(QSharedPointer<DkTiledImage> source, qint64 imgKey);
+
+	static int tileSize();
+
+signals:
+	void tilesChanged();
+
+public slots:
+	void addTile(int generation, quint64 key, const QImage& tile);
+
+protected:
+	struct Tile {
+		quint64 key = 0;
+		QRect rect;		// w.r.t. the scaled image
+		QImage img;
+	};
+
+	static QImage renderTile(const QImage& img, double scale, const QRect& tileRect, bool smooth, double dpr);
+	static QImage renderTile(const QSharedPointer<DkTiledImage>& source, double scale, const QRect& tileRect, bool smooth, double dpr);
+	void renderTileThreaded(int generation, Tile tile, QImage img, QSharedPointer<DkTiledImage> source, double scale, bool smooth, double dpr);
+
+	QCache<quint64, QImage> mTiles;
+	QSet<quint64> mPending;
+	QThreadPool mPool;
+
+	QImage mImg;
+	qint64 mImgKey = 0;
+	double mScale = 0.0;		// w.r.t. device pixels
+	double mNextScale = 0.0;	// the zoom level we are animating to
+	bool mSmooth = false;
+	int mGeneration = 0;
+	QTimer mZoomTimer;			// the tiles are rebuilt once zooming stopped
+
+	QSharedPointer<DkTiledImage> mSource;	// full resolution of streamed images
+	qint64 mSourceKey = 0;					// the overview that belongs to mSource
+	bool mStreamed = false;
+};
+
 };
@@ -32,12 +32,18 @@
 #include "DkImageStorage.h"
 #include "DkImageContainer.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 
 #pragma warning(push, 0)	// no warnings from includes
 #include <QSharedPointer>
 #include <QWidget>
+#include <QGuiApplication>
+#include <QDebug>
+#include <QtConcurrentMap>
 #pragma warning(pop)
 
+#include <cassert>
+
 namespace nmc {
 
 // DkBaseManipulator --------------------------------------------------------------------
@@ -65,6 +71,161 @@ QIcon DkBaseManipulator::icon() const {
 	return mAction->icon();
 }
 
+// DkPixelKernel --------------------------------------------------------------------
+/**
+ * Adds a look-up table which is applied to all color channels.
+ * It is merged with the previous stage if that is a look-up table too.
+ * @param lut 256 values
+ * @param convertsToRgb true if the manipulator returns RGB888 images when applied on its own
+ **/ 
+void DkPixelKernel::addLUT(const QVector<uchar>& lut, bool convertsToRgb) {
+
+	assert(lut.size() == 256);
+
+	if (!mStages.empty() && mStages.last().type == stage_lut) {
+		
+		QVector<uchar>& cLut = mStages.last().lut;
+		for (int idx = 0; idx < cLut.size(); idx++)
+			cLut[idx] = lut[cLut[idx]];
+	}
+	else {
+		Stage s;
+		s.type = stage_lut;
+		s.lut = lut;
+		mStages << s;
+	}
+
+	mRgb |= convertsToRgb;
+}
+
+void DkPixelKernel::addGrayscale() {
+
+	Stage s;
+	s.type = stage_grayscale;
+	s.rgbInput = mRgb;
+	mStages << s;
+
+	mRgb = true;
+}
+
+void DkPixelKernel::addHueSaturation(int hue, int sat, int brightness) {
+
+	Stage s;
+	s.type = stage_hue;
+	s.hue = hue;
+	s.sat = sat;
+	s.brightness = brightness;
+	mStages << s;
+
+	mRgb = true;
+}
+
+bool DkPixelKernel::isEmpty() const {
+	return mStages.empty();
+}
+
+void DkPixelKernel::clear() {
+	mStages.clear();
+	mRgb = false;
+}
+
+QImage DkPixelKernel::apply(const QImage& img) const {
+
+	if (mStages.empty() || img.isNull())
+		return img;
+
+	DkTimer dt;
+
+	bool rgbInput = img.format() == QImage::Format_RGB888;
+
+	QImage imgR = img;
+	if (imgR.format() != QImage::Format_RGB32 && imgR.format() != QImage::Format_ARGB32)
+		imgR = imgR.convertToFormat(QImage::Format_ARGB32);
+
+	// detach once - the bands are processed in place
+	uchar* bits = imgR.bits();
+	int bpl = imgR.bytesPerLine();
+	int width = imgR.width();
+	
+	QVector<int> bands;
+	for (int rIdx = 0; rIdx < imgR.height(); rIdx += 32)
+		bands << rIdx;
+
+	QtConcurrent::blockingMap(bands, [&](int rIdx) {
+		applyBand(bits + rIdx * bpl, bpl, width, qMin(32, imgR.height() - rIdx), rgbInput);
+	});
+
+	qDebug() << mStages.size() << "fused stages applied in" << dt;
+
+	return imgR;
+}
+
+void DkPixelKernel::applyBand(uchar* ptr, int bytesPerLine, int width, int numRows, bool rgbInput) const {
+
+	for (const Stage& s : mStages) {
+
+		if (s.type == stage_lut) {
+
+			const uchar* lut = s.lut.constData();
+
+			for (int rIdx = 0; rIdx < numRows; rIdx++) {
+
+				uchar* pPtr = ptr + rIdx * bytesPerLine;
+
+				// alpha is not touched
+				for (int cIdx = 0; cIdx < width; cIdx++, pPtr += 4) {
+					pPtr[0] = lut[pPtr[0]];
+					pPtr[1] = lut[pPtr[1]];
+					pPtr[2] = lut[pPtr[2]];
+				}
+			}
+		}
+#ifdef WITH_OPENCV
+		else if (s.type == stage_grayscale) {
+
+			// DkImage::grayscaleImage interprets 32 bit images as RGBA and RGB888 images as RGB
+			cv::Mat band(numRows, width, CV_8UC4, ptr, bytesPerLine);
+			cv::Mat labImg;
+			cv::cvtColor(band, labImg, (rgbInput || s.rgbInput) ? CV_BGR2Lab : CV_RGB2Lab);
+
+			for (int rIdx = 0; rIdx < numRows; rIdx++) {
+
+				uchar* pPtr = band.ptr<uchar>(rIdx);
+				const uchar* lPtr = labImg.ptr<uchar>(rIdx);
+
+				for (int cIdx = 0; cIdx < width; cIdx++, pPtr += 4, lPtr += 3) {
+					pPtr[0] = lPtr[0];
+					pPtr[1] = lPtr[0];
+					pPtr[2] = lPtr[0];
+				}
+			}
+		}
+		else if (s.type == stage_hue) {
+
+			// same conversions as DkImage::hueSaturation
+			cv::Mat band(numRows, width, CV_8UC4, ptr, bytesPerLine);
+			cv::Mat hsvImg;
+			cv::cvtColor(band, hsvImg, CV_RGBA2BGR);
+			cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
+			DkImage::hueSaturationMat(hsvImg, s.hue, s.sat, s.brightness);
+			cv::cvtColor(hsvImg, hsvImg, CV_HSV2BGR);
+
+			for (int rIdx = 0; rIdx < numRows; rIdx++) {
+
+				uchar* pPtr = band.ptr<uchar>(rIdx);
+				const uchar* hPtr = hsvImg.ptr<uchar>(rIdx);
+
+				for (int cIdx = 0; cIdx < width; cIdx++, pPtr += 4, hPtr += 3) {
+					pPtr[0] = hPtr[2];
+					pPtr[1] = hPtr[1];
+					pPtr[2] = hPtr[0];
+				}
+			}
+		}
+#endif // WITH_OPENCV
+	}
+}
+
 // DkManipulatorManager --------------------------------------------------------------------
 DkManipulatorManager::DkManipulatorManager() {
 }
@@ -79,6 +240,9 @@ void DkManipulatorManager::createManipulators(QWidget* parent) {
 
 	QSize size(22, 22);
 
+	// shortcuts need a gui application (e.g. not available in nomacs-batch)
+	bool gui = qobject_cast<QGuiApplication*>(QCoreApplication::instance()) != 0;
+
 	// grayscale
 	QAction* action;
 	action = new QAction(DkImage::loadIcon(":/nomacs/img/grayscale.svg", size), QObject::tr("&Grayscale"), parent);
@@ -87,13 +251,15 @@ void DkManipulatorManager::createManipulators(QWidget* parent) {
 
 	// auto adjust
 	action = new QAction(DkImage::loadIcon(":/nomacs/img/auto-adjust.svg", size), QObject::tr("&Auto Adjust"), parent);
-	action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_L);
+	if (gui)
+		action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_L);
 	action->setStatusTip(QObject::tr("Auto Adjust Image Contrast and Color Balance"));
 	mpls[m_auto_adjust] = QSharedPointer<DkAutoAdjustManipulator>::create(action);
 
 	// normalize
 	action = new QAction(DkImage::loadIcon(":/nomacs/img/normalize.svg", size), QObject::tr("Nor&malize Image"), parent);
-	action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_N);
+	if (gui)
+		action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_N);
 	action->setStatusTip(QObject::tr("Normalize the Image"));
 	mpls[m_normalize] = QSharedPointer<DkNormalizeManipulator>::create(action);
 
@@ -31,6 +31,8 @@
 #pragma warning(push, 0)	// no warnings from includes
 #include <QAction>
 #include <QSettings>
+#include <QImage>
+#include <QVector>
 #pragma warning(pop)
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -51,6 +53,7 @@ namespace nmc {
 
 // nomacs defines
 class DkImageContainer;
+class DkPixelKernel;
 
 /// <summary>
 /// Base class of simple image manipulators.
@@ -73,6 +76,7 @@ public:
 
 	virtual QString errorMessage() const = 0;
 	virtual QImage apply(const QImage& img) const = 0;
+	virtual bool compile(DkPixelKernel&) const { return false; };
 
 	virtual void saveSettings(QSettings& settings);
 	virtual void loadSettings(QSettings& settings);
@@ -105,6 +109,47 @@ private:
 	QWidget* mWidget = 0;
 };
 
+/// <summary>
+/// Point-wise manipulators compiled into a single kernel.
+/// Consecutive look-up tables are merged and all stages
+/// are applied in place on bands of rows in parallel.
+/// The result equals applying the manipulators one by one.
+/// </summary>
+class DllCoreExport DkPixelKernel {
+
+public:
+	void addLUT(const QVector<uchar>& lut, bool convertsToRgb = false);
+	void addGrayscale();
+	void addHueSaturation(int hue, int sat, int brightness);
+
+	bool isEmpty() const;
+	void clear();
+	QImage apply(const QImage& img) const;
+
+protected:
+	enum StageType {
+		stage_lut = 0,
+		stage_grayscale,
+		stage_hue,
+
+		stage_end
+	};
+
+	struct Stage {
+		int type = stage_lut;
+		QVector<uchar> lut;		// 256 values which are applied to all color channels
+		int hue = 0;
+		int sat = 0;
+		int brightness = 0;
+		bool rgbInput = false;	// a previous stage hands over an RGB888 image
+	};
+
+	void applyBand(uchar* ptr, int bytesPerLine, int width, int numRows, bool rgbInput) const;
+
+	QVector<Stage> mStages;
+	bool mRgb = false;	// manipulators applied one by one would convert the image to RGB888
+};
+
 class DllCoreExport DkManipulatorManager {
 
 public:
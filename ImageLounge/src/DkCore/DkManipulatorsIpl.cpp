@@ -36,6 +36,8 @@
 #include <QDebug>
 #pragma warning(pop)
 
+#include <limits>
+
 namespace nmc {
 
 // DkGrayScaleManipulator --------------------------------------------------------------------
@@ -50,6 +52,17 @@ QImage DkGrayScaleManipulator::apply(const QImage& img) const {
 	return DkImage::grayscaleImage(img);
 }
 
+bool DkGrayScaleManipulator::compile(DkPixelKernel& kernel) const {
+
+#ifdef WITH_OPENCV
+	kernel.addGrayscale();
+	return true;
+#else
+	Q_UNUSED(kernel);
+	return false;
+#endif
+}
+
 QString DkGrayScaleManipulator::errorMessage() const {
 	return QObject::tr("Could not convert to grayscale");
 }
@@ -100,6 +113,16 @@ QImage DkInvertManipulator::apply(const QImage & img) const {
 	return imgR;
 }
 
+bool DkInvertManipulator::compile(DkPixelKernel& kernel) const {
+
+	QVector<uchar> lut(256);
+	for (int idx = 0; idx < lut.size(); idx++)
+		lut[idx] = (uchar)(255 - idx);
+
+	kernel.addLUT(lut);
+	return true;
+}
+
 QString DkInvertManipulator::errorMessage() const {
 	return QObject::tr("Cannot invert image");
 }
@@ -265,6 +288,24 @@ QImage DkThresholdManipulator::apply(const QImage & img) const {
 	return DkImage::thresholdImage(img, threshold(), color());
 }
 
+bool DkThresholdManipulator::compile(DkPixelKernel& kernel) const {
+
+#ifdef WITH_OPENCV
+	if (!color())
+		kernel.addGrayscale();
+
+	QVector<uchar> lut(256);
+	for (int idx = 0; idx < lut.size(); idx++)
+		lut[idx] = idx > threshold() ? 255 : 0;
+
+	kernel.addLUT(lut);
+	return true;
+#else
+	Q_UNUSED(kernel);
+	return false;
+#endif
+}
+
 QString DkThresholdManipulator::errorMessage() const {
 	return QObject::tr("Cannot threshold image");
 }
@@ -303,6 +344,20 @@ QImage DkHueManipulator::apply(const QImage & img) const {
 	return DkImage::hueSaturation(img, hue(), saturation(), value());
 }
 
+bool DkHueManipulator::compile(DkPixelKernel& kernel) const {
+
+#ifdef WITH_OPENCV
+	// nothing to do?
+	if (hue() != 0 || saturation() != 0 || value() != 0)
+		kernel.addHueSaturation(hue(), saturation(), value());
+
+	return true;
+#else
+	Q_UNUSED(kernel);
+	return false;
+#endif
+}
+
 QString DkHueManipulator::errorMessage() const {
 	return QObject::tr("Cannot change Hue/Saturation");
 }
@@ -353,6 +408,40 @@ QImage DkExposureManipulator::apply(const QImage & img) const {
 	return DkImage::exposure(img, exposure(), offset(), gamma());
 }
 
+bool DkExposureManipulator::compile(DkPixelKernel& kernel) const {
+
+#ifdef WITH_OPENCV
+	// nothing to do?
+	if (exposure() == 0.0 && offset() == 0.0 && gamma() == 1.0)
+		return true;
+
+	// run all 8 bit values through the same conversions as DkImage::exposure
+	cv::Mat lutImg(1, 256, CV_8UC1);
+	for (int idx = 0; idx < lutImg.cols; idx++)
+		lutImg.at<uchar>(idx) = (uchar)idx;
+
+	lutImg.convertTo(lutImg, CV_16U, 256, offset()*std::numeric_limits<unsigned short>::max());
+
+	if (exposure() != 0.0)
+		lutImg = DkImage::exposureMat(lutImg, exposure());
+
+	if (gamma() != 1.0)
+		lutImg = DkImage::gammaMat(lutImg, gamma());
+
+	lutImg.convertTo(lutImg, CV_8U, 1.0/256.0);
+
+	QVector<uchar> lut(256);
+	for (int idx = 0; idx < lut.size(); idx++)
+		lut[idx] = lutImg.at<uchar>(idx);
+
+	kernel.addLUT(lut, true);
+	return true;
+#else
+	Q_UNUSED(kernel);
+	return false;
+#endif
+}
+
 QString DkExposureManipulator::errorMessage() const {
 	return QObject::tr("Cannot apply exposure");
 }
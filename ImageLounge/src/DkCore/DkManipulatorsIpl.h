@@ -58,6 +58,7 @@ public:
 	DkGrayScaleManipulator(QAction* action = 0);
 
 	QImage apply(const QImage& img) const override;
+	bool compile(DkPixelKernel& kernel) const override;
 	QString errorMessage() const override;
 };
 
@@ -85,6 +86,7 @@ public:
 	DkInvertManipulator(QAction* action = 0);
 
 	QImage apply(const QImage& img) const override;
+	bool compile(DkPixelKernel& kernel) const override;
 	QString errorMessage() const override;
 };
 
@@ -170,6 +172,7 @@ public:
 	DkThresholdManipulator(QAction* action);
 
 	QImage apply(const QImage& img) const override;
+	bool compile(DkPixelKernel& kernel) const override;
 	QString errorMessage() const override;
 
 	void setThreshold(int thr);
@@ -189,6 +192,7 @@ public:
 	DkHueManipulator(QAction* action);
 
 	QImage apply(const QImage& img) const override;
+	bool compile(DkPixelKernel& kernel) const override;
 	QString errorMessage() const override;
 
 	void setHue(int hue);
@@ -212,6 +216,7 @@ public:
 	DkExposureManipulator(QAction* action);
 
 	QImage apply(const QImage& img) const override;
+	bool compile(DkPixelKernel& kernel) const override;
 	QString errorMessage() const override;
 
 	void setExposure(double exposure);
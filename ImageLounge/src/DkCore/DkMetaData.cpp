@@ -30,6 +30,7 @@
 #include "DkMath.h"
 #include "DkImageStorage.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTranslator>
@@ -39,6 +40,13 @@
 #include <QBuffer>
 #include <QVector2D>
 #include <QApplication>
+#include <QDir>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QRegExp>
+#include <QSaveFile>
+#include <QtConcurrentMap>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -111,6 +119,7 @@ void DkMetaDataT::readMetaData(const QString& filePath, QSharedPointer<QByteArra
 	
 	//qDebug() << "[Exiv2] metadata loaded";
 	mExifState = loaded;
+	indexMetaData();
 
 	//printMetaData();
 
@@ -136,9 +145,15 @@ bool DkMetaDataT::saveMetaData(const QString& filePath, bool force) {
 		return false;
 	}
 
-	file.open(QFile::WriteOnly);
-	file.write(ba->data(), ba->size());
-	file.close();
+	// the file is replaced (not truncated) - buffers that map the old file stay valid
+	QSaveFile saveFile(filePath);
+	saveFile.open(QFile::WriteOnly);
+	saveFile.write(ba->constData(), ba->size());
+	
+	if (!saveFile.commit()) {
+		qDebug() << "[DkMetaDataT] could not write: " << QFileInfo(filePath).fileName();
+		return false;
+	}
 
 	qDebug() << "[DkMetaDataT] I saved: " << ba->size() << " bytes";
 
@@ -164,7 +179,7 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray>& ba, bool force) {
 
 	try {
 
-		exifMem = Exiv2::MemIo::AutoPtr(new Exiv2::MemIo((byte*)ba->data(), ba->size()));
+		exifMem = Exiv2::MemIo::AutoPtr(new Exiv2::MemIo((const byte*)ba->constData(), ba->size()));
 		exifImgN = Exiv2::ImageFactory::open(exifMem);
 	} 
 	catch (...) {
@@ -202,38 +217,14 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray>& ba, bool force) {
 
 	mExifImg = exifImgN;
 	mExifState = loaded;
+	indexMetaData();
 
 	return true;
 }
 
 QString DkMetaDataT::getDescription() const {
 
-	QString description;
-
-	if (mExifState != loaded && mExifState != dirty)
-		return description;
-
-	try {
-		Exiv2::ExifData &exifData = mExifImg->exifData();
-
-		if (!exifData.empty()) {
-
-			Exiv2::ExifKey key = Exiv2::ExifKey("Exif.Image.ImageDescription");
-			Exiv2::ExifData::iterator pos = exifData.findKey(key);
-
-			if (pos != exifData.end() && pos->count() != 0) {
-				description = exiv2ToQString(pos->toString());
-			}
-		}
-	}
-	catch (...) {
-
-		qDebug() << "[DkMetaDataT] Error: could not load description";
-		return description;
-	}
-
-	return description;
-
+	return indexedValue("Exif.Image.ImageDescription");
 }
 
 int DkMetaDataT::getOrientationDegree() const {
@@ -241,39 +232,18 @@ int DkMetaDataT::getOrientationDegree() const {
 	if (mExifState != loaded && mExifState != dirty)
 		return 0;
 
-	int orientation = 0;
-
-	try {
-		Exiv2::ExifData &exifData = mExifImg->exifData();
-
-		if (!exifData.empty()) {
-
-			Exiv2::ExifKey key = Exiv2::ExifKey("Exif.Image.Orientation");
-			Exiv2::ExifData::iterator pos = exifData.findKey(key);
-
-			if (pos != exifData.end() && pos->count() != 0) {
-			
-				Exiv2::Value::AutoPtr v = pos->getValue();
-				orientation = (int)pos->toFloat();
-
-				switch (orientation) {
-				case 6:		orientation = 90;	break;
-				case 7:		orientation = 90;	break;
-				case 3:		orientation = 180;	break;
-				case 4:		orientation = 180;	break;
-				case 8:		orientation = -90;	break;
-				case 5:		orientation = -90;	break;
-				case 1:		orientation = 0; 	break;
-				default:	orientation = -1;	break;
-				}	
-			}
-		}
-	}
-	catch(...) {
-		return 0;
+	switch (mOrientation) {
+	case -1:	return 0;	// not set
+	case 6:		return 90;
+	case 7:		return 90;
+	case 3:		return 180;
+	case 4:		return 180;
+	case 8:		return -90;
+	case 5:		return -90;
+	case 1:		return 0;
 	}
 
-	return orientation;
+	return -1;
 }
 
 DkMetaDataT::ExifOrientationState DkMetaDataT::checkExifOrientation() const {
@@ -281,7 +251,7 @@ DkMetaDataT::ExifOrientationState DkMetaDataT::checkExifOrientation() const {
 	if (mExifState != loaded && mExifState != dirty)
 		return or_not_set;
 
-	QString orStr = getNativeExifValue("Exif.Image.Orientation");
+	QString orStr = indexedValue("Exif.Image.Orientation");
 
 	if (orStr.isEmpty())
 		return or_not_set;
@@ -305,218 +275,208 @@ int DkMetaDataT::getRating() const {
 	if (mExifState != loaded && mExifState != dirty)
 		return -1;
 
-	float exifRating = -1;
-	float xmpRating = -1;
-	float fRating = 0;
-
-	Exiv2::ExifData &exifData = mExifImg->exifData();		//Exif.Image.Rating  - short
-	Exiv2::XmpData &xmpData = mExifImg->xmpData();			//Xmp.xmp.Rating - text
-
-	//get Rating of Exif Tag
-	if (!exifData.empty()) {
-		Exiv2::ExifKey key = Exiv2::ExifKey("Exif.Image.Rating");
-		Exiv2::ExifData::iterator pos = exifData.findKey(key);
-
-		if (pos != exifData.end() && pos->count() != 0) {
-			Exiv2::Value::AutoPtr v = pos->getValue();
-			exifRating = v->toFloat();
-		}
-	}
-
-	//get Rating of Xmp Tag
-	if (!xmpData.empty()) {
-		Exiv2::XmpKey key = Exiv2::XmpKey("Xmp.xmp.Rating");
-		Exiv2::XmpData::iterator pos = xmpData.findKey(key);
-
-		//xmp Rating tag
-		if (pos != xmpData.end() && pos->count() != 0) {
-			Exiv2::Value::AutoPtr v = pos->getValue();
-			xmpRating = v->toFloat();
-		}
+	return mRating;
+}
 
-		//if xmpRating not found, try to find MicrosoftPhoto Rating tag
-		if (xmpRating == -1) {
-			key = Exiv2::XmpKey("Xmp.MicrosoftPhoto.Rating");
-			pos = xmpData.findKey(key);
-			if (pos != xmpData.end() && pos->count() != 0) {
-				Exiv2::Value::AutoPtr v = pos->getValue();
-				xmpRating = v->toFloat();
-			}
-		}
-	}
+QSize DkMetaDataT::getImageSize() const {
 
-	if (xmpRating == -1.0f && exifRating != -1.0f)
-		fRating = exifRating;
-	else if (xmpRating != -1.0f && exifRating == -1.0f)
-		fRating = xmpRating;
-	else
-		fRating = exifRating;
+	if (mExifState != loaded && mExifState != dirty)
+		return QSize();
 
-	return qRound(fRating);
+	return mImageSize;
 }
 
-QSize DkMetaDataT::getImageSize() const {
-
-	QSize size;
+/**
+ * Returns the date when the image was taken (Exif DateTimeOriginal).
+ * The date is invalid if it is not set.
+ **/ 
+QDateTime DkMetaDataT::getDateTaken() const {
 
 	if (mExifState != loaded && mExifState != dirty)
-		return size;
-
-	bool ok = false;
-	int width = getNativeExifValue("Exif.Photo.PixelXDimension").toInt(&ok);
+		return QDateTime();
 
-	if (!ok)
-		return size;
+	return mDateTaken;
+}
 
-	int height = getNativeExifValue("Exif.Photo.PixelYDimension").toInt(&ok);
+bool DkMetaDataT::hasGPS() const {
 
-	if (!ok)
-		return size;
+	if (mExifState != loaded && mExifState != dirty)
+		return false;
 
-	return QSize(width, height);
+	return mHasGPS;
 }
 
 QString DkMetaDataT::getNativeExifValue(const QString& key) const {
 
-	QString info;
-
-	if (mExifState != loaded && mExifState != dirty)
-		return info;
+	bool large = false;
+	QString value = indexedValue(key, &large);
 
-	Exiv2::ExifData &exifData = mExifImg->exifData();
+	// diem: this is about performance - adobe obviously embeds whole images into tiff exiv data 
+	if (large)
+		return QObject::tr("<data too large to display>");
 
-	if (!exifData.empty()) {
-
-		Exiv2::ExifData::iterator pos;
+	return value;
+}
 
-		try {
-			Exiv2::ExifKey ekey = Exiv2::ExifKey(key.toStdString());
-			pos = exifData.findKey(ekey);
+QString DkMetaDataT::getXmpValue(const QString& key) const {
 
-		} catch(...) {
-			return info;
-		}
+	return indexedValue(key);
+}
 
-		if (pos != exifData.end() && pos->count() != 0) {
-			
-			if (pos->count () < 2000) {	// diem: this is about performance - adobe obviously embeds whole images into tiff exiv data 
+QString DkMetaDataT::getExifValue(const QString& key) const {
 
-				//qDebug() << "pos count: " << pos->count();
-				//Exiv2::Value::AutoPtr v = pos->getValue();
-				info = exiv2ToQString(pos->toString());
+	QString info = indexedValue("Exif.Image." + key);
 
-			}
-			else {
-				info = QObject::tr("<data too large to display>");
-			}
-		}
-			
-	}
+	if (info.isEmpty())
+		info = indexedValue("Exif.Photo." + key);
 
 	return info;
-
 }
 
-QString DkMetaDataT::getXmpValue(const QString& key) const {
-
-	QString info;
+QString DkMetaDataT::getIptcValue(const QString& key) const {
 
-	if (mExifState != loaded && mExifState != dirty)
-		return info;
+	return indexedValue(key);
+}
 
-	Exiv2::XmpData &xmpData = mExifImg->xmpData();
+/**
+ * Returns the value of an Exif, IPTC or XMP key.
+ * Values are converted when they are first queried and then indexed.
+ * Large values are not indexed - these are read from exiv2.
+ * @param key the exiv2 key (e.g. Exif.Image.Make)
+ * @param large if not NULL, large values are not converted but flagged
+ * @return QString the value or an empty string if the key does not exist.
+ **/ 
+QString DkMetaDataT::indexedValue(const QString& key, bool* large) const {
 
-	if (!xmpData.empty()) {
+	if (mExifState != loaded && mExifState != dirty)
+		return QString();
 
-		Exiv2::XmpData::iterator pos;
+	{
+		QMutexLocker locker(&mIndexMutex);
+		QHash<QString, QString>::const_iterator pos = mIndex.constFind(key);
 
-		try {
-			Exiv2::XmpKey ekey = Exiv2::XmpKey(key.toStdString());
-			pos = xmpData.findKey(ekey);
+		if (pos != mIndex.constEnd())
+			return *pos;
+	}
 
-		} catch(...) {
-			return info;
-		}
+	bool isLarge = false;
+	QString value = readValue(key, &isLarge);
 
-		if (pos != xmpData.end() && pos->count() != 0) {
-			Exiv2::Value::AutoPtr v = pos->getValue();
-			info = exiv2ToQString(pos->toString());
+	if (isLarge) {
+		if (large) {
+			*large = true;
+			return QString();
 		}
+		return readValue(key);
 	}
 
-	return info;
-}
-
-
-QString DkMetaDataT::getExifValue(const QString& key) const {
+	QMutexLocker locker(&mIndexMutex);
+	mIndex.insert(key, value);
 
-	QString info;
+	return value;
+}
 
-	if (mExifState != loaded && mExifState != dirty)
-		return info;
+/**
+ * Reads a single Exif, IPTC or XMP value from exiv2.
+ * @param key the exiv2 key
+ * @param large if not NULL, values with more than maxIndexedCount components are not converted but flagged
+ * @return QString the value or an empty string if the key does not exist.
+ **/ 
+QString DkMetaDataT::readValue(const QString& key, bool* large) const {
 
-	Exiv2::ExifData &exifData = mExifImg->exifData();
-	std::string sKey = key.toStdString();
+	std::string k = key.toStdString();
 
-	if (!exifData.empty()) {
+	try {
+		if (key.startsWith("Exif.")) {
+			const Exiv2::ExifData& exifData = mExifImg->exifData();
+			Exiv2::ExifData::const_iterator pos = exifData.findKey(Exiv2::ExifKey(k));
 
-		Exiv2::ExifData::iterator pos;
+			if (pos != exifData.end() && pos->count() != 0) {
 
-		try {
-			Exiv2::ExifKey ekey = Exiv2::ExifKey("Exif.Image." + sKey);
-			pos = exifData.findKey(ekey);
+				if (large && pos->count() >= maxIndexedCount) {
+					*large = true;
+					return QString();
+				}
 
-			if (pos == exifData.end() || pos->count() == 0) {
-				Exiv2::ExifKey lEkey = Exiv2::ExifKey("Exif.Photo." + sKey);	
-				pos = exifData.findKey(lEkey);
-			}
-		} catch(...) {
-			try {
-				sKey = "Exif.Photo." + sKey;
-				Exiv2::ExifKey ekey = Exiv2::ExifKey(sKey);	
-				pos = exifData.findKey(ekey);
-			} catch (... ) {
-				return "";
+				return exiv2ToQString(pos->toString());
 			}
 		}
+		else if (key.startsWith("Iptc.")) {
+			const Exiv2::IptcData& iptcData = mExifImg->iptcData();
+			Exiv2::IptcData::const_iterator pos = iptcData.findKey(Exiv2::IptcKey(k));
 
-		if (pos != exifData.end() && pos->count() != 0) {
-			//Exiv2::Value::AutoPtr v = pos->getValue();
-			info = exiv2ToQString(pos->toString());
+			if (pos != iptcData.end() && pos->count() != 0)
+				return exiv2ToQString(pos->toString());
 		}
-	}
+		else if (key.startsWith("Xmp.")) {
+			const Exiv2::XmpData& xmpData = mExifImg->xmpData();
+			Exiv2::XmpData::const_iterator pos = xmpData.findKey(Exiv2::XmpKey(k));
 
+			if (pos != xmpData.end() && pos->count() != 0)
+				return exiv2ToQString(pos->toString());
+		}
+	}
+	catch (...) {
+		// unknown tag or namespace
+		qDebug() << "[DkMetaDataT] could not read" << key;
+	}
 
-	return info;
+	return QString();
 }
 
-QString DkMetaDataT::getIptcValue(const QString& key) const {
+/**
+ * Resets the index and parses the typed values (e.g. orientation, rating).
+ * Other Exif, IPTC and XMP values are only converted if they are queried
+ * (see indexedValue()) - so large tags like MakerNotes are never converted.
+ * This needs to be called whenever the meta data changes.
+ **/ 
+void DkMetaDataT::indexMetaData() {
 
-	QString info;
+	{
+		QMutexLocker locker(&mIndexMutex);
+		mIndex.clear();
+	}
+
+	mOrientation = -1;
+	mRating = -1;
+	mImageSize = QSize();
+	mDateTaken = QDateTime();
+	mHasGPS = false;
 
 	if (mExifState != loaded && mExifState != dirty)
-		return info;
+		return;
 
-	Exiv2::IptcData &iptcData = mExifImg->iptcData();
+	bool ok = false;
+	float orientation = indexedValue("Exif.Image.Orientation").toFloat(&ok);
+	if (ok)
+		mOrientation = (int)orientation;
 
-	if (!iptcData.empty()) {
+	// rating: Exif.Image.Rating (short) or Xmp.xmp.Rating (text)
+	float exifRating = indexedValue("Exif.Image.Rating").toFloat(&ok);
+	if (!ok) exifRating = -1;
 
-		Exiv2::IptcData::iterator pos;
+	float xmpRating = indexedValue("Xmp.xmp.Rating").toFloat(&ok);
+	if (!ok) {
+		// if xmpRating not found, try to find MicrosoftPhoto Rating tag
+		xmpRating = indexedValue("Xmp.MicrosoftPhoto.Rating").toFloat(&ok);
+		if (!ok) xmpRating = -1;
+	}
 
-		try {
-			Exiv2::IptcKey ekey = Exiv2::IptcKey(key.toStdString());
-			pos = iptcData.findKey(ekey);
-		} catch (...) {
-			return info;
-		}
+	mRating = qRound(xmpRating != -1.0f && exifRating == -1.0f ? xmpRating : exifRating);
 
-		if (pos != iptcData.end() && pos->count() != 0) {
-			Exiv2::Value::AutoPtr v = pos->getValue();
-			info = exiv2ToQString(pos->toString());
-		}
+	// image size
+	int width = indexedValue("Exif.Photo.PixelXDimension").toInt(&ok);
+	if (ok) {
+		int height = indexedValue("Exif.Photo.PixelYDimension").toInt(&ok);
+		if (ok)
+			mImageSize = QSize(width, height);
 	}
 
-	return info;
+	mDateTaken = DkUtils::getConvertableDate(getExifValue("DateTimeOriginal"));
+
+	mHasGPS = 
+		!DkMetaDataHelper::getInstance().convertGpsCoordinates(indexedValue("Exif.GPSInfo.GPSLatitude")).isEmpty() &&
+		!DkMetaDataHelper::getInstance().convertGpsCoordinates(indexedValue("Exif.GPSInfo.GPSLongitude")).isEmpty();
 }
 
 void DkMetaDataT::getFileMetaData(QStringList& fileKeys, QStringList& fileValues) const {
@@ -954,6 +914,7 @@ void DkMetaDataT::setThumbnail(QImage thumb) {
 
 		mExifImg->setExifData(exifData);
 		mExifState = dirty;
+		indexMetaData();
 
 	} catch (...) {
 		qDebug() << "I could not save the thumbnail...";
@@ -1081,6 +1042,7 @@ void DkMetaDataT::setOrientation(int o) {
 	mExifImg->setExifData(exifData);
 
 	mExifState = dirty;
+	indexMetaData();
 }
 
 bool DkMetaDataT::setDescription(const QString& description) {
@@ -1143,6 +1105,7 @@ void DkMetaDataT::setRating(int r) {
 		mExifImg->setXmpData(xmpData);
 
 		mExifState = dirty;
+		indexMetaData();
 	}
 	catch (...) {
 		qDebug() << "[WARNING] I could not set the exif data for this image format...";
@@ -1204,6 +1167,9 @@ bool DkMetaDataT::setExifValue(QString key, QString taginfo) {
 		exifData.add(tag);
 	}
 
+	if (setExifSuccessfull)
+		indexMetaData();
+
 	return setExifSuccessfull;
 }
 
@@ -1299,6 +1265,7 @@ bool DkMetaDataT::saveRectToXMP(const DkRotatingRect& rect, const QSize& size) {
 	try {
 		mExifImg->setXmpData(xmpData);
 		mExifState = dirty;
+		indexMetaData();
 
 		qInfo() << r << "written to XMP";
 
@@ -1319,6 +1286,7 @@ bool DkMetaDataT::clearXMPRect() {
 	setXMPValue(xmpData, "Xmp.crs.HasCrop", "False");
 	mExifImg->setXmpData(xmpData);
 	mExifState = dirty;
+	indexMetaData();
 
 	return true;
 }
@@ -1783,7 +1751,7 @@ QString DkMetaDataHelper::resolveSpecialValue(QSharedPointer<DkMetaDataT> metaDa
 
 bool DkMetaDataHelper::hasGPS(QSharedPointer<DkMetaDataT> metaData) const {
 
-	return !getGpsCoordinates(metaData).isEmpty();
+	return metaData && metaData->hasGPS();
 }
 
 QStringList DkMetaDataHelper::getCamSearchTags() const {
@@ -1816,4 +1784,361 @@ QMap<int, QString> DkMetaDataHelper::getAllFlashModes() const {
 	return mFlashModes;
 }
 
+// DkMetaDataIndex --------------------------------------------------------------------
+DkMetaDataIndex& DkMetaDataIndex::instance() {
+
+	static DkMetaDataIndex inst;
+	return inst;
+}
+
+/**
+ * Returns the indexed entry of a file.
+ * @param file the image file
+ * @param e the entry which is only set if the file is indexed
+ * @return bool false if the file is not indexed or if it changed since.
+ **/ 
+bool DkMetaDataIndex::entry(const QFileInfo& file, Entry& e) const {
+
+	QString key = file.absoluteFilePath();
+	qint64 modified = file.lastModified().toMSecsSinceEpoch();
+	qint64 size = file.size();
+
+	QReadLocker locker(&mLock);
+	QHash<QString, Entry>::const_iterator it = mEntries.find(key);
+
+	if (it == mEntries.end() || it->modified != modified || it->size != size)
+		return false;
+
+	e = *it;
+	return true;
+}
+
+/**
+ * Indexes all files that are not indexed yet.
+ * The persisted index of the files' folders is loaded first, hence
+ * only new or changed files need to be read. These are read in parallel.
+ * This function blocks - run it in a thread.
+ * @param files the files to be indexed
+ * @param cancel indexing stops if this is set (files read so far are kept)
+ * @return bool true if entries were added to the index.
+ **/ 
+bool DkMetaDataIndex::update(const QFileInfoList& files, const QAtomicInt* cancel) {
+
+	QMutexLocker locker(&mUpdateMutex);
+	DkTimer dt;
+
+	QSet<QString> dirs;
+	for (const QFileInfo& file : files)
+		dirs.insert(file.absolutePath());
+
+	bool changed = false;
+	for (const QString& dirPath : dirs)
+		changed |= load(dirPath);
+
+	struct Job {
+		QFileInfo file;
+		Entry entry;
+		bool read = false;
+	};
+
+	QVector<Job> jobs;
+	for (const QFileInfo& file : files) {
+
+		Entry e;
+		if (!file.isFile() || entry(file, e))
+			continue;
+
+		Job job;
+		job.file = file;
+		jobs << job;
+	}
+
+	QtConcurrent::blockingMap(jobs, [cancel](Job& job) {
+
+		if (cancel && cancel->load())
+			return;
+
+		job.entry = readEntry(job.file);
+		job.read = true;
+	});
+
+	QSet<QString> dirtyDirs;
+	for (const Job& job : jobs) {
+
+		if (!job.read)
+			continue;
+
+		QWriteLocker wl(&mLock);
+		mEntries.insert(job.file.absoluteFilePath(), job.entry);
+		dirtyDirs.insert(job.file.absolutePath());
+	}
+
+	for (const QString& dirPath : dirtyDirs)
+		save(dirPath);
+
+	if (!dirtyDirs.isEmpty())
+		qInfo() << "[DkMetaDataIndex] meta data of" << files.size() << "files indexed in" << dt;
+
+	return changed || !dirtyDirs.isEmpty();
+}
+
+/**
+ * Reads the values that are indexed from the file's header.
+ * @param file the image file
+ * @return DkMetaDataIndex::Entry the entry (values are not set if the file has no meta data)
+ **/ 
+DkMetaDataIndex::Entry DkMetaDataIndex::readEntry(const QFileInfo& file) {
+
+	Entry e;
+	e.modified = file.lastModified().toMSecsSinceEpoch();
+	e.size = file.size();
+
+	try {
+#ifdef EXV_UNICODE_PATH
+		std::wstring strFilePath = (file.isSymLink()) ? (wchar_t*)file.symLinkTarget().utf16() : (wchar_t*)file.absoluteFilePath().utf16();
+#else
+		std::string strFilePath = (file.isSymLink()) ? file.symLinkTarget().toStdString() : file.absoluteFilePath().toStdString();
+#endif
+		Exiv2::Image::AutoPtr img = Exiv2::ImageFactory::open(strFilePath);
+
+		if (img.get() == 0)
+			return e;
+
+		img->readMetadata();
+
+		const Exiv2::ExifData& exifData = img->exifData();
+		const Exiv2::XmpData& xmpData = img->xmpData();
+
+		// we only look up the tags we need - nothing else is converted
+		auto exifValue = [&](const char* key) -> QString {
+			Exiv2::ExifData::const_iterator pos = exifData.findKey(Exiv2::ExifKey(key));
+			return pos != exifData.end() && pos->count() != 0 ? DkMetaDataT::exiv2ToQString(pos->toString()) : QString();
+		};
+
+		auto xmpValue = [&](const char* key) -> QString {
+			try {
+				Exiv2::XmpData::const_iterator pos = xmpData.findKey(Exiv2::XmpKey(key));
+				return pos != xmpData.end() && pos->count() != 0 ? DkMetaDataT::exiv2ToQString(pos->toString()) : QString();
+			}
+			catch (...) {
+				return QString();	// unknown namespace
+			}
+		};
+
+		QDateTime dateTaken = DkUtils::getConvertableDate(exifValue("Exif.Photo.DateTimeOriginal"));
+		if (dateTaken.isValid())
+			e.dateTaken = dateTaken.toMSecsSinceEpoch();
+
+		// same precedence as DkMetaDataT::getRating()
+		bool ok = false;
+		float exifRating = exifValue("Exif.Image.Rating").toFloat(&ok);
+		if (!ok) exifRating = -1;
+
+		float xmpRating = xmpValue("Xmp.xmp.Rating").toFloat(&ok);
+		if (!ok) {
+			xmpRating = xmpValue("Xmp.MicrosoftPhoto.Rating").toFloat(&ok);
+			if (!ok) xmpRating = -1;
+		}
+
+		e.rating = qRound(xmpRating != -1.0f && exifRating == -1.0f ? xmpRating : exifRating);
+
+		QString make = exifValue("Exif.Image.Make").trimmed();
+		QString model = exifValue("Exif.Image.Model").trimmed();
+
+		// most models contain the make already (e.g. Canon EOS 5D)
+		if (model.startsWith(make, Qt::CaseInsensitive))
+			e.camera = model;
+		else
+			e.camera = (make + " " + model).trimmed();
+	}
+	catch (...) {
+		qDebug() << "[DkMetaDataIndex] could not read meta data of" << file.fileName();
+	}
+
+	return e;
+}
+
+static QRegExp metaDataQueryExp() {
+	return QRegExp("^(rating|camera|taken)(<=|>=|:|=|<|>)(.+)$", Qt::CaseInsensitive);
+}
+
+/**
+ * Returns true if token is a meta data query.
+ * Supported queries are: rating>=3, rating:5, camera:canon, taken:2017-05, taken<2018
+ * @param token a single filter token
+ * @return bool true if token should be evaluated against the index.
+ **/ 
+bool DkMetaDataIndex::isQuery(const QString& token) {
+
+	return metaDataQueryExp().exactMatch(token);
+}
+
+/**
+ * Filters files using meta data queries (see isQuery()).
+ * Files that are not indexed yet are kept.
+ * @param files the files to be filtered
+ * @param queries all queries that must match
+ * @return QFileInfoList the matching files
+ **/ 
+QFileInfoList DkMetaDataIndex::filter(const QFileInfoList& files, const QStringList& queries) const {
+
+	if (queries.isEmpty())
+		return files;
+
+	QFileInfoList filtered;
+
+	for (const QFileInfo& file : files) {
+
+		Entry e;
+		bool keep = true;
+
+		if (entry(file, e)) {
+			for (const QString& q : queries) {
+				if (!matches(e, q)) {
+					keep = false;
+					break;
+				}
+			}
+		}
+
+		if (keep)
+			filtered << file;
+	}
+
+	return filtered;
+}
+
+bool DkMetaDataIndex::matches(const Entry& e, const QString& query) const {
+
+	QRegExp exp = metaDataQueryExp();
+
+	if (!exp.exactMatch(query))
+		return true;
+
+	QString key = exp.cap(1).toLower();
+	QString op = exp.cap(2);
+	QString val = exp.cap(3);
+
+	// compares an indexed value with the query's value
+	auto compare = [&](int cmp) -> bool {
+		if (op == "<")	return cmp < 0;
+		if (op == "<=") return cmp <= 0;
+		if (op == ">")	return cmp > 0;
+		if (op == ">=") return cmp >= 0;
+		return cmp == 0;
+	};
+
+	if (key == "rating") {
+		bool ok = false;
+		int r = val.toInt(&ok);
+		return !ok || compare(qMax(e.rating, 0) - r);
+	}
+	else if (key == "camera") {
+		return e.camera.contains(val, Qt::CaseInsensitive);
+	}
+	else if (key == "taken") {
+
+		if (e.dateTaken == 0)
+			return false;
+
+		// ISO dates can be compared as strings: taken:2017 matches all of 2017
+		QString date = QDateTime::fromMSecsSinceEpoch(e.dateTaken).toString("yyyy-MM-dd");
+		return compare(QString::compare(date.left(val.size()), val));
+	}
+
+	return true;
+}
+
+QString DkMetaDataIndex::indexFilePath(const QString& dirPath) {
+
+	QString hash = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Md5).toHex();
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata/" + hash + ".idx";
+}
+
+/**
+ * Loads the persisted index of a folder.
+ * Entries that are in memory already are not replaced.
+ * @param dirPath the folder's path
+ * @return bool true if entries were added.
+ **/ 
+bool DkMetaDataIndex::load(const QString& dirPath) {
+
+	if (mLoadedDirs.contains(dirPath))
+		return false;
+
+	mLoadedDirs.insert(dirPath);
+
+	QFile file(indexFilePath(dirPath));
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream ds(&file);
+	quint32 magic = 0, version = 0;
+	ds >> magic >> version;
+
+	if (magic != 0x4e4d4d49 || version != 1)	// NMMI
+		return false;
+
+	QDir dir(dirPath);
+	int numEntries = 0;
+	ds >> numEntries;
+
+	QWriteLocker locker(&mLock);
+	int numAdded = 0;
+
+	for (int idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+
+		QString fileName;
+		Entry e;
+		ds >> fileName >> e.modified >> e.size >> e.dateTaken >> e.rating >> e.camera;
+
+		QString key = dir.absoluteFilePath(fileName);
+		if (ds.status() == QDataStream::Ok && !mEntries.contains(key)) {
+			mEntries.insert(key, e);
+			numAdded++;
+		}
+	}
+
+	return numAdded > 0;
+}
+
+void DkMetaDataIndex::save(const QString& dirPath) const {
+
+	if (DkSettingsManager::param().app().privateMode)
+		return;
+
+	QString indexPath = indexFilePath(dirPath);
+	QDir().mkpath(QFileInfo(indexPath).absolutePath());
+
+	// a crash must not leave a broken index
+	QSaveFile file(indexPath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkMetaDataIndex] cannot write" << indexPath;
+		return;
+	}
+
+	QVector<QPair<QString, Entry> > entries;
+
+	{
+		QReadLocker locker(&mLock);
+		for (QHash<QString, Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++) {
+			QFileInfo fi(it.key());
+			if (fi.absolutePath() == dirPath)
+				entries << qMakePair(fi.fileName(), it.value());
+		}
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)0x4e4d4d49 << (quint32)1;
+	ds << entries.size();
+
+	for (const QPair<QString, Entry>& p : entries) {
+		const Entry& e = p.second;
+		ds << p.first << e.modified << e.size << e.dateTaken << e.rating << e.camera;
+	}
+
+	if (!file.commit())
+		qWarning() << "[DkMetaDataIndex] cannot write" << indexPath;
+}
+
 }
@@ -31,6 +31,14 @@
 #include <QSharedPointer>
 #include <QStringList>
 #include <QMap>
+#include <QHash>
+#include <QSize>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSet>
 
 //code for metadata crop:
 #include "DkMath.h"
@@ -88,6 +96,8 @@ public:
 	ExifOrientationState checkExifOrientation() const;
 	int getRating() const;
 	QSize getImageSize() const;
+	QDateTime getDateTaken() const;
+	bool hasGPS() const;
 	QString getDescription() const;
 	QVector2D getResolution() const;
 	QString getNativeExifValue(const QString& key) const;
@@ -136,6 +146,9 @@ public:
 
 protected:
 	Exiv2::Image::AutoPtr loadSidecar(const QString& filePath) const;
+	void indexMetaData();
+	QString indexedValue(const QString& key, bool* large = 0) const;
+	QString readValue(const QString& key, bool* large = 0) const;
 
 	enum {
 		not_loaded,
@@ -151,6 +164,19 @@ protected:
 
 	int mExifState = not_loaded;
 	bool mUseSidecar = false;
+
+	// Exif, IPTC & XMP key -> value of all keys that were queried (large values are not indexed)
+	mutable QHash<QString, QString> mIndex;
+	mutable QMutex mIndexMutex;
+
+	static const long maxIndexedCount = 2000;	// adobe embeds whole images into tiff exif data
+
+	// typed values which are parsed once per index
+	int mOrientation = -1;
+	int mRating = -1;
+	QSize mImageSize;
+	QDateTime mDateTaken;
+	bool mHasGPS = false;
 };
 
 class DllCoreExport DkMetaDataHelper {
@@ -200,4 +226,48 @@ protected:
 	QMap<int, QString> mFlashModes;
 };
 
+/**
+ * Folder-wide index of the meta data that is needed to sort & filter folders.
+ * Entries are read from the file header only (no image is decoded) and
+ * they are valid as long as the file's size & modification date do not change.
+ * The index of each folder is persisted in the cache location.
+ **/ 
+class DllCoreExport DkMetaDataIndex {
+
+public:
+	class Entry {
+
+	public:
+		qint64 modified = 0;	// ms since epoch
+		qint64 size = -1;
+		qint64 dateTaken = 0;	// ms since epoch, 0 if not set
+		int rating = -1;
+		QString camera;
+	};
+
+	static DkMetaDataIndex& instance();
+
+	bool entry(const QFileInfo& file, Entry& e) const;
+	bool update(const QFileInfoList& files, const QAtomicInt* cancel = 0);
+	static Entry readEntry(const QFileInfo& file);
+
+	static bool isQuery(const QString& token);
+	QFileInfoList filter(const QFileInfoList& files, const QStringList& queries) const;
+
+protected:
+	DkMetaDataIndex() {};
+	DkMetaDataIndex(DkMetaDataIndex const&);		// hide
+	void operator=(DkMetaDataIndex const&);		// hide
+
+	bool load(const QString& dirPath);
+	void save(const QString& dirPath) const;
+	static QString indexFilePath(const QString& dirPath);
+	bool matches(const Entry& e, const QString& query) const;
+
+	mutable QReadWriteLock mLock;
+	QHash<QString, Entry> mEntries;		// absolute file path -> entry
+	QSet<QString> mLoadedDirs;
+	QMutex mUpdateMutex;
+};
+
 };
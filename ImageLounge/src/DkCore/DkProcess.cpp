@@ -39,7 +39,16 @@
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QtConcurrentMap>
+#include <QtConcurrentRun>
+#include <QThread>
 #include <QWidget>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QCoreApplication>
 #pragma warning(pop)		// no warnings from includes - end
 
 #include <cassert>
@@ -361,18 +370,41 @@ bool DkManipulatorBatch::compute(QSharedPointer<DkImageContainer> container, QSt
 	}
 
 	if (container && container->hasImage()) {
+
+		QImage img = container->image();
+		QStringList applied;
+		DkPixelKernel kernel;
+
 		for (const QSharedPointer<DkBaseManipulator>& mpl : mManager.manipulators()) {
 
-			if (mpl->isSelected()) {
-				QImage img = mpl->apply(container->image());
-				if (!img.isNull()) {
-					container->setImage(img, mpl->name());
-					logStrings.append(QObject::tr("%1 %2 applied.").arg(name()).arg(mpl->name()));
-				}
-				else
-					logStrings.append(QObject::tr("%1 Cannot apply %2.").arg(name()).arg(mpl->name()));
+			if (!mpl->isSelected())
+				continue;
+
+			// point-wise manipulators are merged into a single pass
+			if (mpl->compile(kernel)) {
+				applied << mpl->name();
+				logStrings.append(QObject::tr("%1 %2 applied.").arg(name()).arg(mpl->name()));
+				continue;
 			}
+
+			// spatial manipulators need the result of all previous ones
+			img = kernel.apply(img);
+			kernel.clear();
+
+			QImage mImg = mpl->apply(img);
+			if (!mImg.isNull()) {
+				img = mImg;
+				applied << mpl->name();
+				logStrings.append(QObject::tr("%1 %2 applied.").arg(name()).arg(mpl->name()));
+			}
+			else
+				logStrings.append(QObject::tr("%1 Cannot apply %2.").arg(name()).arg(mpl->name()));
 		}
+
+		img = kernel.apply(img);
+
+		if (!applied.empty())
+			container->setImage(img, applied.join(", "));
 	}
 	
 	if (!container || !container->hasImage()) {
@@ -632,6 +664,11 @@ QString DkBatchProcess::outputFile() const {
 	return mSaveInfo.outputFilePath();
 }
 
+QString DkBatchProcess::outputHash() const {
+
+	return mOutputHash;
+}
+
 QVector<QSharedPointer<DkBatchInfo> > DkBatchProcess::batchInfo() const {
 
 	return mInfos;
@@ -647,9 +684,72 @@ bool DkBatchProcess::wasProcessed() const {
 	return mIsProcessed;
 }
 
-bool DkBatchProcess::compute() {
+bool DkBatchProcess::wasCompletedBefore() const {
+
+	return mCompletedBefore;
+}
+
+/**
+ * Marks the item as processed without computing it.
+ * This is used for items that an interrupted run completed (see DkBatchJournal).
+ **/ 
+void DkBatchProcess::setCompletedBefore() {
 
+	mLogStrings.append(QObject::tr("%1 was completed in a previous run -> skipping").arg(mSaveInfo.inputFilePath()));
+	mLogStrings.append(QObject::tr("Output: %1").arg(mSaveInfo.outputFilePath()));
+	mCompletedBefore = true;
 	mIsProcessed = true;
+}
+
+bool DkBatchProcess::compute() {
+
+	for (int stage = stage_read; stage < stage_end; stage++) {
+
+		if (!compute(stage))
+			break;
+	}
+
+	return mFailure == 0;
+}
+
+/**
+ * Runs a single stage of the batch process.
+ * @param stage the stage to run (stage_read | ... | stage_write)
+ * @return bool true if the item needs to be passed to the next stage.
+ **/ 
+bool DkBatchProcess::compute(int stage) {
+
+	bool next = false;
+
+	switch (stage) {
+	case stage_read:	next = readFile();	break;
+	case stage_decode:	next = decode();	break;
+	case stage_process:	next = process();	break;
+	case stage_encode:	next = encode();	break;
+	case stage_write:	writeFile();		break;
+	}
+
+	// we are done
+	if (!next) {
+		release();
+		mIsProcessed = true;
+	}
+
+	return next;
+}
+
+void DkBatchProcess::release() {
+
+	mImgC.clear();
+	mBuffer.clear();
+}
+
+QStringList DkBatchProcess::getLog() const {
+
+	return mLogStrings;
+}
+
+bool DkBatchProcess::readFile() {
 
 	QFileInfo fInfoIn(mSaveInfo.inputFilePath());
 	QFileInfo fInfoOut(mSaveInfo.outputFilePath());
@@ -659,18 +759,18 @@ bool DkBatchProcess::compute() {
 		(fInfoOut.exists() && mSaveInfo.mode() == DkSaveInfo::mode_skip_existing)) {
 		mLogStrings.append(QObject::tr("%1 already exists -> skipping (check 'overwrite' if you want to overwrite the file)").arg(mSaveInfo.outputFilePath()));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	else if (!fInfoIn.exists()) {
 		mLogStrings.append(QObject::tr("Error: input file does not exist"));
 		mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	else if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && mProcessFunctions.empty()) {
 		mLogStrings.append(QObject::tr("Skipping: nothing to do here."));
 		mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	
 	// rename operation?
@@ -679,7 +779,7 @@ bool DkBatchProcess::compute() {
 		fInfoIn.suffix() == fInfoOut.suffix()) {
 		if (!renameFile())
 			mFailure++;
-		return mFailure == 0;
+		return false;
 	}
 	// copy operation?
 	else if (mProcessFunctions.empty() && fInfoIn.suffix() == fInfoOut.suffix()) {
@@ -688,32 +788,33 @@ bool DkBatchProcess::compute() {
 		else
 			deleteOriginalFile();
 
-		return mFailure == 0;
+		return false;
 	}
 
-	// do the work
-	process();
-
-	return mFailure == 0;
-}
+	mLogStrings.append(QObject::tr("processing %1").arg(mSaveInfo.inputFilePath()));
 
-QStringList DkBatchProcess::getLog() const {
+	mImgC = QSharedPointer<DkImageContainer>(new DkImageContainer(mSaveInfo.inputFilePath()));
+	mImgC->setFileBuffer(mImgC->loadFileToBuffer(mSaveInfo.inputFilePath()));
 
-	return mLogStrings;
+	return true;
 }
 
-bool DkBatchProcess::process() {
+bool DkBatchProcess::decode() {
 
-	mLogStrings.append(QObject::tr("processing %1").arg(mSaveInfo.inputFilePath()));
-
-	QSharedPointer<DkImageContainer> imgC(new DkImageContainer(mSaveInfo.inputFilePath()));
-
-	if (!imgC->loadImage() || imgC->image().isNull()) {
+	if (!mImgC->loadImage() || mImgC->image().isNull()) {
 		mLogStrings.append(QObject::tr("Error while loading..."));
 		mFailure++;
 		return false;
 	}
 
+	// the file buffer is not needed anymore
+	mImgC->setFileBuffer(QSharedPointer<QByteArray>());
+
+	return true;
+}
+
+bool DkBatchProcess::process() {
+
 	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
 
 		if (!batch) {
@@ -722,7 +823,7 @@ bool DkBatchProcess::process() {
 		}
 
 		QVector<QSharedPointer<DkBatchInfo> > cInfos;
-		if (!batch->compute(imgC, mSaveInfo, mLogStrings, cInfos)) {
+		if (!batch->compute(mImgC, mSaveInfo, mLogStrings, cInfos)) {
 			mLogStrings.append(QObject::tr("%1 failed").arg(batch->name()));
 			mFailure++;
 		}
@@ -730,6 +831,11 @@ bool DkBatchProcess::process() {
 		mInfos << cInfos;
 	}
 
+	return true;
+}
+
+bool DkBatchProcess::encode() {
+
 	// report we could not back-up & break here
 	if (!prepareDeleteExisting()) {
 		mFailure++;
@@ -739,13 +845,37 @@ bool DkBatchProcess::process() {
 	// early break
 	if (mSaveInfo.mode() & DkSaveInfo::mode_do_not_save_output) {
 		mLogStrings.append(QObject::tr("%1 not saved - option 'Do not Save' is checked...").arg(mSaveInfo.outputFilePath()));
-		return true;
+		return false;
+	}
+
+	if (!mImgC->getLoader()->saveToBuffer(mSaveInfo.outputFilePath(), mImgC->image(), mBuffer, mSaveInfo.compression()) || 
+		!mBuffer || mBuffer->isEmpty()) {
+		mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
+		mFailure++;
+
+		if (!deleteOrRestoreExisting())
+			mFailure++;
+
+		return false;
 	}
 
-	if (imgC->saveImage(mSaveInfo.outputFilePath(), mSaveInfo.compression())) {
+	// free the image - just the encoded buffer is kept
+	mImgC.clear();
+
+	return true;
+}
+
+bool DkBatchProcess::writeFile() {
+
+	// the file is replaced (not truncated) - buffers that map the old file stay valid
+	QSaveFile file(mSaveInfo.outputFilePath());
+
+	if (file.open(QIODevice::WriteOnly) && file.write(*mBuffer) == mBuffer->size() && file.commit()) {
+		mOutputHash = QCryptographicHash::hash(*mBuffer, QCryptographicHash::Sha1).toHex();
 		mLogStrings.append(QObject::tr("%1 saved...").arg(mSaveInfo.outputFilePath()));
 	}
 	else {
+		file.cancelWriting();	// don't keep partially written files
 		mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
 		mFailure++;
 	}
@@ -885,6 +1015,475 @@ bool DkBatchProcess::deleteOriginalFile() {
 	return true;
 }
 
+// DkBatchQueue --------------------------------------------------------------------
+DkBatchQueue::DkBatchQueue(int capacity) {
+	mCapacity = qMax(capacity, 1);
+}
+
+/**
+ * Appends an item and blocks while the queue is full.
+ * @param idx the batch item index
+ * @return bool false if the queue was closed.
+ **/ 
+bool DkBatchQueue::push(int idx) {
+
+	QMutexLocker locker(&mMutex);
+
+	while (mItems.size() >= mCapacity && !mClosed)
+		mNotFull.wait(&mMutex);
+
+	if (mClosed)
+		return false;
+
+	mItems.enqueue(idx);
+	mNotEmpty.wakeOne();
+
+	return true;
+}
+
+/**
+ * Takes the next item and blocks while the queue is empty.
+ * @param idx the batch item index
+ * @return bool false if the queue is closed and all items are taken.
+ **/ 
+bool DkBatchQueue::pop(int& idx) {
+
+	QMutexLocker locker(&mMutex);
+
+	while (mItems.empty() && !mClosed)
+		mNotEmpty.wait(&mMutex);
+
+	if (mItems.empty())
+		return false;
+
+	idx = mItems.dequeue();
+	mNotFull.wakeOne();
+
+	return true;
+}
+
+void DkBatchQueue::close() {
+
+	QMutexLocker locker(&mMutex);
+	mClosed = true;
+	mNotEmpty.wakeAll();
+	mNotFull.wakeAll();
+}
+
+int DkBatchQueue::size() const {
+
+	QMutexLocker locker(&mMutex);
+	return mItems.size();
+}
+
+int DkBatchQueue::capacity() const {
+	return mCapacity;
+}
+
+// DkBatchJournal --------------------------------------------------------------------
+DkBatchJournal::DkBatchJournal(const QString& filePath) : mFilePath(filePath), mFile(filePath) {
+}
+
+/**
+ * Opens the journal for writing.
+ * @param resume if true, the entries of a previous run are kept and indexed, otherwise they are discarded
+ * @return bool true if the journal can be written
+ **/ 
+bool DkBatchJournal::open(bool resume) {
+
+	QMutexLocker locker(&mMutex);
+	mCompleted.clear();
+
+	if (resume && mFile.open(QIODevice::ReadOnly)) {
+
+		QTextStream s(&mFile);
+		s.setCodec("UTF-8");
+
+		while (!s.atEnd()) {
+
+			// a broken (last) line is ignored - the item is simply processed again
+			QStringList entry = s.readLine().split('\t');
+
+			if (entry.size() == 4 && entry[0] == "ok")
+				mCompleted.insert(entry[2], qMakePair(entry[3], entry[1]));
+		}
+
+		mFile.close();
+	}
+
+	QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::Text;
+	mode |= resume ? QIODevice::Append : QIODevice::Truncate;
+
+	if (!mFile.open(mode)) {
+		qWarning() << "[Batch] cannot write journal to" << mFilePath << mFile.errorString();
+		return false;
+	}
+
+	return true;
+}
+
+void DkBatchJournal::append(const DkBatchProcess& item) {
+
+	QMutexLocker locker(&mMutex);
+
+	if (!mFile.isOpen())
+		return;
+
+	QString line = QString("%1\t%2\t%3\t%4\n")
+		.arg(item.hasFailed() ? "failed" : "ok")
+		.arg(item.outputHash())
+		.arg(item.inputFile())
+		.arg(item.outputFile());
+
+	mFile.write(line.toUtf8());
+	mFile.flush();
+}
+
+/**
+ * Returns true if the item was successfully processed in a previous run
+ * and its output still exists.
+ **/ 
+/**
+ * Returns true if the item was completed by a previous run.
+ * Outputs that were truncated or replaced in the meantime
+ * do not match their SHA-1 hash anymore - these items are computed again.
+ * Copied or renamed files have no hash - for them, we just check that the output exists.
+ **/ 
+bool DkBatchJournal::isCompleted(const DkBatchProcess& item) const {
+
+	QPair<QString, QString> entry = mCompleted.value(item.inputFile());
+	QString outputPath = entry.first;
+
+	if (outputPath.isEmpty() || outputPath != item.outputFile() || !QFileInfo(outputPath).exists())
+		return false;
+
+	if (!entry.second.isEmpty() && hashFile(outputPath) != entry.second) {
+		qInfo() << "[Batch]" << outputPath << "changed since the previous run - processing it again";
+		return false;
+	}
+
+	return true;
+}
+
+QString DkBatchJournal::hashFile(const QString& filePath) {
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+		return QString();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(&file);
+
+	return hash.result().toHex();
+}
+
+int DkBatchJournal::numCompleted() const {
+	return mCompleted.size();
+}
+
+QString DkBatchJournal::filePath() const {
+	return mFilePath;
+}
+
+QString DkBatchJournal::journalPath(const QString& settingsPath) {
+
+	QFileInfo fi(settingsPath);
+	return QFileInfo(fi.absolutePath(), fi.completeBaseName() + ".journal").absoluteFilePath();
+}
+
+// DkBatchWorkQueue --------------------------------------------------------------------
+DkBatchWorkQueue::DkBatchWorkQueue(const QString& settingsPath, int chunkSize) : mDir(queuePath(settingsPath)) {
+
+	mChunkSize = qMax(chunkSize, 1);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+	QString host = QSysInfo::machineHostName();
+#else
+	QString host = QString::fromLocal8Bit(qgetenv("HOSTNAME"));
+#endif
+
+	mWorkerId = QString("%1-%2").arg(host).arg(QCoreApplication::applicationPid());
+}
+
+/**
+ * Opens the queue - it is created by the first worker.
+ * @param numItems the number of items of the batch profile
+ * @return bool false if the queue cannot be created or belongs to a different batch
+ **/ 
+bool DkBatchWorkQueue::open(int numItems) {
+
+	if (!mDir.mkpath(".")) {
+		qCritical() << "[Batch] cannot create the work queue:" << mDir.absolutePath();
+		return false;
+	}
+
+	QString iniPath = mDir.absoluteFilePath("queue.ini");
+
+	// all workers might start at once: each stages the todo markers in a private folder
+	// and just the one that renames it to todo first creates the queue
+	// (a lock file could be broken by other nodes if the share is slow - a rename cannot)
+	if (!QFileInfo(iniPath).exists()) {
+
+		int numChunks = (numItems + mChunkSize - 1) / mChunkSize;
+		QString staging = "todo." + mWorkerId;
+		mDir.mkpath(staging);
+
+		for (int idx = 0; idx < numChunks; idx++) {
+			QFile marker(markerPath(staging, idx));
+			marker.open(QIODevice::WriteOnly);
+		}
+
+		if (mDir.rename(staging, "todo")) {
+
+			for (const QString& state : QStringList() << "claimed" << "done" << "results")
+				mDir.mkpath(state);
+
+			// written last: the queue is valid once the ini exists
+			QSaveFile iniFile(iniPath);
+			iniFile.open(QIODevice::WriteOnly);
+			QTextStream ts(&iniFile);
+			ts << "[General]\n";
+			ts << "NumItems=" << numItems << "\n";
+			ts << "ChunkSize=" << mChunkSize << "\n";
+			ts << "NumChunks=" << numChunks << "\n";
+			ts.flush();
+
+			if (!iniFile.commit()) {
+				qCritical() << "[Batch] cannot write" << iniPath;
+				return false;
+			}
+
+			qInfo() << "[Batch]" << numChunks << "chunks created in" << mDir.absolutePath();
+		}
+		else
+			QDir(mDir.absoluteFilePath(staging)).removeRecursively();	// another worker was faster
+	}
+
+	// the worker that created the queue might still be writing the ini
+	for (int idx = 0; idx < 300 && !QFileInfo(iniPath).exists(); idx++)
+		QThread::msleep(100);
+
+	if (!QFileInfo(iniPath).exists()) {
+		qCritical() << "[Batch] the work queue" << mDir.absolutePath() << "is incomplete - please delete it";
+		return false;
+	}
+
+	QSettings settings(iniPath, QSettings::IniFormat);
+	mChunkSize = settings.value("ChunkSize", mChunkSize).toInt();
+	mNumChunks = settings.value("NumChunks", mNumChunks).toInt();
+
+	if (settings.value("NumItems", -1).toInt() != numItems) {
+		qCritical() << "[Batch] the work queue" << mDir.absolutePath() << "belongs to a different batch - please delete it";
+		return false;
+	}
+
+	return mNumChunks > 0;
+}
+
+/**
+ * Claims the next chunk.
+ * Claims of workers that did not send a heartbeat are reclaimed.
+ * @return int the chunk's index or -1 if no chunk is available
+ **/ 
+int DkBatchWorkQueue::claim() {
+
+	for (int tries = 0; tries < 2; tries++) {
+
+		QStringList todo = QDir(mDir.absoluteFilePath("todo")).entryList(QDir::Files, QDir::Name);
+
+		for (const QString& name : todo) {
+
+			int chunk = name.toInt();
+
+			// rename is atomic - only one worker succeeds
+			if (QFile::rename(markerPath("todo", chunk), markerPath("claimed", chunk))) {
+				heartbeat(chunk);
+				return chunk;
+			}
+		}
+
+		if (!reclaim())
+			break;
+	}
+
+	return -1;
+}
+
+void DkBatchWorkQueue::heartbeat(int chunk) const {
+
+	// we lost the claim - do not create it again
+	if (!QFileInfo(markerPath("claimed", chunk)).exists())
+		return;
+
+	QFile marker(markerPath("claimed", chunk));
+
+	if (marker.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		marker.write(QString("%1\t%2").arg(mWorkerId).arg(QDateTime::currentDateTimeUtc().toString(Qt::ISODate)).toUtf8());
+}
+
+/**
+ * Moves chunks back to the todo list if their workers stopped sending heartbeats.
+ * @return int the number of reclaimed chunks
+ **/ 
+int DkBatchWorkQueue::reclaim() {
+
+	int numReclaimed = 0;
+	QDateTime now = QDateTime::currentDateTime();
+	QFileInfoList claimed = QDir(mDir.absoluteFilePath("claimed")).entryInfoList(QDir::Files, QDir::Name);
+
+	for (const QFileInfo& fi : claimed) {
+
+		// allow for some clock skew between the machines
+		if (fi.lastModified().msecsTo(now) < 10 * heartbeatInterval())
+			continue;
+
+		int chunk = fi.fileName().toInt();
+
+		if (QFile::rename(fi.absoluteFilePath(), markerPath("todo", chunk))) {
+			qInfo() << "[Batch] reclaimed chunk" << chunk << "- the worker stopped" << fi.lastModified().msecsTo(now) / 1000 << "sec ago";
+			numReclaimed++;
+		}
+	}
+
+	return numReclaimed;
+}
+
+/**
+ * Saves the chunk's log and batch infos and marks it as done.
+ **/ 
+void DkBatchWorkQueue::finish(int chunk, const DkBatchProcessing& process) {
+
+	// results first - the done marker indicates that they are complete
+	QSaveFile logFile(markerPath("results", chunk) + ".log");
+	if (logFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		logFile.write(process.getLog().join("\n").toUtf8());
+		logFile.commit();
+	}
+
+	QSaveFile infoFile(markerPath("results", chunk) + ".info");
+	if (infoFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		
+		for (const QSharedPointer<DkBatchInfo>& info : process.batchInfo()) {
+			if (info)
+				infoFile.write(QString("%1\t%2\n").arg(info->id()).arg(info->filePath()).toUtf8());
+		}
+		infoFile.commit();
+	}
+
+	// the chunk might have been reclaimed meanwhile - it is finished anyway
+	if (!QFile::rename(markerPath("claimed", chunk), markerPath("done", chunk)))
+		QFile::rename(markerPath("todo", chunk), markerPath("done", chunk));
+
+	QFile marker(markerPath("done", chunk));
+	if (marker.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		marker.write(QString("%1\t%2").arg(mWorkerId).arg(process.getNumFailures()).toUtf8());
+}
+
+bool DkBatchWorkQueue::isFinished() const {
+	return QDir(mDir.absoluteFilePath("done")).entryList(QDir::Files).size() >= mNumChunks;
+}
+
+/**
+ * Merges the logs and calls postLoad on the merged batch infos.
+ * This is done once by the first worker that calls it on a finished queue.
+ * Only the id and file path of the batch infos are shared between the workers.
+ * @param config the batch configuration
+ * @param logPath the merged log is written to this file (optional)
+ * @return bool true if this worker merged the results
+ **/ 
+bool DkBatchWorkQueue::merge(const DkBatchConfig& config, const QString& logPath) {
+
+	if (!isFinished())
+		return false;
+
+	QLockFile lock(mDir.absoluteFilePath("merge.lock"));
+	
+	if (!lock.tryLock() || QFileInfo(mDir.absoluteFilePath("merged")).exists())
+		return false;
+
+	QStringList log;
+	QVector<QSharedPointer<DkBatchInfo> > infos;
+	mNumFailures = 0;
+
+	for (int idx = 0; idx < mNumChunks; idx++) {
+
+		QFile marker(markerPath("done", idx));
+		if (marker.open(QIODevice::ReadOnly))
+			mNumFailures += QString::fromUtf8(marker.readAll()).section('\t', 1).toInt();
+
+		QFile logFile(markerPath("results", idx) + ".log");
+		if (logFile.open(QIODevice::ReadOnly | QIODevice::Text))
+			log << QString::fromUtf8(logFile.readAll());
+
+		QFile infoFile(markerPath("results", idx) + ".info");
+		if (infoFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+			
+			QStringList lines = QString::fromUtf8(infoFile.readAll()).split('\n', QString::SkipEmptyParts);
+
+			for (const QString& line : lines)
+				infos << QSharedPointer<DkBatchInfo>(new DkBatchInfo(line.section('\t', 0, 0), line.section('\t', 1)));
+		}
+	}
+
+	for (QSharedPointer<DkAbstractBatch> fun : config.getProcessFunctions())
+		fun->postLoad(infos);
+
+	if (!logPath.isEmpty()) {
+
+		QDir().mkpath(QFileInfo(logPath).absolutePath());
+
+		QFile file(logPath);
+		if (!file.open(QIODevice::WriteOnly))
+			qWarning() << "Sorry, I could not write to" << logPath;
+		else {
+			file.write(log.join("\n").toUtf8());
+			qInfo() << "log written to: " << logPath;
+		}
+	}
+
+	QFile merged(mDir.absoluteFilePath("merged"));
+	merged.open(QIODevice::WriteOnly);
+
+	qInfo() << "[Batch] results of" << mNumChunks << "chunks merged," << mNumFailures << "errors";
+
+	return true;
+}
+
+int DkBatchWorkQueue::numChunks() const {
+	return mNumChunks;
+}
+
+int DkBatchWorkQueue::chunkSize() const {
+	return mChunkSize;
+}
+
+int DkBatchWorkQueue::numFailures() const {
+	return mNumFailures;
+}
+
+QString DkBatchWorkQueue::workerId() const {
+	return mWorkerId;
+}
+
+QString DkBatchWorkQueue::markerPath(const QString& state, int chunk) const {
+	return mDir.absoluteFilePath(state + "/" + QString("%1").arg(chunk, 5, 10, QChar('0')));
+}
+
+QString DkBatchWorkQueue::queuePath(const QString& settingsPath) {
+
+	QFileInfo fi(settingsPath);
+	return QFileInfo(fi.absolutePath(), fi.completeBaseName() + ".queue").absoluteFilePath();
+}
+
+/**
+ * Returns the heartbeat interval in ms.
+ * Claims are reclaimed if they were not refreshed for 10 intervals.
+ **/ 
+int DkBatchWorkQueue::heartbeatInterval() {
+	return 30000;
+}
+
 // DkBatchConfig --------------------------------------------------------------------
 DkBatchConfig::DkBatchConfig(const QStringList& fileList, const QString& outputDir, const QString& fileNamePattern) {
 
@@ -921,8 +1520,10 @@ DkBatchProcessing::DkBatchProcessing(const DkBatchConfig& config, QWidget* paren
 
 	mBatchConfig = config;
 
-	connect(&mBatchWatcher, SIGNAL(progressValueChanged(int)), this, SIGNAL(progressValueChanged(int)));
 	connect(&mBatchWatcher, SIGNAL(finished()), this, SIGNAL(finished()));
+
+	for (int idx = 0; idx < DkBatchProcess::stage_end; idx++)
+		mPools[idx].setMaxThreadCount(numWorkers(idx));
 }
 
 void DkBatchProcessing::init() {
@@ -931,7 +1532,10 @@ void DkBatchProcessing::init() {
 	
 	QStringList fileList = mBatchConfig.getFileList();
 
-	for (int idx = 0; idx < fileList.size(); idx++) {
+	// the item index is kept global so that the file name pattern's counter is not affected by ranges
+	int lastItem = mNumRangeItems < 0 ? fileList.size() : qMin(mFirstItem + mNumRangeItems, fileList.size());
+
+	for (int idx = qMax(mFirstItem, 0); idx < lastItem; idx++) {
 
 		DkSaveInfo si = mBatchConfig.saveInfo();
 
@@ -1001,14 +1605,28 @@ void DkBatchConfig::loadSettings(QSettings & settings) {
 
 void DkBatchProcessing::compute() {
 
+	if (mBatchWatcher.isRunning())
+		mBatchWatcher.waitForFinished();
+
 	init();
 
 	qDebug() << "computing...";
 
-	if (mBatchWatcher.isRunning())
-		mBatchWatcher.waitForFinished();
+	// the stages are connected with bounded queues: at most 2 items per worker are waiting
+	// decoded images are large, so just one per worker may wait after decoding
+	mQueues.clear();
+	for (int idx = 0; idx < DkBatchProcess::stage_end; idx++)
+		mQueues << QSharedPointer<DkBatchQueue>(new DkBatchQueue(holdsImage(idx) && idx != DkBatchProcess::stage_decode ? numWorkers(idx) : 2 * numWorkers(idx)));
+
+	// in total, not more images are decoded than we have cores (like the former QtConcurrent::map)
+	mImageSlots = QSharedPointer<QSemaphore>(new QSemaphore(numWorkers(DkBatchProcess::stage_decode)));
 
-	QFuture<void> future = QtConcurrent::map(mBatchItems, &nmc::DkBatchProcessing::computeItem);
+	mNumFinished = 0;
+	mCanceled = 0;
+	mPipelineTimer.start();
+	mBatchItems.detach();	// the workers access the items concurrently - so it must not be shared
+
+	QFuture<void> future = QtConcurrent::run(this, &nmc::DkBatchProcessing::runPipeline);
 	mBatchWatcher.setFuture(future);
 }
 
@@ -1017,21 +1635,132 @@ bool DkBatchProcessing::computeItem(DkBatchProcess& item) {
 	return item.compute();
 }
 
+/**
+ * Returns the number of threads assigned to a pipeline stage.
+ * Reading & writing are I/O bound - decoding, processing and encoding are CPU bound.
+ * @param stage the pipeline stage
+ * @return int the number of workers
+ **/ 
+int DkBatchProcessing::numWorkers(int stage) {
+
+	int numCores = qMax(QThread::idealThreadCount(), 1);
+
+	switch (stage) {
+	case DkBatchProcess::stage_read:
+	case DkBatchProcess::stage_write:
+		return 2;
+	case DkBatchProcess::stage_encode:
+		return qMax(numCores / 2, 1);
+	}
+
+	return numCores;
+}
+
+/**
+ * Returns true if items hold a decoded image while they are in this stage (or its input queue).
+ * @param stage the pipeline stage
+ **/ 
+bool DkBatchProcessing::holdsImage(int stage) {
+
+	return stage >= DkBatchProcess::stage_decode && stage <= DkBatchProcess::stage_encode;
+}
+
+void DkBatchProcessing::runPipeline() {
+
+	for (int idx = 0; idx < DkBatchProcess::stage_end; idx++) {
+
+		int nw = numWorkers(idx);
+		mNumWorkers[idx] = nw;
+
+		for (int wIdx = 0; wIdx < nw; wIdx++)
+			QtConcurrent::run(&mPools[idx], this, &nmc::DkBatchProcessing::runStage, idx);
+	}
+
+	// feed the pipeline - this blocks if the readers are busy
+	for (int idx = 0; idx < mBatchItems.size() && !mCanceled; idx++) {
+
+		// skip items that were finished by an interrupted run
+		if (mJournal && mJournal->isCompleted(mBatchItems.at(idx))) {
+			mBatchItems[idx].setCompletedBefore();
+			emit progressValueChanged(mNumFinished.fetchAndAddOrdered(1) + 1);
+			continue;
+		}
+
+		mQueues[DkBatchProcess::stage_read]->push(idx);
+	}
+
+	mQueues[DkBatchProcess::stage_read]->close();
+
+	for (QThreadPool& pool : mPools)
+		pool.waitForDone();
+
+	qInfo() << "[Batch]" << getPipelineStats();
+}
+
+void DkBatchProcessing::runStage(int stage) {
+
+	int idx = 0;
+
+	while (mQueues[stage]->pop(idx)) {
+
+		DkBatchProcess& item = mBatchItems[idx];
+
+		// drain the queues if the user canceled
+		if (mCanceled) {
+			if (holdsImage(stage) && stage != DkBatchProcess::stage_decode)
+				mImageSlots->release();
+			item.release();
+			continue;
+		}
+
+		// blocks until another item's image is encoded
+		if (stage == DkBatchProcess::stage_decode)
+			mImageSlots->acquire();
+
+		bool next = item.compute(stage);
+
+		// the image is freed after encoding (or if the item is done earlier)
+		if (holdsImage(stage) && (!next || stage == DkBatchProcess::stage_encode))
+			mImageSlots->release();
+
+		if (next) {
+			mQueues[stage + 1]->push(idx);
+			continue;
+		}
+
+		if (mJournal)
+			mJournal->append(item);
+
+		emit progressValueChanged(mNumFinished.fetchAndAddOrdered(1) + 1);
+	}
+
+	// the last worker closes the next stage
+	if (!mNumWorkers[stage].deref() && stage + 1 < DkBatchProcess::stage_end)
+		mQueues[stage + 1]->close();
+}
+
 void DkBatchProcessing::postLoad() {
 
+	QVector<QSharedPointer<DkBatchInfo> > infos = batchInfo();
+
+	for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions()) {
+		fun->postLoad(infos);
+	}
+}
+
+QVector<QSharedPointer<DkBatchInfo> > DkBatchProcessing::batchInfo() const {
+
 	// collect batch infos
 	QVector<QSharedPointer<DkBatchInfo> > batchInfo;
 
-	for (DkBatchProcess batch : mBatchItems) {
+	for (const DkBatchProcess& batch : mBatchItems) {
 		batchInfo << batch.batchInfo();
 	}
 
-	for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions()) {
-		fun->postLoad(batchInfo);
-	}
+	return batchInfo;
 }
 
-void DkBatchProcessing::computeBatch(const QString& settingsPath, const QString& logPath) {
+bool DkBatchProcessing::computeBatch(const QString& settingsPath, const QString& logPath, bool resume) {
 
 	DkTimer dt;
 	DkBatchConfig bc = DkBatchProfile::loadProfile(settingsPath);
@@ -1039,17 +1768,27 @@ void DkBatchProcessing::computeBatch(const QString& settingsPath, const QString&
 	// guarantee that the output path exists
 	if (!QDir().mkpath(bc.getOutputDirPath())) {
 		qCritical() << "Could not create:" << bc.getOutputDirPath();
-		return;
+		return false;
 	}
 
+	// the journal allows for resuming the batch if it gets interrupted
+	QSharedPointer<DkBatchJournal> journal(new DkBatchJournal(DkBatchJournal::journalPath(settingsPath)));
+	
+	if (journal->open(resume) && resume)
+		qInfo() << "resuming batch:" << journal->numCompleted() << "items were completed before";
+
 	QSharedPointer<nmc::DkBatchProcessing> process(new nmc::DkBatchProcessing());
 	process->setBatchConfig(bc);
+	process->setJournal(journal);
 	process->compute();
 
 	process->waitForFinished();	// block
 
 	qInfo() << "batch finished with" << process->getNumFailures() << "errors in" << dt;
 
+	if (process->getNumCompletedBefore() > 0)
+		qInfo() << process->getNumCompletedBefore() << "of" << process->getNumProcessed() << "items were completed in a previous run";
+
 	if (!logPath.isEmpty()) {
 
 		QFileInfo fi(logPath);
@@ -1067,6 +1806,86 @@ void DkBatchProcessing::computeBatch(const QString& settingsPath, const QString&
 			qInfo() << "log written to: " << logPath;
 		}
 	}
+
+	return process->getNumFailures() == 0;
+}
+
+/**
+ * Computes a share of the batch - other instances (typically on other machines)
+ * work on the same profile. Chunks are claimed until all of them are done.
+ * The worker that finishes last writes the log and calls postLoad.
+ * @param settingsPath the batch profile which needs to be on a shared drive
+ * @param logPath the merged log (optional)
+ * @return bool true if no item failed
+ **/ 
+bool DkBatchProcessing::computeDistributedBatch(const QString& settingsPath, const QString& logPath) {
+
+	DkTimer dt;
+	DkBatchConfig bc = DkBatchProfile::loadProfile(settingsPath);
+
+	// guarantee that the output path exists
+	if (!QDir().mkpath(bc.getOutputDirPath())) {
+		qCritical() << "Could not create:" << bc.getOutputDirPath();
+		return false;
+	}
+
+	DkBatchWorkQueue queue(settingsPath);
+
+	if (!queue.open(bc.getFileList().size()))
+		return false;
+
+	qInfo() << "[Batch] worker" << queue.workerId() << "joined" << DkBatchWorkQueue::queuePath(settingsPath);
+
+	int numFailures = 0;
+	int numChunks = 0;
+	QThreadPool heartbeatPool;	// the global pool is used by the pipeline
+
+	while (!queue.isFinished()) {
+
+		int chunk = queue.claim();
+
+		// everything is claimed - wait for the others (or for abandoned chunks)
+		if (chunk == -1) {
+			QThread::msleep(DkBatchWorkQueue::heartbeatInterval());
+			continue;
+		}
+
+		// keep the claim alive while we are working
+		QAtomicInt working(1);
+		QFuture<void> heartbeat = QtConcurrent::run(&heartbeatPool, [&queue, &working, chunk]() {
+
+			int slept = 0;
+			while (working) {
+				QThread::msleep(200);
+				slept += 200;
+
+				if (slept >= DkBatchWorkQueue::heartbeatInterval()) {
+					queue.heartbeat(chunk);
+					slept = 0;
+				}
+			}
+		});
+
+		DkBatchProcessing process(bc);
+		process.setItemRange(chunk * queue.chunkSize(), queue.chunkSize());
+		process.compute();
+		process.waitForFinished();
+
+		working = 0;
+		heartbeat.waitForFinished();
+
+		queue.finish(chunk, process);
+		numFailures += process.getNumFailures();
+		numChunks++;
+	}
+
+	qInfo() << "[Batch] worker" << queue.workerId() << "processed" << numChunks << "chunks in" << dt;
+
+	// the coordinator (first worker that sees the finished queue) merges the results
+	if (queue.merge(bc, logPath))
+		return queue.numFailures() == 0;
+
+	return numFailures == 0;
 }
 
 
@@ -1083,6 +1902,23 @@ QStringList DkBatchProcessing::getLog() const {
 	return log;
 }
 
+/**
+ * Returns the throughput and the current queue depth of all pipeline stages.
+ **/ 
+QString DkBatchProcessing::getPipelineStats() const {
+
+	QStringList stageNames;
+	stageNames << tr("read") << tr("decode") << tr("process") << tr("encode") << tr("write");
+
+	double sec = mPipelineTimer.elapsed() / 1000.0;
+	QString stats = tr("%1 images/s").arg(sec > 0 ? mNumFinished.load() / sec : 0.0, 0, 'f', 1);
+
+	for (int idx = 0; idx < mQueues.size() && idx < stageNames.size(); idx++)
+		stats += QString(" | %1: %2/%3").arg(stageNames[idx]).arg(mQueues[idx]->size()).arg(mQueues[idx]->capacity());
+
+	return stats;
+}
+
 int DkBatchProcessing::getNumFailures() const {
 
 	int numFailures = 0;
@@ -1109,6 +1945,19 @@ int DkBatchProcessing::getNumProcessed() const {
 	return numProcessed;
 }
 
+int DkBatchProcessing::getNumCompletedBefore() const {
+
+	int numCompleted = 0;
+
+	for (const DkBatchProcess& batch : mBatchItems) {
+
+		if (batch.wasCompletedBefore())
+			numCompleted++;
+	}
+
+	return numCompleted;
+}
+
 QList<int> DkBatchProcessing::getCurrentResults() {
 
 	if (mResList.empty()) {
@@ -1169,6 +2018,7 @@ bool DkBatchProcessing::isComputing() const {
 
 void DkBatchProcessing::cancel() {
 
+	mCanceled = 1;
 	mBatchWatcher.cancel();
 }
 
@@ -34,10 +34,19 @@
 #include <QDir>
 #include <QStringList>
 #include <QUrl>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QHash>
+#include <QFile>
 #pragma warning(pop)		// no warnings from includes - end
 
 #include "DkBatchInfo.h"
 #include "DkManipulators.h"
+#include "DkTimer.h"
 
 #pragma warning(disable: 4251)	// TODO: remove
 
@@ -217,20 +226,39 @@ protected:
 class DllCoreExport DkBatchProcess {
 
 public:
+	enum Stage {
+		stage_read = 0,
+		stage_decode,
+		stage_process,
+		stage_encode,
+		stage_write,
+
+		stage_end
+	};
+
 	DkBatchProcess(const DkSaveInfo& saveInfo = DkSaveInfo());
 
 	void setProcessChain(const QVector<QSharedPointer<DkAbstractBatch> > processes);
 	bool compute();	// do the work
+	bool compute(int stage);
+	void release();
+	void setCompletedBefore();
 	QStringList getLog() const;
 	bool hasFailed() const;
 	bool wasProcessed() const;
+	bool wasCompletedBefore() const;
 	QString inputFile() const;
 	QString outputFile() const;
+	QString outputHash() const;
 
 	QVector<QSharedPointer<DkBatchInfo> > batchInfo() const;
 
 protected:
+	bool readFile();
+	bool decode();
 	bool process();
+	bool encode();
+	bool writeFile();
 	bool prepareDeleteExisting();
 	bool deleteOrRestoreExisting();
 	bool deleteOriginalFile();
@@ -240,10 +268,42 @@ protected:
 	DkSaveInfo mSaveInfo;
 	int mFailure = 0;
 	bool mIsProcessed = false;
+	bool mCompletedBefore = false;	// by an interrupted run
+	QString mOutputHash;
 
 	QVector<QSharedPointer<DkBatchInfo> > mInfos;
 	QVector<QSharedPointer<DkAbstractBatch> > mProcessFunctions;
 	QStringList mLogStrings;
+
+	// intermediate results which are passed between the stages
+	QSharedPointer<DkImageContainer> mImgC;
+	QSharedPointer<QByteArray> mBuffer;
+};
+
+/**
+ * A bounded FIFO of batch item indexes which connects two pipeline stages.
+ * push() blocks while the queue is full so that fast stages cannot run
+ * ahead of slow ones.
+ **/
+class DllCoreExport DkBatchQueue {
+
+public:
+	DkBatchQueue(int capacity = 1);
+
+	bool push(int idx);
+	bool pop(int& idx);
+	void close();
+
+	int size() const;
+	int capacity() const;
+
+protected:
+	mutable QMutex mMutex;
+	QWaitCondition mNotFull;
+	QWaitCondition mNotEmpty;
+	QQueue<int> mItems;
+	int mCapacity = 1;
+	bool mClosed = false;
 };
 
 class DllCoreExport DkBatchConfig {
@@ -280,6 +340,33 @@ protected:
 	QVector<QSharedPointer<DkAbstractBatch> > mProcessFunctions;
 };
 
+/**
+ * An append-only journal of finished batch items.
+ * Each line holds the status, the output's SHA-1 hash, the input and the output path.
+ * It is flushed after every item so that an interrupted batch can be resumed.
+ **/
+class DllCoreExport DkBatchJournal {
+
+public:
+	DkBatchJournal(const QString& filePath);
+
+	bool open(bool resume);
+	void append(const DkBatchProcess& item);
+	bool isCompleted(const DkBatchProcess& item) const;
+	int numCompleted() const;
+	QString filePath() const;
+
+	static QString journalPath(const QString& settingsPath);
+
+protected:
+	static QString hashFile(const QString& filePath);
+
+	QString mFilePath;
+	QFile mFile;
+	QMutex mMutex;
+	QHash<QString, QPair<QString, QString> > mCompleted;	// input -> (output path, SHA-1 hash)
+};
+
 class DllCoreExport DkBatchProcessing : public QObject {
 	Q_OBJECT
 
@@ -297,11 +384,15 @@ public:
 
 	void compute();
 	static bool computeItem(DkBatchProcess& item);
+	static int numWorkers(int stage);
 	
 	QStringList getLog() const;
+	QVector<QSharedPointer<DkBatchInfo> > batchInfo() const;
+	QString getPipelineStats() const;
 	int getNumFailures() const;
 	int getNumItems() const;
 	int getNumProcessed() const;
+	int getNumCompletedBefore() const;
 	
 	bool isComputing() const;
 	QList<int> getCurrentResults();
@@ -312,10 +403,13 @@ public:
 	// getter, setter
 	void setBatchConfig(const DkBatchConfig& config) { mBatchConfig = config; };
 	DkBatchConfig getBatchConfig() const { return mBatchConfig; };
+	void setItemRange(int first, int numItems) { mFirstItem = first; mNumRangeItems = numItems; };
 
 	void postLoad();
+	void setJournal(QSharedPointer<DkBatchJournal> journal) { mJournal = journal; };
 
-	static void computeBatch(const QString& settingsPath, const QString& logPath);
+	static bool computeBatch(const QString& settingsPath, const QString& logPath, bool resume = false);
+	static bool computeDistributedBatch(const QString& settingsPath, const QString& logPath);
 
 public slots:
 	// user interaction
@@ -329,11 +423,63 @@ protected:
 	DkBatchConfig mBatchConfig;
 	QVector<DkBatchProcess> mBatchItems;
 	QList<int> mResList;
+	QSharedPointer<DkBatchJournal> mJournal;
+	int mFirstItem = 0;
+	int mNumRangeItems = -1;	// -1 -> all items
 	
 	// threading
 	QFutureWatcher<void> mBatchWatcher;
+	QThreadPool mPools[DkBatchProcess::stage_end];
+	QVector<QSharedPointer<DkBatchQueue> > mQueues;		// input queue of each stage
+	QAtomicInt mNumWorkers[DkBatchProcess::stage_end];
+	QSharedPointer<QSemaphore> mImageSlots;		// bounds the decoded images in flight
+	QAtomicInt mNumFinished;
+	QAtomicInt mCanceled;
+	DkTimer mPipelineTimer;
 	
 	void init();
+	void runPipeline();
+	void runStage(int stage);
+	static bool holdsImage(int stage);
+};
+
+/**
+ * A file-based work queue which shares a batch among several machines.
+ * The profile's items are split into chunks. Their state is encoded by
+ * marker files (todo, claimed, done) in a folder next to the profile so
+ * that it works on any shared drive. Claiming is an atomic rename, 
+ * workers refresh their claims with heartbeats and claims of workers that 
+ * stopped are reclaimed. The last worker merges the results.
+ **/
+class DllCoreExport DkBatchWorkQueue {
+
+public:
+	DkBatchWorkQueue(const QString& settingsPath, int chunkSize = 64);
+
+	bool open(int numItems);
+	int claim();
+	void heartbeat(int chunk) const;
+	void finish(int chunk, const DkBatchProcessing& process);
+	bool isFinished() const;
+	bool merge(const DkBatchConfig& config, const QString& logPath);
+
+	int numChunks() const;
+	int chunkSize() const;
+	int numFailures() const;
+	QString workerId() const;
+
+	static QString queuePath(const QString& settingsPath);
+	static int heartbeatInterval();
+
+protected:
+	int reclaim();
+	QString markerPath(const QString& state, int chunk) const;
+
+	QDir mDir;
+	QString mWorkerId;
+	int mChunkSize = 64;
+	int mNumChunks = 0;
+	int mNumFailures = 0;
 };
 
 class DllCoreExport DkBatchProfile {
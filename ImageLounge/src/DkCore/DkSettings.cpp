@@ -438,6 +438,7 @@ void DkSettings::load(QSettings& settings, bool defaults) {
 	sync_p.allowPosition = settings.value("allowPosition", sync_p.allowPosition).toBool();
 	sync_p.allowFile = settings.value("allowFile", sync_p.allowFile).toBool();
 	sync_p.allowImage = settings.value("allowImage", sync_p.allowImage).toBool();;
+	sync_p.imagePreviewSize = settings.value("imagePreviewSize", sync_p.imagePreviewSize).toInt();
 	sync_p.checkForUpdates = settings.value("checkForUpdates", sync_p.checkForUpdates).toBool();
 	sync_p.updateDialogShown = settings.value("updateDialogShown", sync_p.updateDialogShown).toBool();
 	sync_p.lastUpdateCheck = settings.value("lastUpdateCheck", sync_p.lastUpdateCheck).toDate();
@@ -459,6 +460,9 @@ void DkSettings::load(QSettings& settings, bool defaults) {
 	resources_p.filterDuplicats = settings.value("filterDuplicates", resources_p.filterDuplicats).toBool();
 	resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();	
 	resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
+	resources_p.cacheThumbs = settings.value("cacheThumbs", resources_p.cacheThumbs).toBool();
+	resources_p.loadPreview = settings.value("loadPreview", resources_p.loadPreview).toBool();
+	resources_p.maxImageMemory = settings.value("maxImageMemory", resources_p.maxImageMemory).toInt();
 
 	if (sync_p.switchModifier) {
 		global_p.altMod = Qt::ControlModifier;
@@ -698,6 +702,8 @@ void DkSettings::save(QSettings& settings, bool force) {
 		settings.setValue("allowFile", sync_p.allowFile);
 	if (force ||sync_p.allowImage != sync_d.allowImage)
 		settings.setValue("allowImage", sync_p.allowImage);
+	if (force ||sync_p.imagePreviewSize != sync_d.imagePreviewSize)
+		settings.setValue("imagePreviewSize", sync_p.imagePreviewSize);
 	if (force ||sync_p.checkForUpdates != sync_d.checkForUpdates)
 		settings.setValue("checkForUpdates", sync_p.checkForUpdates);
 	if (force ||sync_p.updateDialogShown != sync_d.updateDialogShown)
@@ -735,6 +741,12 @@ void DkSettings::save(QSettings& settings, bool force) {
 		settings.setValue("preferredExtension", resources_p.preferredExtension);
 	if (force ||resources_p.gammaCorrection != resources_d.gammaCorrection)
 		settings.setValue("gammaCorrection", resources_p.gammaCorrection);
+	if (force ||resources_p.cacheThumbs != resources_d.cacheThumbs)
+		settings.setValue("cacheThumbs", resources_p.cacheThumbs);
+	if (force ||resources_p.loadPreview != resources_d.loadPreview)
+		settings.setValue("loadPreview", resources_p.loadPreview);
+	if (force ||resources_p.maxImageMemory != resources_d.maxImageMemory)
+		settings.setValue("maxImageMemory", resources_p.maxImageMemory);
 	settings.endGroup();
 
 	// keep loaded settings in mind
@@ -859,6 +871,7 @@ void DkSettings::setToDefaultSettings() {
 	sync_p.allowPosition = true;
 	sync_p.allowFile = true;
 	sync_p.allowImage = true;
+	sync_p.imagePreviewSize = 1920;	// receivers get a preview first if images are larger (0 disables previews)
 	sync_p.checkForUpdates = !isPortable();	// installed version should only check for updates by default
 	sync_p.updateDialogShown = false;
 	sync_p.lastUpdateCheck = QDate(1970 , 1, 1);
@@ -877,6 +890,9 @@ void DkSettings::setToDefaultSettings() {
 	resources_p.maxThumbsLoading = 5;
 	resources_p.gammaCorrection = true;
 	resources_p.waitForLastImg = true;
+	resources_p.cacheThumbs = true;
+	resources_p.loadPreview = true;
+	resources_p.maxImageMemory = 1024;
 
 	qDebug() << "ok... default settings are set";
 }
@@ -91,6 +91,9 @@ public:
 		sort_date_created,
 		sort_date_modified,
 		sort_random,
+		sort_date_taken,
+		sort_rating,
+		sort_camera,
 		sort_end,
 	};
 
@@ -254,6 +257,7 @@ public:
 		bool allowPosition;
 		bool allowFile;
 		bool allowImage;
+		int imagePreviewSize;
 		bool checkForUpdates;
 		bool updateDialogShown;
 		QDate lastUpdateCheck;
@@ -279,6 +283,9 @@ public:
 		int numThumbsLoading;
 		int maxThumbsLoading;
 		bool gammaCorrection;
+		bool cacheThumbs;
+		bool loadPreview;
+		int maxImageMemory;
 	};
 
 	//enums for checkboxes - divide in camera data and description
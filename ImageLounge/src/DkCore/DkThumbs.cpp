@@ -38,9 +38,13 @@
 #include <QStringList>
 #include <QMutex>
 #include <QImageReader>
-#include <QtConcurrentRun>
 #include <QTimer>
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -89,13 +93,31 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	DkTimer dt;
 	//qDebug() << "[thumb] file: " << file.absoluteFilePath();
 
+	// try the persistent cache first - no decoding needed if we had this file before
+	// exif thumbs are never cached, so they bypass the cache
+	if (forceLoad == do_not_force) {
+		
+		QImage cThumb = DkThumbCache::instance().load(filePath, maxThumbSize, minThumbSize);
+		
+		if (!cThumb.isNull()) {
+			qInfoClean() << "[thumb] " << QFileInfo(filePath).fileName() << " (" << cThumb.width() << " x " << cThumb.height() << ") loaded in " << dt << " from cache";
+			return cThumb;
+		}
+	}
+
+	// thumbnails are cached with the size of the specification (e.g. 256 px if 160 px are requested)
+	int thumbSize = maxThumbSize;
+	int cacheSize = forceLoad != force_exif_thumb && DkThumbCache::instance().isEnabled() ? DkThumbCache::specSize(maxThumbSize) : 0;
+	if (cacheSize > 0)
+		maxThumbSize = cacheSize;
+
 	// see if we can read the thumbnail from the exif data
 	QImage thumb;
 	DkMetaDataT metaData;
 
 	QSharedPointer<QByteArray> baZip = QSharedPointer<QByteArray>();
 #ifdef WITH_QUAZIP
-	if (QFileInfo(mFile).dir().path().contains(DkZipContainer::zipMarker())) 
+	if (QFileInfo(filePath).dir().path().contains(DkZipContainer::zipMarker())) 
 		baZip = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
 	try {
@@ -132,15 +154,15 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	fInfo = lFilePath;
 
 	QImageReader* imageReader = 0;
+	QBuffer buffer;	// must outlive the reader
 	
 	if (!ba || ba->isEmpty())
 		imageReader = new QImageReader(lFilePath);
 	else {
-		QBuffer buffer;
-		buffer.setData(ba->data());
+		// share the (possibly mapped) data - data() would detach and copy the whole file
+		buffer.setData(*ba);
 		buffer.open(QIODevice::ReadOnly);
 		imageReader = new QImageReader(&buffer, fInfo.suffix().toStdString().c_str());
-		buffer.close();
 	}
 
 	if (thumb.isNull() || (thumb.width() < tS && thumb.height() < tS)) {
@@ -240,6 +262,11 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 		thumb = thumb.transformed(rotationMatrix);
 	}
 
+	// the cache gets the larger thumbnail - the caller the size requested
+	QImage cacheThumb = thumb;
+	if (thumb.width() > thumbSize || thumb.height() > thumbSize)
+		thumb = thumb.scaled(QSize(thumbSize, thumbSize), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
 	// save the thumbnail if the caller either forces it, or the save thumb is requested and the image did not have any before
 	if (forceLoad == force_save_thumb || (forceLoad == save_thumb && !exifThumb)) {
 		
@@ -266,6 +293,10 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 		}
 	}
 
+	// exif-only thumbs are neither scaled nor complete -> do not cache them
+	if (!cacheThumb.isNull() && cacheSize > 0)
+		DkThumbCache::instance().save(lFilePath, cacheThumb);
+
 	if (!thumb.isNull())
 		qInfoClean() << "[thumb] " << fInfo.fileName() << " (" << thumb.width() << " x " << thumb.height() << ") loaded in " << dt << ((exifThumb) ? " from EXIV" : " from File");
 
@@ -356,52 +387,488 @@ DkThumbNailT::~DkThumbNailT() {
 	if (mFetching && DkSettingsManager::param().resources().numThumbsLoading > 0)
 		DkSettingsManager::param().resources().numThumbsLoading--;
 
-	thumbWatcher.blockSignals(true);
-	thumbWatcher.cancel();
+	// the scheduler must not deliver to us anymore
+	DkThumbScheduler::instance().cancel(this);
 }
 
-bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba) {
+/**
+ * Requests the thumbnail.
+ * If the thumbnail is requested already, the request's priority is updated.
+ * @param forceLoad the loading flag (e.g. exif only)
+ * @param ba the file buffer (can be empty)
+ * @param priority the scheduler priority (e.g. DkThumbScheduler::priority_visible)
+ * @param requester the object that might cancel the request (see cancelFetch())
+ * @return bool true if a new request was scheduled
+ **/ 
+bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba, int priority, const QObject* requester) {
 
 	if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb)
 		mImg = QImage();
 
-	if (!mImg.isNull() || !mImgExists || mFetching)
+	if (mFetching) {
+		mRequesters.insert(requester);
+		DkThumbScheduler::instance().setPriority(this, priority);
+		return false;
+	}
+
+	if (!mImg.isNull() || !mImgExists)
 		return false;
 
-	// we have to do our own bool here
-	// watcher.isRunning() returns false if the thread is waiting in the pool
 	mFetching = true;
+	mRequesters.insert(requester);
 	mForceLoad = forceLoad;
 
-	connect(&thumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()));
-	thumbWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkThumbNailT::computeCall, mFile, ba, forceLoad, mMaxThumbSize, mMinThumbSize));
-
+	DkThumbScheduler::instance().enqueue(this, ba, forceLoad, priority);
 	DkSettingsManager::param().resources().numThumbsLoading++;
 
 	return true;
 }
 
+/**
+ * Cancels the requester's pending thumbnail request.
+ * The request is only canceled if nobody else requested the thumbnail
+ * (thumbnails are shared e.g. with the file preview).
+ * Requests that are already delivered are not affected.
+ * @param requester the object passed to fetchThumb()
+ **/ 
+void DkThumbNailT::cancelFetch(const QObject* requester) {
 
-QImage DkThumbNailT::computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize) {
+	if (!mFetching || !mRequesters.remove(requester) || !mRequesters.isEmpty())
+		return;
 
-	return DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
-}
+	if (!DkThumbScheduler::instance().cancel(this)) {
+		mRequesters.insert(requester);	// it's running - so it will be delivered
+		return;
+	}
 
-void DkThumbNailT::thumbLoaded() {
+	mFetching = false;
 	
-	QFuture<QImage> future = thumbWatcher.future();
+	if (DkSettingsManager::param().resources().numThumbsLoading > 0)
+		DkSettingsManager::param().resources().numThumbsLoading--;
+}
 
-	mImg = future.result();
+void DkThumbNailT::thumbLoaded(const QImage& thumb) {
+	
+	mImg = thumb;
 	
 	if (mImg.isNull() && mForceLoad != force_exif_thumb)
 		mImgExists = false;
 
 	mFetching = false;
+	mRequesters.clear();
 	DkSettingsManager::param().resources().numThumbsLoading--;
 	emit thumbLoadedSignal(!mImg.isNull());
 }
 
+// DkThumbScheduler --------------------------------------------------------------------
+class DkThumbWorker : public QRunnable {
+
+public:
+	DkThumbWorker(int stage) : mStage(stage) {};
+
+	void run() override {
+		DkThumbScheduler::instance().process(mStage);
+	};
+
+protected:
+	int mStage;
+};
+
+DkThumbScheduler::DkThumbScheduler() {
+
+	// reading cached thumbs is I/O bound - so a few threads are enough
+	mPools[stage_io].setMaxThreadCount(2);
+	mPools[stage_decode].setMaxThreadCount(qMax(1, qMin(QThread::idealThreadCount(), DkSettingsManager::param().resources().maxThumbsLoading)));
+}
+
+DkThumbScheduler::~DkThumbScheduler() {
+
+	// cancel everything that is not running yet
+	mMutex.lock();
+	for (QSharedPointer<Job> job : mJobs)
+		job->canceled = true;
+	mJobs.clear();
+	mMutex.unlock();
+
+	for (QThreadPool& pool : mPools)
+		pool.waitForDone();
+}
+
+DkThumbScheduler& DkThumbScheduler::instance() {
+
+	static DkThumbScheduler inst;
+	return inst;
+}
+
+/**
+ * Queues a new thumbnail request.
+ * Note: this function must be called from the thumbnail's thread.
+ * @param thumb the thumbnail that receives the result
+ * @param ba the file buffer (can be empty)
+ * @param forceLoad the loading flag (e.g. exif only)
+ * @param priority the request's priority
+ **/ 
+void DkThumbScheduler::enqueue(DkThumbNailT* thumb, QSharedPointer<QByteArray> ba, int forceLoad, int priority) {
+
+	if (!thumb)
+		return;
+
+	QSharedPointer<Job> job(new Job());
+	job->thumb = thumb;
+	job->filePath = thumb->getFilePath();
+	job->ba = ba;
+	job->forceLoad = forceLoad;
+	job->maxThumbSize = thumb->getMaxThumbSize();
+	job->minThumbSize = thumb->getMinThumbSize();
+	job->priority = qBound(0, priority, (int)priority_end-1);
+
+	// only standard thumbs might be served from the cache
+	job->stage = (forceLoad == DkThumbNail::do_not_force) ? stage_io : stage_decode;
+
+	QMutexLocker locker(&mMutex);
+	
+	// cancel old requests of this thumbnail
+	QSharedPointer<Job> oldJob = mJobs.value(thumb);
+	if (oldJob)
+		oldJob->canceled = true;
+
+	mJobs.insert(thumb, job);
+	schedule(job);
+}
+
+/**
+ * Changes the priority of a pending request.
+ * @param thumb the requesting thumbnail
+ * @param priority the new priority
+ **/ 
+void DkThumbScheduler::setPriority(DkThumbNailT* thumb, int priority) {
+
+	priority = qBound(0, priority, (int)priority_end-1);
+
+	QMutexLocker locker(&mMutex);
+	QSharedPointer<Job> job = mJobs.value(thumb);
+
+	if (!job || job->running || job->priority == priority)
+		return;
+
+	// the old entry is skipped when it is dequeued
+	job->priority = priority;
+	mQueues[job->stage][priority].append(job);
+}
+
+/**
+ * Cancels the request of thumb.
+ * If the request is running already, its result is discarded.
+ * @param thumb the requesting thumbnail
+ * @return bool true if a request was canceled, false if there is none (anymore).
+ **/ 
+bool DkThumbScheduler::cancel(DkThumbNailT* thumb) {
+
+	QMutexLocker locker(&mMutex);
+	QSharedPointer<Job> job = mJobs.take(thumb);
+
+	if (!job)
+		return false;
+
+	job->canceled = true;
+
+	return true;
+}
+
+int DkThumbScheduler::numPending() const {
+
+	QMutexLocker locker(&mMutex);
+	return mJobs.size();
+}
+
+/**
+ * Worker routine: processes the most important job of a given stage.
+ * @param stage the pipeline stage (stage_io | stage_decode)
+ **/ 
+void DkThumbScheduler::process(int stage) {
+
+	QSharedPointer<Job> job = takeJob(stage);
+
+	// the job was canceled meanwhile
+	if (!job)
+		return;
+
+	if (stage == stage_io) {
+
+		QImage thumb = DkThumbCache::instance().load(job->filePath, job->maxThumbSize, job->minThumbSize);
+
+		// cache miss -> decode
+		if (thumb.isNull()) {
+			QMutexLocker locker(&mMutex);
+			job->stage = stage_decode;
+			job->running = false;
+
+			if (!job->canceled)
+				schedule(job);
+			return;
+		}
+
+		deliver(job, thumb);
+	}
+	else {
+		QImage thumb = DkThumbNail::computeIntern(job->filePath, job->ba, job->forceLoad, job->maxThumbSize, job->minThumbSize);
+		deliver(job, thumb);
+	}
+}
+
+// Note: mMutex must be locked
+void DkThumbScheduler::schedule(QSharedPointer<Job> job) {
+
+	mQueues[job->stage][job->priority].append(job);
+
+	// the worker takes the most important job once it is started
+	mPools[job->stage].start(new DkThumbWorker(job->stage));
+}
+
+QSharedPointer<DkThumbScheduler::Job> DkThumbScheduler::takeJob(int stage) {
+
+	QMutexLocker locker(&mMutex);
+
+	for (int pIdx = 0; pIdx < priority_end; pIdx++) {
+
+		QList<QSharedPointer<Job> >& queue = mQueues[stage][pIdx];
+
+		while (!queue.isEmpty()) {
+			QSharedPointer<Job> job = queue.takeFirst();
+
+			// skip canceled & re-prioritized entries
+			if (job->canceled || job->running || job->stage != stage || job->priority != pIdx)
+				continue;
+
+			job->running = true;
+			return job;
+		}
+	}
+
+	return QSharedPointer<Job>();
+}
+
+void DkThumbScheduler::deliver(QSharedPointer<Job> job, const QImage& thumb) {
+
+	// the thumbnail cannot be deleted while we hold the lock (see ~DkThumbNailT)
+	QMutexLocker locker(&mMutex);
+
+	if (job->canceled)
+		return;
+
+	mJobs.remove(job->thumb);
+	QMetaObject::invokeMethod(job->thumb, "thumbLoaded", Qt::QueuedConnection, Q_ARG(QImage, thumb));
+}
+
+// DkThumbCache --------------------------------------------------------------------
+DkThumbCache::DkThumbCache() {
+
+	mCacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/thumbnails";
+}
+
+DkThumbCache& DkThumbCache::instance() {
+
+	static DkThumbCache inst;
+	return inst;
+}
+
+// thumbnail sizes of the freedesktop.org specification (normal, large, x-large, xx-large)
+static const int thumbSpecSizes[] = {128, 256, 512, 1024};
+static const int numThumbSpecSizes = 4;
+
+/**
+ * Returns the smallest size of the specification that holds thumbSize.
+ * @param thumbSize the thumbnail size requested
+ * @return int the size of the specification or 0 if thumbSize is larger than any of them
+ **/ 
+int DkThumbCache::specSize(int thumbSize) {
+
+	for (int idx = 0; idx < numThumbSpecSizes; idx++) {
+		if (thumbSize <= thumbSpecSizes[idx])
+			return thumbSpecSizes[idx];
+	}
+
+	return 0;
+}
+
+bool DkThumbCache::isEnabled() const {
+
+	return DkSettingsManager::param().resources().cacheThumbs && 
+		!DkSettingsManager::param().app().privateMode;
+}
+
+/**
+ * Returns the cached thumbnail of filePath.
+ * The size that holds maxThumbSize is preferred, then larger and finally smaller sizes.
+ * Thumbnails smaller than minThumbSize are ignored - they are replaced once the image is decoded.
+ * @param filePath the image's file path
+ * @param maxThumbSize the maximal thumbnail size (larger thumbs are downscaled)
+ * @param minThumbSize the minimal thumbnail size
+ * @return QImage the cached thumbnail or a null image if it does not exist, is outdated or too small.
+ **/ 
+QImage DkThumbCache::load(const QString& filePath, int maxThumbSize, int minThumbSize) const {
+
+	if (!isEnabled())
+		return QImage();
+
+	QFileInfo fInfo(filePath);
+
+	if (fInfo.isSymLink())
+		fInfo = fInfo.symLinkTarget();
+
+	// e.g. files within zip archives
+	if (!fInfo.isFile())
+		return QImage();
+
+	QString uri = fileUri(fInfo);
+
+	// the size requested first, then larger ones (need downscaling) and finally smaller ones
+	QVector<int> sizes;
+	int sIdx = 0;
+	while (sIdx < numThumbSpecSizes && thumbSpecSizes[sIdx] < maxThumbSize)
+		sIdx++;
+	for (int idx = sIdx; idx < numThumbSpecSizes; idx++)
+		sizes << thumbSpecSizes[idx];
+	for (int idx = sIdx-1; idx >= 0; idx--)
+		sizes << thumbSpecSizes[idx];
+
+	for (int size : sizes) {
+
+		QString tPath = thumbPath(uri, size);
+
+		if (!QFile::exists(tPath))
+			continue;
+
+		// the text chunks are read without decoding the thumbnail
+		QImageReader reader(tPath, "png");
+
+		if (reader.text("Thumb::URI") != uri || 
+			reader.text("Thumb::MTime") != fileMTime(fInfo))
+			continue;
+
+		// the size is optional (according to the specification)
+		QString fSize = reader.text("Thumb::Size");
+		if (!fSize.isEmpty() && fSize != QString::number(fInfo.size()))
+			continue;
+
+		QImage thumb = reader.read();
+
+		// too small - a larger one is created when the image is decoded
+		if (thumb.isNull() || qMax(thumb.width(), thumb.height()) < minThumbSize)
+			continue;
+
+		// larger sizes (or other applications) need downscaling
+		if (thumb.width() > maxThumbSize || thumb.height() > maxThumbSize)
+			thumb = thumb.scaled(QSize(maxThumbSize, maxThumbSize), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+		return thumb;
+	}
+
+	return QImage();
+}
+
+/**
+ * Stores the thumbnail of filePath in the cache.
+ * It is written with the largest size of the specification that it fills
+ * (e.g. a 160 px thumbnail is stored as 128 px thumbnail) and replaces
+ * an existing thumbnail of that size.
+ * The thumbnail is written to a temporary file first so that
+ * concurrent readers never see incomplete thumbnails.
+ * @param filePath the image's file path
+ * @param thumb the thumbnail
+ * @return bool true if the thumbnail was written
+ **/ 
+bool DkThumbCache::save(const QString& filePath, const QImage& thumb) const {
+
+	if (!isEnabled() || thumb.isNull())
+		return false;
+
+	QFileInfo fInfo(filePath);
+
+	if (!fInfo.isFile())
+		return false;
+
+	int longSide = qMax(thumb.width(), thumb.height());
+	int size = 0;
+
+	for (int idx = 0; idx < numThumbSpecSizes; idx++) {
+		if (thumbSpecSizes[idx] <= longSide)
+			size = thumbSpecSizes[idx];
+	}
+
+	// smaller than a normal thumbnail
+	if (size == 0)
+		return false;
+
+	QImage sThumb = thumb;
+	if (longSide > size)
+		sThumb = thumb.scaled(QSize(size, size), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	QString uri = fileUri(fInfo);
+	QString tPath = thumbPath(uri, size);
+	QString tDir = QFileInfo(tPath).absolutePath();
+
+	// do not create thumbnails of thumbnails
+	if (fInfo.absolutePath().startsWith(mCacheDir))
+		return false;
+
+	if (!QDir().mkpath(tDir)) {
+		qWarning() << "[DkThumbCache] I could not create" << tDir;
+		return false;
+	}
+
+	QSaveFile file(tPath);
+	
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QImageWriter writer(&file, "png");
+	writer.setText("Thumb::URI", uri);
+	writer.setText("Thumb::MTime", fileMTime(fInfo));
+	writer.setText("Thumb::Size", QString::number(fInfo.size()));
+	writer.setText("Software", "nomacs");
+
+	if (!writer.write(sThumb)) {
+		file.cancelWriting();
+		return false;
+	}
+
+	if (!file.commit())
+		return false;
+
+	QFile::setPermissions(tPath, QFile::ReadOwner | QFile::WriteOwner);
+
+	return true;
+}
+
+QString DkThumbCache::thumbPath(const QString& fileUri, int specSize) const {
+
+	QString sizeDir;
+
+	if (specSize <= 128)
+		sizeDir = "normal";
+	else if (specSize <= 256)
+		sizeDir = "large";
+	else if (specSize <= 512)
+		sizeDir = "x-large";
+	else
+		sizeDir = "xx-large";
+
+	QString hash = QCryptographicHash::hash(fileUri.toUtf8(), QCryptographicHash::Md5).toHex();
+
+	return mCacheDir + "/" + sizeDir + "/" + hash + ".png";
+}
+
+QString DkThumbCache::fileUri(const QFileInfo& fileInfo) const {
+
+	return QString::fromLatin1(QUrl::fromLocalFile(fileInfo.absoluteFilePath()).toEncoded());
+}
+
+QString DkThumbCache::fileMTime(const QFileInfo& fileInfo) const {
+
+	return QString::number(fileInfo.lastModified().toMSecsSinceEpoch() / 1000);
+}
+
 /**
  * Default constructor of the thumbnail loader.
  * Note: currently the init calls the getFilteredFileList which might be slow.
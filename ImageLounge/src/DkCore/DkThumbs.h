@@ -33,6 +33,10 @@
 #include <QColor>
 #include <QDir>
 #include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QSet>
 #include <QImage>
 #pragma warning(pop)		// no warnings from includes - end
 
@@ -89,7 +93,7 @@ public:
 	 **/ 
 	virtual void setImage(const QImage img);
 
-	void removeBlackBorder(QImage& img);
+	static void removeBlackBorder(QImage& img);
 
 	/**
 	 * Returns the thumbnail.
@@ -156,8 +160,9 @@ public:
 		force_save_thumb,
 	};
 
+	static QImage computeIntern(const QString& file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+
 protected:
-	QImage computeIntern(const QString& file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
 
 	QImage mImg;
 	QString mFile;
@@ -167,6 +172,74 @@ protected:
 	int mMinThumbSize;
 };
 
+class DkThumbNailT;
+
+/**
+ * Schedules threaded thumbnail loading.
+ * Requests are queued with a priority (visible thumbnails first,
+ * then a prefetch band and finally background jobs). Queued requests
+ * can be re-prioritized or canceled (e.g. if they scroll out of view).
+ * Cached thumbnails are fetched by I/O workers, all others are
+ * handed over to a bounded number of decode workers.
+ **/ 
+class DllCoreExport DkThumbScheduler {
+
+public:
+	enum Priority {
+		priority_visible = 0,
+		priority_prefetch,
+		priority_background,
+
+		priority_end
+	};
+
+	enum Stage {
+		stage_io = 0,
+		stage_decode,
+
+		stage_end
+	};
+
+	static DkThumbScheduler& instance();
+	~DkThumbScheduler();
+
+	// singleton
+	DkThumbScheduler(DkThumbScheduler const&)		= delete;
+	void operator=(DkThumbScheduler const&)			= delete;
+
+	void enqueue(DkThumbNailT* thumb, QSharedPointer<QByteArray> ba, int forceLoad, int priority = priority_visible);
+	void setPriority(DkThumbNailT* thumb, int priority);
+	bool cancel(DkThumbNailT* thumb);
+	int numPending() const;
+
+	void process(int stage);
+
+protected:
+	DkThumbScheduler();
+
+	struct Job {
+		DkThumbNailT* thumb = 0;
+		QString filePath;
+		QSharedPointer<QByteArray> ba;
+		int forceLoad = DkThumbNail::do_not_force;
+		int maxThumbSize = 0;
+		int minThumbSize = 0;
+		int priority = priority_visible;
+		int stage = stage_io;
+		bool running = false;
+		bool canceled = false;
+	};
+
+	void schedule(QSharedPointer<Job> job);
+	QSharedPointer<Job> takeJob(int stage);
+	void deliver(QSharedPointer<Job> job, const QImage& thumb);
+
+	mutable QMutex mMutex;
+	QList<QSharedPointer<Job> > mQueues[stage_end][priority_end];
+	QHash<DkThumbNailT*, QSharedPointer<Job> > mJobs;
+	QThreadPool mPools[stage_end];
+};
+
 class DllCoreExport DkThumbNailT : public QObject, public DkThumbNail {
 	Q_OBJECT
 
@@ -174,7 +247,8 @@ public:
 	DkThumbNailT(const QString& mFile = QString(), const QImage& mImg = QImage());
 	~DkThumbNailT();
 
-	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), int priority = DkThumbScheduler::priority_visible, const QObject* requester = 0);
+	void cancelFetch(const QObject* requester);
 
 	/**
 	 * Returns whether the thumbnail was loaded, or does not exist.
@@ -182,7 +256,7 @@ public:
 	 **/ 
 	int hasImage() const {
 		
-		if (thumbWatcher.isRunning())
+		if (mFetching)
 			return loading;
 		else
 			return DkThumbNail::hasImage();
@@ -197,14 +271,45 @@ signals:
 	void thumbLoadedSignal(bool loaded = true);
 
 protected slots:
-	void thumbLoaded();
+	void thumbLoaded(const QImage& thumb);
 
 protected:
-	QImage computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
-
-	QFutureWatcher<QImage> thumbWatcher;
 	bool mFetching;
 	int mForceLoad;
+	QSet<const QObject*> mRequesters;	// 0 -> a requester that never cancels
+};
+
+/**
+ * Persistent on-disk thumbnail cache.
+ * Thumbnails are stored as PNG files according to the freedesktop.org
+ * thumbnail specification (<cache>/thumbnails/<size>/<md5(uri)>.png).
+ * A cached thumbnail is only valid if the file's modification time
+ * and size match the values stored in the thumbnail's text chunks.
+ * Only the sizes of the specification (128, 256, 512, 1024 px) are written.
+ **/ 
+class DllCoreExport DkThumbCache {
+
+public:
+	static DkThumbCache& instance();
+
+	// singleton
+	DkThumbCache(DkThumbCache const&)		= delete;
+	void operator=(DkThumbCache const&)		= delete;
+
+	QImage load(const QString& filePath, int maxThumbSize, int minThumbSize) const;
+	bool save(const QString& filePath, const QImage& thumb) const;
+	bool isEnabled() const;
+
+	static int specSize(int thumbSize);
+
+protected:
+	DkThumbCache();
+
+	QString thumbPath(const QString& fileUri, int specSize) const;
+	QString fileUri(const QFileInfo& fileInfo) const;
+	QString fileMTime(const QFileInfo& fileInfo) const;
+
+	QString mCacheDir;
 };
 
 /**
@@ -29,6 +29,7 @@
 #include "DkUtils.h"
 #include "DkMath.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 
 #if defined(Q_OS_LINUX) && !defined(Q_OS_OPENBSD)
 #include <sys/sysinfo.h>
@@ -38,6 +39,9 @@
 #include <cassert>
 #endif
 
+#include <algorithm>
+#include <iterator>
+
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QString>
 #include <QFileInfo>
@@ -381,6 +385,81 @@ bool DkUtils::compRandom(const QFileInfo&, const QFileInfo&) {
 	return qrand() % 2 != 0;
 }
 
+/**
+ * Returns a key that sorts strings in natural order if keys are compared byte-wise.
+ * Hence, img2.png < img10.png and img2.png == IMG2.png (case insensitive).
+ * Digit runs are encoded by their number of (significant) digits followed by
+ * the digits. All other characters are case folded UTF-16 code units (big endian).
+ * Strings that differ in leading zeros or case only are sorted by their
+ * original code units, which are appended to the key.
+ * @param str the string (e.g. a file name)
+ * @return QByteArray the key - compare it with compareSortKeys()
+ **/ 
+QByteArray DkUtils::naturalSortKey(const QString& str) {
+
+	QString s = str.toCaseFolded();
+
+	QByteArray key;
+	key.reserve((s.length() + str.length()) * 2 + 8);
+
+	auto append16 = [&](int val) {
+		key.append((char)((val >> 8) & 0xff));
+		key.append((char)(val & 0xff));
+	};
+
+	auto isDigit = [&](int idx) {
+		return s.at(idx) >= QChar('0') && s.at(idx) <= QChar('9');
+	};
+
+	for (int idx = 0; idx < s.length();) {
+
+		if (isDigit(idx)) {
+
+			int end = idx;
+			while (end < s.length() && isDigit(end))
+				end++;
+
+			// skip leading zeros (but keep the last digit)
+			int start = idx;
+			while (start < end - 1 && s.at(start) == QChar('0'))
+				start++;
+
+			append16('0');	// numbers are sorted like digits w.r.t. other characters
+			append16(qMin(end - start, 0xffff));
+
+			for (int dIdx = start; dIdx < end; dIdx++)
+				key.append((char)s.at(dIdx).unicode());
+
+			idx = end;
+		}
+		else {
+			append16(s.at(idx).unicode());
+			idx++;
+		}
+	}
+
+	// the original string breaks ties
+	append16(0);
+	for (const QChar& c : str)
+		append16(c.unicode());
+
+	return key;
+}
+
+/**
+ * Compares two keys of naturalSortKey().
+ * @return int < 0 if lhs < rhs, 0 if they are equal and > 0 otherwise
+ **/ 
+int DkUtils::compareSortKeys(const QByteArray& lhs, const QByteArray& rhs) {
+
+	int res = memcmp(lhs.constData(), rhs.constData(), qMin(lhs.size(), rhs.size()));
+
+	if (res != 0)
+		return res;
+
+	return lhs.size() - rhs.size();
+}
+
 void DkUtils::addLanguages(QComboBox* langCombo, QStringList& languages) {
 
 	QDir qmDir = qApp->applicationDirPath();
@@ -1272,6 +1351,241 @@ bool TabMiddleMouseCloser::eventFilter(QObject *obj, QEvent *event) {
 	return QObject::eventFilter(obj, event);
 }
 
+// DkSearchIndex --------------------------------------------------------------------
+DkSearchIndex::DkSearchIndex(const QStringList& list) {
+
+	mList = list;
+}
+
+QStringList DkSearchIndex::list() const {
+
+	return mList;
+}
+
+/**
+ * Splits a query into its keywords.
+ * This is the same as DkUtils::filterStringList: white spaces separate
+ * keywords while leading or trailing spaces are significant.
+ **/ 
+QStringList DkSearchIndex::keywords(const QString& query) {
+
+	QStringList queries = query.split(" ");
+
+	for (int idx = 0; idx < queries.size(); idx++) {
+		if (idx == 0 && queries.size() > 1 && queries[idx].size() == 0) queries[idx] = " " + queries[idx + 1];
+		if (idx == queries.size() - 1 && queries.size() > 2 && queries[idx].size() == 0) queries[idx] = queries[idx - 1] + " ";
+		queries[idx] = queries[idx].toLower();
+	}
+
+	return queries;
+}
+
+/**
+ * Searches the list.
+ * Items match if they contain all keywords (case insensitive). If nothing matches,
+ * the query is used as regular expression (and as wildcard) - see DkUtils::filterStringList.
+ * @param query the search string
+ * @param previous the previous result - it is filtered if the query refines it
+ * @param cancel the search is aborted (result.canceled) as soon as this is set
+ * @return DkSearchIndex::Result the matching items
+ **/ 
+DkSearchIndex::Result DkSearchIndex::search(const QString& query, const Result& previous, const QAtomicInt* cancel) const {
+
+	build();
+
+	Result r;
+	r.query = query;
+	r.keywords = keywords(query);
+
+	// all items that match the new query match the previous one too
+	bool refine = !previous.query.isNull() && !previous.regExp && !previous.canceled && 
+		refines(previous.keywords, r.keywords);
+	
+	// long keywords are more selective
+	QStringList kws = r.keywords;
+	std::sort(kws.begin(), kws.end(), [](const QString& lk, const QString& rk) {
+		return lk.size() > rk.size();
+	});
+
+	bool all = !refine;	// no keyword applied yet (all items match)
+	QVector<int> ids = refine ? previous.ids : QVector<int>();
+
+	for (const QString& kw : kws) {
+
+		if (kw.isEmpty())
+			continue;
+
+		if (all && kw.size() >= 3) {
+			ids = candidates(kw);
+			all = false;
+			continue;
+		}
+
+		QVector<int> filtered;
+		int numItems = all ? mLowerList.size() : ids.size();
+
+		for (int idx = 0; idx < numItems; idx++) {
+
+			if (cancel && (idx & 0x3ff) == 0 && cancel->load()) {
+				r.canceled = true;
+				return r;
+			}
+
+			int id = all ? idx : ids[idx];
+			if (mLowerList.at(id).contains(kw))
+				filtered << id;
+		}
+
+		ids = filtered;
+		all = false;
+	}
+
+	if (all) {
+		ids.resize(mList.size());
+		for (int idx = 0; idx < ids.size(); idx++)
+			ids[idx] = idx;
+	}
+
+	// if string match returns nothing -> try a regexp
+	if (ids.empty() && !query.isEmpty()) {
+
+		r.regExp = true;
+
+		QRegExp regExp(query);
+		QRegExp wildcard(query, Qt::CaseSensitive, QRegExp::Wildcard);
+
+		for (const QRegExp& rx : { regExp, wildcard }) {
+
+			for (int idx = 0; idx < mList.size(); idx++) {
+
+				if (cancel && (idx & 0x3ff) == 0 && cancel->load()) {
+					r.canceled = true;
+					return r;
+				}
+
+				if (mList[idx].contains(rx))
+					ids << idx;
+			}
+
+			if (!ids.empty())
+				break;
+		}
+	}
+
+	r.ids = ids;
+	r.matches.reserve(ids.size());
+	for (int id : ids)
+		r.matches << mList[id];
+
+	return r;
+}
+
+/**
+ * Builds the trigram index (once).
+ **/ 
+void DkSearchIndex::build() const {
+
+	QMutexLocker locker(&mBuildMutex);
+
+	if (mBuilt)
+		return;
+
+	DkTimer dt;
+
+	mLowerList.reserve(mList.size());
+
+	for (int id = 0; id < mList.size(); id++) {
+
+		QString name = mList[id].toLower();
+		mLowerList << name;
+
+		for (int idx = 0; idx + 3 <= name.size(); idx++) {
+
+			QVector<int>& ids = mTrigrams[trigram(name.constData() + idx)];
+
+			// trigrams can occur multiple times in one name
+			if (ids.empty() || ids.last() != id)
+				ids << id;
+		}
+	}
+
+	mBuilt = true;
+
+	qInfo() << "[DkSearchIndex]" << mList.size() << "items indexed in" << dt;
+}
+
+/**
+ * Returns all items containing a keyword.
+ * @param keyword a lower case keyword with at least three characters
+ **/ 
+QVector<int> DkSearchIndex::candidates(const QString& keyword) const {
+
+	// collect the posting lists - the shortest first
+	QVector<const QVector<int>* > postings;
+
+	for (int idx = 0; idx + 3 <= keyword.size(); idx++) {
+
+		QHash<quint64, QVector<int> >::const_iterator it = mTrigrams.constFind(trigram(keyword.constData() + idx));
+
+		if (it == mTrigrams.constEnd())
+			return QVector<int>();
+
+		postings << &it.value();
+	}
+
+	std::sort(postings.begin(), postings.end(), [](const QVector<int>* l, const QVector<int>* r) {
+		return l->size() < r->size();
+	});
+
+	// intersect
+	QVector<int> ids = *postings.first();
+
+	for (int pIdx = 1; pIdx < postings.size() && !ids.empty(); pIdx++) {
+
+		QVector<int> intersection;
+		std::set_intersection(ids.begin(), ids.end(), postings[pIdx]->begin(), postings[pIdx]->end(), std::back_inserter(intersection));
+		ids = intersection;
+	}
+
+	// the trigrams' order is not indexed
+	QVector<int> matches;
+	for (int id : ids) {
+		if (mLowerList.at(id).contains(keyword))
+			matches << id;
+	}
+
+	return matches;
+}
+
+/**
+ * Returns true if all items matching the new keywords match the old keywords too.
+ * This is the case if each old keyword is part of a new keyword.
+ **/ 
+bool DkSearchIndex::refines(const QStringList& oldKeywords, const QStringList& newKeywords) {
+
+	for (const QString& o : oldKeywords) {
+
+		bool found = false;
+
+		for (const QString& n : newKeywords) {
+			if (n.contains(o)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			return false;
+	}
+
+	return true;
+}
+
+quint64 DkSearchIndex::trigram(const QChar* c) {
+
+	return ((quint64)c[0].unicode() << 32) | ((quint64)c[1].unicode() << 16) | (quint64)c[2].unicode();
+}
+
 // DkRunGuard --------------------------------------------------------------------
 DkRunGuard::DkRunGuard() : mSharedMem(mSharedMemKey) {
 
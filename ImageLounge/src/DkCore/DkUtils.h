@@ -36,6 +36,9 @@
 #include <QDebug>
 
 #include <QSharedMemory>
+#include <QMutex>
+#include <QHash>
+#include <QAtomicInt>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// dll interface missing
@@ -146,6 +149,10 @@ public:
 
 	static bool naturalCompare(const QString& s1, const QString& s2, Qt::CaseSensitivity cs = Qt::CaseSensitive);
 
+	static QByteArray naturalSortKey(const QString& str);
+
+	static int compareSortKeys(const QByteArray& lhs, const QByteArray& rhs);
+
 	static QString resolveSymLink(const QString& filePath);
 
 	static QString getLongestNumber(const QString& str, int startIdx = 0);
@@ -468,6 +475,46 @@ protected:
 	int mCIdx;
 };
 
+/**
+ * Trigram index for searching (file) names.
+ * The index is built once per list. Searches that refine the previous
+ * query (e.g. typing) just filter the previous result.
+ * All functions are thread-safe.
+ **/ 
+class DllCoreExport DkSearchIndex {
+
+public:
+	class Result {
+
+	public:
+		QString query;
+		QStringList keywords;
+		QVector<int> ids;		// indexes of the matching items (ascending)
+		QStringList matches;
+		bool regExp = false;	// true if the query was matched as regular expression
+		bool canceled = false;
+	};
+
+	DkSearchIndex(const QStringList& list = QStringList());
+
+	QStringList list() const;
+	Result search(const QString& query, const Result& previous = Result(), const QAtomicInt* cancel = 0) const;
+	static QStringList keywords(const QString& query);
+
+protected:
+	void build() const;
+	QVector<int> candidates(const QString& keyword) const;
+	static bool refines(const QStringList& oldKeywords, const QStringList& newKeywords);
+	static quint64 trigram(const QChar* c);
+
+	QStringList mList;
+
+	mutable QMutex mBuildMutex;
+	mutable bool mBuilt = false;
+	mutable QStringList mLowerList;
+	mutable QHash<quint64, QVector<int> > mTrigrams;	// trigram -> ids (ascending)
+};
+
 // from: http://stackoverflow.com/questions/5006547/qt-best-practice-for-a-single-instance-app-protection
 class DllCoreExport DkRunGuard {
 
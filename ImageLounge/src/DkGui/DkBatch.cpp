@@ -2705,6 +2705,7 @@ void DkBatchWidget::updateLog() {
 void DkBatchWidget::updateProgress(int progress) {
 
 	mProgressBar->setValue(progress);
+	mProgressBar->setToolTip(mBatchProcessing->getPipelineStats());
 	mLogNeedsUpdate = true;
 
 	DkGlobalProgress::instance().setProgressValue(qRound((double)progress / inputWidget()->getSelectedFiles().size()*100));
@@ -27,6 +27,8 @@
 
 #include "DkConnection.h"
 #include "DkSettings.h"
+#include "DkBasicLoader.h"
+#include "DkTimer.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QBuffer>
@@ -35,6 +37,8 @@
 #include <QHostInfo>
 #include <QThread>
 #include <QDebug>
+#include <QtConcurrentRun>
+#include <climits>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -551,6 +555,10 @@ void DkLocalConnection::sendQuitMessage() {
 
 // DkLANConnection --------------------------------------------------------------------
 DkLANConnection::DkLANConnection(QObject* parent /* = 0 */) : DkConnection(parent) {
+
+	connect(this, SIGNAL(bytesWritten(qint64)), this, SLOT(sendNextImageChunks()));
+	connect(&mDecodeWatcher, SIGNAL(finished()), this, SLOT(imageDecoded()));
+	connect(&mPreviewWatcher, SIGNAL(finished()), this, SLOT(previewDecoded()));
 }
 
 void DkLANConnection::sendNewUpcomingImageMessage(const QString& imageTitle) {
@@ -571,7 +579,18 @@ void DkLANConnection::sendNewUpcomingImageMessage(const QString& imageTitle) {
 };
 
 
-void DkLANConnection::sendNewImageMessage(const QImage& image, const QString& imageTitle) {
+/**
+ * Sends an image to the peer.
+ * Peers that support chunked transfers first receive a header (with a preview
+ * if they requested one) and then the image data in chunks. Chunks are only
+ * written if the socket's write buffer is (almost) empty, so sending large
+ * images neither blocks nor copies the whole image into the socket.
+ * @param image the image (used for previews & older peers)
+ * @param imageTitle the image's title
+ * @param imageData the original file's bytes or the encoded image
+ * @param fileName the file name which is needed to decode imageData
+ **/ 
+void DkLANConnection::sendNewImageMessage(const QImage& image, const QString& imageTitle, const QByteArray& imageData, const QString& fileName) {
 	if (!mAllowImage)
 		return;
 
@@ -580,19 +599,78 @@ void DkLANConnection::sendNewImageMessage(const QImage& image, const QString& im
 	if (title == "")
 		title = "nomacs - ImageLounge";
 
+	if (mPeerProtocolVersion < 2 || imageData.isEmpty()) {
+		sendLegacyImageMessage(image, title);
+		return;
+	}
+
+	QByteArray previewBA;
+	int ps = mPeerPreviewSize;
+
+	if (ps > 0 && (image.width() > ps || image.height() > ps)) {
+		QImage preview = image.scaled(ps, ps, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+		QBuffer buffer(&previewBA);
+		buffer.open(QIODevice::WriteOnly);
+		preview.save(&buffer, "JPG", 90);
+		buffer.close();
+	}
+
+	// a new image cancels the one that is currently sent
+	mSendId++;
+	mSendData = imageData;
+	mSendOffset = 0;
+
 	QByteArray ba;
 	QDataStream ds(&ba, QIODevice::ReadWrite);
+	ds << mSendId;
 	ds << title;
+	ds << fileName;
+	ds << (qint64)mSendData.size();
+	ds << previewBA;
 
-	QByteArray imageBA;
-	QBuffer buffer(&imageBA);
-	buffer.open(QIODevice::WriteOnly);
-	
-	if (image.hasAlphaChannel())
-		image.save(&buffer, "TIF");
-	else
-		image.save(&buffer, "JPG", 100);	// fastest way
-	buffer.close();
+	QByteArray data = "IMAGEHEADER";
+	data.append(SeparatorToken).append(QByteArray::number(ba.size())).append(SeparatorToken).append(ba);
+	write(data);
+
+	sendNextImageChunks();
+}
+
+void DkLANConnection::sendNextImageChunks() {
+
+	// backpressure: we only add chunks if the previous ones were written
+	while (mSendOffset < mSendData.size() && bytesToWrite() < MaxPendingImageBytes) {
+
+		int chunkSize = qMin(ImageChunkSize, mSendData.size() - mSendOffset);
+
+		QByteArray ba;
+		QDataStream ds(&ba, QIODevice::ReadWrite);
+		ds << mSendId;
+		ds << QByteArray::fromRawData(mSendData.constData() + mSendOffset, chunkSize);
+
+		QByteArray data = "IMAGECHUNK";
+		data.append(SeparatorToken).append(QByteArray::number(ba.size())).append(SeparatorToken).append(ba);
+		write(data);
+
+		mSendOffset += chunkSize;
+	}
+
+	if (!mSendData.isEmpty() && mSendOffset >= mSendData.size()) {
+		mSendData.clear();
+		mSendOffset = 0;
+	}
+}
+
+/**
+ * Sends the whole image in a single message (protocol version 1).
+ **/ 
+void DkLANConnection::sendLegacyImageMessage(const QImage& image, const QString& title) {
+
+	QByteArray ba;
+	QDataStream ds(&ba, QIODevice::ReadWrite);
+	ds << title;
+
+	QString fileName;
+	QByteArray imageBA = encodeImage(image, fileName);
 
 	ds << imageBA;
 
@@ -607,7 +685,7 @@ void DkLANConnection::sendNewImageMessage(const QImage& image, const QString& im
 	} 
 	catch(...) {
 		QString imageSize;
-		imageSize.setNum(buffer.size() / 1000000);
+		imageSize.setNum(imageBA.size() / 1000000);
 		QString msg = "sorry, I could not send the image\n " + imageSize + " MB is too much for me...";
 		qDebug() << msg;
 		emit connectionShowStatusMessage(this, msg);
@@ -643,6 +721,10 @@ void DkLANConnection::sendGreetingMessage(const QString& currentTitle) {
 	else
 		ds << " ";
 
+	// appended values are ignored by older versions
+	ds << LanProtocolVersion;
+	ds << DkSettingsManager::param().sync().imagePreviewSize;
+
 	//QByteArray data = "GREETING" + SeparatorToken + QByteArray::number(ba.size()) + SeparatorToken + ba;
 	QByteArray data = "GREETING";
 	data.append(SeparatorToken);
@@ -655,10 +737,10 @@ void DkLANConnection::sendGreetingMessage(const QString& currentTitle) {
 
 void DkLANConnection::readGreetingMessage() {
 	QString title;
+	QDataStream ds(mBuffer);
 
 	if (!mIAmServer) { // server controls which actions are allowed 
 		
-		QDataStream ds(mBuffer);
 		ds >> mClientName;
 		ds >> mAllowFile;
 		ds >> mAllowImage;
@@ -666,8 +748,10 @@ void DkLANConnection::readGreetingMessage() {
 		ds >> mAllowTransformation;
 		ds >> title;		
 	} else {
-		QDataStream ds(mBuffer); // only read clientname
+		bool allowFile, allowImage, allowPosition, allowTransformation;
 		ds >> mClientName;
+		ds >> allowFile >> allowImage >> allowPosition >> allowTransformation;	// ignored
+		ds >> title;
 
 		mAllowFile = DkSettingsManager::param().sync().allowFile;
 		mAllowImage = DkSettingsManager::param().sync().allowImage;
@@ -676,6 +760,12 @@ void DkLANConnection::readGreetingMessage() {
 		title = "";
 	}
 
+	// older versions do not send their protocol version
+	if (!ds.atEnd()) {
+		ds >> mPeerProtocolVersion;
+		ds >> mPeerPreviewSize;
+	}
+
 	//qDebug() << "emitting readyForUse";
 	emit connectionReadyForUse(mPeerServerPort, title, this);
 }
@@ -685,6 +775,8 @@ bool DkLANConnection::readProtocolHeader() {
 	QByteArray newImageBA = QByteArray("NEWIMAGE").append(SeparatorToken);
 	QByteArray upcomingImageBA = QByteArray("UPCOMINGIMAGE").append(SeparatorToken);
 	QByteArray switchServerBA = QByteArray("SWITCHSERVER").append(SeparatorToken);
+	QByteArray imageHeaderBA = QByteArray("IMAGEHEADER").append(SeparatorToken);
+	QByteArray imageChunkBA = QByteArray("IMAGECHUNK").append(SeparatorToken);
 
 	if (mBuffer == newImageBA) {
 		//qDebug() << "New Image received from:" << this->peerAddress() << ":" << this->peerPort();
@@ -695,6 +787,10 @@ bool DkLANConnection::readProtocolHeader() {
 	} else if (mBuffer == switchServerBA) {
 		//qDebug() << "Switch Server received from:" << this->peerAddress() << ":" << this->peerPort();
 		mCurrentLanDataType = switchServer;
+	} else if (mBuffer == imageHeaderBA) {
+		mCurrentLanDataType = imageHeader;
+	} else if (mBuffer == imageChunkBA) {
+		mCurrentLanDataType = imageChunk;
 	} else {
 		return DkConnection::readProtocolHeader();
 	}
@@ -706,7 +802,7 @@ bool DkLANConnection::readProtocolHeader() {
 
 void DkLANConnection::processReadyRead() {
 
-	if (mCurrentLanDataType == newImage) { // long message
+	if (mCurrentLanDataType != Undefined) { // long message
 		readWhileBytesAvailable();
 		return;
 	}
@@ -759,11 +855,67 @@ void  DkLANConnection::processData() {
 				ds >> imageBA;
 				QImage image;
 				image.loadFromData(imageBA);
-				emit connectionNewImage(this, image, title);
+				emit connectionNewImage(this, image, title, imageBA, QString());
 				//qDebug() << "emitted receivedNewImage";
 			}
 			break;
 
+	case imageHeader:
+			if (mState == Synchronized) {
+
+				QByteArray previewBA;
+				QDataStream ds(mBuffer);
+				ds >> mReceiveId;
+				ds >> mReceiveTitle;
+				ds >> mReceiveFileName;
+				ds >> mReceiveSize;
+				ds >> previewBA;
+
+				// drops the image that was received before (if any)
+				mReceiveData.clear();
+
+				// the size is sent by the peer - never trust it blindly
+				if (mReceiveSize <= 0 || mReceiveSize > MaxImageSize) {
+					qWarning() << "[DkLANConnection] illegal image size:" << mReceiveSize;
+					mReceiveSize = 0;
+				}
+				else
+					mReceiveData.reserve((int)qMin(mReceiveSize, (qint64)MaxBufferSize));
+
+				if (!previewBA.isEmpty())
+					mPreviewWatcher.setFuture(QtConcurrent::run(&DkLANConnection::decodeImage, previewBA, QString("preview.jpg")));
+			}
+			break;
+
+	case imageChunk:
+			if (mState == Synchronized) {
+
+				quint32 id = 0;
+				QByteArray chunk;
+				QDataStream ds(mBuffer);
+				ds >> id;
+				ds >> chunk;
+
+				// chunks of cancelled images are ignored
+				if (id != mReceiveId || mReceiveSize == 0)
+					break;
+
+				mReceiveData.append(chunk);
+
+				if (mReceiveData.size() >= mReceiveSize) {
+
+					mDecodeData = mReceiveData;
+					mDecodeTitle = mReceiveTitle;
+					mDecodeFileName = mReceiveFileName;
+					mReceiveData.clear();
+					mReceiveSize = 0;
+
+					// decode on a worker thread - the connection keeps receiving
+					mDecodeWatcher.setFuture(QtConcurrent::run(&DkLANConnection::decodeImage, mDecodeData, mDecodeFileName));
+				}
+			}
+			break;
+
 	case upcomingImage:
 			if (mState == Synchronized) {
 				//QString imageTitle = QString::fromUtf8(buffer);
@@ -816,4 +968,75 @@ void DkLANConnection::sendNewFileMessage(qint16 op, const QString& filename) {
 	DkConnection::sendNewFileMessage(op, filename);
 }
 
+void DkLANConnection::imageDecoded() {
+
+	QImage image = mDecodeWatcher.result();
+
+	if (image.isNull()) {
+		emit connectionShowStatusMessage(this, tr("Sorry, I could not decode %1").arg(mDecodeTitle));
+		return;
+	}
+
+	emit connectionNewImage(this, image, mDecodeTitle, mDecodeData, mDecodeFileName);
+	mDecodeData.clear();
+}
+
+void DkLANConnection::previewDecoded() {
+
+	QImage preview = mPreviewWatcher.result();
+
+	// the full image is here already
+	if (preview.isNull() || mReceiveSize == 0)
+		return;
+
+	emit connectionNewPreview(this, preview, mReceiveTitle);
+}
+
+/**
+ * Encodes an image for sending if the original file is not available.
+ * @param image the image
+ * @param fileName is set to a file name with the format's suffix
+ * @return QByteArray the encoded image
+ **/ 
+QByteArray DkLANConnection::encodeImage(const QImage& image, QString& fileName) {
+
+	QByteArray imageBA;
+	QBuffer buffer(&imageBA);
+	buffer.open(QIODevice::WriteOnly);
+	
+	if (image.hasAlphaChannel()) {
+		image.save(&buffer, "TIF");
+		fileName = "image.tif";
+	}
+	else {
+		image.save(&buffer, "JPG", 100);	// fastest way
+		fileName = "image.jpg";
+	}
+	buffer.close();
+
+	return imageBA;
+}
+
+/**
+ * Decodes received image data.
+ * All formats that nomacs can load are supported (e.g. RAW files).
+ * This function is thread-safe.
+ * @param imageData the image file's bytes
+ * @param fileName the file name which is used to identify the format
+ * @return QImage the decoded image (null if it could not be decoded)
+ **/ 
+QImage DkLANConnection::decodeImage(const QByteArray& imageData, const QString& fileName) {
+
+	DkTimer dt;
+	DkBasicLoader loader;
+	QSharedPointer<QByteArray> ba(new QByteArray(imageData));
+
+	if (!loader.loadGeneral(fileName, ba, true))
+		return QImage();
+
+	qDebug() << "[DkLANConnection]" << fileName << "decoded in" << dt;
+
+	return loader.image();
+}
+
 }
@@ -33,6 +33,7 @@
 #include <QTransform>
 #include <QHostAddress>
 #include <QImage>
+#include <QFutureWatcher>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)
@@ -58,6 +59,10 @@ namespace nmc {
 
 static const int MaxBufferSize = 102400000;
 static const char SeparatorToken = '<';
+static const quint16 LanProtocolVersion = 2;		// 2: chunked image transfer
+static const int ImageChunkSize = 512*1024;
+static const int MaxPendingImageBytes = 4*ImageChunkSize;
+static const qint64 MaxImageSize = 4*(qint64)MaxBufferSize;	// larger images announced by peers are rejected
 
 class DllCoreExport DkConnection : public QTcpSocket {
 	Q_OBJECT;
@@ -202,16 +207,23 @@ class DllCoreExport DkLANConnection : public DkConnection {
 		bool getIAmServer() {return mIAmServer;};
 		void setIAmServer(bool iAmServer) { this->mIAmServer = iAmServer;};
 
+		static QByteArray encodeImage(const QImage& image, QString& fileName);
+		static QImage decodeImage(const QByteArray& imageData, const QString& fileName);
+
 	signals:	
-		void connectionNewImage(DkConnection* connection, const QImage& image, const QString& title);
+		void connectionNewImage(DkConnection* connection, const QImage& image, const QString& title, const QByteArray& imageData, const QString& fileName);
+		void connectionNewPreview(DkConnection* connection, const QImage& image, const QString& title);
 		void connectionUpcomingImage(DkConnection* connection, const QString& imageTitle);
 		void connectionSwitchServer(DkConnection* connection, const QHostAddress& address, quint16 port);
 
 	protected slots:
 		void processReadyRead();
+		void sendNextImageChunks();
+		void imageDecoded();
+		void previewDecoded();
 
 	public slots:
-		void sendNewImageMessage(const QImage& image, const QString& title);
+		void sendNewImageMessage(const QImage& image, const QString& title, const QByteArray& imageData, const QString& fileName);
 		void sendNewUpcomingImageMessage(const QString& imageTitle);
 		void sendNewPositionMessage(const QRect& position, bool opacity, bool overlaid);
 		void sendNewTransformMessage(const QTransform& transform, const QTransform& imgTransform, const QPointF& canvasSize);
@@ -224,11 +236,14 @@ class DllCoreExport DkLANConnection : public DkConnection {
 		virtual bool readProtocolHeader();
 		virtual void processData();
 		virtual void readWhileBytesAvailable();
+		void sendLegacyImageMessage(const QImage& image, const QString& title);
 
 		enum LANDataType {
 			upcomingImage = 9,
 			newImage,
 			switchServer,
+			imageHeader,
+			imageChunk,
 			Undefined
 		};
 		LANDataType mCurrentLanDataType = Undefined;
@@ -236,6 +251,26 @@ class DllCoreExport DkLANConnection : public DkConnection {
 		bool mAllowPosition = false;
 		bool mAllowFile = false;
 		bool mAllowImage = false;
+		quint16 mPeerProtocolVersion = 1;
+		int mPeerPreviewSize = 0;
+
+		// image that is sent in chunks
+		quint32 mSendId = 0;
+		QByteArray mSendData;
+		int mSendOffset = 0;
+
+		// image that is received in chunks
+		quint32 mReceiveId = 0;
+		qint64 mReceiveSize = 0;
+		QByteArray mReceiveData;
+		QString mReceiveTitle;
+		QString mReceiveFileName;
+
+		QFutureWatcher<QImage> mDecodeWatcher;
+		QFutureWatcher<QImage> mPreviewWatcher;
+		QByteArray mDecodeData;
+		QString mDecodeTitle;
+		QString mDecodeFileName;
 
 	private:
 
@@ -332,7 +332,7 @@ void DkControlWidget::update() {
 
 void DkControlWidget::showWidgetsSettings() {
 
-	if (mViewport->getImage().isNull()) {
+	if (!mViewport->hasImage()) {
 		showPreview(false);
 		showScroller(false);
 		showMetaData(false);
@@ -388,7 +388,7 @@ void DkControlWidget::showPreview(bool visible) {
 	if (visible && !mFilePreview->isVisible())
 		mFilePreview->show();
 	else if (!visible && mFilePreview->isVisible())
-		mFilePreview->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mFilePreview->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 }
 
 void DkControlWidget::showScroller(bool visible) {
@@ -399,7 +399,7 @@ void DkControlWidget::showScroller(bool visible) {
 	if (visible && !mFolderScroll->isVisible())
 		mFolderScroll->show();
 	else if (!visible && mFolderScroll->isVisible())
-		mFolderScroll->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mFolderScroll->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 }
 
 void DkControlWidget::showMetaData(bool visible) {
@@ -412,7 +412,7 @@ void DkControlWidget::showMetaData(bool visible) {
 		qDebug() << "showing metadata...";
 	}
 	else if (!visible && mMetaDataInfo->isVisible())
-		mMetaDataInfo->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mMetaDataInfo->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 }
 
 void DkControlWidget::showFileInfo(bool visible) {
@@ -425,7 +425,7 @@ void DkControlWidget::showFileInfo(bool visible) {
 		mRatingLabel->block(mFileInfoLabel->isVisible());
 	}
 	else if (!visible && mFileInfoLabel->isVisible()) {
-		mFileInfoLabel->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mFileInfoLabel->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 		mRatingLabel->block(false);
 	}
 }
@@ -438,7 +438,7 @@ void DkControlWidget::showPlayer(bool visible) {
 	if (visible)
 		mPlayer->show();
 	else
-		mPlayer->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mPlayer->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 }
 
 void DkControlWidget::startSlideshow(bool start) {
@@ -455,7 +455,7 @@ void DkControlWidget::showOverview(bool visible) {
 		mZoomWidget->show();
 	}
 	else if (!visible && mZoomWidget->isVisible()) {
-		mZoomWidget->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mZoomWidget->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 	}
 
 }
@@ -484,11 +484,11 @@ void DkControlWidget::showHistogram(bool visible) {
 
 	if (visible && !mHistogram->isVisible()) {
 		mHistogram->show();
-		if(!mViewport->getImage().isNull()) mHistogram->drawHistogram(mViewport->getImage());
+		if(mViewport->hasImage()) mHistogram->drawHistogram(mViewport->getImageStorage()->getImageConst());
 		else  mHistogram->clearHistogram();
 	}
 	else if (!visible && mHistogram->isVisible()) {
-		mHistogram->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mHistogram->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 	}
 }
 
@@ -501,7 +501,7 @@ void DkControlWidget::showCommentWidget(bool visible) {
 		mCommentWidget->show();
 	}
 	else if (!visible && mCommentWidget->isVisible()) {
-		mCommentWidget->hide(!mViewport->getImage().isNull());	// do not save settings if we have no image in the mViewport
+		mCommentWidget->hide(mViewport->hasImage());	// do not save settings if we have no image in the mViewport
 	}
 }
 
@@ -78,6 +78,11 @@
 #include <QProgressBar>
 #include <QFuture>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QDirIterator>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QSaveFile>
 #include <QMouseEvent>
 #include <QAction>
 #include <QMessageBox>
@@ -97,6 +102,9 @@
 
 #pragma warning(pop)		// no warnings from includes - end
 
+#include <algorithm>
+#include <cfloat>
+
 namespace nmc {
 
 // DkSplashScreen --------------------------------------------------------------------
@@ -653,12 +661,21 @@ void DkSearchDialog::init() {
 
 	mSearchBar->setFocus(Qt::MouseFocusReason);
 
+	connect(&mSearchWatcher, SIGNAL(finished()), this, SLOT(searchFinished()));
+
 	QMetaObject::connectSlotsByName(this);
 }
 
 void DkSearchDialog::setFiles(const QStringList& fileList) {
+
+	// a running search would report matches of the old files
+	if (mCancelSearch)
+		mCancelSearch->store(1);
+
 	mFileList = fileList;
 	mResultList = fileList;
+	mIndex = QSharedPointer<DkSearchIndex>(new DkSearchIndex(fileList));
+	mLastResult = DkSearchIndex::Result();
 	mStringModel->setStringList(makeViewable(fileList));
 }
 
@@ -672,15 +689,46 @@ bool DkSearchDialog::filterPressed() const {
 
 void DkSearchDialog::on_searchBar_textChanged(const QString& text) {
 
-	DkTimer dt;
-
 	if (text == mCurrentSearch)
 		return;
 	
-	mResultList = DkUtils::filterStringList(text, mFileList);
-	qDebug() << "searching [" << text << "] - converted to individual keywords [" << text.split(" ") << "] takes: " << dt;
 	mCurrentSearch = text;
 
+	if (!mIndex)
+		mIndex = QSharedPointer<DkSearchIndex>(new DkSearchIndex(mFileList));
+
+	// cancel the running search - its result is outdated anyway
+	if (mCancelSearch)
+		mCancelSearch->store(1);
+
+	mCancelSearch = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+	QSharedPointer<DkSearchIndex> index = mIndex;
+	QSharedPointer<QAtomicInt> cancel = mCancelSearch;
+	DkSearchIndex::Result previous = mLastResult;
+
+	// the index is built with the first search - so it runs in the thread too
+	QFuture<DkSearchIndex::Result> future = QtConcurrent::run([index, text, previous, cancel]() {
+		return index->search(text, previous, cancel.data());
+	});
+	mSearchWatcher.setFuture(future);
+}
+
+void DkSearchDialog::searchFinished() {
+
+	DkSearchIndex::Result r = mSearchWatcher.result();
+
+	if (r.canceled || r.query != mCurrentSearch)
+		return;
+
+	mLastResult = r;
+	mResultList = r.matches;
+
+	updateResults();
+}
+
+void DkSearchDialog::updateResults() {
+
 	if (mResultList.empty()) {
 		QStringList answerList;
 		answerList.append(tr("No Matching Items"));
@@ -702,8 +750,6 @@ void DkSearchDialog::on_searchBar_textChanged(const QString& text) {
 	mResultListView->style()->unpolish(mResultListView);
 	mResultListView->style()->polish(mResultListView);
 	mResultListView->update();
-
-	qDebug() << "searching takes (total): " << dt;
 }
 
 void DkSearchDialog::on_resultListView_doubleClicked(const QModelIndex& modelIndex) {
@@ -725,6 +771,12 @@ void DkSearchDialog::on_resultListView_clicked(const QModelIndex& modelIndex) {
 
 void DkSearchDialog::accept() {
 
+	// enter was pressed before the search finished - the selection is outdated
+	if (mCancelSearch && mLastResult.query != mCurrentSearch) {
+		mSearchWatcher.waitForFinished();
+		searchFinished();
+	}
+
 	if (mResultListView->selectionModel()->currentIndex().data().toString() == mEndMessage) {
 		mStringModel->setStringList(makeViewable(mResultList, true));
 		return;
@@ -2843,6 +2895,371 @@ void DkExportTiffDialog::enableTIFFSave(bool enable) {
 
 #ifdef WITH_OPENCV
 
+// DkMosaicDatabase --------------------------------------------------------------------
+DkMosaicDatabase::DkMosaicDatabase(const QString& dirPath) {
+
+	mDirPath = QFileInfo(dirPath).absoluteFilePath();
+}
+
+/**
+ * Lists all images of the database folder (including sub folders).
+ * @param dirPath the database folder
+ * @param ignore files are ignored if their path contains one of these (; separated) keywords
+ * @param suffix if not empty, only files with this suffix are listed
+ * @return QStringList the sorted file paths
+ **/ 
+QStringList DkMosaicDatabase::imageFiles(const QString& dirPath, const QString& ignore, const QString& suffix) {
+
+	QStringList fileFilters = (suffix.isEmpty()) ? DkSettingsManager::param().app().fileFilters : QStringList(suffix);
+	QStringList ignoreList = ignore.split(";", QString::SkipEmptyParts);
+	QStringList files;
+
+	QDirIterator it(dirPath, fileFilters, QDir::Files, QDirIterator::Subdirectories);
+
+	while (it.hasNext()) {
+
+		QString filePath = it.next();
+		bool lIgnore = false;
+
+		for (const QString& i : ignoreList) {
+			if (filePath.contains(i)) {
+				lIgnore = true;
+				break;
+			}
+		}
+
+		if (!lIgnore)
+			files << filePath;
+	}
+
+	files.sort();	// the mosaic should not depend on the file system's order
+
+	return files;
+}
+
+/**
+ * Updates the tile descriptors.
+ * Descriptors of new or changed files are computed in parallel,
+ * all others are loaded from the persisted database.
+ * This function blocks - run it in a thread.
+ * @param files the database's images
+ * @param progress is called with the progress [0 100] - indexing is canceled if it returns false
+ * @return bool false if indexing was canceled.
+ **/ 
+bool DkMosaicDatabase::update(const QStringList& files, std::function<bool (int)> progress) {
+
+	DkTimer dt;
+
+	QHash<QString, Tile> persisted;
+	load(persisted);
+
+	QVector<Tile> tiles;
+	QVector<Tile> missing;
+
+	for (const QString& filePath : files) {
+
+		QFileInfo fi(filePath);
+		QHash<QString, Tile>::const_iterator it = persisted.find(filePath);
+
+		if (it != persisted.end() && it->modified == fi.lastModified().toMSecsSinceEpoch() && it->size == fi.size()) {
+			tiles << it.value();
+		}
+		else {
+			Tile t;
+			t.filePath = filePath;
+			missing << t;
+		}
+	}
+
+	QAtomicInt numComputed = 0;
+	QAtomicInt canceled = 0;
+
+	QtConcurrent::blockingMap(missing, [&](Tile& t) {
+
+		if (canceled.load())
+			return;
+
+		computeTile(t);
+
+		int cnt = numComputed.fetchAndAddRelaxed(1) + 1;
+		if (progress && !progress(qRound((float)cnt / missing.size() * 100)))
+			canceled.store(1);
+	});
+
+	// tiles that were not computed (canceled) are saved as outdated
+	tiles << missing;
+
+	mTiles.clear();
+	for (const Tile& t : tiles) {
+		if (!t.luminance.isEmpty())
+			mTiles << t;
+	}
+
+	// failed images are saved too - so they are not read again
+	if (!missing.isEmpty() || tiles.size() != persisted.size())
+		save(tiles);
+
+	std::sort(mTiles.begin(), mTiles.end(), [](const Tile& l, const Tile& r) {
+		return l.meanL < r.meanL;
+	});
+
+	qInfo() << "[DkMosaicDatabase]" << missing.size() << "of" << files.size() << "tiles computed in" << dt;
+
+	return !canceled.load();
+}
+
+/**
+ * Assigns tiles to the patches of an image.
+ * Each patch gets the tile which is closest (sum of squared differences of the
+ * luminance descriptors). Tiles are only used twice if the database is too small.
+ * The search starts at the patch's mean luminance and stops as soon as the mean
+ * difference alone exceeds the best distance found - since
+ * SSD(x,y) >= n * (mean(x) - mean(y))^2 this is an exact nearest neighbor search.
+ * @param imgL the image's luminance channel
+ * @param patchRes the patch resolution in imgL
+ * @param numPatchesH the number of horizontal patches
+ * @param numPatchesV the number of vertical patches
+ * @return QVector<int> the tile index of each patch (row-major)
+ **/ 
+QVector<int> DkMosaicDatabase::assign(const cv::Mat& imgL, int patchRes, int numPatchesH, int numPatchesV) const {
+
+	int numPatches = numPatchesH * numPatchesV;
+	QVector<int> assignment(numPatches, -1);
+
+	if (mTiles.empty())
+		return assignment;
+
+	// compute the descriptors of all patches
+	QVector<float> means(numPatches);
+	QVector<QByteArray> descriptors(numPatches);
+	QVector<int> patches(numPatches);
+
+	for (int idx = 0; idx < numPatches; idx++)
+		patches[idx] = idx;
+
+	float* meanPtr = means.data();
+	QByteArray* descriptorPtr = descriptors.data();
+
+	QtConcurrent::blockingMap(patches, [&](int pIdx) {
+
+		int rIdx = pIdx / numPatchesH;
+		int cIdx = pIdx % numPatchesH;
+
+		cv::Mat p = imgL.rowRange(rIdx*patchRes, rIdx*patchRes+patchRes).colRange(cIdx*patchRes, cIdx*patchRes+patchRes);
+		descriptorPtr[pIdx] = descriptor(p, meanPtr[pIdx]);
+	});
+
+	const int n = descriptorRes*descriptorRes;
+	int maxUses = qCeil((float)numPatches / mTiles.size());
+	QVector<int> uses(mTiles.size(), 0);
+
+	for (int pIdx = 0; pIdx < numPatches; pIdx++) {
+
+		const unsigned char* pd = (const unsigned char*)descriptors[pIdx].constData();
+		float mean = means[pIdx];
+
+		// the first tile with a mean >= the patch's mean
+		int hi = (int)(std::lower_bound(mTiles.begin(), mTiles.end(), mean, [](const Tile& t, float m) {
+			return t.meanL < m;
+		}) - mTiles.begin());
+		int lo = hi-1;
+
+		int bestIdx = -1;
+		double bestDist = DBL_MAX;
+
+		while (lo >= 0 || hi < mTiles.size()) {
+
+			float dLo = (lo >= 0) ? mean - mTiles[lo].meanL : FLT_MAX;
+			float dHi = (hi < mTiles.size()) ? mTiles[hi].meanL - mean : FLT_MAX;
+			bool takeLo = dLo <= dHi;
+			float dMean = takeLo ? dLo : dHi;
+
+			if ((double)n*dMean*dMean >= bestDist)
+				break;
+
+			int tIdx = takeLo ? lo-- : hi++;
+
+			if (uses[tIdx] >= maxUses)
+				continue;
+
+			const unsigned char* td = (const unsigned char*)mTiles[tIdx].luminance.constData();
+			int dist = 0;
+			for (int idx = 0; idx < n; idx++) {
+				int d = (int)pd[idx] - (int)td[idx];
+				dist += d*d;
+			}
+
+			if (dist < bestDist) {
+				bestDist = dist;
+				bestIdx = tIdx;
+			}
+		}
+
+		if (bestIdx >= 0) {
+			assignment[pIdx] = bestIdx;
+			uses[bestIdx]++;
+		}
+	}
+
+	return assignment;
+}
+
+int DkMosaicDatabase::size() const {
+
+	return mTiles.size();
+}
+
+const DkMosaicDatabase::Tile& DkMosaicDatabase::tile(int idx) const {
+
+	return mTiles[idx];
+}
+
+/**
+ * Creates a square luminance patch of an image.
+ * The full image is loaded if the thumbnail's resolution is not sufficient.
+ * @param thumb the image's thumbnail
+ * @param patchRes the patch resolution
+ * @return cv::Mat the patch (empty if the image cannot be loaded)
+ **/ 
+cv::Mat DkMosaicDatabase::patch(const DkThumbNail& thumb, int patchRes) {
+
+	QImage img;
+
+	// load full image if we have not enough resolution
+	if (qMin(thumb.getImage().width(), thumb.getImage().height()) < patchRes) {
+		DkBasicLoader loader;
+		loader.loadGeneral(thumb.getFilePath(), true, true);
+		img = loader.image();
+	}
+	else
+		img = thumb.getImage();
+
+	if (img.isNull())
+		return cv::Mat();
+
+	cv::Mat cvThumb = DkImage::qImage2Mat(img);
+	cv::cvtColor(cvThumb, cvThumb, CV_RGB2Lab);
+	std::vector<cv::Mat> channels;
+	cv::split(cvThumb, channels);
+	cvThumb = channels[0];
+	channels.clear();
+
+	// make square
+	if (cvThumb.rows != cvThumb.cols) {
+
+		if (cvThumb.rows > cvThumb.cols) {
+			float sh = (cvThumb.rows - cvThumb.cols)/2.0f;
+			cvThumb = cvThumb.rowRange(qFloor(sh), cvThumb.rows-qCeil(sh));
+		}
+		else {
+			float sh = (cvThumb.cols - cvThumb.rows)/2.0f;
+			cvThumb = cvThumb.colRange(qFloor(sh), cvThumb.cols-qCeil(sh));
+		}
+	}
+
+	cv::resize(cvThumb, cvThumb, cv::Size(patchRes, patchRes), 0.0, 0.0, CV_INTER_AREA);
+
+	return cvThumb;
+}
+
+void DkMosaicDatabase::computeTile(Tile& tile) {
+
+	QFileInfo fi(tile.filePath);
+	tile.modified = fi.lastModified().toMSecsSinceEpoch();
+	tile.size = fi.size();
+
+	try {
+		DkThumbNail thumb(tile.filePath);
+		thumb.compute();
+
+		cv::Mat p = patch(thumb, descriptorRes);
+
+		if (!p.empty())
+			tile.luminance = descriptor(p, tile.meanL);
+	}
+	// catch cv exceptions e.g. out of memory
+	catch(...) {
+		tile.luminance.clear();
+	}
+}
+
+QByteArray DkMosaicDatabase::descriptor(const cv::Mat& patchL, float& meanL) {
+
+	cv::Mat d;
+	cv::resize(patchL, d, cv::Size(descriptorRes, descriptorRes), 0.0, 0.0, CV_INTER_AREA);
+
+	QByteArray ba(descriptorRes*descriptorRes, '\0');
+	unsigned char* baPtr = (unsigned char*)ba.data();
+	int sum = 0;
+
+	for (int rIdx = 0; rIdx < d.rows; rIdx++) {
+
+		const unsigned char* dPtr = d.ptr<unsigned char>(rIdx);
+
+		for (int cIdx = 0; cIdx < d.cols; cIdx++) {
+			*baPtr++ = dPtr[cIdx];
+			sum += dPtr[cIdx];
+		}
+	}
+
+	meanL = (float)sum / (descriptorRes*descriptorRes);
+
+	return ba;
+}
+
+QString DkMosaicDatabase::databaseFilePath() const {
+
+	QString hash = QCryptographicHash::hash(mDirPath.toUtf8(), QCryptographicHash::Md5).toHex();
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/mosaic/" + hash + ".db";
+}
+
+void DkMosaicDatabase::load(QHash<QString, Tile>& tiles) const {
+
+	QFile file(databaseFilePath());
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream ds(&file);
+	quint32 magic = 0, version = 0;
+	int res = 0, numTiles = 0;
+	ds >> magic >> version >> res >> numTiles;
+
+	if (magic != 0x4e4d4d44 || version != 1 || res != descriptorRes)	// NMMD
+		return;
+
+	for (int idx = 0; idx < numTiles && ds.status() == QDataStream::Ok; idx++) {
+
+		Tile t;
+		ds >> t.filePath >> t.modified >> t.size >> t.meanL >> t.luminance;
+
+		if (ds.status() == QDataStream::Ok)
+			tiles.insert(t.filePath, t);
+	}
+}
+
+void DkMosaicDatabase::save(const QVector<Tile>& tiles) const {
+
+	if (DkSettingsManager::param().app().privateMode)
+		return;
+
+	QString dbPath = databaseFilePath();
+	QDir().mkpath(QFileInfo(dbPath).absolutePath());
+
+	QSaveFile file(dbPath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkMosaicDatabase] cannot write" << dbPath;
+		return;
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)0x4e4d4d44 << (quint32)1 << (int)descriptorRes << tiles.size();
+
+	for (const Tile& t : tiles)
+		ds << t.filePath << t.modified << t.size << t.meanL << t.luminance;
+
+	file.commit();
+}
+
 // DkMosaicDialog --------------------------------------------------------------------
 DkMosaicDialog::DkMosaicDialog(QWidget* parent /* = 0 */, Qt::WindowFlags f /* = 0 */) : QDialog(parent, f) {
 
@@ -3304,12 +3721,8 @@ int DkMosaicDialog::computeMosaic(const QString& filter, const QString& suffix,
 	cv::split(mImgLab, channels);
 	cv::Mat imgL = channels[0];
 
-	// keeps track of the weights
-	cv::Mat cc(numPatches.height(), numPatches.width(), CV_32FC1);
-	cc.setTo(0);
-	cv::Mat ccD(numPatches.height(), numPatches.width(), CV_8UC1);	// tells us if we have already computed the real patch
-
-	mFilesUsed.resize(numPatches.height()*numPatches.width());
+	int maxP = numPatches.width()*numPatches.height();
+	mFilesUsed.resize(maxP);
 
 	// destination image
 	cv::Mat dImg(patchResD*numPatches.height(), patchResD*numPatches.width(), CV_8UC1);
@@ -3325,171 +3738,93 @@ int DkMosaicDialog::computeMosaic(const QString& filter, const QString& suffix,
 	qDebug() << "num patches: " << numPatches.width() << " x " << numPatches.height();
 	qDebug() << "mosaic data --------------------------------";
 
-	// progress bar
-	int pIdx = 0;
-	int maxP = numPatches.width()*numPatches.height();
+	// index the database - only new or changed images are read
+	emit infoMessage(tr("Indexing images..."));
 
-	int iDidNothing = 0;
-	bool force = false;
-	bool useTwice = false;
+	DkMosaicDatabase db(mSavePath);
+	bool indexed = db.update(DkMosaicDatabase::imageFiles(mSavePath, filter, suffix), [&](int progress) {
+		emit updateProgress(progress);
+		return mProcessing;
+	});
 
-	while (iDidNothing < 10000) {
+	if (!indexed || !mProcessing)
+		return QDialog::Rejected;
 
-		if (!mProcessing)
-			return QDialog::Rejected;
+	if (db.size() == 0) {
+		emit infoMessage(tr("Sorry, it seems that i cannot create your mosaic with this database."));
+		return QDialog::Rejected;
+	}
 
-		if (iDidNothing > 100) {
-			force = true;
+	QVector<int> tiles = db.assign(imgL, patchResO, numPatches.width(), numPatches.height());
 
-			if (!useTwice)
-				emit infoMessage(tr("Filling empty areas..."));
-		}
+	if (db.size() < maxP)
+		emit infoMessage(tr("I need to use some images twice - maybe the database is too small?"));
+	else
+		emit infoMessage(tr("Rendering %1 patches...").arg(maxP));
 
-		if (iDidNothing > 400 && !useTwice) {
-			emit infoMessage(tr("I need to use some images twice - maybe the database is too small?"));
-			iDidNothing = 0;
-			useTwice = true;
-		}
-		else if (iDidNothing > 400) {
-			emit infoMessage(tr("Sorry, it seems that i cannot create your mosaic with this database."));
-			return QDialog::Rejected;
-		}
+	emit updateProgress(0);
 
-		QString imgPath = getRandomImagePath(mSavePath, filter, suffix);
+	// render all patches
+	QVector<int> patches(maxP);
+	for (int idx = 0; idx < maxP; idx++)
+		patches[idx] = idx;
 
-		if (!useTwice && mFilesUsed.contains(QFileInfo(imgPath))) {
-			iDidNothing++;
-			continue;
-		}
+	QFileInfo* filesUsed = mFilesUsed.data();
+	QAtomicInt numRendered = 0;
+	QAtomicInt numFailed = 0;
 
-		try {
+	QtConcurrent::blockingMap(patches, [&](int pIdx) {
 
-			DkThumbNail thumb = DkThumbNail(imgPath);
-			thumb.setMinThumbSize(patchResO);
-			//thumb.setRescale(false);
-			thumb.compute();
+		if (!mProcessing || tiles[pIdx] < 0)
+			return;
 
-			if (!thumb.hasImage()) {
-				iDidNothing++;
-				continue;
-			}
+		int rIdx = pIdx / numPatches.width();
+		int cIdx = pIdx % numPatches.width();
+		QString filePath = db.tile(tiles[pIdx]).filePath;
 
-			cv::Mat ccTmp(cc.size(), cc.depth());
-		
-			if (!force)
-				ccTmp.setTo(0);
-			else
-				ccTmp = cc.clone();
+		try {
+			DkThumbNail thumb(filePath);
+			thumb.compute();
 
-			cv::Mat thumbPatch = createPatch(thumb, patchResO);
-		
-			if (thumbPatch.rows != patchResO || thumbPatch.cols != patchResO) {
-				iDidNothing++;
-				continue;
-			}
-		
-			matchPatch(imgL, thumbPatch, patchResO, ccTmp);
+			cv::Mat thumbPatch = DkMosaicDatabase::patch(thumb, patchResD);
 
-			if (force) {
-				cv::Mat mask = (cc == 0);
-				mask.convertTo(mask, CV_32FC1, 1.0f/255.0f);
-				ccTmp = ccTmp.mul(mask);
+			if (thumbPatch.empty()) {
+				numFailed.fetchAndAddRelaxed(1);
+				return;
 			}
-				
-			double maxVal = 0;
-			cv::Point maxIdx;
-			cv::minMaxLoc(ccTmp, 0, &maxVal, 0, &maxIdx);
-			float* ccPtr = cc.ptr<float>(maxIdx.y);
 
-			if (maxVal > ccPtr[maxIdx.x]) {
-
-				cv::Mat pPatch = pImg.rowRange(maxIdx.y*patchResO, maxIdx.y*patchResO+patchResO)
-					.colRange(maxIdx.x*patchResO, maxIdx.x*patchResO+patchResO);
-				thumbPatch.copyTo(pPatch);
-			
-				// visualize
-				if (pIdx % 10 == 0) {
-				
-					channels[0] = pImg;
-				
-					//debug
-					cv::Mat imgT3;
-					cv::merge(channels, imgT3);
-					cv::cvtColor(imgT3, imgT3, CV_Lab2BGR);
-					emit updateImage(DkImage::mat2QImage(imgT3));
-				}
-
-				if (ccPtr[maxIdx.x] == 0) {
-					pIdx++;
-					emit updateProgress(qRound((float)pIdx/maxP*100));
-				}
-
-				// compute it now if we already have the full image loaded
-				if (thumb.getImage().width() > patchResD && thumb.getImage().height() > patchResD) {
-					thumbPatch = createPatch(thumb, patchResD);
-
-					cv::Mat dPatch = dImg.rowRange(maxIdx.y*patchResD, maxIdx.y*patchResD+patchResD)
-						.colRange(maxIdx.x*patchResD, maxIdx.x*patchResD+patchResD);
-					thumbPatch.copyTo(dPatch);
-					ccD.ptr<unsigned char>(maxIdx.y)[maxIdx.x] = 1;
-				}
-				else
-					ccD.ptr<unsigned char>(maxIdx.y)[maxIdx.x] = 0;
+			cv::Mat dPatch = dImg.rowRange(rIdx*patchResD, rIdx*patchResD+patchResD)
+				.colRange(cIdx*patchResD, cIdx*patchResD+patchResD);
+			thumbPatch.copyTo(dPatch);
 
-				// update cc
-				ccPtr[maxIdx.x] = (float)maxVal;
+			cv::Mat pPatch = pImg.rowRange(rIdx*patchResO, rIdx*patchResO+patchResO)
+				.colRange(cIdx*patchResO, cIdx*patchResO+patchResO);
+			cv::resize(thumbPatch, pPatch, pPatch.size(), 0.0, 0.0, CV_INTER_AREA);
 
-				mFilesUsed[maxIdx.y*numPatchesH+maxIdx.x] = thumb.getFilePath();	// replaces additionally the old file
-				iDidNothing = 0;
-			}
-			else
-				iDidNothing++;
-		} 
+			filesUsed[pIdx] = QFileInfo(filePath);
+		}
 		// catch cv exceptions e.g. out of memory
 		catch(...) {
-			iDidNothing++;
+			numFailed.fetchAndAddRelaxed(1);
+			return;
 		}
 
-		// are we done yet?
-		double minVal = 0;
-		cv::minMaxLoc(cc, &minVal);
-
-		if (minVal > 0)
-			break;
-		
-	}
-
-	pIdx = 0;
-
-	// compute real resolution
-	for (int rIdx = 0; rIdx < ccD.rows; rIdx++) {
-
-		const unsigned char* ccDPtr = ccD.ptr<unsigned char>(rIdx);
-
-		for (int cIdx = 0; cIdx < ccD.cols; cIdx++) {
-
-			// is the patch already computed?
-			if (ccDPtr[cIdx])
-				continue;
-
-			QFileInfo cFile = mFilesUsed.at(rIdx*ccD.cols+cIdx);
+		int cnt = numRendered.fetchAndAddRelaxed(1) + 1;
+		emit updateProgress(qRound((float)cnt/maxP*100));
+	});
 
-			if (!cFile.exists()) {
-				emit infoMessage(tr("Something is seriously wrong, I could not load: %1").arg(cFile.absoluteFilePath()));
-				continue;
-			}
-
-			cv::Mat thumbPatch = createPatch(DkThumbNail(cFile.absoluteFilePath()), patchResD);
+	if (!mProcessing)
+		return QDialog::Rejected;
 
-			cv::Mat dPatch = dImg.rowRange(rIdx*patchResD, rIdx*patchResD+patchResD)
-				.colRange(cIdx*patchResD, cIdx*patchResD+patchResD);
-			thumbPatch.copyTo(dPatch);
-			emit updateProgress(qRound((float)pIdx/maxP*100));
-			pIdx++;
-		}
-	}
+	if (numFailed.load() > 0)
+		qWarning() << "[DkMosaicDialog]" << numFailed.load() << "patches could not be rendered";
 
-	qDebug() << "I fully rendered: " << ccD.rows*ccD.cols-cv::sum(ccD)[0] << " images";
+	// visualize
+	channels[0] = pImg;
+	cv::Mat imgT3;
+	cv::merge(channels, imgT3);
+	cv::cvtColor(imgT3, imgT3, CV_Lab2BGR);
+	emit updateImage(DkImage::mat2QImage(imgT3));
 
 	// create final images
 	mOrigImg = mImgLab;
@@ -3503,121 +3838,6 @@ int DkMosaicDialog::computeMosaic(const QString& filter, const QString& suffix,
 	return QDialog::Accepted;
 }
 
-void DkMosaicDialog::matchPatch(const cv::Mat& img, const cv::Mat& thumb, int patchRes, cv::Mat& cc) {
-
-	for (int rIdx = 0; rIdx < cc.rows; rIdx++) {
-
-		float* ccPtr = cc.ptr<float>(rIdx);
-		const cv::Mat imgStrip = img.rowRange(rIdx*patchRes, rIdx*patchRes+patchRes);
-
-		for (int cIdx = 0; cIdx < cc.cols; cIdx++) {
-
-			// already computed?
-			if (ccPtr[cIdx] != 0)
-				continue;
-
-			const cv::Mat cPatch = imgStrip.colRange(cIdx*patchRes, cIdx*patchRes+patchRes);
-			
-			cv::Mat absDiff;
-			cv::absdiff(cPatch, thumb, absDiff);
-			ccPtr[cIdx] = 1.0f-((float)cv::sum(absDiff)[0]/(patchRes*patchRes*255));
-		}
-	}
-}
-
-cv::Mat DkMosaicDialog::createPatch(const DkThumbNail& thumb, int patchRes) {
-
-	QImage img;
-
-	// load full image if we have not enough resolution
-	if (qMin(thumb.getImage().width(), thumb.getImage().height()) < patchRes) {
-		DkBasicLoader loader;
-		loader.loadGeneral(thumb.getFilePath(), true, true);
-		img = loader.image();
-	}
-	else
-		img = thumb.getImage();
-
-	cv::Mat cvThumb = DkImage::qImage2Mat(img);
-	cv::cvtColor(cvThumb, cvThumb, CV_RGB2Lab);
-	std::vector<cv::Mat> channels;
-	cv::split(cvThumb, channels);
-	cvThumb = channels[0];
-	channels.clear();
-
-	// make square
-	if (cvThumb.rows != cvThumb.cols) {
-
-		if (cvThumb.rows > cvThumb.cols) {
-			float sh = (cvThumb.rows - cvThumb.cols)/2.0f;
-			cvThumb = cvThumb.rowRange(qFloor(sh), cvThumb.rows-qCeil(sh));
-		}
-		else {
-			float sh = (cvThumb.cols - cvThumb.rows)/2.0f;
-			cvThumb = cvThumb.colRange(qFloor(sh), cvThumb.cols-qCeil(sh));
-		}
-	}
-
-	if (cvThumb.rows < patchRes || cvThumb.cols < patchRes)
-		qDebug() << "enlarging thumbs!!";
-
-	cv::resize(cvThumb, cvThumb, cv::Size(patchRes, patchRes), 0.0, 0.0, CV_INTER_AREA);
-
-	return cvThumb;
-}
-
-QString DkMosaicDialog::getRandomImagePath(const QString& cPath, const QString& ignore, const QString& suffix) {
-
-	// TODO: remove hierarchy
-	QStringList fileFilters = (suffix.isEmpty()) ? DkSettingsManager::param().app().fileFilters : QStringList(suffix);
-
-	// get all dirs
-	QFileInfoList entries = QDir(cPath).entryInfoList(QStringList(), QDir::AllDirs | QDir::NoDotAndDotDot);
-	//qDebug() << entries;
-	// get all files
-	entries += QDir(cPath).entryInfoList(fileFilters);
-	//qDebug() << "current entries: " << e;
-
-	if (!ignore.isEmpty()) {
-
-		QStringList ignoreList = ignore.split(";");
-		QFileInfoList entriesTmp = entries;
-		entries.clear();
-
-		for (int idx = 0; idx < entriesTmp.size(); idx++) {
-			
-			bool lIgnore = false;
-			QString p = entriesTmp.at(idx).absoluteFilePath();
-
-			for (int iIdx = 0; iIdx < ignoreList.size(); iIdx++) {
-				if (p.contains(ignoreList.at(iIdx))) {
-					lIgnore = true;
-					break;
-				}
-			}
-
-			if (!lIgnore)
-				entries.append(entriesTmp.at(idx));
-		}
-	}
-		
-
-	if (entries.isEmpty())
-		return QString();
-
-	int rIdx = qRound((float)qrand()/RAND_MAX*(entries.size()-1));
-
-	//qDebug() << "rand index: " << rIdx;
-
-	QFileInfo rPath = entries.at(rIdx);
-	//qDebug() << rPath.absoluteFilePath();
-
-	if (rPath.isDir())
-		return getRandomImagePath(rPath.absoluteFilePath(), ignore, suffix);
-	else
-		return rPath.absoluteFilePath();
-}
-
 void DkMosaicDialog::updatePostProcess() {
 	
 	if (mMosaicMat.empty() || mProcessing)
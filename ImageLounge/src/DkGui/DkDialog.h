@@ -38,7 +38,10 @@
 #include <QFutureWatcher>
 #pragma warning(pop)		// no warnings from includes - end
 
+#include <functional>
+
 #include "DkBasicLoader.h"
+#include "DkUtils.h"
 
 // Qt defines
 class QStandardItemModel;
@@ -228,6 +231,7 @@ public slots:
 	void on_resultListView_doubleClicked(const QModelIndex& modelIndex);
 	void on_resultListView_clicked(const QModelIndex& modelIndex);
 	virtual void accept();
+	void searchFinished();
 
 signals:
 	void loadFileSignal(const QString& filePath) const;
@@ -237,6 +241,7 @@ protected:
 
 	void updateHistory();
 	void init();
+	void updateResults();
 	QStringList makeViewable(const QStringList& resultList, bool forceAll = false);
 
 	QStringListModel* mStringModel = 0;
@@ -252,6 +257,11 @@ protected:
 	QStringList mFileList;
 	QStringList mResultList;
 
+	QSharedPointer<DkSearchIndex> mIndex;
+	DkSearchIndex::Result mLastResult;
+	QFutureWatcher<DkSearchIndex::Result> mSearchWatcher;
+	QSharedPointer<QAtomicInt> mCancelSearch;
+
 	QString mEndMessage;
 
 	bool mAllDisplayed = true;
@@ -695,6 +705,48 @@ protected:
 
 #ifdef WITH_OPENCV
 
+/**
+ * Tile descriptors of a mosaic image database.
+ * The descriptors (a low-res luminance patch and its mean) are computed
+ * once per image and persisted for each database folder. Patches are then
+ * assigned to their nearest tiles which are searched by mean luminance.
+ **/ 
+class DkMosaicDatabase {
+
+public:
+	class Tile {
+
+	public:
+		QString filePath;
+		qint64 modified = 0;	// ms since epoch
+		qint64 size = -1;
+		float meanL = 0.0f;
+		QByteArray luminance;	// descriptorRes x descriptorRes L channel (empty if the image cannot be loaded)
+	};
+
+	DkMosaicDatabase(const QString& dirPath = QString());
+
+	static QStringList imageFiles(const QString& dirPath, const QString& ignore, const QString& suffix);
+	bool update(const QStringList& files, std::function<bool (int)> progress = std::function<bool (int)>());
+	QVector<int> assign(const cv::Mat& imgL, int patchRes, int numPatchesH, int numPatchesV) const;
+
+	int size() const;
+	const Tile& tile(int idx) const;
+	static cv::Mat patch(const DkThumbNail& thumb, int patchRes);
+
+	static const int descriptorRes = 8;
+
+protected:
+	static void computeTile(Tile& tile);
+	static QByteArray descriptor(const cv::Mat& patchL, float& meanL);
+	void load(QHash<QString, Tile>& tiles) const;
+	void save(const QVector<Tile>& tiles) const;
+	QString databaseFilePath() const;
+
+	QString mDirPath;
+	QVector<Tile> mTiles;	// sorted by mean luminance
+};
+
 class DkMosaicDialog : public QDialog {
 	Q_OBJECT
 
@@ -736,9 +788,6 @@ protected:
 	void enableAll(bool enable);
 	void dropEvent(QDropEvent *event);
 	void dragEnterEvent(QDragEnterEvent *event);
-	QString getRandomImagePath(const QString& cPath, const QString& ignore, const QString& suffix);
-	void matchPatch(const cv::Mat& img, const cv::Mat& thumb, int patchRes, cv::Mat& cc);
-	cv::Mat createPatch(const DkThumbNail& thumb, int patchRes);
 	
 	DkBaseViewPort* mViewport = 0;
 	DkBaseViewPort* mPreview = 0;
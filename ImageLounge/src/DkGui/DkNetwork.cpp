@@ -39,6 +39,8 @@
 #include <QTcpSocket>
 #include <QStringBuilder>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QNetworkInterface>
 #include <QList>
 #include <QThread>
@@ -674,25 +676,32 @@ void DkLANClientManager::connectionReceivedUpcomingImage(DkConnection*, const QS
 }
 
 
-void DkLANClientManager::connectionReceivedNewImage(DkConnection* connection, const QImage& image, const QString& title) {
+void DkLANClientManager::connectionReceivedNewImage(DkConnection* connection, const QImage& image, const QString& title, const QByteArray& imageData, const QString& fileName) {
 	//qDebug() << "DkTcpNetworkClient:: connection Received New Image";
 	emit receivedImage(image);
 	emit receivedImageTitle(title + " - ");
 	//qDebug() << "received title: " << title;
 
-	// propagate this message
+	// propagate this message - the received bytes are forwarded (no re-encoding)
 	QList<DkPeer*> syncPeerList = mPeerList.getSynchronizedPeers();
 	foreach (DkPeer* peer, syncPeerList) {
 		if (peer && peer->peerId != connection->getPeerId()) {
 			DkLANConnection* con = dynamic_cast<DkLANConnection*>(peer->connection); // TODO???? darf ich das
-			connect(this,SIGNAL(sendNewImageMessage(QImage, const QString&)), con, SLOT(sendNewImageMessage(QImage, const QString&)));
-			emit sendNewImageMessage(image, title);
-			connect(this,SIGNAL(sendNewImageMessage(QImage, const QString&)), con, SLOT(sendNewImageMessage(QImage, const QString&)));
+			connect(this,SIGNAL(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)), con, SLOT(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)));
+			emit sendNewImageMessage(image, title, fileName.isEmpty() ? QByteArray() : imageData, fileName);
+			disconnect(this,SIGNAL(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)), con, SLOT(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)));
 		}
 	}
 
 }
 
+void DkLANClientManager::connectionReceivedNewPreview(DkConnection*, const QImage& image, const QString& title) {
+	
+	// previews are shown until the full image is received
+	emit receivedImage(image);
+	emit receivedImageTitle(title + " - ");
+}
+
 void DkLANClientManager::connectionReceivedSwitchServer(DkConnection* connection, const QHostAddress& address, quint16 port) {
 	//qDebug() << "DkLANClientManager::connectionReceivedSwitchServer:" << address << ":" << port;
 	if (!mPeerList.alreadyConnectedTo(address, port))
@@ -733,9 +742,33 @@ void DkLANClientManager::sendTitle(const QString& newTitle) {
 	}
 }
 
-void DkLANClientManager::sendNewImage(QImage image, const QString& title) {
+/**
+ * Sends an image to all synchronized peers.
+ * The original file is sent if filePath is set, otherwise the image is encoded.
+ * In both cases the data is created once and shared by all connections.
+ * @param image the image
+ * @param title the image's title
+ * @param filePath the image's file (empty if the image was edited)
+ **/ 
+void DkLANClientManager::sendNewImage(QImage image, const QString& title, const QString& filePath) {
 	//qDebug() << "sending new image";
 	QList<DkPeer*> synchronizedPeers = mPeerList.getSynchronizedPeers();
+
+	if (synchronizedPeers.isEmpty())
+		return;
+
+	QByteArray imageData;
+	QString fileName;
+	QFile file(filePath);
+
+	if (!filePath.isEmpty() && file.open(QIODevice::ReadOnly)) {
+		imageData = file.readAll();
+		fileName = QFileInfo(filePath).fileName();
+	}
+
+	if (imageData.isEmpty())
+		imageData = DkLANConnection::encodeImage(image, fileName);
+
 	foreach (DkPeer* peer , synchronizedPeers) {
 		
 		if (!peer)
@@ -746,9 +779,9 @@ void DkLANClientManager::sendNewImage(QImage image, const QString& title) {
 		emit sendNewUpcomingImageMessage(title);
 		disconnect(this,SIGNAL(sendNewUpcomingImageMessage(const QString&)), connection, SLOT(sendNewUpcomingImageMessage(const QString&)));
 
-		connect(this,SIGNAL(sendNewImageMessage(QImage, const QString&)), connection, SLOT(sendNewImageMessage(QImage, const QString&)));
-		emit sendNewImageMessage(image, title);
-		disconnect(this,SIGNAL(sendNewImageMessage(QImage, const QString&)), connection, SLOT(sendNewImageMessage(QImage, const QString&)));
+		connect(this,SIGNAL(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)), connection, SLOT(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)));
+		emit sendNewImageMessage(image, title, imageData, fileName);
+		disconnect(this,SIGNAL(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)), connection, SLOT(sendNewImageMessage(const QImage&, const QString&, const QByteArray&, const QString&)));
 	}
 }
 
@@ -803,7 +836,8 @@ DkLANConnection* DkLANClientManager::createConnection() {
 
 void DkLANClientManager::connectConnection(DkConnection* connection) {
 	DkClientManager::connectConnection(connection);
-	connect(connection, SIGNAL(connectionNewImage(DkConnection*, const QImage&, const QString&)), this, SLOT(connectionReceivedNewImage(DkConnection*, const QImage&, const QString&)));
+	connect(connection, SIGNAL(connectionNewImage(DkConnection*, const QImage&, const QString&, const QByteArray&, const QString&)), this, SLOT(connectionReceivedNewImage(DkConnection*, const QImage&, const QString&, const QByteArray&, const QString&)));
+	connect(connection, SIGNAL(connectionNewPreview(DkConnection*, const QImage&, const QString&)), this, SLOT(connectionReceivedNewPreview(DkConnection*, const QImage&, const QString&)));
 	connect(connection, SIGNAL(connectionUpcomingImage(DkConnection*, const QString&)), this, SLOT(connectionReceivedUpcomingImage(DkConnection*, const QString&)));
 	connect(connection, SIGNAL(connectionSwitchServer(DkConnection*, const QHostAddress&, quint16)), this, SLOT(connectionReceivedSwitchServer(DkConnection*, const QHostAddress&, quint16)));
 }
@@ -1305,7 +1339,7 @@ DkLanManagerThread::DkLanManagerThread(DkNoMacs* parent) : DkManagerThread(paren
 
 void DkLanManagerThread::connectClient() {
 
-	connect(parent->viewport(), SIGNAL(sendImageSignal(QImage, const QString&)), clientManager, SLOT(sendNewImage(QImage, const QString&)));
+	connect(parent->viewport(), SIGNAL(sendImageSignal(QImage, const QString&, const QString&)), clientManager, SLOT(sendNewImage(QImage, const QString&, const QString&)));
 	connect(clientManager, SIGNAL(receivedImage(const QImage &)), parent->viewport(), SLOT(loadImage(const QImage&)));
 	connect(clientManager, SIGNAL(receivedImageTitle(const QString&)), parent, SLOT(setWindowTitle(const QString&)));
 	connect(this, SIGNAL(startServerSignal(bool)), clientManager, SLOT(startServer(bool)));
@@ -137,7 +137,7 @@ class DkClientManager : public QThread {
 		void sendNewPositionMessage(QRect position, bool opacity, bool overlaid);
 		void sendNewTransformMessage(QTransform transform, QTransform imgTransform, QPointF canvasSize);
 		void sendNewFileMessage(qint16 op, const QString& filename);
-		void sendNewImageMessage(QImage image, const QString& title);
+		void sendNewImageMessage(const QImage& image, const QString& title, const QByteArray& imageData, const QString& fileName);
 		void sendNewUpcomingImageMessage(const QString& imageTitle);
 		void sendGoodByeMessage();
 		void synchronizedPeersListChanged(QList<quint16> newList);
@@ -154,7 +154,7 @@ class DkClientManager : public QThread {
 		void sendPosition(QRect newRect, bool overlaid);
 
 		void sendNewFile(qint16 op, const QString& filename);
-		virtual void sendNewImage(QImage, const QString&) {}; // dummy
+		virtual void sendNewImage(QImage, const QString&, const QString&) {}; // dummy
 		void sendGoodByeToAll();
 
 	protected slots:
@@ -231,7 +231,7 @@ class DkLANClientManager : public DkClientManager {
 		virtual void synchronizeWithServerPort(quint16) {}; // dummy
 		void stopSynchronizeWith(quint16 peerId = USHRT_MAX);
 		void startServer(bool flag);
-		void sendNewImage(QImage image, const QString& title);
+		void sendNewImage(QImage image, const QString& title, const QString& filePath = QString());
 		void synchronizeWith(quint16 peerId);
 
 	protected:
@@ -243,7 +243,8 @@ class DkLANClientManager : public DkClientManager {
 		virtual void connectionReadyForUse(quint16 peerServerPort, const QString& title, DkConnection* connection);
 
 	private slots:
-		void connectionReceivedNewImage(DkConnection* connection, const QImage& image, const QString& title);
+		void connectionReceivedNewImage(DkConnection* connection, const QImage& image, const QString& title, const QByteArray& imageData, const QString& fileName);
+		void connectionReceivedNewPreview(DkConnection* connection, const QImage& image, const QString& title);
 		void startConnection(const QHostAddress& address, quint16 port, const QString& clientName);
 		void sendStopSynchronizationToAll();
 		
@@ -390,6 +390,9 @@ void DkNoMacs::createActions() {
 	connect(am.action(DkActionManager::menu_sort_date_created), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_date_modified), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_random), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+	connect(am.action(DkActionManager::menu_sort_date_taken), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+	connect(am.action(DkActionManager::menu_sort_rating), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+	connect(am.action(DkActionManager::menu_sort_camera), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_ascending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_descending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 
@@ -663,7 +666,7 @@ void DkNoMacs::moveEvent(QMoveEvent *event) {
 
 void DkNoMacs::mouseDoubleClickEvent(QMouseEvent* event) {
 
-	if (event->button() != Qt::LeftButton || (viewport() && viewport()->getImage().isNull()))
+	if (event->button() != Qt::LeftButton || (viewport() && !viewport()->hasImage()))
 		return;
 
 	if (isFullScreen())
@@ -1542,6 +1545,12 @@ void DkNoMacs::changeSorting(bool change) {
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_date_modified;
 		else if (senderName == "menu_sort_random")
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_random;
+		else if (senderName == "menu_sort_date_taken")
+			DkSettingsManager::param().global().sortMode = DkSettings::sort_date_taken;
+		else if (senderName == "menu_sort_rating")
+			DkSettingsManager::param().global().sortMode = DkSettings::sort_rating;
+		else if (senderName == "menu_sort_camera")
+			DkSettingsManager::param().global().sortMode = DkSettings::sort_camera;
 		else if (senderName == "menu_sort_ascending")
 			DkSettingsManager::param().global().sortDir = DkSettings::sort_ascending;
 		else if (senderName == "menu_sort_descending")
@@ -1617,7 +1626,7 @@ void DkNoMacs::extractImagesFromArchive() {
 
 void DkNoMacs::resizeImage() {
 
-	if (!viewport() || viewport()->getImage().isNull())
+	if (!viewport() || !viewport()->hasImage())
 		return;
 
 	viewport()->getController()->applyPluginChanges(true);
@@ -1666,7 +1675,7 @@ void DkNoMacs::resizeImage() {
 
 void DkNoMacs::deleteFile() {
 
-	if (!viewport() || viewport()->getImage().isNull() || !getTabWidget()->getCurrentImageLoader())
+	if (!viewport() || !viewport()->hasImage() || !getTabWidget()->getCurrentImageLoader())
 		return;
 	
 	viewport()->getController()->applyPluginChanges(true);
@@ -2114,7 +2123,7 @@ void DkNoMacs::setWindowTitle(QSharedPointer<DkImageContainerT> imgC) {
 		return;
 	}
 
-	setWindowTitle(imgC->filePath(), imgC->image().size(), imgC->isEdited(), imgC->getTitleAttribute());
+	setWindowTitle(imgC->filePath(), imgC->getLoader()->fullSize(), imgC->isEdited(), imgC->getTitleAttribute());
 }
 
 void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool edited, const QString& attr) {
@@ -2146,7 +2155,7 @@ void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool e
 	if (!size.isEmpty())
 		attributes.sprintf(" - %i x %i", size.width(), size.height());
 	if (size.isEmpty() && viewport() && !viewport()->getImageSize().isEmpty())
-		attributes.sprintf(" - %i x %i", viewport()->getImage().width(), viewport()->getImage().height());
+		attributes.sprintf(" - %i x %i", viewport()->getImageSize().width(), viewport()->getImageSize().height());
 	if (DkSettingsManager::param().app().privateMode) 
 		attributes.append(tr(" [Private Mode]"));
 
@@ -916,9 +916,35 @@ void DkFilePreference::createLayout() {
 	QLabel* cLabel = new QLabel(tr("We recommend to set a moderate cache value around 100 MB. [%1-%2 MB]")
 		.arg(cacheBox->minimum()).arg(cacheBox->maximum()), this);
 	
+	QCheckBox* cbCacheThumbs = new QCheckBox(tr("Cache Thumbnails on Disk"), this);
+	cbCacheThumbs->setObjectName("cacheThumbs");
+	cbCacheThumbs->setToolTip(tr("If checked, thumbnails are stored on disk and re-used when a folder is opened again."));
+	cbCacheThumbs->setChecked(DkSettingsManager::param().resources().cacheThumbs);
+
+	QCheckBox* cbLoadPreview = new QCheckBox(tr("Load Screen-sized Previews"), this);
+	cbLoadPreview->setObjectName("loadPreview");
+	cbLoadPreview->setToolTip(tr("If checked, large images are decoded to the screen size first. The full resolution is loaded when you zoom in."));
+	cbLoadPreview->setChecked(DkSettingsManager::param().resources().loadPreview);
+
+	QSpinBox* imageMemoryBox = new QSpinBox(this);
+	imageMemoryBox->setObjectName("imageMemoryBox");
+	imageMemoryBox->setMinimum(64);
+	imageMemoryBox->setMaximum(maxCache);
+	imageMemoryBox->setSuffix(" MB");
+	imageMemoryBox->setMaximumWidth(200);
+	imageMemoryBox->setToolTip(tr("Tiff images that need more memory are streamed tile by tile when loading previews."));
+	imageMemoryBox->setValue(DkSettingsManager::param().resources().maxImageMemory);
+
+	QLabel* imLabel = new QLabel(tr("Maximal memory of a single image [%1-%2 MB]")
+		.arg(imageMemoryBox->minimum()).arg(imageMemoryBox->maximum()), this);
+
 	DkGroupWidget* cacheGroup = new DkGroupWidget(tr("Maximal Cache Size"), this);
 	cacheGroup->addWidget(cacheBox);
 	cacheGroup->addWidget(cLabel);
+	cacheGroup->addWidget(cbCacheThumbs);
+	cacheGroup->addWidget(cbLoadPreview);
+	cacheGroup->addWidget(imageMemoryBox);
+	cacheGroup->addWidget(imLabel);
 
 	// history size
 	// cache size
@@ -1017,6 +1043,12 @@ void DkFilePreference::on_cacheBox_valueChanged(int value) const {
 
 }
 
+void DkFilePreference::on_imageMemoryBox_valueChanged(int value) const {
+
+	if (DkSettingsManager::param().resources().maxImageMemory != value)
+		DkSettingsManager::param().resources().maxImageMemory = value;
+}
+
 void DkFilePreference::on_historyBox_valueChanged(int value) const {
 
 	if (DkSettingsManager::param().resources().historyMemory != value) {
@@ -1024,6 +1056,18 @@ void DkFilePreference::on_historyBox_valueChanged(int value) const {
 	}
 }
 
+void DkFilePreference::on_cacheThumbs_toggled(bool checked) const {
+
+	if (DkSettingsManager::param().resources().cacheThumbs != checked)
+		DkSettingsManager::param().resources().cacheThumbs = checked;
+}
+
+void DkFilePreference::on_loadPreview_toggled(bool checked) const {
+
+	if (DkSettingsManager::param().resources().loadPreview != checked)
+		DkSettingsManager::param().resources().loadPreview = checked;
+}
+
 void DkFilePreference::paintEvent(QPaintEvent *event) {
 
 	// fixes stylesheets which are not applied to custom widgets
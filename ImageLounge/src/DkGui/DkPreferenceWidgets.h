@@ -213,6 +213,9 @@ public slots:
 	void on_skipBox_valueChanged(int value) const;
 	void on_cacheBox_valueChanged(int value) const;
 	void on_historyBox_valueChanged(int value) const;
+	void on_imageMemoryBox_valueChanged(int value) const;
+	void on_cacheThumbs_toggled(bool checked) const;
+	void on_loadPreview_toggled(bool checked) const;
 
 signals:
 	void infoSignal(const QString& msg) const;
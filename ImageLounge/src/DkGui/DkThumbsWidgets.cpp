@@ -344,10 +344,9 @@ void DkFilePreview::drawThumbs(QPainter* painter) {
 		else if (orientation == Qt::Horizontal && imgWorldRect.left() > width() || orientation == Qt::Vertical && imgWorldRect.top() > height())
 			break;
 
-		if (thumb->hasImage() == DkThumbNail::not_loaded && 
-			DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading) {
+		if (thumb->hasImage() == DkThumbNail::not_loaded) {
 				thumb->fetchThumb();
-				connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(update()));
+				connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(update()), Qt::UniqueConnection);
 		}
 
 		bool isLeftGradient = (orientation == Qt::Horizontal && worldMatrix.dx() < 0 && imgWorldRect.left() < leftGradient.finalStop().x()) ||
@@ -852,6 +851,39 @@ void DkFilePreview::updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thu
 	update();
 }
 
+void DkFilePreview::insertThumb(int idx, QSharedPointer<DkImageContainerT> thumb) {
+
+	if (idx < 0 || idx > mThumbs.size())
+		return;
+
+	mThumbs.insert(idx, thumb);
+
+	// keep the current image in place
+	if (currentFileIdx >= idx)
+		currentFileIdx++;
+	if (oldFileIdx >= idx)
+		oldFileIdx++;
+	selected = -1;
+
+	update();
+}
+
+void DkFilePreview::removeThumb(int idx) {
+
+	if (idx < 0 || idx >= mThumbs.size())
+		return;
+
+	mThumbs.remove(idx);
+
+	if (currentFileIdx > idx)
+		currentFileIdx--;
+	if (oldFileIdx > idx)
+		oldFileIdx--;
+	selected = -1;
+
+	update();
+}
+
 void DkFilePreview::setVisible(bool visible, bool saveSettings) {
 
 	emit showThumbsDockSignal(visible);
@@ -863,7 +895,6 @@ void DkFilePreview::setVisible(bool visible, bool saveSettings) {
 DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem* parent) : QGraphicsObject(parent), mText(this) {
 
 	mThumbInitialized = false;
-	mFetchingThumb = false;
 	mIsHovered = false;
 
 	//imgLabel = new QLabel(this);
@@ -1041,10 +1072,9 @@ void DkThumbLabel::setVisible(bool visible) {
 
 void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
 	
-	if (!mFetchingThumb && mThumb->hasImage() == DkThumbNail::not_loaded && 
-		DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading*2) {
-			mThumb->fetchThumb();
-			mFetchingThumb = true;
+	// we are painted -> we are visible
+	if (mThumb->hasImage() == DkThumbNail::not_loaded) {
+		mThumb->fetchThumb();
 	}
 	else if (!mThumbInitialized && (mThumb->hasImage() == DkThumbNail::loaded || mThumb->hasImage() == DkThumbNail::exists_not)) {
 		updateLabel();
@@ -1204,17 +1234,8 @@ void DkThumbScene::updateThumbLabels() {
 
 	mThumbLabels.clear();
 
-	for (int idx = 0; idx < mThumbs.size(); idx++) {
-		DkThumbLabel* thumb = new DkThumbLabel(mThumbs.at(idx)->getThumb());
-		connect(thumb, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
-		connect(thumb, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
-		connect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
-
-		//thumb->show();
-		addItem(thumb);
-		mThumbLabels.append(thumb);
-		//thumbsNotLoaded.append(thumb);
-	}
+	for (int idx = 0; idx < mThumbs.size(); idx++)
+		mThumbLabels.append(createThumbLabel(mThumbs.at(idx)));
 
 	showFile();
 
@@ -1224,6 +1245,47 @@ void DkThumbScene::updateThumbLabels() {
 	emit selectionChanged();
 }
 
+DkThumbLabel* DkThumbScene::createThumbLabel(QSharedPointer<DkImageContainerT> thumb) {
+
+	DkThumbLabel* label = new DkThumbLabel(thumb->getThumb());
+	connect(label, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
+	connect(label, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
+	connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+
+	addItem(label);
+
+	return label;
+}
+
+void DkThumbScene::insertThumb(int idx, QSharedPointer<DkImageContainerT> thumb) {
+
+	if (idx < 0 || idx > mThumbLabels.size())
+		return;
+
+	mThumbs.insert(idx, thumb);
+	mThumbLabels.insert(idx, createThumbLabel(thumb));
+
+	updateLayout();
+}
+
+void DkThumbScene::removeThumb(int idx) {
+
+	if (idx < 0 || idx >= mThumbLabels.size())
+		return;
+
+	DkThumbLabel* label = mThumbLabels.takeAt(idx);
+	bool wasSelected = label->isSelected();
+	
+	disconnect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+	mThumbs.remove(idx);
+	delete label;	// removes it from the scene
+
+	updateLayout();
+
+	if (wasSelected)
+		emit selectionChanged();
+}
+
 void DkThumbScene::setImageLoader(QSharedPointer<DkImageLoader> loader) {
 	
 	connectLoader(this->mLoader, false);		// disconnect
@@ -1238,9 +1300,13 @@ void DkThumbScene::connectLoader(QSharedPointer<DkImageLoader> loader, bool conn
 
 	if (connectSignals) {
 		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), this, SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), this, SLOT(insertThumb(int, QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageRemovedSignal(int)), this, SLOT(removeThumb(int)), Qt::UniqueConnection);
 	}
 	else {
 		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), this, SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), this, SLOT(insertThumb(int, QSharedPointer<DkImageContainerT>)));
+		disconnect(loader.data(), SIGNAL(imageRemovedSignal(int)), this, SLOT(removeThumb(int)));
 	}
 }
 
@@ -1563,6 +1629,7 @@ DkThumbsView::DkThumbsView(DkThumbScene* scene, QWidget* parent /* = 0 */) : QGr
 	setObjectName("DkThumbsView");
 	this->scene = scene;
 	connect(scene, SIGNAL(thumbLoadedSignal()), this, SLOT(fetchThumbs()));
+	connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(fetchThumbs()));
 
 	//setDragMode(QGraphicsView::RubberBandDrag);
 
@@ -1802,37 +1869,44 @@ void DkThumbsView::dropEvent(QDropEvent *event) {
 	qDebug() << "drop event...";
 }
 
+/**
+ * Requests the thumbnails within (and around) the viewport.
+ * Visible thumbnails are loaded first, the ones which are one page
+ * above or below are prefetched. Pending requests of thumbnails
+ * which scrolled out of that band are canceled.
+ **/ 
 void DkThumbsView::fetchThumbs() {
 
-	int maxThreads = DkSettingsManager::param().resources().maxThumbsLoading*2;
-
-	// don't do anything if it is loading anyway
-	if (DkSettingsManager::param().resources().numThumbsLoading/* > maxThreads*/) {
-		return;
-	}
+	QRectF visibleRect = mapToScene(viewport()->rect()).boundingRect();
+	QRectF prefetchRect = visibleRect.adjusted(0, -visibleRect.height(), 0, visibleRect.height());
 
-	QList<QGraphicsItem*> items = scene->items(mapToScene(viewport()->rect()).boundingRect(), Qt::IntersectsItemShape);
+	QList<QGraphicsItem*> items = scene->items(prefetchRect, Qt::IntersectsItemShape);
+	QVector<QSharedPointer<DkThumbNailT> > requestedThumbs;
 
 	for (int idx = 0; idx < items.size(); idx++) {
 
-		if (!maxThreads)
-			break;
-
 		DkThumbLabel* th = dynamic_cast<DkThumbLabel*>(items.at(idx));
 
-		if (!th) {
-			qDebug() << "not a thumb label...";
+		if (!th || !th->getThumb())
 			continue;
-		}
 
-		if (th->pixmap().isNull()) {
-			th->update();
-			maxThreads--;
+		QSharedPointer<DkThumbNailT> thumb = th->getThumb();
+		int priority = th->sceneBoundingRect().intersects(visibleRect) ? DkThumbScheduler::priority_visible : DkThumbScheduler::priority_prefetch;
+
+		// (re-)prioritize pending requests too
+		if (thumb->hasImage() == DkThumbNail::not_loaded || thumb->hasImage() == DkThumbNail::loading) {
+			thumb->fetchThumb(DkThumbNail::do_not_force, QSharedPointer<QByteArray>(), priority, this);
+			requestedThumbs << thumb;
 		}
-		//else if (!thumbLabels.at(idx)->pixmap().isNull())
-		//	firstReached = true;
 	}
 
+	// cancel thumbnails that are out of view (if nobody else requested them)
+	for (QSharedPointer<DkThumbNailT> thumb : mRequestedThumbs) {
+		if (!requestedThumbs.contains(thumb))
+			thumb->cancelFetch(this);
+	}
+
+	mRequestedThumbs = requestedThumbs;
 }
 
 // DkThumbScrollWidget --------------------------------------------------------------------
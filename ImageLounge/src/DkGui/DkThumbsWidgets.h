@@ -109,6 +109,8 @@ public slots:
 	void moveImages();
 	void updateFileIdx(int fileIdx);
 	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
+	void insertThumb(int idx, QSharedPointer<DkImageContainerT> thumb);
+	void removeThumb(int idx);
 	void setFileInfo(QSharedPointer<DkImageContainerT> cImage);
 	void newPosition();
 
@@ -214,7 +216,6 @@ protected:
 	QGraphicsPixmapItem mIcon;
 	QGraphicsTextItem mText;
 	bool mThumbInitialized = false;
-	bool mFetchingThumb = false;
 	QPen mNoImagePen;
 	QBrush mNoImageBrush;
 	QPen mSelectPen;
@@ -250,6 +251,8 @@ public slots:
 	void selectThumbs(bool select = true, int from = 0, int to = -1);
 	void selectAllThumbs(bool select = true);
 	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
+	void insertThumb(int idx, QSharedPointer<DkImageContainerT> thumb);
+	void removeThumb(int idx);
 	void deleteSelected() const;
 	void copySelected() const;
 	void pasteImages() const;
@@ -262,6 +265,7 @@ signals:
 
 protected:
 	void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
+	DkThumbLabel* createThumbLabel(QSharedPointer<DkImageContainerT> thumb);
 	
 	int mXOffset = 0;
 	int mNumRows = 0;
@@ -297,6 +301,7 @@ protected:
 	DkThumbScene* scene;
 	QPointF mousePos;
 	int lastShiftIdx;
+	QVector<QSharedPointer<DkThumbNailT> > mRequestedThumbs;
 
 };
 
@@ -224,10 +224,48 @@ void DkViewPort::updateImage(QSharedPointer<DkImageContainerT> image, bool loade
 		return;
 
 	if (mLoader->hasImage()) {
-		setImage(mLoader->getImage());
+		// the preview is swapped if the full resolution is loaded - asynchronously or for saving/editing
+		connect(mLoader->getCurrentImage().data(), SIGNAL(fullResolutionLoadedSignal()), this, SLOT(fullResolutionLoaded()), Qt::UniqueConnection);
+		setImage(mLoader->getCurrentImage()->displayImage());
+		fetchFullResolution();
 	}
 }
 
+void DkViewPort::fullResolutionLoaded() {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	// ignore images that are not displayed anymore
+	if (!imgC || imgC.data() != sender() || imgC->getLoader()->isPreview())
+		return;
+
+	// swap the preview: the image is shown at the same position & scale
+	QTransform worldMatrix = mWorldMatrix;
+
+	mImgStorage.setImage(imgC->image());
+	mImgRect = QRectF(QPoint(), getImageSize());
+	mOldImgRect = mImgRect;
+	updateImageMatrix();
+	mWorldMatrix = worldMatrix;
+
+	mCropRect = imgC->cropRect();
+
+	update();
+}
+
+/**
+ * Requests the full resolution image if a magnified preview is displayed.
+ **/ 
+void DkViewPort::fetchFullResolution() {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (!imgC || !imgC->getLoader()->isPreview() || mWorldMatrix.m11()*mImgMatrix.m11() <= 1.0)
+		return;
+
+	imgC->fetchFullResolution();
+}
+
 void DkViewPort::loadImage(const QImage& newImg) {
 
 	// delete current information
@@ -252,7 +290,7 @@ void DkViewPort::loadImage(QSharedPointer<DkImageContainerT> img) {
 
 		if (img->hasImage()) {
 			mLoader->setCurrentImage(img);
-			setImage(img->image());
+			setImage(img->displayImage());
 		}
 		mLoader->load(img);
 	}
@@ -275,6 +313,13 @@ void DkViewPort::setImage(QImage newImg) {
 
 	mImgStorage.setImage(newImg);
 
+	// zoomed tiles of streamed images are read from the full resolution
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+	if (imgC && imgC->getLoader()->tiledImage() && imgC->getLoader()->image().cacheKey() == newImg.cacheKey())
+		mTileCache.setSource(imgC->getLoader()->tiledImage(), newImg.cacheKey());
+	else
+		mTileCache.setSource(QSharedPointer<DkTiledImage>(), 0);
+
 	if (mLoader->hasMovie() && !mLoader->isEdited())
 		loadMovie();
 	if (mLoader->hasSvg() && !mLoader->isEdited())
@@ -341,7 +386,8 @@ void DkViewPort::setImage(QImage newImg) {
 	if (!newImg.isNull()) {
 		DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
 		DkStatusBarManager::instance().setMessage(DkUtils::formatToString(newImg.format()), DkStatusBar::status_format_info);
-		DkStatusBarManager::instance().setMessage(QString::number(newImg.width()) + " x " + QString::number(newImg.height()), DkStatusBar::status_dimension_info);
+		QSize imgSize = imageContainer() && imageContainer()->getLoader()->isPreview() ? imageContainer()->getLoader()->fullSize() : newImg.size();
+		DkStatusBarManager::instance().setMessage(QString::number(imgSize.width()) + " x " + QString::number(imgSize.height()), DkStatusBar::status_dimension_info);
 	}
 	else {
 		DkStatusBarManager::instance().setMessage("", DkStatusBar::status_zoom_info);
@@ -379,10 +425,15 @@ void DkViewPort::tcpSendImage(bool silent) {
 	if (!silent)
 		mController->setInfo("sending image...", 3000);
 
+	// the original file is sent unless the image was edited
+	QString filePath;
+	if (imageContainer() && !imageContainer()->isEdited())
+		filePath = imageContainer()->filePath();
+
 	if (mLoader)
-		emit sendImageSignal(mImgStorage.getImage(), mLoader->fileName());
+		emit sendImageSignal(mImgStorage.getImage(), mLoader->fileName(), filePath);
 	else
-		emit sendImageSignal(mImgStorage.getImage(), "nomacs - Image Lounge");
+		emit sendImageSignal(mImgStorage.getImage(), "nomacs - Image Lounge", filePath);
 }
 
 void DkViewPort::zoom(float factor, QPointF center) {
@@ -474,6 +525,8 @@ void DkViewPort::zoom(float factor, QPointF center) {
 
 	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
 	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
+
+	fetchFullResolution();
 }
 
 void DkViewPort::zoomTo(float zoomLevel, const QPoint&) {
@@ -504,8 +557,15 @@ void DkViewPort::zoomToFit() {
 
 void DkViewPort::fullView() {
 
+	// 100% refers to the full resolution if a preview is shown
+	float previewScale = 1.0f;
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (imgC && imgC->getLoader()->isPreview() && !mImgRect.isEmpty())
+		previewScale = (float)(imgC->getLoader()->fullSize().width() / mImgRect.width());
+
 	mWorldMatrix.reset();
-	zoom(1.0f/(float)mImgMatrix.m11());
+	zoom(previewScale/(float)mImgMatrix.m11());
 	showZoom();
 	changeCursor();
 	update();
@@ -1140,15 +1200,15 @@ void DkViewPort::mouseMoveEvent(QMouseEvent *event) {
 	if (event->buttons() == Qt::LeftButton 
 		&& dist > QApplication::startDragDistance()
 		&& imageInside()
-		&& !getImage().isNull()
+		&& hasImage()
 		&& mLoader
 		&& !QApplication::widgetAt(event->globalPos())) {	// is NULL if the mouse leaves the window
 
 			QMimeData* mimeData = createMime();
 
 			QPixmap pm;
-			if (!getImage().isNull())
-				pm = QPixmap::fromImage(getImage()).scaledToHeight(73, Qt::SmoothTransformation);
+			if (hasImage())
+				pm = QPixmap::fromImage(DkBaseViewPort::getImage()).scaledToHeight(73, Qt::SmoothTransformation);
 			if (pm.width() > 130)
 				pm = pm.scaledToWidth(100, Qt::SmoothTransformation);
 
@@ -1325,13 +1385,11 @@ QString DkViewPort::getCurrentPixelHexValue() {
 // Copy & Paste --------------------------------------------------------
 void DkViewPort::copyPixelColorValue() {
 
-	if (getImage().isNull())
+	if (!hasImage())
 		return;
 
 	QMimeData* mimeData = new QMimeData;
-
-	if (!getImage().isNull())
-		mimeData->setText(getCurrentPixelHexValue());
+	mimeData->setText(getCurrentPixelHexValue());
 
 	QClipboard* clipboard = QApplication::clipboard();
 	clipboard->setMimeData(mimeData);
@@ -1347,7 +1405,7 @@ void DkViewPort::copyImage() {
 
 QMimeData * DkViewPort::createMime() const {
 
-	if (getImage().isNull() || !mLoader)
+	if (!hasImage() || !mLoader)
 		return 0;
 
 	// NOTE: if we do the file:/// thingy, we will get into problems with mounted drives (e.g. //hermes...)
@@ -1360,7 +1418,7 @@ QMimeData * DkViewPort::createMime() const {
 
 	if (QFileInfo(mLoader->filePath()).exists() && !mLoader->isEdited())
 		mimeData->setUrls(urls);
-	else if (!getImage().isNull())
+	else
 		mimeData->setImageData(getImage());
 
 	return mimeData;
@@ -1368,13 +1426,11 @@ QMimeData * DkViewPort::createMime() const {
 
 void DkViewPort::copyImageBuffer() {
 
-	if (getImage().isNull())
+	if (!hasImage())
 		return;
 
 	QMimeData* mimeData = new QMimeData;
-
-	if (!getImage().isNull())
-		mimeData->setImageData(getImage());
+	mimeData->setImageData(getImage());
 
 	QClipboard* clipboard = QApplication::clipboard();
 	clipboard->setMimeData(mimeData);
@@ -1777,6 +1833,18 @@ QSharedPointer<DkImageContainerT> DkViewPort::imageContainer() const {
 	return mLoader->getCurrentImage();
 }
 
+QImage DkViewPort::getImage() const {
+
+	// we might just display a preview - the full resolution is needed for saving/editing
+	// NOTE: this decodes the image - use hasImage() if you just need to know whether an image is shown
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (imgC && imgC->getLoader()->isPreview())
+		return imgC->image();
+
+	return DkBaseViewPort::getImage();
+}
+
 void DkViewPort::setImageLoader(QSharedPointer<DkImageLoader> newLoader) {
 	
 	mLoader = newLoader;
@@ -1796,6 +1864,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 
 		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(insertThumb(int, QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageRemovedSignal(int)), mController->getFilePreview(), SLOT(removeThumb(int)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getMetaDataWidget(), SLOT(updateMetaData(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController, SLOT(updateImage(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
@@ -1805,6 +1875,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		connect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)), Qt::UniqueConnection);
 
 		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getScroller(), SLOT(updateDir(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), mController->getScroller(), SLOT(insertFile(int)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(imageRemovedSignal(int)), mController->getScroller(), SLOT(removeFile(int)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(int)), mController->getScroller(), SLOT(updateFile(int)), Qt::UniqueConnection);
 		connect(mController->getScroller(), SIGNAL(valueChanged(int)), loader.data(), SLOT(loadFileAt(int)));
 
@@ -1815,6 +1887,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)));
 
 		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(insertThumb(int, QSharedPointer<DkImageContainerT>)));
+		disconnect(loader.data(), SIGNAL(imageRemovedSignal(int)), mController->getFilePreview(), SLOT(removeThumb(int)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getMetaDataWidget(), SLOT(updateMetaData(QSharedPointer<DkImageContainerT>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController, SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
@@ -1825,6 +1899,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		disconnect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)));
 
 		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getScroller(), SLOT(updateDir(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(imageInsertedSignal(int, QSharedPointer<DkImageContainerT>)), mController->getScroller(), SLOT(insertFile(int)));
+		disconnect(loader.data(), SIGNAL(imageRemovedSignal(int)), mController->getScroller(), SLOT(removeFile(int)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getScroller(), SLOT(updateFile(QSharedPointer<DkImageContainerT>)));
 		
 		// not sure if this is elegant?!
@@ -2406,6 +2482,10 @@ void DkViewPortContrast::draw(QPainter & painter, double opacity) {
 
 void DkViewPortContrast::setImage(QImage newImg) {
 
+	// the channels are computed from the full resolution image
+	if (imageContainer() && imageContainer()->getLoader()->isPreview())
+		newImg = imageContainer()->image();
+
 	DkViewPort::setImage(newImg);
 	
 	if (newImg.isNull())
@@ -2423,7 +2503,12 @@ void DkViewPortContrast::setImage(QImage newImg) {
 			mImgs = QVector<QImage>(4);
 			std::vector<cv::Mat> planes;
 			
-			cv::Mat imgUC3 = DkImage::qImage2Mat(mImgStorage.getImage());
+			// the planes are split from the displayed pixels directly
+			QImage img = mImgStorage.getImage();
+			cv::Mat imgUC3 = DkImage::constMatView(img);
+
+			if (imgUC3.empty())
+				imgUC3 = DkImage::qImage2Mat(img);
 			//int format = imgQt.format();
 			//if (format == QImage::Format_RGB888)
 			//	imgUC3 = Mat(imgQt.height(), imgQt.width(), CV_8UC3, (uchar*)imgQt.bits(), imgQt.bytesPerLine());
@@ -2437,16 +2522,14 @@ void DkViewPortContrast::setImage(QImage newImg) {
 
 				// dirty hack
 				if (i >= (int)planes.size()) i = 0;
-				mImgs[idx] = QImage((const unsigned char*)planes[i].data, (int)planes[i].cols, (int)planes[i].rows, (int)planes[i].step,  QImage::Format_Indexed8);
-				mImgs[idx] = mImgs[idx].copy();
+				mImgs[idx] = DkImage::imageView(planes[i]);
 				idx++;
 
 			}
 			// The first element in the vector contains the gray scale 'average' of the 3 channels:
 			cv::Mat grayMat;
 			cv::cvtColor(imgUC3, grayMat, CV_BGR2GRAY);
-			mImgs[0] = QImage((const unsigned char*)grayMat.data, (int)grayMat.cols, (int)grayMat.rows, (int)grayMat.step,  QImage::Format_Indexed8);
-			mImgs[0] = mImgs[0].copy();
+			mImgs[0] = DkImage::imageView(grayMat);
 			planes.clear();
 
 	}
@@ -101,6 +101,7 @@ public:
 
 	// getter
 	QSharedPointer<DkImageContainerT> imageContainer() const;
+	QImage getImage() const override;
 	void setImageLoader(QSharedPointer<DkImageLoader> newLoader);
 	DkControlWidget* getController();
 	bool isTestLoaded() { return mTestLoaded; };
@@ -116,7 +117,7 @@ public:
 signals:
 	void sendTransformSignal(QTransform transform, QTransform imgTransform, QPointF canvasSize) const;
 	void sendNewFileSignal(qint16 op, QString filename = "") const;
-	void sendImageSignal(QImage img, QString title) const;
+	void sendImageSignal(QImage img, QString title, QString filePath) const;
 	void newClientConnectedSignal(bool connect, bool local) const;
 	void movieLoadedSignal(bool isMovie) const;
 	void infoSignal(const QString& msg) const;	// needed to forward signals
@@ -181,6 +182,7 @@ public slots:
 	void manipulatorApplied();
 
 	virtual void updateImage(QSharedPointer<DkImageContainerT> image, bool loaded = true);
+	void fullResolutionLoaded();
 	virtual void loadImage(const QImage& newImg);
 	virtual void loadImage(QSharedPointer<DkImageContainerT> img);
 	virtual void setEditedImage(const QImage& newImg, const QString& editName);
@@ -254,6 +256,7 @@ protected:
 	void showZoom();
 	void toggleLena(bool fullscreen);
 	void getPixelInfo(const QPoint& pos);
+	void fetchFullResolution();
 
 };
 
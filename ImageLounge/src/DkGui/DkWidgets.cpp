@@ -142,6 +142,16 @@ void DkFolderScrollBar::updateDir(QVector<QSharedPointer<DkImageContainerT> > im
 	setMaximum(images.size()-1);
 }
 
+void DkFolderScrollBar::insertFile(int) {
+
+	setMaximum(maximum()+1);
+}
+
+void DkFolderScrollBar::removeFile(int) {
+
+	setMaximum(maximum()-1);
+}
+
 void DkFolderScrollBar::updateFile(int idx) {
 	
 	if (mMouseDown)
@@ -343,7 +353,7 @@ void DkThumbsSaver::loadNext() {
 	for (int idx = mCLoadIdx; idx < mImages.size() && idx < numLoading; idx++) {
 		mCLoadIdx++;
 		connect(mImages.at(idx)->getThumb().data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(thumbLoaded(bool)));
-		mImages.at(idx)->getThumb()->fetchThumb(force);
+		mImages.at(idx)->getThumb()->fetchThumb(force, QSharedPointer<QByteArray>(), DkThumbScheduler::priority_background);
 	}
 }
 
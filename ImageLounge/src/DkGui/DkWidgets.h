@@ -286,6 +286,8 @@ public:
 
 public slots:
 	void updateDir(QVector<QSharedPointer<DkImageContainerT> > images);
+	void insertFile(int idx);
+	void removeFile(int idx);
 
 	virtual void show(bool saveSettings = true);
 	virtual void hide(bool saveSettings = true);
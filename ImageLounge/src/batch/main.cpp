@@ -0,0 +1,114 @@
+/*******************************************************************************************************
+ main.cpp
+ Created on:	17.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#ifdef QT_NO_DEBUG_OUTPUT
+#pragma warning(disable: 4127)		// no 'conditional expression is constant' if qDebug() messages are removed
+#endif
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#pragma warning(pop)	// no warnings from includes - end
+
+#include "DkSettings.h"
+#include "DkUtils.h"
+#include "DkProcess.h"
+#include "DkPluginManager.h"
+#include "DkBasicLoader.h"
+
+// nomacs-batch runs batch profiles without any window system:
+// no QApplication is created, so no display (or offscreen platform) is needed
+// and startup only costs loading the settings.
+int main(int argc, char *argv[]) {
+
+#ifdef READ_TUWIEN
+	QCoreApplication::setOrganizationName("TU Wien");
+	QCoreApplication::setOrganizationDomain("http://www.nomacs.org");
+	QCoreApplication::setApplicationName("nomacs [READ]");
+#else
+	QCoreApplication::setOrganizationName("nomacs");
+	QCoreApplication::setOrganizationDomain("http://www.nomacs.org");
+	QCoreApplication::setApplicationName("Image Lounge");
+#endif
+
+	nmc::DkUtils::registerFileVersion();
+
+	QCoreApplication app(argc, argv);
+
+	// init settings
+	nmc::DkSettingsManager::instance().init();
+
+	// CMD parser --------------------------------------------------------------------
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription(QObject::tr("Processes nomacs batch profiles without a GUI."));
+	parser.addHelpOption();
+	parser.addVersionOption();
+	parser.addPositionalArgument("batch-settings", QObject::tr("The batch profile <batch-settings.pnm>."));
+
+	QCommandLineOption batchLogOpt(QStringList() << "batch-log",
+		QObject::tr("Saves batch log to <log-path.txt>."),
+		QObject::tr("log-path.txt"));
+	parser.addOption(batchLogOpt);
+
+	QCommandLineOption batchResumeOpt(QStringList() << "resume",
+		QObject::tr("Resumes an interrupted batch process - items that were completed are skipped."));
+	parser.addOption(batchResumeOpt);
+
+	QCommandLineOption batchDistributeOpt(QStringList() << "distribute",
+		QObject::tr("Shares the batch with other workers that process the same <batch-settings.pnm> on a shared drive."));
+	parser.addOption(batchDistributeOpt);
+
+#ifdef WITH_LIBRAW
+	QCommandLineOption benchmarkRawOpt(QStringList() << "benchmark-raw",
+		QObject::tr("Benchmarks the RAW development and checks the vectorized results against the scalar ones."));
+	parser.addOption(benchmarkRawOpt);
+#endif
+
+	parser.process(app);
+	// CMD parser --------------------------------------------------------------------
+
+#ifdef WITH_LIBRAW
+	if (parser.isSet(benchmarkRawOpt))
+		return nmc::DkRawLoader::benchmarkDevelop() ? 0 : 1;
+#endif
+
+	if (parser.positionalArguments().empty()) {
+		qCritical() << "no batch profile specified";
+		parser.showHelp(1);
+	}
+
+	nmc::DkPluginManager::createPluginsPath();
+
+	QString batchSettingsPath = parser.positionalArguments().first();
+	bool success = parser.isSet(batchDistributeOpt) ?
+		nmc::DkBatchProcessing::computeDistributedBatch(batchSettingsPath, parser.value(batchLogOpt)) :
+		nmc::DkBatchProcessing::computeBatch(batchSettingsPath, parser.value(batchLogOpt), parser.isSet(batchResumeOpt));
+
+	return success ? 0 : 1;
+}
@@ -152,6 +152,14 @@ int main(int argc, char *argv[]) {
 		QObject::tr("log-path.txt"));
 	parser.addOption(batchLogOpt);
 
+	QCommandLineOption batchResumeOpt(QStringList() << "resume",
+		QObject::tr("Resumes an interrupted batch process - items that were completed are skipped."));
+	parser.addOption(batchResumeOpt);
+
+	QCommandLineOption batchDistributeOpt(QStringList() << "distribute",
+		QObject::tr("Shares the batch with other workers that process the same <batch-settings.pnm> on a shared drive."));
+	parser.addOption(batchDistributeOpt);
+
 	QCommandLineOption importSettingsOpt(QStringList() << "import-settings",
 		QObject::tr("Imports the settings from <settings-path.nfo> and saves them."),
 		QObject::tr("settings-path.nfo"));
@@ -170,9 +178,11 @@ int main(int argc, char *argv[]) {
 			logPath = parser.value(batchLogOpt);
 
 		QString batchSettingsPath = parser.value(batchOpt);
-		nmc::DkBatchProcessing::computeBatch(batchSettingsPath, logPath);
+		bool success = parser.isSet(batchDistributeOpt) ?
+			nmc::DkBatchProcessing::computeDistributedBatch(batchSettingsPath, logPath) :
+			nmc::DkBatchProcessing::computeBatch(batchSettingsPath, logPath, parser.isSet(batchResumeOpt));
 		
-		return 0;
+		return success ? 0 : 1;
 	}
 
 	// apply default settings